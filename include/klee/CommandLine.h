@@ -19,6 +19,10 @@ extern llvm::cl::opt<bool> UseCache;
 
 extern llvm::cl::opt<bool> UseIndependentSolver; 
 
+extern llvm::cl::opt<bool> UsePersistentCache;
+
+extern llvm::cl::opt<std::string> PersistentCachePath;
+
 extern llvm::cl::opt<bool> DebugValidateSolver;
   
 extern llvm::cl::opt<int> MinQueryTimeToLog;
@@ -44,9 +48,13 @@ enum QueryLoggingSolverType
  */
 extern llvm::cl::list<QueryLoggingSolverType> queryLoggingOptions;
 
-enum CoreSolverType { STP_SOLVER, METASMT_SOLVER, DUMMY_SOLVER, Z3_SOLVER };
+enum CoreSolverType { STP_SOLVER, METASMT_SOLVER, DUMMY_SOLVER, Z3_SOLVER,
+                      PORTFOLIO_SOLVER };
 extern llvm::cl::opt<CoreSolverType> CoreSolverToUse;
 
+/// The backends raced against each other by --solver-backend=portfolio
+extern llvm::cl::list<CoreSolverType> PortfolioBackends;
+
 #ifdef ENABLE_METASMT
 
 enum MetaSMTBackendType
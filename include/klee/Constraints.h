@@ -12,30 +12,112 @@
 
 #include "klee/Expr.h"
 
+#include <cstddef>
+#include <iterator>
+#include <vector>
+
 // FIXME: Currently we use ConstraintManager for two things: to pass
 // sets of constraints around, and to optimize constraints. We should
 // move the first usage into a separate data structure
 // (ConstraintSet?) which ConstraintManager could embed if it likes.
 namespace klee {
 
+class ConstraintPartition;
 class ExprVisitor;
   
+/// ConstraintManager - An ordered set of constraints, with optimizations
+/// applied as constraints are added.
+///
+/// The constraints are kept in a persistent list of fixed-size chunks,
+/// each linked to the chunk holding the constraints before it. Copies
+/// share all chunks, so copying a constraint set (as forking a state
+/// does) takes constant time regardless of its size. A copy that adds a
+/// constraint while the last chunk is in use by another copy duplicates
+/// only that chunk.
 class ConstraintManager {
-public:
-  typedef std::vector< ref<Expr> > constraints_ty;
-  typedef constraints_ty::iterator iterator;
-  typedef constraints_ty::const_iterator const_iterator;
+  struct Chunk {
+    enum { Capacity = 32 };
+
+    unsigned refCount;
+    /// The number of slots filled, by any of the sets sharing the chunk.
+    unsigned used;
+    Chunk *prev;
+    ref<Expr> elts[Capacity];
+
+    Chunk(Chunk *_prev) : refCount(1), used(0), prev(_prev) {
+      if (prev)
+        ++prev->refCount;
+    }
+  };
 
-  ConstraintManager() {}
+public:
+  /// Iterates over the constraints oldest first. Invalidated by any
+  /// change to the constraint set.
+  class constraint_iterator
+    : public std::iterator<std::random_access_iterator_tag, ref<Expr>,
+                           ptrdiff_t, const ref<Expr> *, const ref<Expr> &> {
+    friend class ConstraintManager;
+
+    Chunk *const *chunks;
+    unsigned index;
+
+    constraint_iterator(Chunk *const *_chunks, unsigned _index)
+      : chunks(_chunks), index(_index) {}
+
+  public:
+    constraint_iterator() : chunks(0), index(0) {}
+
+    const ref<Expr> &operator*() const {
+      return chunks[index / Chunk::Capacity]->elts[index % Chunk::Capacity];
+    }
+    const ref<Expr> *operator->() const { return &**this; }
+    const ref<Expr> &operator[](ptrdiff_t n) const { return *(*this + n); }
+
+    constraint_iterator &operator++() { ++index; return *this; }
+    constraint_iterator operator++(int) {
+      constraint_iterator res = *this; ++index; return res;
+    }
+    constraint_iterator &operator--() { --index; return *this; }
+    constraint_iterator operator--(int) {
+      constraint_iterator res = *this; --index; return res;
+    }
+    constraint_iterator &operator+=(ptrdiff_t n) { index += n; return *this; }
+    constraint_iterator &operator-=(ptrdiff_t n) { index -= n; return *this; }
+    constraint_iterator operator+(ptrdiff_t n) const {
+      return constraint_iterator(chunks, index + n);
+    }
+    constraint_iterator operator-(ptrdiff_t n) const {
+      return constraint_iterator(chunks, index - n);
+    }
+    ptrdiff_t operator-(const constraint_iterator &b) const {
+      return (ptrdiff_t) index - (ptrdiff_t) b.index;
+    }
+
+    bool operator==(const constraint_iterator &b) const {
+      return index == b.index;
+    }
+    bool operator!=(const constraint_iterator &b) const {
+      return index != b.index;
+    }
+    bool operator<(const constraint_iterator &b) const {
+      return index < b.index;
+    }
+  };
+
+  typedef constraint_iterator iterator;
+  typedef constraint_iterator const_iterator;
+
+  ConstraintManager() : tail(0), numConstraints(0), partition(0) {}
 
   // create from constraints with no optimization
   explicit
-  ConstraintManager(const std::vector< ref<Expr> > &_constraints) :
-    constraints(_constraints) {}
+  ConstraintManager(const std::vector< ref<Expr> > &_constraints);
+
+  ConstraintManager(const ConstraintManager &cs);
 
-  ConstraintManager(const ConstraintManager &cs) : constraints(cs.constraints) {}
+  ~ConstraintManager();
 
-  typedef std::vector< ref<Expr> >::const_iterator constraint_iterator;
+  ConstraintManager &operator=(const ConstraintManager &cs);
 
   // given a constraint which is known to be valid, attempt to 
   // simplify the existing constraint set
@@ -46,27 +128,58 @@ public:
   void addConstraint(ref<Expr> e);
   
   bool empty() const {
-    return constraints.empty();
+    return numConstraints == 0;
   }
   ref<Expr> back() const {
-    return constraints.back();
+    return tail->elts[(numConstraints - 1) % Chunk::Capacity];
   }
   constraint_iterator begin() const {
-    return constraints.begin();
+    return constraint_iterator(getChunks(), 0);
   }
   constraint_iterator end() const {
-    return constraints.end();
+    return constraint_iterator(getChunks(), numConstraints);
   }
   size_t size() const {
-    return constraints.size();
+    return numConstraints;
   }
 
-  bool operator==(const ConstraintManager &other) const {
-    return constraints == other.constraints;
-  }
+  bool operator==(const ConstraintManager &other) const;
+
+  /// Remove the newest constraints, held in chunks no other set shares,
+  /// appending them oldest first to \arg removed.
+  void takeUnshared(std::vector< ref<Expr> > &removed);
+
+  /// Add back constraints removed by takeUnshared, without optimization.
+  void append(const std::vector< ref<Expr> > &constraints);
+
+  /// Get the partition of the constraints into independent factors,
+  /// brought up to date with the constraints added since the last call.
+  const ConstraintPartition &getPartition() const;
   
 private:
-  std::vector< ref<Expr> > constraints;
+  /// The chunk holding the newest constraint, or null if empty.
+  Chunk *tail;
+  unsigned numConstraints;
+
+  /// The chunks oldest first, rebuilt on demand for iteration. Cleared
+  /// whenever a chunk in it is replaced, as only its size and newest
+  /// chunk are checked before use.
+  mutable std::vector<Chunk*> chunks;
+
+  /// The independence partition of a prefix of the constraints, shared
+  /// with copies and extended lazily; null until first requested.
+  mutable ConstraintPartition *partition;
+
+  static void release(Chunk *chunk);
+  static void release(ConstraintPartition *partition);
+
+  Chunk *const *getChunks() const;
+
+  /// Append a constraint without any optimization.
+  void push_back(ref<Expr> e);
+
+  /// Drop all but the oldest n constraints.
+  void truncate(unsigned n);
 
   // returns true iff the constraints were modified
   bool rewriteConstraints(ExprVisitor &visitor);
@@ -30,6 +30,8 @@ struct KFunction;
 struct KInstruction;
 class MemoryObject;
 class PTreeNode;
+class SpillReader;
+class SpillWriter;
 struct InstructionInfo;
 
 llvm::raw_ostream &operator<<(llvm::raw_ostream &os, const MemoryMap &mm);
@@ -117,6 +119,13 @@ public:
   /// taken to reach/create this state
   TreeOStream symPathOS;
 
+  /// @brief Branch decisions this state has to follow before it explores
+  /// on its own, e.g. a path prefix handed over by another worker
+  std::vector<bool> pathPrefix;
+
+  /// @brief Number of decisions from pathPrefix already followed
+  unsigned pathPrefixPosition;
+
   /// @brief Counts how many instructions were executed since the last new
   /// instruction was covered.
   unsigned instsSinceCovNew;
@@ -133,6 +142,9 @@ public:
   /// @brief Pointer to the process tree of the current state
   PTreeNode *ptreeNode;
 
+  /// @brief Whether the bulk of the state is on disk, see StateSpiller
+  bool spilled;
+
   /// @brief Ordered list of symbolics: used to generate test cases.
   //
   // FIXME: Move to a shared list structure (not critical).
@@ -146,7 +158,7 @@ public:
   void removeFnAlias(std::string fn);
 
 private:
-  ExecutionState() : ptreeNode(0) {}
+  ExecutionState() : pathPrefixPosition(0), ptreeNode(0), spilled(false) {}
 
 public:
   ExecutionState(KFunction *kf);
@@ -169,6 +181,12 @@ public:
 
   bool merge(const ExecutionState &b);
   void dumpStack(llvm::raw_ostream &out) const;
+
+  /// Write the unshared constraints, the registers and the exclusively
+  /// owned memory to \arg writer and release them.
+  void spill(SpillWriter &writer);
+  /// Restore what spill() wrote.
+  void reload(SpillReader &reader);
 };
 }
 
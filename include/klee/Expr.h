@@ -174,12 +174,25 @@ public:
 
   unsigned refCount;
 
+  /// Whether this node is the single copy of its structure kept in the
+  /// table of interned expressions (see --expr-hash-consing).
+  bool isCached;
+
 protected:  
   unsigned hashValue;
+
+  /// Return the interned node structurally equal to \a e, interning \a e
+  /// if there is none yet. Returns \a e unchanged unless hash-consing is
+  /// enabled.
+  static ref<Expr> createCachedExpr(const ref<Expr> &e);
   
 public:
-  Expr() : refCount(0) { Expr::count++; }
-  virtual ~Expr() { Expr::count--; } 
+  Expr() : refCount(0), isCached(false) { Expr::count++; }
+  virtual ~Expr();
+
+  /// Expression nodes are allocated from a SlabAllocator.
+  static void *operator new(size_t size);
+  static void operator delete(void *p, size_t size);
 
   virtual Kind getKind() const = 0;
   virtual Width getWidth() const = 0;
@@ -388,7 +401,7 @@ public:
   static ref<Expr> alloc(const ref<Expr> &src) {
     ref<Expr> r(new NotOptimizedExpr(src));
     r->computeHash();
-    return r;
+    return createCachedExpr(r);
   }
   
   static ref<Expr> create(ref<Expr> src);
@@ -433,8 +446,15 @@ public:
              const ref<Expr> &_index, 
              const ref<Expr> &_value);
 
+  /// Update nodes are allocated from a SlabAllocator.
+  static void *operator new(size_t size);
+  static void operator delete(void *p, size_t size);
+
   unsigned getSize() const { return size; }
 
+  /// Whether another update or update list also refers to this update.
+  bool isShared() const { return refCount > 1; }
+
   int compare(const UpdateNode &b) const;  
   unsigned hash() const { return hashValue; }
 
@@ -542,7 +562,7 @@ public:
   static ref<Expr> alloc(const UpdateList &updates, const ref<Expr> &index) {
     ref<Expr> r(new ReadExpr(updates, index));
     r->computeHash();
-    return r;
+    return createCachedExpr(r);
   }
   
   static ref<Expr> create(const UpdateList &updates, ref<Expr> i);
@@ -587,7 +607,7 @@ public:
                          const ref<Expr> &f) {
     ref<Expr> r(new SelectExpr(c, t, f));
     r->computeHash();
-    return r;
+    return createCachedExpr(r);
   }
   
   static ref<Expr> create(ref<Expr> c, ref<Expr> t, ref<Expr> f);
@@ -644,7 +664,7 @@ public:
   static ref<Expr> alloc(const ref<Expr> &l, const ref<Expr> &r) {
     ref<Expr> c(new ConcatExpr(l, r));
     c->computeHash();
-    return c;
+    return createCachedExpr(c);
   }
   
   static ref<Expr> create(const ref<Expr> &l, const ref<Expr> &r);
@@ -703,7 +723,7 @@ public:
   static ref<Expr> alloc(const ref<Expr> &e, unsigned o, Width w) {
     ref<Expr> r(new ExtractExpr(e, o, w));
     r->computeHash();
-    return r;
+    return createCachedExpr(r);
   }
   
   /// Creates an ExtractExpr with the given bit offset and width
@@ -754,7 +774,7 @@ public:
   static ref<Expr> alloc(const ref<Expr> &e) {
     ref<Expr> r(new NotExpr(e));
     r->computeHash();
-    return r;
+    return createCachedExpr(r);
   }
   
   static ref<Expr> create(const ref<Expr> &e);
@@ -831,7 +851,7 @@ public:                                                          \
     static ref<Expr> alloc(const ref<Expr> &e, Width w) {        \
       ref<Expr> r(new _class_kind ## Expr(e, w));                \
       r->computeHash();                                          \
-      return r;                                                  \
+      return createCachedExpr(r);                                \
     }                                                            \
     static ref<Expr> create(const ref<Expr> &e, Width w);        \
     Kind getKind() const { return _class_kind; }                 \
@@ -863,7 +883,7 @@ public:                                                              \
     static ref<Expr> alloc(const ref<Expr> &l, const ref<Expr> &r) { \
       ref<Expr> res(new _class_kind ## Expr (l, r));                 \
       res->computeHash();                                            \
-      return res;                                                    \
+      return createCachedExpr(res);                                  \
     }                                                                \
     static ref<Expr> create(const ref<Expr> &l, const ref<Expr> &r); \
     Width getWidth() const { return left->getWidth(); }              \
@@ -907,7 +927,7 @@ public:                                                              \
     static ref<Expr> alloc(const ref<Expr> &l, const ref<Expr> &r) { \
       ref<Expr> res(new _class_kind ## Expr (l, r));                 \
       res->computeHash();                                            \
-      return res;                                                    \
+      return createCachedExpr(res);                                  \
     }                                                                \
     static ref<Expr> create(const ref<Expr> &l, const ref<Expr> &r); \
     Kind getKind() const { return _class_kind; }                     \
@@ -1008,7 +1028,7 @@ public:
   static ref<ConstantExpr> alloc(const llvm::APInt &v) {
     ref<ConstantExpr> r(new ConstantExpr(v));
     r->computeHash();
-    return r;
+    return static_cast<ConstantExpr *>(createCachedExpr(r).get());
   }
 
   static ref<ConstantExpr> alloc(const llvm::APFloat &f) {
@@ -7,7 +7,29 @@
 //
 //===----------------------------------------------------------------------===//
 
+#ifndef KLEE_DISCRETEPDF_H
+#define KLEE_DISCRETEPDF_H
+
+#include <ciso646>
+#ifdef _LIBCPP_VERSION
+#include <unordered_map>
+#define unordered_map std::unordered_map
+#else
+#include <tr1/unordered_map>
+#define unordered_map std::tr1::unordered_map
+#endif
+
+#include <algorithm>
+#include <cassert>
+#include <vector>
+
 namespace klee {
+  /// DiscretePDF - A weighted set of items to pick from at random.
+  ///
+  /// The weights are the leaves of a complete binary tree of partial
+  /// sums, kept in one flat array: node i has children 2i and 2i+1, and
+  /// node 1 holds the total. Updates recompute the sums on the path to
+  /// the root, so rounding errors do not accumulate.
   template <class T>
   class DiscretePDF {
     // not perfectly parameterized, but float/double/int should work ok,
@@ -32,16 +54,21 @@ namespace klee {
     T choose(double p);
     
   private:
-    class Node;
-    Node *m_root;
-    
-    Node **lookup(T item, Node **parent_out);
-    void split(Node *node);
-    void rotate(Node *node);
-    void lengthen(Node *node);
-    void propogateSumsUp(Node *n);
+    /// The number of leaves, a power of two.
+    unsigned capacity;
+    std::vector<weight_type> sums;
+    /// The items by leaf, leaves past the last item have weight 0.
+    std::vector<T> items;
+    unordered_map<T, unsigned> slots;
+
+    void setWeight(unsigned slot, weight_type weight);
+    void grow();
   };
 
 }
 
 #include "DiscretePDF.inc"
+
+#undef unordered_map
+
+#endif
@@ -55,6 +55,41 @@ extern "C" {
 
   void  kTest_free(KTest *);
 
+  /* An archive holds many tests in one append-only file: a header, then
+     one record per test, each holding the test id and the test in the
+     .ktest format. Readers map the file and index the records without
+     parsing them, and the tests they return point into the mapping. */
+  typedef struct KTestArchive KTestArchive;
+
+  /* return true iff file at path matches the archive header */
+  int   kTest_isArchive(const char *path);
+
+  /* opens the archive at path for appending, creating it if needed;
+     returns NULL on (unspecified) error */
+  KTestArchive* kTestArchive_create(const char *path);
+
+  /* appends a test with the given id; each test is written with a single
+     write, so processes sharing the archive don't interleave.
+     returns 1 on success, 0 on (unspecified) error */
+  int   kTestArchive_append(KTestArchive *, KTest *, unsigned id);
+
+  /* opens the archive at path for reading; a truncated last record is
+     ignored. returns NULL on (unspecified) error */
+  KTestArchive* kTestArchive_open(const char *path);
+
+  /* returns the number of tests in an archive opened for reading */
+  unsigned kTestArchive_numTests(KTestArchive *);
+
+  /* returns the id the test at index was appended with */
+  unsigned kTestArchive_getId(KTestArchive *, unsigned index);
+
+  /* returns the test at index, or NULL if it is malformed. The object
+     bytes are not copied, and the test is owned by the archive: it must
+     not be passed to kTest_free and is valid until kTestArchive_close. */
+  KTest* kTestArchive_getTest(KTestArchive *, unsigned index);
+
+  void  kTestArchive_close(KTestArchive *);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,101 @@
+//===-- SlabAllocator.h -----------------------------------------*- C++ -*-===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef KLEE_SLABALLOCATOR_H
+#define KLEE_SLABALLOCATOR_H
+
+#include "llvm/Support/ErrorHandling.h"
+
+#include <cstdlib>
+#include <new>
+
+namespace klee {
+
+  /// Allocator for many small objects of a few distinct sizes, such as
+  /// expression nodes. Memory is carved out of large slabs and freed
+  /// blocks go onto a free list per size class, so that they are reused
+  /// for objects of the same size instead of fragmenting the heap. Slabs
+  /// are never returned to the system; the bytes in them that are not in
+  /// use are counted instead, so that memory limits can leave them out.
+  ///
+  /// An all-zero SlabAllocator is ready for use, so that instances with
+  /// static storage can be used during static initialization. Other
+  /// instances must be value-initialized.
+  class SlabAllocator {
+  public:
+    enum {
+      Granularity = 8,
+      MaxSize = 256,
+      SlabSize = 64 * 1024
+    };
+
+  private:
+    struct FreeBlock {
+      FreeBlock *next;
+    };
+
+    FreeBlock *freeLists[MaxSize / Granularity];
+    char *current, *end;
+
+    /// The bytes in the slabs of all allocators that are free for reuse.
+    static size_t freeBytes;
+
+    static unsigned getSizeClass(size_t size) {
+      return (size + Granularity - 1) / Granularity - 1;
+    }
+
+  public:
+    void *allocate(size_t size) {
+      if (size > MaxSize || !size)
+        return ::operator new(size);
+
+      unsigned sizeClass = getSizeClass(size);
+      size = (sizeClass + 1) * Granularity;
+      if (FreeBlock *block = freeLists[sizeClass]) {
+        freeLists[sizeClass] = block->next;
+        freeBytes -= size;
+        return block;
+      }
+
+      if ((size_t) (end - current) < size) {
+        // The rest of the old slab is too small to ever be used.
+        freeBytes -= end - current;
+        current = static_cast<char*>(std::malloc(SlabSize));
+        if (!current)
+          llvm::report_fatal_error("unable to allocate slab");
+        end = current + SlabSize;
+        freeBytes += SlabSize;
+      }
+      void *res = current;
+      current += size;
+      freeBytes -= size;
+      return res;
+    }
+
+    void deallocate(void *p, size_t size) {
+      if (size > MaxSize || !size) {
+        ::operator delete(p);
+        return;
+      }
+
+      unsigned sizeClass = getSizeClass(size);
+      FreeBlock *block = static_cast<FreeBlock*>(p);
+      block->next = freeLists[sizeClass];
+      freeLists[sizeClass] = block;
+      freeBytes += (sizeClass + 1) * Granularity;
+    }
+
+    /// The number of bytes taken from the system for slabs, by all
+    /// allocators, that are not currently allocated.
+    static size_t getFreeBytes() { return freeBytes; }
+  };
+
+}
+
+#endif
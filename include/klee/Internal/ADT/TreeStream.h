@@ -45,6 +45,10 @@ namespace klee {
 
     void flush();
 
+    // continue the stream in a copy of its file at the given path, so
+    // that a forked process does not write into the file of its parent
+    bool reopen(const std::string &newPath);
+
     // hack, to be replace by proper stream capabilities
     void readStream(TreeStreamID id,
                     std::vector<unsigned char> &out);
@@ -15,8 +15,55 @@
 namespace klee {
   class MemoryObject;
 
+  /// Cell - A register or constant table slot. A register holding a
+  /// concrete value of at most 64 bits may keep it unboxed, in which case
+  /// the expression is only built when something asks for it.
   struct Cell {
-    ref<Expr> value;
+    /// The value as an expression; for an unboxed value, null until
+    /// getValue() is called. Use getValue() and setValue() for registers.
+    mutable ref<Expr> value;
+    /// The width of the unboxed value, or 0 if the cell holds an
+    /// expression.
+    Expr::Width concreteWidth;
+    uint64_t concreteValue;
+
+    Cell() : concreteWidth(0), concreteValue(0) {}
+
+    const ref<Expr> &getValue() const {
+      if (concreteWidth && value.isNull())
+        value = ConstantExpr::create(concreteValue, concreteWidth);
+      return value;
+    }
+
+    void setValue(ref<Expr> e) {
+      value = e;
+      concreteWidth = 0;
+    }
+
+    /// Store an unboxed value, already truncated to \arg width bits.
+    void setConcrete(uint64_t v, Expr::Width width) {
+      value = ref<Expr>();
+      concreteWidth = width;
+      concreteValue = v;
+    }
+
+    /// Get the value as an integer, if it is a constant no wider than 64
+    /// bits.
+    bool getConcrete(uint64_t &v, Expr::Width &width) const {
+      if (concreteWidth) {
+        v = concreteValue;
+        width = concreteWidth;
+        return true;
+      }
+      if (value.isNull())
+        return false;
+      ConstantExpr *CE = dyn_cast<ConstantExpr>(value);
+      if (!CE || CE->getWidth() > Expr::Int64)
+        return false;
+      v = CE->getZExtValue();
+      width = CE->getWidth();
+      return true;
+    }
   };
 }
 
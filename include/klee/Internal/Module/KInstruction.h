@@ -53,6 +53,23 @@ namespace klee {
     /// instruction.
     uint64_t offset;
   };
+
+  /// KBranchTarget - A control flow edge, decoded when the function is
+  /// prepared so that taking it needs no lookups.
+  struct KBranchTarget {
+    /// Index into the function's instructions of the first instruction of
+    /// the successor block.
+    unsigned entry;
+    /// The index of the source block among the incoming blocks of the PHI
+    /// nodes of the successor, or -1 if the successor has no PHI nodes.
+    int incomingBBIndex;
+  };
+
+  struct KBranchInstruction : KInstruction {
+    /// targets - The edge to each successor of the terminator, in successor
+    /// order.
+    std::vector<KBranchTarget> targets;
+  };
 }
 
 #endif
@@ -43,6 +43,19 @@ public:
   virtual void processTestCase(const ExecutionState &state,
                                const char *err, 
                                const char *suffix) = 0;
+
+  virtual unsigned getNumTestCases() = 0;
+  virtual unsigned getNumPathsExplored() = 0;
+
+  /// Called in a forked worker process (see --num-workers) before it
+  /// starts exploring its share of the states. Test cases written by
+  /// worker \a index must not collide with those of the other workers.
+  virtual void setWorkerIndex(unsigned index, unsigned numWorkers) = 0;
+
+  /// Called in the parent process to account for the test cases and
+  /// paths of a worker which has finished.
+  virtual void addWorkerResults(unsigned numTestCases,
+                                unsigned numPathsExplored) = 0;
 };
 
 class Interpreter {
@@ -85,6 +85,18 @@ namespace klee {
     ///
     /// \return True on success.
     bool evaluate(const Query&, Validity &result);
+
+    /// evaluate - Determine the validity of each of several expressions
+    /// under the same constraints, as evaluate(const Query&, Validity&)
+    /// does for one. Implementations may share work between them, such
+    /// as the constraints asserted in the underlying solver.
+    ///
+    /// \param [out] results - The validity of each expression, in order.
+    ///
+    /// \return True on success.
+    bool evaluate(const ConstraintManager &constraints,
+                  const std::vector< ref<Expr> > &exprs,
+                  std::vector<Validity> &results);
   
     /// mustBeTrue - Determine if the expression is provably true.
     /// 
@@ -274,6 +286,15 @@ namespace klee {
   /// \param s - The underlying solver to use.
   Solver *createCachingSolver(Solver *s);
 
+  /// createPersistentCachingSolver - Create a solver which caches validity,
+  /// value and counterexample results in a file, which outlives the process and may be
+  /// shared by several processes at once. If the file cannot be opened a
+  /// warning is emitted and \a s is returned unchanged.
+  ///
+  /// \param s - The underlying solver to use.
+  /// \param path - The cache file, created if it does not exist.
+  Solver *createPersistentCachingSolver(Solver *s, std::string path);
+
   /// createCexCachingSolver - Create a counterexample caching solver. This is a
   /// more sophisticated cache which records counterexamples for a constraint
   /// set and uses subset/superset relations among constraints to try and
@@ -311,6 +332,12 @@ namespace klee {
   /// fails.
   Solver *createDummySolver();
 
+  /// createPortfolioSolver - Create a solver which runs every query on all
+  /// of the given backends at once, each in a forked process, and takes the
+  /// first answer. The portfolio takes ownership of the backends.
+  Solver *createPortfolioSolver(
+      const std::vector<std::pair<CoreSolverType, Solver *> > &backends);
+
   // Create a solver based on the supplied ``CoreSolverType``.
   Solver *createCoreSolver(CoreSolverType cst);
 }
@@ -14,6 +14,7 @@
 
 namespace klee {
   class Array;
+  class ConstraintManager;
   class ExecutionState;
   class Expr;
   struct Query;
@@ -58,6 +59,23 @@ namespace klee {
     ///
     /// \return True on success
     virtual bool computeValidity(const Query& query, Solver::Validity &result);
+
+    /// computeValidities - Compute full validity results for several
+    /// query expressions under the same constraints.
+    ///
+    /// The query expressions are guaranteed to be non-constant and have
+    /// bool type.
+    ///
+    /// SolverImpl provides a default implementation which uses
+    /// computeValidity on each expression in turn. Solvers that can share
+    /// work between the expressions override it and pass the batch on.
+    ///
+    /// \param [out] results - The validity of each expression, in order.
+    ///
+    /// \return True on success
+    virtual bool computeValidities(const ConstraintManager &constraints,
+                                   const std::vector< ref<Expr> > &exprs,
+                                   std::vector<Solver::Validity> &results);
     
     /// computeTruth - Determine whether the given query expression is provably true
     /// given the constraints.
@@ -23,9 +23,16 @@ namespace stats {
   extern Statistic queryCacheMisses;
   extern Statistic queryCexCacheHits;
   extern Statistic queryCexCacheMisses;
+  extern Statistic queryCexCacheEvictions;
+  extern Statistic queryConstraintsReused;
   extern Statistic queryConstructTime;
   extern Statistic queryConstructs;
   extern Statistic queryCounterexamples;
+  extern Statistic queryPersistentCacheHits;
+  extern Statistic queryPersistentCacheMisses;
+  extern Statistic queryPortfolioWinsMetaSMT;
+  extern Statistic queryPortfolioWinsSTP;
+  extern Statistic queryPortfolioWinsZ3;
   extern Statistic queryTime;
   
 #ifdef DEBUG
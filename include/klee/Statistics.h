@@ -62,6 +62,9 @@ namespace klee {
     
     void registerStatistic(Statistic &s);
     void incrementStatistic(Statistic &s, uint64_t addend);
+    /// Increment only the global value of a statistic, e.g. to account
+    /// for work done in another process.
+    void incrementGlobalValue(const Statistic &s, uint64_t addend);
     uint64_t getValue(const Statistic &s) const;
     void incrementIndexedValue(const Statistic &s, unsigned index, 
                                uint64_t addend) const;
@@ -85,6 +88,11 @@ namespace klee {
     }
   }
 
+  inline void StatisticManager::incrementGlobalValue(const Statistic &s,
+                                                     uint64_t addend) {
+    globalStats[s.id] += addend;
+  }
+
   inline StatisticRecord *StatisticManager::getContext() {
     return contextStats;
   }
@@ -31,10 +31,37 @@ public:
   }
   ~BitArray() { delete[] bits; }
 
-  bool get(unsigned idx) { return (bool) ((bits[idx/32]>>(idx&0x1F))&1); }
+  bool get(unsigned idx) const { return (bool) ((bits[idx/32]>>(idx&0x1F))&1); }
   void set(unsigned idx) { bits[idx/32] |= 1<<(idx&0x1F); }
   void unset(unsigned idx) { bits[idx/32] &= ~(1<<(idx&0x1F)); }
   void set(unsigned idx, bool value) { if (value) set(idx); else unset(idx); }
+
+  /// Whether all bits in [begin, end) are set, tested a word at a time.
+  bool allSet(unsigned begin, unsigned end) const {
+    while (begin < end) {
+      uint32_t mask = rangeMask(begin, end);
+      if ((bits[begin/32] & mask) != mask)
+        return false;
+      begin = (begin | 0x1F) + 1;
+    }
+    return true;
+  }
+
+  /// Set all bits in [begin, end), a word at a time.
+  void setRange(unsigned begin, unsigned end) {
+    while (begin < end) {
+      bits[begin/32] |= rangeMask(begin, end);
+      begin = (begin | 0x1F) + 1;
+    }
+  }
+
+private:
+  /// The bits of [begin, end) within the word holding bit \a begin.
+  static uint32_t rangeMask(unsigned begin, unsigned end) {
+    unsigned lo = begin & 0x1F;
+    unsigned n = end - begin < 32 - lo ? end - begin : 32 - lo;
+    return (n == 32 ? ~0u : (1u << n) - 1) << lo;
+  }
 };
 
 } // End klee namespace
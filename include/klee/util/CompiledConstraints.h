@@ -0,0 +1,136 @@
+//===-- CompiledConstraints.h -----------------------------------*- C++ -*-===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef KLEE_UTIL_COMPILEDCONSTRAINTS_H
+#define KLEE_UTIL_COMPILEDCONSTRAINTS_H
+
+#include "klee/Expr.h"
+
+#include <map>
+#include <vector>
+
+namespace klee {
+  class Array;
+  class Assignment;
+
+  /// CompiledConstraints - A set of constraints compiled to a flat,
+  /// postorder list of instructions over 64-bit registers, for checking
+  /// many assignments against the same constraints.
+  ///
+  /// Evaluation neither recurses nor allocates expressions, and runs up to
+  /// MaxLanes assignments in lockstep so that the per-instruction loops over
+  /// the lanes can be vectorized. Its result matches Assignment::satisfies,
+  /// except that an assignment may fail where the evaluator would accept
+  /// it, never the other way around:
+  ///
+  ///  - Every operand is evaluated, including the arm of a select that is
+  ///    not taken and the values of updates that are overwritten, so a
+  ///    division by zero in any of them fails the assignment.
+  ///  - With allowFreeValues, a read of an unassigned byte fails the
+  ///    assignment wherever it occurs, also where the evaluator's
+  ///    simplifications would have dropped it.
+  class CompiledConstraints {
+  public:
+    enum { MaxLanes = 8 };
+
+  private:
+    enum Opcode {
+      Constant,
+      Read,
+      Update,
+      Select,
+      Concat,
+      Extract,
+      SExt,
+      Not,
+      Add,
+      Sub,
+      Mul,
+      UDiv,
+      SDiv,
+      URem,
+      SRem,
+      And,
+      Or,
+      Xor,
+      Shl,
+      LShr,
+      AShr,
+      Eq,
+      Ult,
+      Ule,
+      Slt,
+      Sle
+    };
+
+    struct Instruction {
+      unsigned char opcode;
+      /// The width of the result, at most 64 bits.
+      unsigned char width;
+      /// Whether the result is one of the constraints.
+      bool isConstraint;
+      /// Operand registers.
+      unsigned ops[3];
+      /// A constant, an extract offset, an array slot, or for Update the
+      /// register holding the value of the older updates.
+      uint64_t imm;
+    };
+
+    std::vector<Instruction> code;
+    /// The arrays read, by slot.
+    std::vector<const Array*> arrays;
+    /// The contents of the arrays read, by slot; empty for symbolic arrays.
+    std::vector< std::vector<uint64_t> > constantArrays;
+    /// The register holding each compiled expression.
+    std::map<const Expr*, unsigned> registers;
+    std::map<const Array*, unsigned> arraySlots;
+    /// Keeps the compiled expressions alive while they are in registers.
+    std::vector< ref<Expr> > constraints;
+    bool valid;
+
+    /// Scratch register file, MaxLanes registers per instruction.
+    mutable std::vector<uint64_t> values;
+
+    bool compile(ref<Expr> e, unsigned &result);
+    bool compileRead(const ReadExpr *re, unsigned &result);
+    unsigned emit(Opcode opcode, Expr::Width width, unsigned a = 0,
+                  unsigned b = 0, unsigned c = 0, uint64_t imm = 0);
+
+    void evaluateLanes(const Assignment *const *assignments, unsigned n,
+                       bool *results) const;
+
+  public:
+    CompiledConstraints() : valid(true) {}
+
+    /// Add a constraint, returning false if it uses an expression that
+    /// cannot be compiled (one wider than 64 bits). After a failure the
+    /// program is no longer valid and must not be evaluated.
+    bool addConstraint(ref<Expr> e);
+
+    template<typename InputIterator>
+    bool addConstraints(InputIterator begin, InputIterator end) {
+      for (; begin != end; ++begin)
+        if (!addConstraint(*begin))
+          return false;
+      return true;
+    }
+
+    bool isValid() const { return valid; }
+
+    /// Return whether \arg a satisfies all the constraints.
+    bool satisfies(const Assignment &a) const;
+
+    /// Check \arg n assignments at once, setting \arg results[i] to whether
+    /// \arg assignments[i] satisfies all the constraints.
+    void satisfies(const Assignment *const *assignments, unsigned n,
+                   bool *results) const;
+  };
+}
+
+#endif
@@ -0,0 +1,126 @@
+//===-- ConstraintPartition.h -----------------------------------*- C++ -*-===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef KLEE_UTIL_CONSTRAINTPARTITION_H
+#define KLEE_UTIL_CONSTRAINTPARTITION_H
+
+#include "klee/Expr.h"
+
+#include <map>
+#include <vector>
+
+namespace klee {
+
+/// ConstraintPartition - Splits a list of constraints into independent
+/// factors: two constraints are in the same factor when they
+/// (transitively) read a common byte of an array, or when either reads
+/// the array at a symbolic index.
+///
+/// The partition is a union-find over the constraints, extended one
+/// constraint at a time, so maintaining it along a path costs near
+/// constant time per constraint instead of a fixpoint over the whole
+/// list per query. Forked paths copy the partition of their common prefix
+/// copy-on-write, so a copy only pays for the parts it changes.
+class ConstraintPartition {
+  /// The constraints reading one array.
+  struct ArrayUsers {
+    /// Reference count, for sharing between copies of the partition.
+    unsigned refCount;
+    /// Whether some constraint reads the array at a symbolic index, in
+    /// which case all constraints reading the array share a factor and
+    /// bytes is empty.
+    bool isWhole;
+    /// A constraint reading the array at a symbolic index, if isWhole.
+    unsigned whole;
+    /// A constraint reading each concrete index, if not isWhole.
+    std::map<unsigned, unsigned> bytes;
+
+    ArrayUsers() : refCount(1), isWhole(false), whole(0) {}
+  };
+
+  typedef std::map<const Array*, ArrayUsers*> arrays_ty;
+
+  /// The union-find entry of one constraint.
+  struct Node {
+    /// Parent in the union-find forest over the constraint indices.
+    unsigned parent;
+    /// Number of constraints in the factor, valid for the roots.
+    unsigned factorSize;
+    /// Links the constraints of each factor into a circular list.
+    unsigned next;
+  };
+
+  /// The nodes of consecutive constraints.
+  struct NodeChunk {
+    enum { Capacity = 64 };
+
+    /// Reference count, for sharing between copies of the partition.
+    unsigned refCount;
+    Node nodes[Capacity];
+
+    NodeChunk() : refCount(1) {}
+  };
+
+  unsigned numConstraints;
+  /// The nodes, and the users of each array, are shared with copies of
+  /// the partition until either side changes them.
+  std::vector<NodeChunk*> chunks;
+  arrays_ty arrays;
+
+  const Node &getNode(unsigned index) const {
+    return chunks[index / NodeChunk::Capacity]->nodes[index %
+                                                      NodeChunk::Capacity];
+  }
+  Node &getWriteableNode(unsigned index);
+  ArrayUsers &getWriteableUsers(const Array *array);
+
+  void touch(unsigned index, const Array *array, bool isWhole,
+             unsigned byte);
+  void unite(unsigned a, unsigned b);
+
+  // Not implemented.
+  ConstraintPartition &operator=(const ConstraintPartition &);
+
+public:
+  /// Reference count, for sharing between ConstraintManager copies.
+  unsigned refCount;
+
+  ConstraintPartition() : numConstraints(0), refCount(0) {}
+  /// Copy \arg p, sharing its nodes and array users. The copy takes
+  /// time linear in the number of chunks and arrays, not constraints.
+  ConstraintPartition(const ConstraintPartition &p);
+  ~ConstraintPartition();
+
+  /// The number of constraints partitioned so far.
+  unsigned size() const { return numConstraints; }
+
+  /// Add the constraint with the next index.
+  void addConstraint(ref<Expr> e);
+
+  /// Get the factor of the constraint at the given index. Factors are
+  /// identified by one of their constraints, and the identity of a factor
+  /// can change as constraints are added; together with getFactorSize()
+  /// it is unique for the current partition.
+  unsigned getFactor(unsigned index) const;
+
+  unsigned getFactorSize(unsigned factor) const {
+    return getNode(factor).factorSize;
+  }
+
+  /// Get the distinct factors the expression \arg e depends on.
+  void getFactors(ref<Expr> e, std::vector<unsigned> &result) const;
+
+  /// Append the indices of the constraints in \arg factor, in no
+  /// particular order.
+  void getMembers(unsigned factor, std::vector<unsigned> &result) const;
+};
+
+}
+
+#endif
@@ -26,6 +26,37 @@ namespace llvm {
 
 namespace klee {
 
+/// Plain reference count updates, for builds in which a reference is
+/// only ever touched by one thread.
+struct PlainRefCount {
+  template<typename C> static void increment(C &count) { ++count; }
+
+  /// Returns true if the last reference was dropped.
+  template<typename C> static bool decrement(C &count) { return --count == 0; }
+};
+
+/// Atomic reference count updates, for builds that share references
+/// between threads.
+struct AtomicRefCount {
+  template<typename C> static void increment(C &count) {
+    __sync_fetch_and_add(&count, 1);
+  }
+
+  /// Returns true if the last reference was dropped.
+  template<typename C> static bool decrement(C &count) {
+    return __sync_sub_and_fetch(&count, 1) == 0;
+  }
+};
+
+/// The policy used by ref<> and the other reference counted objects,
+/// selected when KLEE is compiled: define KLEE_ATOMIC_REFCOUNT for a
+/// multi-threaded build.
+#ifdef KLEE_ATOMIC_REFCOUNT
+typedef AtomicRefCount RefCountPolicy;
+#else
+typedef PlainRefCount RefCountPolicy;
+#endif
+
 template<class T>
 class ref {
   T *ptr;
@@ -38,11 +69,11 @@ public:
 private:
   void inc() const {
     if (ptr)
-      ++ptr->refCount;
+      RefCountPolicy::increment(ptr->refCount);
   }
 
   void dec() const {
-    if (ptr && --ptr->refCount == 0)
+    if (ptr && RefCountPolicy::decrement(ptr->refCount))
       delete ptr;
   }
 
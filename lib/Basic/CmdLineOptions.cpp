@@ -36,6 +36,19 @@ UseIndependentSolver("use-independent-solver",
                      llvm::cl::init(true),
                      llvm::cl::desc("Use constraint independence (default=on)"));
 
+llvm::cl::opt<bool>
+UsePersistentCache("use-persistent-cache",
+                   llvm::cl::init(false),
+                   llvm::cl::desc("Keep solver results in a cache file that "
+                                  "is reused by later runs (default=off)"));
+
+llvm::cl::opt<std::string>
+PersistentCachePath("persistent-cache-path",
+                    llvm::cl::desc("Cache file for --use-persistent-cache, "
+                                   "may be shared by concurrent runs "
+                                   "(default=query-cache.kqc in the output "
+                                   "directory)"));
+
 llvm::cl::opt<bool>
 DebugValidateSolver("debug-validate-solver",
 		             llvm::cl::init(false));
@@ -123,8 +136,22 @@ llvm::cl::opt<CoreSolverType> CoreSolverToUse(
                      clEnumValN(METASMT_SOLVER, "metasmt", "metaSMT" METASMT_IS_DEFAULT_STR),
                      clEnumValN(DUMMY_SOLVER, "dummy", "Dummy solver"),
                      clEnumValN(Z3_SOLVER, "z3", "Z3" Z3_IS_DEFAULT_STR),
+                     clEnumValN(PORTFOLIO_SOLVER, "portfolio",
+                                "Race several backends against each other "
+                                "(see --portfolio-backends)"),
                      clEnumValEnd),
     llvm::cl::init(DEFAULT_CORE_SOLVER));
+
+llvm::cl::list<CoreSolverType> PortfolioBackends(
+    "portfolio-backends",
+    llvm::cl::desc("The backends to run for each query with "
+                   "--solver-backend=portfolio (default=all available)"),
+    llvm::cl::values(clEnumValN(STP_SOLVER, "stp", "stp"),
+                     clEnumValN(METASMT_SOLVER, "metasmt", "metaSMT"),
+                     clEnumValN(DUMMY_SOLVER, "dummy", "Dummy solver"),
+                     clEnumValN(Z3_SOLVER, "z3", "Z3"),
+                     clEnumValEnd),
+    llvm::cl::CommaSeparated);
 }
 #undef STP_IS_DEFAULT_STR
 #undef METASMT_IS_DEFAULT_STR
@@ -20,7 +20,8 @@ namespace klee
                                      std::string querySMT2LogPath,
                                      std::string baseSolverQuerySMT2LogPath,
                                      std::string queryPCLogPath,
-                                     std::string baseSolverQueryPCLogPath)
+                                     std::string baseSolverQueryPCLogPath,
+                                     std::string persistentCachePath)
 	{
 	  Solver *solver = coreSolver;
 
@@ -42,6 +43,13 @@ namespace klee
 			  << baseSolverQuerySMT2LogPath.c_str() << "\n";
 	  }
 
+	  if (UsePersistentCache)
+	  {
+		if (!PersistentCachePath.empty())
+		  persistentCachePath = PersistentCachePath;
+		solver = createPersistentCachingSolver(solver, persistentCachePath);
+	  }
+
 	  if (UseFastCexSolver)
 		solver = createFastCexSolver(solver);
 
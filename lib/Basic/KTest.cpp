@@ -9,9 +9,13 @@
 
 #include "klee/Internal/ADT/KTest.h"
 
+#include <fcntl.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #define KTEST_VERSION 3
 #define KTEST_MAGIC_SIZE 5
@@ -20,6 +24,13 @@
 // for compatibility reasons
 #define BOUT_MAGIC "BOUT\n"
 
+#define KTEST_ARCHIVE_VERSION 1
+#define KTEST_ARCHIVE_MAGIC_SIZE 5
+#define KTEST_ARCHIVE_MAGIC "KTARC"
+#define KTEST_ARCHIVE_HEADER_SIZE (KTEST_ARCHIVE_MAGIC_SIZE + 4)
+/* id and size */
+#define KTEST_ARCHIVE_RECORD_HEADER_SIZE 8
+
 /***/
 
 static int read_uint32(FILE *f, unsigned *value_out) {
@@ -30,15 +41,6 @@ static int read_uint32(FILE *f, unsigned *value_out) {
   return 1;
 }
 
-static int write_uint32(FILE *f, unsigned value) {
-  unsigned char data[4];
-  data[0] = value>>24;
-  data[1] = value>>16;
-  data[2] = value>> 8;
-  data[3] = value>> 0;
-  return fwrite(data, 1, 4, f)==4;
-}
-
 static int read_string(FILE *f, char **value_out) {
   unsigned len;
   if (!read_uint32(f, &len))
@@ -52,15 +54,66 @@ static int read_string(FILE *f, char **value_out) {
   return 1;
 }
 
-static int write_string(FILE *f, const char *value) {
-  unsigned len = strlen(value);
-  if (!write_uint32(f, len))
+/* Tests in archives are read from, and written to, memory. */
+
+typedef struct {
+  const unsigned char *pos, *end;
+} Buffer;
+
+static unsigned get_uint32(const unsigned char *data) {
+  return (((((data[0]<<8) + data[1])<<8) + data[2])<<8) + data[3];
+}
+
+static void put_uint32(unsigned char *data, unsigned value) {
+  data[0] = value>>24;
+  data[1] = value>>16;
+  data[2] = value>> 8;
+  data[3] = value>> 0;
+}
+
+static int buffer_read_uint32(Buffer *b, unsigned *value_out) {
+  if (b->end - b->pos < 4)
     return 0;
-  if (fwrite(value, len, 1, f)!=1)
+  *value_out = get_uint32(b->pos);
+  b->pos += 4;
+  return 1;
+}
+
+static int buffer_read_bytes(Buffer *b, unsigned len,
+                             const unsigned char **value_out) {
+  if ((unsigned long) (b->end - b->pos) < len)
     return 0;
+  *value_out = b->pos;
+  b->pos += len;
   return 1;
 }
 
+static int buffer_read_string(Buffer *b, char **value_out) {
+  unsigned len;
+  const unsigned char *data;
+  if (!buffer_read_uint32(b, &len) || !buffer_read_bytes(b, len, &data))
+    return 0;
+  *value_out = (char*) malloc(len+1);
+  if (!*value_out)
+    return 0;
+  memcpy(*value_out, data, len);
+  (*value_out)[len] = 0;
+  return 1;
+}
+
+static unsigned char *buffer_write_uint32(unsigned char *pos, unsigned value) {
+  put_uint32(pos, value);
+  return pos + 4;
+}
+
+static unsigned char *buffer_write_string(unsigned char *pos,
+                                          const char *value) {
+  unsigned len = strlen(value);
+  pos = buffer_write_uint32(pos, len);
+  memcpy(pos, value, len);
+  return pos + len;
+}
+
 /***/
 
 
@@ -175,45 +228,67 @@ KTest *kTest_fromFile(const char *path) {
   return 0;
 }
 
-int kTest_toFile(KTest *bo, const char *path) {
-  FILE *f = fopen(path, "wb");
-  unsigned i;
+/* Returns the test in the .ktest format, in a buffer to be freed by the
+   caller, with room for prefix bytes before it. */
+static unsigned char *kTest_serialize(KTest *bo, unsigned prefix,
+                                      unsigned *size_out) {
+  unsigned i, size = KTEST_MAGIC_SIZE + 4 * 5;
+  unsigned char *res, *pos;
 
-  if (!f) 
-    goto error;
-  if (fwrite(KTEST_MAGIC, strlen(KTEST_MAGIC), 1, f)!=1)
-    goto error;
-  if (!write_uint32(f, KTEST_VERSION))
-    goto error;
-      
-  if (!write_uint32(f, bo->numArgs))
-    goto error;
-  for (i=0; i<bo->numArgs; i++) {
-    if (!write_string(f, bo->args[i]))
-      goto error;
+  for (i=0; i<bo->numArgs; i++)
+    size += 4 + strlen(bo->args[i]);
+  for (i=0; i<bo->numObjects; i++)
+    size += 4 + strlen(bo->objects[i].name) + 4 + bo->objects[i].numBytes;
+
+  res = (unsigned char*) malloc(prefix + size);
+  if (!res)
+    return 0;
+
+  pos = res + prefix;
+  memcpy(pos, KTEST_MAGIC, KTEST_MAGIC_SIZE);
+  pos += KTEST_MAGIC_SIZE;
+  pos = buffer_write_uint32(pos, KTEST_VERSION);
+
+  pos = buffer_write_uint32(pos, bo->numArgs);
+  for (i=0; i<bo->numArgs; i++)
+    pos = buffer_write_string(pos, bo->args[i]);
+
+  pos = buffer_write_uint32(pos, bo->symArgvs);
+  pos = buffer_write_uint32(pos, bo->symArgvLen);
+
+  pos = buffer_write_uint32(pos, bo->numObjects);
+  for (i=0; i<bo->numObjects; i++) {
+    KTestObject *o = &bo->objects[i];
+    pos = buffer_write_string(pos, o->name);
+    pos = buffer_write_uint32(pos, o->numBytes);
+    memcpy(pos, o->bytes, o->numBytes);
+    pos += o->numBytes;
   }
 
-  if (!write_uint32(f, bo->symArgvs))
+  *size_out = size;
+  return res;
+}
+
+int kTest_toFile(KTest *bo, const char *path) {
+  unsigned size;
+  unsigned char *data = kTest_serialize(bo, 0, &size);
+  FILE *f = 0;
+
+  if (!data)
     goto error;
-  if (!write_uint32(f, bo->symArgvLen))
+  f = fopen(path, "wb");
+  if (!f) 
     goto error;
-  
-  if (!write_uint32(f, bo->numObjects))
+  if (fwrite(data, size, 1, f)!=1)
     goto error;
-  for (i=0; i<bo->numObjects; i++) {
-    KTestObject *o = &bo->objects[i];
-    if (!write_string(f, o->name))
-      goto error;
-    if (!write_uint32(f, o->numBytes))
-      goto error;
-    if (fwrite(o->bytes, o->numBytes, 1, f)!=1)
-      goto error;
-  }
 
-  fclose(f);
+  free(data);
+  if (fclose(f))
+    return 0;
 
   return 1;
  error:
+  free(data);
   if (f) fclose(f);
   
   return 0;
@@ -238,3 +313,244 @@ void kTest_free(KTest *bo) {
   free(bo->objects);
   free(bo);
 }
+
+/***/
+
+/* Frees a test read from an archive, whose object bytes belong to the
+   mapping. */
+static void kTest_freeShallow(KTest *bo) {
+  unsigned i;
+  if (bo->args) {
+    for (i=0; i<bo->numArgs; i++)
+      free(bo->args[i]);
+    free(bo->args);
+  }
+  if (bo->objects) {
+    for (i=0; i<bo->numObjects; i++)
+      free(bo->objects[i].name);
+    free(bo->objects);
+  }
+  free(bo);
+}
+
+static KTest *kTest_fromBuffer(const unsigned char *data, unsigned size) {
+  Buffer b = { data, data + size };
+  const unsigned char *header;
+  KTest *res;
+  unsigned i, version;
+
+  if (!buffer_read_bytes(&b, KTEST_MAGIC_SIZE, &header) ||
+      (memcmp(header, KTEST_MAGIC, KTEST_MAGIC_SIZE) &&
+       memcmp(header, BOUT_MAGIC, KTEST_MAGIC_SIZE)))
+    return 0;
+
+  res = (KTest*) calloc(1, sizeof(*res));
+  if (!res)
+    return 0;
+
+  if (!buffer_read_uint32(&b, &version) ||
+      version > kTest_getCurrentVersion())
+    goto error;
+  res->version = version;
+
+  if (!buffer_read_uint32(&b, &res->numArgs))
+    goto error;
+  res->args = (char**) calloc(res->numArgs, sizeof(*res->args));
+  if (res->numArgs && !res->args)
+    goto error;
+  for (i=0; i<res->numArgs; i++)
+    if (!buffer_read_string(&b, &res->args[i]))
+      goto error;
+
+  if (version >= 2) {
+    if (!buffer_read_uint32(&b, &res->symArgvs) ||
+        !buffer_read_uint32(&b, &res->symArgvLen))
+      goto error;
+  }
+
+  if (!buffer_read_uint32(&b, &res->numObjects))
+    goto error;
+  res->objects = (KTestObject*) calloc(res->numObjects, sizeof(*res->objects));
+  if (res->numObjects && !res->objects)
+    goto error;
+  for (i=0; i<res->numObjects; i++) {
+    KTestObject *o = &res->objects[i];
+    const unsigned char *bytes;
+    if (!buffer_read_string(&b, &o->name))
+      goto error;
+    if (!buffer_read_uint32(&b, &o->numBytes) ||
+        !buffer_read_bytes(&b, o->numBytes, &bytes))
+      goto error;
+    o->bytes = (unsigned char*) bytes;
+  }
+
+  return res;
+ error:
+  kTest_freeShallow(res);
+  return 0;
+}
+
+struct KTestArchive {
+  int fd;
+  /* The mapped file, when reading. */
+  unsigned char *data;
+  size_t size;
+  unsigned numTests;
+  /* The offset of each record. */
+  size_t *offsets;
+  /* The tests read so far. */
+  KTest **tests;
+};
+
+static int kTest_checkArchiveHeader(const unsigned char *header) {
+  return !memcmp(header, KTEST_ARCHIVE_MAGIC, KTEST_ARCHIVE_MAGIC_SIZE) &&
+    get_uint32(header + KTEST_ARCHIVE_MAGIC_SIZE) <= KTEST_ARCHIVE_VERSION;
+}
+
+int kTest_isArchive(const char *path) {
+  unsigned char header[KTEST_ARCHIVE_HEADER_SIZE];
+  int fd = open(path, O_RDONLY);
+  int res;
+
+  if (fd < 0)
+    return 0;
+  res = read(fd, header, sizeof header) == sizeof header &&
+    kTest_checkArchiveHeader(header);
+  close(fd);
+
+  return res;
+}
+
+KTestArchive *kTestArchive_create(const char *path) {
+  unsigned char header[KTEST_ARCHIVE_HEADER_SIZE];
+  KTestArchive *res = (KTestArchive*) calloc(1, sizeof(*res));
+  struct stat st;
+
+  if (!res)
+    return 0;
+  res->fd = open(path, O_RDWR | O_CREAT | O_APPEND, 0644);
+  if (res->fd < 0)
+    goto error;
+  if (fstat(res->fd, &st))
+    goto error;
+
+  if (st.st_size == 0) {
+    memcpy(header, KTEST_ARCHIVE_MAGIC, KTEST_ARCHIVE_MAGIC_SIZE);
+    put_uint32(header + KTEST_ARCHIVE_MAGIC_SIZE, KTEST_ARCHIVE_VERSION);
+    if (write(res->fd, header, sizeof header) != sizeof header)
+      goto error;
+  } else {
+    if (pread(res->fd, header, sizeof header, 0) != sizeof header ||
+        !kTest_checkArchiveHeader(header))
+      goto error;
+  }
+
+  return res;
+ error:
+  kTestArchive_close(res);
+  return 0;
+}
+
+int kTestArchive_append(KTestArchive *archive, KTest *bo, unsigned id) {
+  unsigned size;
+  unsigned char *data = kTest_serialize(bo, KTEST_ARCHIVE_RECORD_HEADER_SIZE,
+                                        &size);
+  size_t total = KTEST_ARCHIVE_RECORD_HEADER_SIZE + size;
+  int res;
+
+  if (!data)
+    return 0;
+  put_uint32(data, id);
+  put_uint32(data + 4, size);
+  res = write(archive->fd, data, total) == (ssize_t) total;
+  free(data);
+
+  return res;
+}
+
+KTestArchive *kTestArchive_open(const char *path) {
+  KTestArchive *res = (KTestArchive*) calloc(1, sizeof(*res));
+  unsigned capacity = 0;
+  struct stat st;
+  size_t offset;
+
+  if (!res)
+    return 0;
+  res->fd = open(path, O_RDONLY);
+  if (res->fd < 0)
+    goto error;
+  if (fstat(res->fd, &st) || (size_t) st.st_size < KTEST_ARCHIVE_HEADER_SIZE)
+    goto error;
+
+  res->size = st.st_size;
+  /* Private and writable, so that users modifying a test see a copy. */
+  res->data = (unsigned char*) mmap(0, res->size, PROT_READ | PROT_WRITE,
+                                    MAP_PRIVATE, res->fd, 0);
+  if (res->data == MAP_FAILED) {
+    res->data = 0;
+    goto error;
+  }
+  if (!kTest_checkArchiveHeader(res->data))
+    goto error;
+
+  /* Index the records; a record cut short by a crash ends the archive. */
+  offset = KTEST_ARCHIVE_HEADER_SIZE;
+  while (res->size - offset >= KTEST_ARCHIVE_RECORD_HEADER_SIZE) {
+    size_t size = get_uint32(res->data + offset + 4);
+    if (res->size - offset - KTEST_ARCHIVE_RECORD_HEADER_SIZE < size)
+      break;
+    if (res->numTests == capacity) {
+      size_t *offsets;
+      capacity = capacity ? 2 * capacity : 64;
+      offsets = (size_t*) realloc(res->offsets, capacity * sizeof(*offsets));
+      if (!offsets)
+        goto error;
+      res->offsets = offsets;
+    }
+    res->offsets[res->numTests++] = offset;
+    offset += KTEST_ARCHIVE_RECORD_HEADER_SIZE + size;
+  }
+
+  res->tests = (KTest**) calloc(res->numTests, sizeof(*res->tests));
+  if (res->numTests && !res->tests)
+    goto error;
+
+  return res;
+ error:
+  kTestArchive_close(res);
+  return 0;
+}
+
+unsigned kTestArchive_numTests(KTestArchive *archive) {
+  return archive->numTests;
+}
+
+unsigned kTestArchive_getId(KTestArchive *archive, unsigned index) {
+  return get_uint32(archive->data + archive->offsets[index]);
+}
+
+KTest *kTestArchive_getTest(KTestArchive *archive, unsigned index) {
+  if (!archive->tests[index]) {
+    const unsigned char *record = archive->data + archive->offsets[index];
+    archive->tests[index] =
+      kTest_fromBuffer(record + KTEST_ARCHIVE_RECORD_HEADER_SIZE,
+                       get_uint32(record + 4));
+  }
+  return archive->tests[index];
+}
+
+void kTestArchive_close(KTestArchive *archive) {
+  unsigned i;
+  if (archive->tests) {
+    for (i=0; i<archive->numTests; i++)
+      if (archive->tests[i])
+        kTest_freeShallow(archive->tests[i]);
+    free(archive->tests);
+  }
+  free(archive->offsets);
+  if (archive->data)
+    munmap(archive->data, archive->size);
+  if (archive->fd >= 0)
+    close(archive->fd);
+  free(archive);
+}
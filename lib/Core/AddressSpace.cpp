@@ -10,11 +10,14 @@
 #include "AddressSpace.h"
 #include "CoreStats.h"
 #include "Memory.h"
+#include "StateSpiller.h"
 #include "TimingSolver.h"
 
 #include "klee/Expr.h"
 #include "klee/TimerStatIncrementer.h"
 
+#include <algorithm>
+
 using namespace klee;
 
 ///
@@ -68,6 +71,229 @@ bool AddressSpace::resolveOne(const ref<ConstantExpr> &addr,
   return false;
 }
 
+namespace {
+  /// Finds the objects a symbolic address may point to. The objects the
+  /// address can reach are first bounded on either side of an example
+  /// value with a galloping search over the sorted object map, which needs
+  /// a number of queries logarithmic in the number of objects skipped.
+  /// The remaining candidates are then tested in groups, with one query
+  /// for the disjunction of their bounds checks, so that runs of objects
+  /// the address cannot point to are discarded together. Only groups the
+  /// address may point into are then tested one candidate at a time.
+  class ResolutionSearch {
+    const MemoryMap &objects;
+    ExecutionState &state;
+    TimingSolver *solver;
+    ref<Expr> address;
+    TimerStatIncrementer &timer;
+    uint64_t timeout_us;
+
+    bool timedOut() {
+      return timeout_us && timeout_us < timer.check();
+    }
+
+    /// The condition for \a address lying at or beyond the boundary of
+    /// \a mo nearest to the example, when searching in the given
+    /// direction.
+    ref<Expr> getReachExpr(const MemoryObject *mo, bool forward) {
+      if (forward)
+        return UgeExpr::create(address, mo->getBaseExpr());
+      uint64_t last = mo->address + (mo->size ? mo->size - 1 : 0);
+      return UleExpr::create(address,
+                             ConstantExpr::create(last, address->getWidth()));
+    }
+
+    bool next(MemoryMap::iterator &it, bool forward, ObjectPair &result) {
+      if (forward) {
+        if (it == objects.end())
+          return false;
+        result = *it;
+        ++it;
+      } else {
+        if (it == objects.begin())
+          return false;
+        --it;
+        result = *it;
+      }
+      return true;
+    }
+
+  public:
+    ResolutionSearch(const MemoryMap &_objects, ExecutionState &_state,
+                     TimingSolver *_solver, ref<Expr> _address,
+                     TimerStatIncrementer &_timer, uint64_t _timeout_us)
+      : objects(_objects), state(_state), solver(_solver), address(_address),
+        timer(_timer), timeout_us(_timeout_us) {}
+
+    /// Append to \a result the objects, walking from \a start in the
+    /// given direction, that the address can reach. If \a firstKnown is
+    /// set the first of them is known to be reachable.
+    ///
+    /// \return false if a query failed or the search timed out.
+    bool findReachable(MemoryMap::iterator start, bool forward,
+                       bool firstKnown, std::vector<ObjectPair> &result) {
+      MemoryMap::iterator it = start;
+      std::vector<ObjectPair> seen;
+      ObjectPair op;
+
+      // Invariant: seen[0, lo) are reachable and, once an unreachable
+      // object has been found, seen[hi] is one.
+      unsigned lo = 0, hi = 0, step = 1;
+      bool bounded = false;
+      if (firstKnown && next(it, forward, op)) {
+        seen.push_back(op);
+        lo = 1;
+      }
+
+      // Gallop away from the example until an unreachable object is found.
+      while (!bounded) {
+        unsigned pos = lo + step - 1;
+        while (seen.size() <= pos && next(it, forward, op))
+          seen.push_back(op);
+        if (seen.size() == lo) {
+          hi = lo;
+          break;
+        }
+        if (seen.size() <= pos)
+          pos = seen.size() - 1;
+
+        if (timedOut())
+          return false;
+        bool reachable;
+        if (!solver->mayBeTrue(state, getReachExpr(seen[pos].first, forward),
+                               reachable))
+          return false;
+        if (reachable) {
+          lo = pos + 1;
+          step *= 2;
+        } else {
+          hi = pos;
+          bounded = true;
+        }
+      }
+
+      // Binary search for the first unreachable object.
+      while (lo < hi) {
+        unsigned mid = lo + (hi - lo) / 2;
+        if (timedOut())
+          return false;
+        bool reachable;
+        if (!solver->mayBeTrue(state, getReachExpr(seen[mid].first, forward),
+                               reachable))
+          return false;
+        if (reachable)
+          lo = mid + 1;
+        else
+          hi = mid;
+      }
+
+      result.insert(result.end(), seen.begin(), seen.begin() + lo);
+      return true;
+    }
+
+    /// The number of candidates tested with one query before falling
+    /// back to a query per candidate.
+    enum { GroupSize = 8 };
+
+    /// Append to \a rl the candidates in [begin, end) the address may
+    /// point into, stopping once \a rl holds \a maxResolutions objects
+    /// (if non-zero). Each group of candidates is tested with one query
+    /// for the disjunction of their bounds checks; only if that may be
+    /// true is each candidate in the group tested on its own. The last
+    /// one then needs no query if none of the others is feasible.
+    ///
+    /// \return false if a query failed or the search timed out.
+    bool filterFeasible(const std::vector<ObjectPair> &candidates,
+                        unsigned begin, unsigned end, ResolutionList &rl,
+                        unsigned maxResolutions) {
+      for (unsigned group = begin; group < end; group += GroupSize) {
+        if (maxResolutions && rl.size() >= maxResolutions)
+          return true;
+
+        unsigned groupEnd = std::min(end, group + (unsigned) GroupSize);
+        bool mayBeTrue;
+
+        if (groupEnd - group > 1) {
+          ref<Expr> inBounds =
+            candidates[group].first->getBoundsCheckPointer(address);
+          for (unsigned i = group + 1; i != groupEnd; ++i)
+            inBounds = OrExpr::create(
+                inBounds, candidates[i].first->getBoundsCheckPointer(address));
+
+          if (timedOut())
+            return false;
+          if (!solver->mayBeTrue(state, inBounds, mayBeTrue))
+            return false;
+          if (!mayBeTrue)
+            continue;
+        }
+
+        bool anyFeasible = false;
+        for (unsigned i = group; i != groupEnd; ++i) {
+          if (maxResolutions && rl.size() >= maxResolutions)
+            return true;
+
+          if (i + 1 == groupEnd && groupEnd - group > 1 && !anyFeasible) {
+            mayBeTrue = true;
+          } else {
+            if (timedOut())
+              return false;
+            ref<Expr> inBounds =
+              candidates[i].first->getBoundsCheckPointer(address);
+            if (!solver->mayBeTrue(state, inBounds, mayBeTrue))
+              return false;
+          }
+          if (mayBeTrue) {
+            rl.push_back(candidates[i]);
+            anyFeasible = true;
+          }
+        }
+      }
+      return true;
+    }
+
+    /// Append to \a rl the objects the address may point into, in address
+    /// order. \a example is a feasible value of the address.
+    ///
+    /// \return false if a query failed or the search timed out.
+    bool resolve(uint64_t example, ResolutionList &rl,
+                 unsigned maxResolutions) {
+      MemoryObject hack(example);
+      MemoryMap::iterator start = objects.upper_bound(&hack);
+
+      // The object at or below the example contains it, unless the
+      // example lies in a gap between objects.
+      bool containsExample = false;
+      if (const MemoryMap::value_type *res = objects.lookup_previous(&hack)) {
+        const MemoryObject *mo = res->first;
+        containsExample = (mo->size==0 && example==mo->address) ||
+                          (example - mo->address < mo->size);
+      }
+
+      std::vector<ObjectPair> candidates;
+      if (!findReachable(start, false, containsExample, candidates))
+        return false;
+      std::reverse(candidates.begin(), candidates.end());
+      unsigned numBelow = candidates.size();
+      if (!findReachable(start, true, false, candidates))
+        return false;
+
+      if (!containsExample)
+        return filterFeasible(candidates, 0, candidates.size(), rl,
+                              maxResolutions);
+
+      // The object containing the example needs no query.
+      unsigned known = numBelow - 1;
+      if (!filterFeasible(candidates, 0, known, rl, maxResolutions))
+        return false;
+      if (!maxResolutions || rl.size() < maxResolutions)
+        rl.push_back(candidates[known]);
+      return filterFeasible(candidates, known + 1, candidates.size(), rl,
+                            maxResolutions);
+    }
+  };
+}
+
 bool AddressSpace::resolveOne(ExecutionState &state,
                               TimingSolver *solver,
                               ref<Expr> address,
@@ -98,62 +324,15 @@ bool AddressSpace::resolveOne(ExecutionState &state,
     }
 
     // didn't work, now we have to search
-       
-    MemoryMap::iterator oi = objects.upper_bound(&hack);
-    MemoryMap::iterator begin = objects.begin();
-    MemoryMap::iterator end = objects.end();
-      
-    MemoryMap::iterator start = oi;
-    while (oi!=begin) {
-      --oi;
-      const MemoryObject *mo = oi->first;
-        
-      bool mayBeTrue;
-      if (!solver->mayBeTrue(state, 
-                             mo->getBoundsCheckPointer(address), mayBeTrue))
-        return false;
-      if (mayBeTrue) {
-        result = *oi;
-        success = true;
-        return true;
-      } else {
-        bool mustBeTrue;
-        if (!solver->mustBeTrue(state, 
-                                UgeExpr::create(address, mo->getBaseExpr()),
-                                mustBeTrue))
-          return false;
-        if (mustBeTrue)
-          break;
-      }
-    }
-
-    // search forwards
-    for (oi=start; oi!=end; ++oi) {
-      const MemoryObject *mo = oi->first;
 
-      bool mustBeTrue;
-      if (!solver->mustBeTrue(state, 
-                              UltExpr::create(address, mo->getBaseExpr()),
-                              mustBeTrue))
-        return false;
-      if (mustBeTrue) {
-        break;
-      } else {
-        bool mayBeTrue;
-
-        if (!solver->mayBeTrue(state, 
-                               mo->getBoundsCheckPointer(address),
-                               mayBeTrue))
-          return false;
-        if (mayBeTrue) {
-          result = *oi;
-          success = true;
-          return true;
-        }
-      }
-    }
+    ResolutionSearch search(objects, state, solver, address, timer, 0);
+    ResolutionList rl;
+    if (!search.resolve(example, rl, 1))
+      return false;
 
-    success = false;
+    success = !rl.empty();
+    if (success)
+      result = rl[0];
     return true;
   }
 }
@@ -173,114 +352,16 @@ bool AddressSpace::resolve(ExecutionState &state,
     TimerStatIncrementer timer(stats::resolveTime);
     uint64_t timeout_us = (uint64_t) (timeout*1000000.);
 
-    // XXX in general this isn't exactly what we want... for
-    // a multiple resolution case (or for example, a \in {b,c,0})
-    // we want to find the first object, find a cex assuming
-    // not the first, find a cex assuming not the second...
-    // etc.
-    
-    // XXX how do we smartly amortize the cost of checking to
-    // see if we need to keep searching up/down, in bad cases?
-    // maybe we don't care?
-    
-    // XXX we really just need a smart place to start (although
-    // if its a known solution then the code below is guaranteed
-    // to hit the fast path with exactly 2 queries). we could also
-    // just get this by inspection of the expr.
-    
     ref<ConstantExpr> cex;
     if (!solver->getValue(state, p, cex))
       return true;
-    uint64_t example = cex->getZExtValue();
-    MemoryObject hack(example);
-    
-    MemoryMap::iterator oi = objects.upper_bound(&hack);
-    MemoryMap::iterator begin = objects.begin();
-    MemoryMap::iterator end = objects.end();
-      
-    MemoryMap::iterator start = oi;
-      
-    // XXX in the common case we can save one query if we ask
-    // mustBeTrue before mayBeTrue for the first result. easy
-    // to add I just want to have a nice symbolic test case first.
-      
-    // search backwards, start with one minus because this
-    // is the object that p *should* be within, which means we
-    // get write off the end with 4 queries (XXX can be better,
-    // no?)
-    while (oi!=begin) {
-      --oi;
-      const MemoryObject *mo = oi->first;
-      if (timeout_us && timeout_us < timer.check())
-        return true;
 
-      // XXX I think there is some query wasteage here?
-      ref<Expr> inBounds = mo->getBoundsCheckPointer(p);
-      bool mayBeTrue;
-      if (!solver->mayBeTrue(state, inBounds, mayBeTrue))
-        return true;
-      if (mayBeTrue) {
-        rl.push_back(*oi);
-        
-        // fast path check
-        unsigned size = rl.size();
-        if (size==1) {
-          bool mustBeTrue;
-          if (!solver->mustBeTrue(state, inBounds, mustBeTrue))
-            return true;
-          if (mustBeTrue)
-            return false;
-        } else if (size==maxResolutions) {
-          return true;
-        }
-      }
-        
-      bool mustBeTrue;
-      if (!solver->mustBeTrue(state, 
-                              UgeExpr::create(p, mo->getBaseExpr()),
-                              mustBeTrue))
-        return true;
-      if (mustBeTrue)
-        break;
-    }
-    // search forwards
-    for (oi=start; oi!=end; ++oi) {
-      const MemoryObject *mo = oi->first;
-      if (timeout_us && timeout_us < timer.check())
-        return true;
+    ResolutionSearch search(objects, state, solver, p, timer, timeout_us);
+    if (!search.resolve(cex->getZExtValue(), rl, maxResolutions))
+      return true;
 
-      bool mustBeTrue;
-      if (!solver->mustBeTrue(state, 
-                              UltExpr::create(p, mo->getBaseExpr()),
-                              mustBeTrue))
-        return true;
-      if (mustBeTrue)
-        break;
-      
-      // XXX I think there is some query wasteage here?
-      ref<Expr> inBounds = mo->getBoundsCheckPointer(p);
-      bool mayBeTrue;
-      if (!solver->mayBeTrue(state, inBounds, mayBeTrue))
-        return true;
-      if (mayBeTrue) {
-        rl.push_back(*oi);
-        
-        // fast path check
-        unsigned size = rl.size();
-        if (size==1) {
-          bool mustBeTrue;
-          if (!solver->mustBeTrue(state, inBounds, mustBeTrue))
-            return true;
-          if (mustBeTrue)
-            return false;
-        } else if (size==maxResolutions) {
-          return true;
-        }
-      }
-    }
+    return maxResolutions && rl.size() == maxResolutions;
   }
-
-  return false;
 }
 
 // These two are pretty big hack so we can sort of pass memory back
@@ -299,7 +380,7 @@ void AddressSpace::copyOutConcretes() {
       uint8_t *address = (uint8_t*) (unsigned long) mo->address;
 
       if (!os->readOnly)
-        memcpy(address, os->concreteStore, mo->size);
+        os->copyConcreteStoreTo(address);
     }
   }
 }
@@ -313,12 +394,12 @@ bool AddressSpace::copyInConcretes() {
       const ObjectState *os = it->second;
       uint8_t *address = (uint8_t*) (unsigned long) mo->address;
 
-      if (memcmp(address, os->concreteStore, mo->size)!=0) {
+      if (!os->isConcreteStoreEqual(address)) {
         if (os->readOnly) {
           return false;
         } else {
           ObjectState *wos = getWriteable(mo, os);
-          memcpy(wos->concreteStore, address, mo->size);
+          wos->copyConcreteStoreFrom(address);
         }
       }
     }
@@ -333,3 +414,26 @@ bool MemoryObjectLT::operator()(const MemoryObject *a, const MemoryObject *b) co
   return a->address < b->address;
 }
 
+
+/***/
+
+void AddressSpace::spill(SpillWriter &writer) {
+  for (MemoryMap::iterator it = objects.begin(), ie = objects.end(); 
+       it != ie; ++it) {
+    ObjectState *os = it->second;
+    // Objects we own are not visible to any other address space.
+    bool owned = os->copyOnWriteOwner == cowKey;
+    writer.writeU8(owned);
+    if (owned)
+      os->spill(writer);
+  }
+}
+
+void AddressSpace::reload(SpillReader &reader) {
+  for (MemoryMap::iterator it = objects.begin(), ie = objects.end(); 
+       it != ie; ++it)
+    if (reader.readU8()) {
+      ObjectState *os = it->second;
+      os->reload(reader);
+    }
+}
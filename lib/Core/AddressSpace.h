@@ -19,6 +19,8 @@ namespace klee {
   class ExecutionState;
   class MemoryObject;
   class ObjectState;
+  class SpillReader;
+  class SpillWriter;
   class TimingSolver;
 
   template<class T> class ref;
@@ -125,6 +127,13 @@ namespace klee {
     /// \retval true The copy succeeded. 
     /// \retval false The copy failed because a read-only object was modified.
     bool copyInConcretes();
+
+    /// Write the contents of the objects this address space owns to
+    /// \a writer and release them, see StateSpiller.
+    void spill(SpillWriter &writer);
+
+    /// Restore the contents written by spill().
+    void reload(SpillReader &reader);
   };
 } // End klee namespace
 
@@ -27,6 +27,14 @@ namespace stats {
   extern Statistic forkTime;
   extern Statistic solverTime;
 
+  /// The number of queries whose time went into solverTime, counted
+  /// where they are timed rather than in the core solver.
+  extern Statistic solverQueries;
+
+  /// The part of solverTime spent in forked solver processes while the
+  /// executor went on with other states.
+  extern Statistic hiddenSolverTime;
+
   /// The number of process forks.
   extern Statistic forks;
 
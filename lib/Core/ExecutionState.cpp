@@ -17,6 +17,7 @@
 #include "klee/Expr.h"
 
 #include "Memory.h"
+#include "StateSpiller.h"
 #if LLVM_VERSION_CODE >= LLVM_VERSION(3, 3)
 #include "llvm/IR/Function.h"
 #else
@@ -74,15 +75,19 @@ ExecutionState::ExecutionState(KFunction *kf) :
     weight(1),
     depth(0),
 
+    pathPrefixPosition(0),
+
     instsSinceCovNew(0),
     coveredNew(false),
     forkDisabled(false),
-    ptreeNode(0) {
+    ptreeNode(0),
+    spilled(false) {
   pushFrame(0, kf);
 }
 
 ExecutionState::ExecutionState(const std::vector<ref<Expr> > &assumptions)
-    : constraints(assumptions), queryCost(0.), ptreeNode(0) {}
+    : constraints(assumptions), queryCost(0.), pathPrefixPosition(0),
+      ptreeNode(0), spilled(false) {}
 
 ExecutionState::~ExecutionState() {
   for (unsigned int i=0; i<symbolics.size(); i++)
@@ -113,12 +118,15 @@ ExecutionState::ExecutionState(const ExecutionState& state):
 
     pathOS(state.pathOS),
     symPathOS(state.symPathOS),
+    pathPrefix(state.pathPrefix),
+    pathPrefixPosition(state.pathPrefixPosition),
 
     instsSinceCovNew(state.instsSinceCovNew),
     coveredNew(state.coveredNew),
     forkDisabled(state.forkDisabled),
     coveredLines(state.coveredLines),
     ptreeNode(state.ptreeNode),
+    spilled(false),
     symbolics(state.symbolics),
     arrayNames(state.arrayNames)
 {
@@ -311,13 +319,13 @@ bool ExecutionState::merge(const ExecutionState &b) {
     StackFrame &af = *itA;
     const StackFrame &bf = *itB;
     for (unsigned i=0; i<af.kf->numRegisters; i++) {
-      ref<Expr> &av = af.locals[i].value;
-      const ref<Expr> &bv = bf.locals[i].value;
+      ref<Expr> av = af.locals[i].getValue();
+      ref<Expr> bv = bf.locals[i].getValue();
       if (av.isNull() || bv.isNull()) {
         // if one is null then by implication (we are at same pc)
         // we cannot reuse this local, so just ignore
       } else {
-        av = SelectExpr::create(inA, av, bv);
+        af.locals[i].setValue(SelectExpr::create(inA, av, bv));
       }
     }
   }
@@ -370,7 +378,7 @@ void ExecutionState::dumpStack(llvm::raw_ostream &out) const {
 
       out << ai->getName().str();
       // XXX should go through function
-      ref<Expr> value = sf.locals[sf.kf->getArgRegister(index++)].value; 
+      ref<Expr> value = sf.locals[sf.kf->getArgRegister(index++)].getValue();
       if (isa<ConstantExpr>(value))
         out << "=" << value;
     }
@@ -381,3 +389,52 @@ void ExecutionState::dumpStack(llvm::raw_ostream &out) const {
     target = sf.caller;
   }
 }
+
+void ExecutionState::spill(SpillWriter &writer) {
+  assert(!spilled && "state already spilled");
+
+  // Chunks shared with other states stay in memory.
+  std::vector< ref<Expr> > unshared;
+  constraints.takeUnshared(unshared);
+  writer.writeU32(unshared.size());
+  for (unsigned i = 0; i < unshared.size(); ++i)
+    writer.writeExpr(unshared[i]);
+  unshared.clear();
+
+  // Unboxed values stay in place, their expression is rebuilt on demand.
+  for (stack_ty::iterator it = stack.begin(), ie = stack.end(); it != ie;
+       ++it) {
+    for (unsigned i = 0; i < it->kf->numRegisters; ++i) {
+      Cell &cell = it->locals[i];
+      if (cell.concreteWidth)
+        writer.writeExpr(ref<Expr>());
+      else
+        writer.writeExpr(cell.value);
+      cell.value = ref<Expr>();
+    }
+  }
+
+  addressSpace.spill(writer);
+  spilled = true;
+}
+
+void ExecutionState::reload(SpillReader &reader) {
+  assert(spilled && "state not spilled");
+
+  std::vector< ref<Expr> > unshared(reader.readU32());
+  for (unsigned i = 0; i < unshared.size(); ++i)
+    unshared[i] = reader.readExpr();
+  constraints.append(unshared);
+
+  for (stack_ty::iterator it = stack.begin(), ie = stack.end(); it != ie;
+       ++it) {
+    for (unsigned i = 0; i < it->kf->numRegisters; ++i) {
+      ref<Expr> value = reader.readExpr();
+      if (!it->locals[i].concreteWidth)
+        it->locals[i].value = value;
+    }
+  }
+
+  addressSpace.reload(reader);
+  spilled = false;
+}
@@ -18,6 +18,7 @@
 #include "Searcher.h"
 #include "SeedInfo.h"
 #include "SpecialFunctionHandler.h"
+#include "StateSpiller.h"
 #include "StatsTracker.h"
 #include "TimingSolver.h"
 #include "UserSearcher.h"
@@ -38,6 +39,7 @@
 #include "klee/Config/Version.h"
 #include "klee/Internal/ADT/KTest.h"
 #include "klee/Internal/ADT/RNG.h"
+#include "klee/Internal/ADT/SlabAllocator.h"
 #include "klee/Internal/Module/Cell.h"
 #include "klee/Internal/Module/InstructionInfoTable.h"
 #include "klee/Internal/Module/KInstruction.h"
@@ -228,6 +230,11 @@ namespace {
 		      cl::init(1.),
 		      cl::desc("(default=1.0)"));
 
+  cl::opt<unsigned>
+  AsyncBranchQueries("async-branch-queries",
+                     cl::desc("Number of branch feasibility queries that may run in forked solver processes while other states execute (default=0 (off))"),
+                     cl::init(0));
+
   cl::opt<double>
   MaxInstructionTime("max-instruction-time",
                      cl::desc("Only allow a single instruction to take this much time (default=0s (off)). Enables --use-forked-solver"),
@@ -262,6 +269,18 @@ namespace {
   MaxMemoryInhibit("max-memory-inhibit",
             cl::desc("Inhibit forking at memory cap (vs. random terminate) (default=on)"),
             cl::init(true));
+
+  cl::opt<bool>
+  SpillStates("spill-states",
+              cl::desc("Write inactive states to disk at memory cap, instead "
+                       "of terminating them (default=off)"),
+              cl::init(false));
+
+  cl::opt<unsigned>
+  NumWorkers("num-workers",
+             cl::desc("Split the search between this many forked worker processes, "
+                      "once there is a state for each of them (default=1 (off))"),
+             cl::init(1));
 }
 
 
@@ -286,12 +305,19 @@ Executor::Executor(const InterpreterOptions &opts,
     replayPath(0),    
     usingSeeds(0),
     atMemoryLimit(false),
+    spiller(0),
     inhibitForking(false),
     haltExecution(false),
     ivcEnabled(false),
     coreSolverTimeout(MaxCoreSolverTime != 0 && MaxInstructionTime != 0
       ? std::min(MaxCoreSolverTime,MaxInstructionTime)
-      : std::max(MaxCoreSolverTime,MaxInstructionTime)) {
+      : std::max(MaxCoreSolverTime,MaxInstructionTime)),
+    workerIndex(-1),
+    workerResultFD(-1),
+    workerCount(1),
+    workTemplate(0),
+    workPathWriter(0),
+    workDonated(0) {
       
   if (coreSolverTimeout) UseForkedCoreSolver = true;
   Solver *coreSolver = klee::createCoreSolver(CoreSolverToUse);
@@ -304,7 +330,8 @@ Executor::Executor(const InterpreterOptions &opts,
       interpreterHandler->getOutputFilename(ALL_QUERIES_SMT2_FILE_NAME),
       interpreterHandler->getOutputFilename(SOLVER_QUERIES_SMT2_FILE_NAME),
       interpreterHandler->getOutputFilename(ALL_QUERIES_PC_FILE_NAME),
-      interpreterHandler->getOutputFilename(SOLVER_QUERIES_PC_FILE_NAME));
+      interpreterHandler->getOutputFilename(SOLVER_QUERIES_PC_FILE_NAME),
+      interpreterHandler->getOutputFilename(PERSISTENT_CACHE_FILE_NAME));
 
   this->solver = new TimingSolver(solver, EqualitySubstitution);
   memory = new MemoryManager(&arrayCache);
@@ -353,6 +380,8 @@ Executor::~Executor() {
     delete statsTracker;
   delete solver;
   delete kmodule;
+  if (workPathWriter)
+    delete workPathWriter;
   while(!timers.empty()) {
     delete timers.back();
     timers.pop_back();
@@ -583,14 +612,48 @@ void Executor::initializeGlobals(ExecutionState &state) {
   }
 }
 
+/// The number of path bits recording which of \a N branches was taken.
+static unsigned getBranchBits(unsigned N) {
+  unsigned bits = 0;
+  while ((1u << bits) < N)
+    ++bits;
+  return bits;
+}
+
 void Executor::branch(ExecutionState &state, 
                       const std::vector< ref<Expr> > &conditions,
                       std::vector<ExecutionState*> &result) {
   TimerStatIncrementer timer(stats::forkTime);
   unsigned N = conditions.size();
   assert(N);
+  unsigned bits = getBranchBits(N);
+
+  if (state.pathPrefixPosition < state.pathPrefix.size()) {
+    // Follow the prefix another worker handed over, as fork() does.
+    unsigned index = 0;
+    bool diverged = false;
+    for (unsigned i = 0; i < bits; ++i) {
+      if (state.pathPrefixPosition == state.pathPrefix.size()) {
+        diverged = true;
+        break;
+      }
+      index = (index << 1) | state.pathPrefix[state.pathPrefixPosition++];
+    }
+    if (state.pathPrefixPosition == state.pathPrefix.size()) {
+      state.pathPrefix.clear();
+      state.pathPrefixPosition = 0;
+    }
+
+    if (diverged || index >= N) {
+      state.pc = state.prevPC;
+      terminateStateEarly(state, "Path prefix diverged.");
+      result.assign(N, NULL);
+      return;
+    }
 
-  if (MaxForks!=~0u && stats::forks >= MaxForks) {
+    for (unsigned i=0; i<N; ++i)
+      result.push_back(i == index ? &state : NULL);
+  } else if (MaxForks!=~0u && stats::forks >= MaxForks) {
     unsigned next = theRNG.getInt32() % N;
     for (unsigned i=0; i<N; ++i) {
       if (i == next) {
@@ -609,6 +672,10 @@ void Executor::branch(ExecutionState &state,
       ExecutionState *ns = es->branch();
       addedStates.insert(ns);
       result.push_back(ns);
+      if (pathWriter)
+        ns->pathOS = pathWriter->open(es->pathOS);
+      if (symPathWriter)
+        ns->symPathOS = symPathWriter->open(es->symPathOS);
       es->ptreeNode->data = 0;
       std::pair<PTree::Node*,PTree::Node*> res = 
         processTree->split(es->ptreeNode, ns, es);
@@ -664,6 +731,20 @@ void Executor::branch(ExecutionState &state,
     }
   }
 
+  // Record the branch taken in the path, so that a prefix handed over to
+  // another worker can be followed through it.
+  for (unsigned i=0; i<N; ++i) {
+    if (!result[i])
+      continue;
+    for (unsigned b = bits; b--; ) {
+      const char *bit = ((i >> b) & 1) ? "1" : "0";
+      if (pathWriter)
+        result[i]->pathOS << bit;
+      if (symPathWriter)
+        result[i]->symPathOS << bit;
+    }
+  }
+
   for (unsigned i=0; i<N; ++i)
     if (result[i])
       addConstraint(*result[i], conditions[i]);
@@ -676,7 +757,34 @@ Executor::fork(ExecutionState &current, ref<Expr> condition, bool isInternal) {
     seedMap.find(&current);
   bool isSeeding = it != seedMap.end();
 
-  if (!isSeeding && !isa<ConstantExpr>(condition) && 
+  double timeout = coreSolverTimeout;
+  if (isSeeding)
+    timeout *= it->second.size();
+  solver->setTimeout(timeout);
+  bool success = solver->evaluate(current, condition, res);
+  solver->setTimeout(0);
+  if (!success) {
+    current.pc = current.prevPC;
+    terminateStateEarly(current, "Query timed out (fork).");
+    return StatePair(0, 0);
+  }
+
+  return fork(current, condition, isInternal, res);
+}
+
+Executor::StatePair
+Executor::fork(ExecutionState &current, ref<Expr> condition, bool isInternal,
+               Solver::Validity res) {
+  std::map< ExecutionState*, std::vector<SeedInfo> >::iterator it = 
+    seedMap.find(&current);
+  bool isSeeding = it != seedMap.end();
+  // Work handed over between workers is a path prefix, which has to
+  // cover the forks of multiple object resolution too.
+  bool recordPath = !isInternal || workTemplate;
+
+  // Rather than fork at an instruction or call path that already took
+  // too large a share of the forks or solver time, pick one side.
+  if (!isSeeding && res==Solver::Unknown && 
       (MaxStaticForkPct!=1. || MaxStaticSolvePct != 1. ||
        MaxStaticCPForkPct!=1. || MaxStaticCPSolvePct != 1.) &&
       statsTracker->elapsed() > 60.) {
@@ -700,21 +808,10 @@ Executor::fork(ExecutionState &current, ref<Expr> condition, bool isInternal) {
       (void) success;
       addConstraint(current, EqExpr::create(value, condition));
       condition = value;
+      res = value->isTrue() ? Solver::True : Solver::False;
     }
   }
 
-  double timeout = coreSolverTimeout;
-  if (isSeeding)
-    timeout *= it->second.size();
-  solver->setTimeout(timeout);
-  bool success = solver->evaluate(current, condition, res);
-  solver->setTimeout(0);
-  if (!success) {
-    current.pc = current.prevPC;
-    terminateStateEarly(current, "Query timed out (fork).");
-    return StatePair(0, 0);
-  }
-
   if (!isSeeding) {
     if (replayPath && !isInternal) {
       assert(replayPosition<replayPath->size() &&
@@ -735,6 +832,29 @@ Executor::fork(ExecutionState &current, ref<Expr> condition, bool isInternal) {
           addConstraint(current, Expr::createIsZero(condition));
         }
       }
+    } else if (recordPath &&
+               current.pathPrefixPosition < current.pathPrefix.size()) {
+      bool branch = current.pathPrefix[current.pathPrefixPosition++];
+      if (current.pathPrefixPosition == current.pathPrefix.size()) {
+        current.pathPrefix.clear();
+        current.pathPrefixPosition = 0;
+      }
+
+      if ((res==Solver::True && !branch) || (res==Solver::False && branch)) {
+        // The prefix was recorded by another process, which may have
+        // made different concrete choices (e.g. addresses) on the way.
+        current.pc = current.prevPC;
+        terminateStateEarly(current, "Path prefix diverged.");
+        return StatePair(0, 0);
+      } else if (res==Solver::Unknown) {
+        if (branch) {
+          res = Solver::True;
+          addConstraint(current, condition);
+        } else {
+          res = Solver::False;
+          addConstraint(current, Expr::createIsZero(condition));
+        }
+      }
     } else if (res==Solver::Unknown) {
       assert(!replayOut && "in replay mode, only one branch can be true.");
       
@@ -803,7 +923,7 @@ Executor::fork(ExecutionState &current, ref<Expr> condition, bool isInternal) {
   // hint to just use the single constraint instead of all the binary
   // search ones. If that makes sense.
   if (res==Solver::True) {
-    if (!isInternal) {
+    if (recordPath) {
       if (pathWriter) {
         current.pathOS << "1";
       }
@@ -811,7 +931,7 @@ Executor::fork(ExecutionState &current, ref<Expr> condition, bool isInternal) {
 
     return StatePair(&current, 0);
   } else if (res==Solver::False) {
-    if (!isInternal) {
+    if (recordPath) {
       if (pathWriter) {
         current.pathOS << "0";
       }
@@ -870,7 +990,7 @@ Executor::fork(ExecutionState &current, ref<Expr> condition, bool isInternal) {
     falseState->ptreeNode = res.first;
     trueState->ptreeNode = res.second;
 
-    if (!isInternal) {
+    if (recordPath) {
       if (pathWriter) {
         falseState->pathOS = pathWriter->open(current.pathOS);
         trueState->pathOS << "1";
@@ -992,8 +1112,8 @@ ref<klee::ConstantExpr> Executor::evalConstant(const Constant *c) {
   }
 }
 
-const Cell& Executor::eval(KInstruction *ki, unsigned index, 
-                           ExecutionState &state) const {
+const Cell& Executor::getOperandCell(KInstruction *ki, unsigned index,
+                                     ExecutionState &state) const {
   assert(index < ki->inst->getNumOperands());
   int vnumber = ki->operands[index];
 
@@ -1011,14 +1131,42 @@ const Cell& Executor::eval(KInstruction *ki, unsigned index,
   }
 }
 
+const Cell& Executor::eval(KInstruction *ki, unsigned index, 
+                           ExecutionState &state) const {
+  const Cell &c = getOperandCell(ki, index, state);
+  // Box an unboxed register for the callers using the expression.
+  c.getValue();
+  return c;
+}
+
+bool Executor::evalConcrete(KInstruction *ki, unsigned index,
+                            ExecutionState &state,
+                            uint64_t &value, Expr::Width &width) const {
+  return getOperandCell(ki, index, state).getConcrete(value, width);
+}
+
+bool Executor::evalConcrete(KInstruction *ki, ExecutionState &state,
+                            uint64_t &left, uint64_t &right,
+                            Expr::Width &width) const {
+  Expr::Width rightWidth;
+  return evalConcrete(ki, 0, state, left, width) &&
+    evalConcrete(ki, 1, state, right, rightWidth);
+}
+
 void Executor::bindLocal(KInstruction *target, ExecutionState &state, 
                          ref<Expr> value) {
-  getDestCell(state, target).value = value;
+  getDestCell(state, target).setValue(value);
+}
+
+void Executor::bindLocalConcrete(KInstruction *target, ExecutionState &state,
+                                 uint64_t value, Expr::Width width) {
+  getDestCell(state, target).setConcrete(bits64::truncateToNBits(value, width),
+                                         width);
 }
 
 void Executor::bindArgument(KFunction *kf, unsigned index, 
                             ExecutionState &state, ref<Expr> value) {
-  getArgumentCell(state, kf, index).value = value;
+  getArgumentCell(state, kf, index).setValue(value);
 }
 
 ref<Expr> Executor::toUnique(const ExecutionState &state, 
@@ -1197,8 +1345,8 @@ void Executor::executeCall(ExecutionState &state,
       klee_error("unknown intrinsic: %s", f->getName().data());
     }
 
-    if (InvokeInst *ii = dyn_cast<InvokeInst>(i))
-      transferToBasicBlock(ii->getNormalDest(), i->getParent(), state);
+    if (isa<InvokeInst>(i))
+      transferToSuccessor(ki, 0, state);
   } else {
     // FIXME: I'm not really happy about this reliance on prevPC but it is ok, I
     // guess. This just done to avoid having to pass KInstIterator everywhere
@@ -1317,6 +1465,16 @@ void Executor::transferToBasicBlock(BasicBlock *dst, BasicBlock *src,
   }
 }
 
+void Executor::transferToSuccessor(KInstruction *ki, unsigned successor,
+                                   ExecutionState &state) {
+  // Same as transferToBasicBlock, with the lookups done by KFunction.
+  const KBranchTarget &target =
+    static_cast<KBranchInstruction*>(ki)->targets[successor];
+  state.pc = &state.stack.back().kf->instructions[target.entry];
+  if (target.incomingBBIndex >= 0)
+    state.incomingBBIndex = target.incomingBBIndex;
+}
+
 void Executor::printFileLine(ExecutionState &state, KInstruction *ki) {
   const InstructionInfo &ii = *ki->info;
   if (ii.file != "")
@@ -1409,8 +1567,9 @@ void Executor::executeInstruction(ExecutionState &state, KInstruction *ki) {
       if (statsTracker)
         statsTracker->framePopped(state);
 
-      if (InvokeInst *ii = dyn_cast<InvokeInst>(caller)) {
-        transferToBasicBlock(ii->getNormalDest(), caller->getParent(), state);
+      if (isa<InvokeInst>(caller)) {
+        // The normal destination.
+        transferToSuccessor(kcaller, 0, state);
       } else {
         state.pc = kcaller;
         ++state.pc;
@@ -1481,12 +1640,28 @@ void Executor::executeInstruction(ExecutionState &state, KInstruction *ki) {
   case Instruction::Br: {
     BranchInst *bi = cast<BranchInst>(i);
     if (bi->isUnconditional()) {
-      transferToBasicBlock(bi->getSuccessor(0), bi->getParent(), state);
+      transferToSuccessor(ki, 0, state);
     } else {
       // FIXME: Find a way that we don't have this hidden dependency.
       assert(bi->getCondition() == bi->getOperand(0) &&
              "Wrong operand index!");
       ref<Expr> cond = eval(ki, 0, state).value;
+
+      if (!isa<ConstantExpr>(cond) && canParkBranch(state)) {
+        solver->setTimeout(coreSolverTimeout);
+        SolverFuture *future = solver->evaluateAsync(state, cond);
+        solver->setTimeout(0);
+        if (future) {
+          ParkedBranch &pb = parkedStates[&state];
+          pb.ki = ki;
+          pb.condition = cond;
+          pb.future = future;
+          states.erase(&state);
+          newlyParkedStates.insert(&state);
+          break;
+        }
+      }
+
       Executor::StatePair branches = fork(state, cond, false);
 
       // NOTE: There is a hidden dependency here, markBranchVisited
@@ -1497,9 +1672,9 @@ void Executor::executeInstruction(ExecutionState &state, KInstruction *ki) {
         statsTracker->markBranchVisited(branches.first, branches.second);
 
       if (branches.first)
-        transferToBasicBlock(bi->getSuccessor(0), bi->getParent(), *branches.first);
+        transferToSuccessor(ki, 0, *branches.first);
       if (branches.second)
-        transferToBasicBlock(bi->getSuccessor(1), bi->getParent(), *branches.second);
+        transferToSuccessor(ki, 1, *branches.second);
     }
     break;
   }
@@ -1520,7 +1695,7 @@ void Executor::executeInstruction(ExecutionState &state, KInstruction *ki) {
 #else
       unsigned index = si->findCaseValue(ci);
 #endif
-      transferToBasicBlock(si->getSuccessor(index), si->getParent(), state);
+      transferToSuccessor(ki, index, state);
     } else {
       std::map<BasicBlock*, ref<Expr> > targets;
       ref<Expr> isDefault = ConstantExpr::alloc(1, Expr::Bool);
@@ -1722,6 +1897,13 @@ void Executor::executeInstruction(ExecutionState &state, KInstruction *ki) {
     // Arithmetic / logical
 
   case Instruction::Add: {
+    uint64_t cleft, cright;
+    Expr::Width width;
+    if (evalConcrete(ki, state, cleft, cright, width)) {
+      bindLocalConcrete(ki, state, cleft + cright, width);
+      break;
+    }
+
     ref<Expr> left = eval(ki, 0, state).value;
     ref<Expr> right = eval(ki, 1, state).value;
     bindLocal(ki, state, AddExpr::create(left, right));
@@ -1729,6 +1911,13 @@ void Executor::executeInstruction(ExecutionState &state, KInstruction *ki) {
   }
 
   case Instruction::Sub: {
+    uint64_t cleft, cright;
+    Expr::Width width;
+    if (evalConcrete(ki, state, cleft, cright, width)) {
+      bindLocalConcrete(ki, state, cleft - cright, width);
+      break;
+    }
+
     ref<Expr> left = eval(ki, 0, state).value;
     ref<Expr> right = eval(ki, 1, state).value;
     bindLocal(ki, state, SubExpr::create(left, right));
@@ -1736,6 +1925,13 @@ void Executor::executeInstruction(ExecutionState &state, KInstruction *ki) {
   }
  
   case Instruction::Mul: {
+    uint64_t cleft, cright;
+    Expr::Width width;
+    if (evalConcrete(ki, state, cleft, cright, width)) {
+      bindLocalConcrete(ki, state, cleft * cright, width);
+      break;
+    }
+
     ref<Expr> left = eval(ki, 0, state).value;
     ref<Expr> right = eval(ki, 1, state).value;
     bindLocal(ki, state, MulExpr::create(left, right));
@@ -1775,6 +1971,13 @@ void Executor::executeInstruction(ExecutionState &state, KInstruction *ki) {
   }
 
   case Instruction::And: {
+    uint64_t cleft, cright;
+    Expr::Width width;
+    if (evalConcrete(ki, state, cleft, cright, width)) {
+      bindLocalConcrete(ki, state, cleft & cright, width);
+      break;
+    }
+
     ref<Expr> left = eval(ki, 0, state).value;
     ref<Expr> right = eval(ki, 1, state).value;
     ref<Expr> result = AndExpr::create(left, right);
@@ -1783,6 +1986,13 @@ void Executor::executeInstruction(ExecutionState &state, KInstruction *ki) {
   }
 
   case Instruction::Or: {
+    uint64_t cleft, cright;
+    Expr::Width width;
+    if (evalConcrete(ki, state, cleft, cright, width)) {
+      bindLocalConcrete(ki, state, cleft | cright, width);
+      break;
+    }
+
     ref<Expr> left = eval(ki, 0, state).value;
     ref<Expr> right = eval(ki, 1, state).value;
     ref<Expr> result = OrExpr::create(left, right);
@@ -1791,6 +2001,13 @@ void Executor::executeInstruction(ExecutionState &state, KInstruction *ki) {
   }
 
   case Instruction::Xor: {
+    uint64_t cleft, cright;
+    Expr::Width width;
+    if (evalConcrete(ki, state, cleft, cright, width)) {
+      bindLocalConcrete(ki, state, cleft ^ cright, width);
+      break;
+    }
+
     ref<Expr> left = eval(ki, 0, state).value;
     ref<Expr> right = eval(ki, 1, state).value;
     ref<Expr> result = XorExpr::create(left, right);
@@ -1827,6 +2044,35 @@ void Executor::executeInstruction(ExecutionState &state, KInstruction *ki) {
   case Instruction::ICmp: {
     CmpInst *ci = cast<CmpInst>(i);
     ICmpInst *ii = cast<ICmpInst>(ci);
+
+    uint64_t cleft, cright;
+    Expr::Width width;
+    if (evalConcrete(ki, state, cleft, cright, width)) {
+      bool result, known = true;
+      if (ii->isSigned()) {
+        // Compare the sign extended values.
+        uint64_t signBit = (uint64_t) 1 << (width - 1);
+        cleft ^= signBit;
+        cright ^= signBit;
+      }
+      switch(ii->getPredicate()) {
+      case ICmpInst::ICMP_EQ:  result = cleft == cright; break;
+      case ICmpInst::ICMP_NE:  result = cleft != cright; break;
+      case ICmpInst::ICMP_UGT:
+      case ICmpInst::ICMP_SGT: result = cleft > cright; break;
+      case ICmpInst::ICMP_UGE:
+      case ICmpInst::ICMP_SGE: result = cleft >= cright; break;
+      case ICmpInst::ICMP_ULT:
+      case ICmpInst::ICMP_SLT: result = cleft < cright; break;
+      case ICmpInst::ICMP_ULE:
+      case ICmpInst::ICMP_SLE: result = cleft <= cright; break;
+      default: result = known = false; break;
+      }
+      if (known) {
+        bindLocalConcrete(ki, state, result, Expr::Bool);
+        break;
+      }
+    }
  
     switch(ii->getPredicate()) {
     case ICmpInst::ICMP_EQ: {
@@ -1945,6 +2191,29 @@ void Executor::executeInstruction(ExecutionState &state, KInstruction *ki) {
 
   case Instruction::GetElementPtr: {
     KGEPInstruction *kgepi = static_cast<KGEPInstruction*>(ki);
+
+    uint64_t address;
+    Expr::Width width;
+    if (Context::get().getPointerWidth() <= Expr::Int64 &&
+        evalConcrete(ki, 0, state, address, width)) {
+      std::vector< std::pair<unsigned, uint64_t> >::iterator
+        it = kgepi->indices.begin(), ie = kgepi->indices.end();
+      for (; it != ie; ++it) {
+        uint64_t index;
+        if (!evalConcrete(ki, it->first, state, index, width))
+          break;
+        // Sign extend the index to the pointer width.
+        if (width < Expr::Int64 && (index >> (width - 1)) & 1)
+          index |= ~bits64::maxValueOfNBits(width);
+        address += index * it->second;
+      }
+      if (it == ie) {
+        bindLocalConcrete(ki, state, address + kgepi->offset,
+                          Context::get().getPointerWidth());
+        break;
+      }
+    }
+
     ref<Expr> base = eval(ki, 0, state).value;
 
     for (std::vector< std::pair<unsigned, uint64_t> >::iterator 
@@ -1966,6 +2235,13 @@ void Executor::executeInstruction(ExecutionState &state, KInstruction *ki) {
     // Conversion
   case Instruction::Trunc: {
     CastInst *ci = cast<CastInst>(i);
+    uint64_t value;
+    Expr::Width width;
+    if (evalConcrete(ki, 0, state, value, width)) {
+      bindLocalConcrete(ki, state, value, getWidthForLLVMType(ci->getType()));
+      break;
+    }
+
     ref<Expr> result = ExtractExpr::create(eval(ki, 0, state).value,
                                            0,
                                            getWidthForLLVMType(ci->getType()));
@@ -1974,6 +2250,13 @@ void Executor::executeInstruction(ExecutionState &state, KInstruction *ki) {
   }
   case Instruction::ZExt: {
     CastInst *ci = cast<CastInst>(i);
+    uint64_t value;
+    Expr::Width width, toWidth = getWidthForLLVMType(ci->getType());
+    if (toWidth <= Expr::Int64 && evalConcrete(ki, 0, state, value, width)) {
+      bindLocalConcrete(ki, state, value, toWidth);
+      break;
+    }
+
     ref<Expr> result = ZExtExpr::create(eval(ki, 0, state).value,
                                         getWidthForLLVMType(ci->getType()));
     bindLocal(ki, state, result);
@@ -1981,6 +2264,15 @@ void Executor::executeInstruction(ExecutionState &state, KInstruction *ki) {
   }
   case Instruction::SExt: {
     CastInst *ci = cast<CastInst>(i);
+    uint64_t value;
+    Expr::Width width, toWidth = getWidthForLLVMType(ci->getType());
+    if (toWidth <= Expr::Int64 && evalConcrete(ki, 0, state, value, width)) {
+      if (width < Expr::Int64 && (value >> (width - 1)) & 1)
+        value |= ~bits64::maxValueOfNBits(width);
+      bindLocalConcrete(ki, state, value, toWidth);
+      break;
+    }
+
     ref<Expr> result = SExtExpr::create(eval(ki, 0, state).value,
                                         getWidthForLLVMType(ci->getType()));
     bindLocal(ki, state, result);
@@ -2376,8 +2668,15 @@ void Executor::executeInstruction(ExecutionState &state, KInstruction *ki) {
 
 void Executor::updateStates(ExecutionState *current) {
   if (searcher) {
-    searcher->update(current, addedStates, removedStates);
+    if (newlyParkedStates.empty()) {
+      searcher->update(current, addedStates, removedStates);
+    } else {
+      std::set<ExecutionState*> removed(removedStates);
+      removed.insert(newlyParkedStates.begin(), newlyParkedStates.end());
+      searcher->update(current, addedStates, removed);
+    }
   }
+  newlyParkedStates.clear();
   
   states.insert(addedStates.begin(), addedStates.end());
   addedStates.clear();
@@ -2394,6 +2693,8 @@ void Executor::updateStates(ExecutionState *current) {
     if (it3 != seedMap.end())
       seedMap.erase(it3);
     processTree->remove(es->ptreeNode);
+    if (es->spilled)
+      spiller->discard(*es);
     delete es;
   }
   removedStates.clear();
@@ -2467,9 +2768,18 @@ void Executor::checkMemoryUsage() {
   if ((stats::instructions & 0xFFFF) == 0) {
     // We need to avoid calling GetTotalMallocUsage() often because it
     // is O(elts on freelist). This is really bad since we start
-    // to pummel the freelist once we hit the memory cap.
-    unsigned mbs = util::GetTotalMallocUsage() >> 20;
+    // to pummel the freelist once we hit the memory cap. Free memory
+    // in the expression slabs is not returned to malloc, but is reused
+    // before anything else, so it does not count. The malloc usage may
+    // be unavailable (0) or wrapped, so don't let it go negative.
+    size_t usage = util::GetTotalMallocUsage();
+    size_t slabFree = SlabAllocator::getFreeBytes();
+    unsigned mbs = (usage > slabFree ? usage - slabFree : 0) >> 20;
     if (mbs > MaxMemory) {
+      if (spiller && spillStates(mbs)) {
+        atMemoryLimit = false;
+        return;
+      }
       if (mbs > MaxMemory + 100) {
         // just guess at how many to kill
         unsigned numStates = states.size();
@@ -2494,6 +2804,40 @@ void Executor::checkMemoryUsage() {
   }
 }
 
+bool Executor::spillStates(unsigned mbs) {
+  std::vector<ExecutionState *> arr;
+  for (std::set<ExecutionState*>::iterator it = states.begin(),
+         ie = states.end(); it != ie; ++it)
+    if (!(*it)->spilled && !removedStates.count(*it))
+      arr.push_back(*it);
+  if (arr.empty())
+    return false;
+
+  // just guess at how many to spill, as for killing
+  unsigned numStates = states.size();
+  unsigned toSpill = std::max(1U, numStates - numStates * MaxMemory / mbs);
+  klee_warning("spilling %d states (over memory cap)", toSpill);
+  unsigned numSpilled = 0;
+  for (unsigned i = 0, N = arr.size(); N && i < toSpill; ++i, --N) {
+    unsigned idx = rand() % N;
+    // Make two pulls to try and keep states that covered new code in
+    // memory, they are likely to be picked soon.
+    if (arr[idx]->coveredNew)
+      idx = rand() % N;
+
+    std::swap(arr[idx], arr[N - 1]);
+    if (!spiller->spill(*arr[N - 1]))
+      break;
+    ++numSpilled;
+  }
+  return numSpilled != 0;
+}
+
+void Executor::reloadState(ExecutionState &state) {
+  if (state.spilled)
+    spiller->reload(state);
+}
+
 void Executor::run(ExecutionState &initialState) {
   bindModuleConstants();
 
@@ -2571,8 +2915,28 @@ void Executor::run(ExecutionState &initialState) {
 
   searcher->update(0, states, std::set<ExecutionState*>());
 
-  while (!states.empty() && !haltExecution) {
+  if (SpillStates && MaxMemory)
+    spiller = new StateSpiller(interpreterHandler->getOutputFilename("spill-"));
+
+  while (!haltExecution &&
+         (!states.empty() || !parkedStates.empty() || acquireWork())) {
+    if (!parkedStates.empty() &&
+        (states.empty() || (stats::instructions & 63) == 0)) {
+      resumeParkedStates(states.empty());
+      updateStates(0);
+      if (states.empty())
+        continue;
+    }
+
     ExecutionState &state = searcher->selectState();
+    if (parkedStates.count(&state)) {
+      // Searchers walking the process tree can reach parked states.
+      resumeParkedState(state);
+      updateStates(0);
+      continue;
+    }
+    reloadState(state);
+
     KInstruction *ki = state.pc;
     stepInstruction(state);
 
@@ -2582,7 +2946,21 @@ void Executor::run(ExecutionState &initialState) {
     checkMemoryUsage();
 
     updateStates(&state);
+
+    // Workers would share the spill file, so wait until it is empty.
+    if (NumWorkers > 1 && workerIndex < 0 && !replayOut && !replayPath &&
+        states.size() >= NumWorkers && parkedStates.empty() &&
+        (!spiller || !spiller->getNumSpilled()))
+      spawnWorkers(NumWorkers);
+  }
+
+  // Queries still running are abandoned along with the search.
+  for (std::map<ExecutionState*, ParkedBranch>::iterator
+         it = parkedStates.begin(), ie = parkedStates.end(); it != ie; ++it) {
+    delete it->second.future;
+    states.insert(it->first);
   }
+  parkedStates.clear();
 
   delete searcher;
   searcher = 0;
@@ -2599,6 +2977,76 @@ void Executor::run(ExecutionState &initialState) {
     }
     updateStates(0);
   }
+
+  delete spiller;
+  spiller = 0;
+
+  delete workTemplate;
+  workTemplate = 0;
+
+  if (workerIndex >= 0)
+    finishWorker();
+}
+
+bool Executor::canParkBranch(ExecutionState &state) {
+  // Seeds and the static fork limits make fork() look at more than the
+  // validity of the condition, so those branches are decided in place.
+  return searcher && parkedStates.size() < AsyncBranchQueries &&
+    !seedMap.count(&state) &&
+    MaxStaticForkPct == 1. && MaxStaticSolvePct == 1. &&
+    MaxStaticCPForkPct == 1. && MaxStaticCPSolvePct == 1.;
+}
+
+void Executor::resumeParkedState(ExecutionState &state) {
+  std::map<ExecutionState*, ParkedBranch>::iterator it =
+    parkedStates.find(&state);
+  assert(it != parkedStates.end() && "state is not parked");
+  KInstruction *ki = it->second.ki;
+  ref<Expr> condition = it->second.condition;
+  SolverFuture *future = it->second.future;
+  parkedStates.erase(it);
+
+  // Back to the search, in the context of the branch instruction, which
+  // is also charged the solver time.
+  addedStates.insert(&state);
+  if (statsTracker)
+    statsTracker->resumeInstruction(state, ki);
+
+  Solver::Validity res;
+  bool success = future->get(res);
+  delete future;
+
+  if (!success) {
+    state.pc = state.prevPC;
+    terminateStateEarly(state, "Query timed out (fork).");
+    return;
+  }
+
+  bool trackCoverage = state.stack.back().kf->trackCoverage;
+  StatePair branches = fork(state, condition, false, res);
+
+  if (statsTracker && trackCoverage)
+    statsTracker->markBranchVisited(branches.first, branches.second);
+
+  if (branches.first)
+    transferToSuccessor(ki, 0, *branches.first);
+  if (branches.second)
+    transferToSuccessor(ki, 1, *branches.second);
+}
+
+void Executor::resumeParkedStates(bool wait) {
+  std::vector<ExecutionState*> ready;
+  for (std::map<ExecutionState*, ParkedBranch>::iterator
+         it = parkedStates.begin(), ie = parkedStates.end(); it != ie; ++it)
+    if (it->second.future->isReady())
+      ready.push_back(it->first);
+
+  if (ready.empty() && wait && !parkedStates.empty())
+    ready.push_back(parkedStates.begin()->first);
+
+  for (std::vector<ExecutionState*>::iterator it = ready.begin(),
+         ie = ready.end(); it != ie; ++it)
+    resumeParkedState(**it);
 }
 
 std::string Executor::getAddressInfo(ExecutionState &state, 
@@ -2678,6 +3126,7 @@ void Executor::terminateState(ExecutionState &state) {
 
 void Executor::terminateStateEarly(ExecutionState &state, 
                                    const Twine &message) {
+  reloadState(state);
   if (!OnlyOutputStatesCoveringNew || state.coveredNew ||
       (AlwaysOutputSeeds && seedMap.count(&state)))
     interpreterHandler->processTestCase(state, (message + "\n").str().c_str(),
@@ -3171,15 +3620,52 @@ void Executor::executeMemoryOperation(ExecutionState &state,
                                                0, coreSolverTimeout);
   solver->setTimeout(0);
   
-  // XXX there is some query wasteage here. who cares?
+  // Every bounds check below is forked on in the state left after the
+  // earlier objects, i.e. with the earlier checks negated. As objects do
+  // not overlap, the validity of each check there follows from a single
+  // batch of queries against the current constraints: a check may be
+  // true iff it may be true now, and may be false iff the address may
+  // lie outside all objects up to and including this one, which for the
+  // last feasible object means outside all of them.
+  std::vector< ref<Expr> > checks;
+  ref<Expr> anyInBounds = ConstantExpr::alloc(0, Expr::Bool);
+  for (ResolutionList::iterator i = rl.begin(), ie = rl.end(); i != ie; ++i) {
+    checks.push_back(i->first->getBoundsCheckPointer(address, bytes));
+    anyInBounds = OrExpr::create(anyInBounds, checks.back());
+  }
+  checks.push_back(anyInBounds);
+
+  std::vector<Solver::Validity> validity;
+  solver->setTimeout(coreSolverTimeout);
+  bool checked = solver->evaluate(state, checks, validity);
+  solver->setTimeout(0);
+  if (!checked) {
+    state.pc = state.prevPC;
+    terminateStateEarly(state, "Query timed out (bounds check).");
+    return;
+  }
+
+  unsigned lastFeasible = rl.size();
+  for (unsigned i = 0; i != rl.size(); ++i)
+    if (validity[i] != Solver::False)
+      lastFeasible = i;
+  bool mayBeOutOfBounds = validity[rl.size()] != Solver::True;
+
   ExecutionState *unbound = &state;
   
-  for (ResolutionList::iterator i = rl.begin(), ie = rl.end(); i != ie; ++i) {
-    const MemoryObject *mo = i->first;
-    const ObjectState *os = i->second;
-    ref<Expr> inBounds = mo->getBoundsCheckPointer(address, bytes);
-    
-    StatePair branches = fork(*unbound, inBounds, true);
+  for (unsigned i = 0; i != rl.size(); ++i) {
+    const MemoryObject *mo = rl[i].first;
+    const ObjectState *os = rl[i].second;
+
+    Solver::Validity res;
+    if (validity[i] == Solver::False)
+      res = Solver::False;
+    else if (i == lastFeasible && !mayBeOutOfBounds)
+      res = Solver::True;
+    else
+      res = Solver::Unknown;
+
+    StatePair branches = fork(*unbound, checks[i], true, res);
     ExecutionState *bound = branches.first;
 
     // bound can be 0 on failure or overlapped 
@@ -3379,6 +3865,9 @@ void Executor::runFunctionAsMain(Function *f,
   
   initializeGlobals(*state);
 
+  if (NumWorkers > 1)
+    initWorkStealing(*state);
+
   processTree = new PTree(state);
   state->ptreeNode = processTree->root;
   run(*state);
@@ -17,6 +17,7 @@
 
 #include "klee/ExecutionState.h"
 #include "klee/Interpreter.h"
+#include "klee/Solver.h"
 #include "klee/Internal/Module/Cell.h"
 #include "klee/Internal/Module/KInstruction.h"
 #include "klee/Internal/Module/KModule.h"
@@ -68,7 +69,9 @@ namespace klee {
   class SeedInfo;
   class SpecialFunctionHandler;
   struct StackFrame;
+  class StateSpiller;
   class StatsTracker;
+  class SolverFuture;
   class TimingSolver;
   class TreeStreamWriter;
   template<class T> class ref;
@@ -80,6 +83,7 @@ namespace klee {
   /// removedStates, and haltExecution, among others.
 
 class Executor : public Interpreter {
+  friend class AutoMergingSearcher;
   friend class BumpMergingSearcher;
   friend class MergingSearcher;
   friend class RandomPathSearcher;
@@ -87,6 +91,7 @@ class Executor : public Interpreter {
   friend class WeightedRandomSearcher;
   friend class SpecialFunctionHandler;
   friend class StatsTracker;
+  friend class WorkStealingTimer;
 
 public:
   class Timer {
@@ -165,6 +170,10 @@ private:
   /// needed to control memory usage. \see fork()
   bool atMemoryLimit;
 
+  /// Holds the states written to disk at the memory cap, null unless
+  /// enabled.
+  StateSpiller *spiller;
+
   /// Disables forking, set by client. \see setInhibitForking()
   bool inhibitForking;
 
@@ -183,6 +192,52 @@ private:
   /// Assumes ownership of the created array objects
   ArrayCache arrayCache;
 
+  /// The index of this process in the worker pool (see --num-workers),
+  /// or -1 when this is not a forked worker.
+  int workerIndex;
+
+  /// In a worker, the pipe on which its totals are reported back to
+  /// the parent when it finishes.
+  int workerResultFD;
+
+  /// In a worker, the global statistic values at the time of the fork
+  /// so that only the worker's own share is reported back.
+  std::vector<uint64_t> workerStatsBase;
+
+  /// The number of workers in the pool this process belongs to.
+  unsigned workerCount;
+
+  /// With --work-stealing, a copy of the initial state from which path
+  /// prefixes handed over by other workers are re-executed.
+  ExecutionState *workTemplate;
+
+  /// The path writer created to record branch decisions for work
+  /// stealing when none was requested through setPathWriter().
+  TreeStreamWriter *workPathWriter;
+
+  /// The directory through which workers hand over path prefixes.
+  std::string workDir;
+
+  /// The number of path prefixes this worker has handed over so far.
+  unsigned workDonated;
+
+  /// A state waiting at a conditional branch for its feasibility query,
+  /// which runs in a forked solver process (see --async-branch-queries).
+  struct ParkedBranch {
+    KInstruction *ki;
+    ref<Expr> condition;
+    SolverFuture *future;
+  };
+
+  /// The states parked at a branch. They are in neither \ref states nor
+  /// the searcher until their query is answered.
+  std::map<ExecutionState*, ParkedBranch> parkedStates;
+
+  /// States parked during the current instruction step, to be taken out
+  /// of the searcher by updateStates(). They are already out of
+  /// \ref states.
+  std::set<ExecutionState*> newlyParkedStates;
+
   llvm::Function* getTargetFunction(llvm::Value *calledVal,
                                     ExecutionState &state);
   
@@ -192,6 +247,17 @@ private:
 
   void run(ExecutionState &initialState);
 
+  /// Whether the branch the state is at may be decided asynchronously.
+  bool canParkBranch(ExecutionState &state);
+
+  /// Finish the branch a parked state is waiting at, waiting for its
+  /// query if needed.
+  void resumeParkedState(ExecutionState &state);
+
+  /// Resume the parked states whose queries are answered. With \arg wait,
+  /// wait for one if none is.
+  void resumeParkedStates(bool wait);
+
   // Given a concrete object in our [klee's] address space, add it to 
   // objects checked code can reference.
   MemoryObject *addExternalObject(ExecutionState &state, void *addr, 
@@ -207,6 +273,10 @@ private:
   void transferToBasicBlock(llvm::BasicBlock *dst, 
 			    llvm::BasicBlock *src,
 			    ExecutionState &state);
+  /// Transfer to the given successor of a branch, switch or invoke
+  /// instruction of the current function.
+  void transferToSuccessor(KInstruction *ki, unsigned successor,
+                           ExecutionState &state);
 
   void callExternalFunction(ExecutionState &state,
                             KInstruction *target,
@@ -291,6 +361,11 @@ private:
   // current state, and one of the states may be null.
   StatePair fork(ExecutionState &current, ref<Expr> condition, bool isInternal);
 
+  // Fork current on a condition whose validity in current is already
+  // known, without querying the solver for it.
+  StatePair fork(ExecutionState &current, ref<Expr> condition, bool isInternal,
+                 Solver::Validity res);
+
   /// Add the given (boolean) condition as a constraint on state. This
   /// function is a wrapper around the state's addConstraint function
   /// which also manages propagation of implied values,
@@ -301,9 +376,22 @@ private:
   // Used for testing.
   ref<Expr> replaceReadWithSymbolic(ExecutionState &state, ref<Expr> e);
 
+  const Cell& getOperandCell(KInstruction *ki, unsigned index,
+                             ExecutionState &state) const;
+
   const Cell& eval(KInstruction *ki, unsigned index, 
                    ExecutionState &state) const;
 
+  /// Get an operand as an unboxed integer, if it is a constant of at most
+  /// 64 bits, without building an expression for it.
+  bool evalConcrete(KInstruction *ki, unsigned index, ExecutionState &state,
+                    uint64_t &value, Expr::Width &width) const;
+
+  /// Get both operands of a binary instruction unboxed, if both are.
+  bool evalConcrete(KInstruction *ki, ExecutionState &state,
+                    uint64_t &left, uint64_t &right,
+                    Expr::Width &width) const;
+
   Cell& getArgumentCell(ExecutionState &state,
                         KFunction *kf,
                         unsigned index) {
@@ -318,6 +406,10 @@ private:
   void bindLocal(KInstruction *target, 
                  ExecutionState &state, 
                  ref<Expr> value);
+  /// Bind an unboxed concrete value, truncating it to \arg width bits.
+  void bindLocalConcrete(KInstruction *target,
+                         ExecutionState &state,
+                         uint64_t value, Expr::Width width);
   void bindArgument(KFunction *kf, 
                     unsigned index,
                     ExecutionState &state,
@@ -401,6 +493,46 @@ private:
                      double maxInstTime);
   void checkMemoryUsage();
 
+  /// Spill some of the states to disk to get back under the memory cap
+  /// of which \a mbs is used, returning false if none could be spilled.
+  bool spillStates(unsigned mbs);
+
+  /// Bring \a state back into memory if it was spilled.
+  void reloadState(ExecutionState &state);
+
+  /// Fork a pool of \a count workers and divide the current states
+  /// between them. In the parent this returns only once all workers have
+  /// finished, with all states handed off; in a worker it returns
+  /// with the worker's share of the states.
+  void spawnWorkers(unsigned count);
+
+  /// Turn the current process into worker \a index of \a count,
+  /// keeping only the states that belong to it.
+  void becomeWorker(unsigned index, unsigned count, int resultFD);
+
+  /// Wait for all workers and fold their results into ours.
+  void collectWorkers(const std::vector<std::pair<int, int> > &workers);
+
+  /// Report the results of a finished worker to the parent and exit.
+  void finishWorker();
+
+  /// Remove a state from the search without generating a test case,
+  /// used when its exploration is taken over by another process.
+  void discardState(ExecutionState &state);
+
+  /// Prepare \a initialState for --work-stealing: make sure its branch
+  /// decisions are recorded and keep a copy to restart from.
+  void initWorkStealing(ExecutionState &initialState);
+
+  /// Hand one of our shallowest states over to each worker that has
+  /// asked for work.
+  void donateWork();
+
+  /// Called by a worker that has run out of states. Wait until another
+  /// worker hands over a path prefix and start a state following it.
+  /// Returns false once all workers are out of work.
+  bool acquireWork();
+
 public:
   Executor(const InterpreterOptions &opts, InterpreterHandler *ie);
   virtual ~Executor();
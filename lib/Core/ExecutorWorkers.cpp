@@ -0,0 +1,459 @@
+//===-- ExecutorWorkers.cpp -----------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Splitting the search between a pool of forked worker processes. Each
+// worker inherits the module, the memory manager and all states from the
+// parent, keeps its share of the states and drops the rest, and has its
+// own solver and statistics. The parent waits for the workers and folds
+// their results into its own statistics.
+//
+// With --work-stealing, a worker that runs out of states asks the others
+// for more by creating a file in a shared directory. A busy worker claims
+// the request and answers it with the branch decisions leading to one of
+// its states, which the idle worker re-executes from the initial state.
+//
+//===----------------------------------------------------------------------===//
+
+#include "CoreStats.h"
+#include "Executor.h"
+#include "PTree.h"
+#include "Searcher.h"
+#include "StatsTracker.h"
+
+#include "klee/ExecutionState.h"
+#include "klee/Statistics.h"
+#include "klee/Internal/ADT/TreeStream.h"
+#include "klee/Internal/Support/ErrorHandling.h"
+
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <fstream>
+#include <sstream>
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+using namespace llvm;
+using namespace klee;
+
+namespace {
+  cl::opt<bool>
+  WorkStealing("work-stealing",
+               cl::desc("Let workers that run out of states take over part of "
+                        "the search of other workers (requires --num-workers)"),
+               cl::init(false));
+
+  cl::opt<double>
+  WorkStealingInterval("work-stealing-interval",
+                       cl::desc("How often a busy worker checks for requests "
+                                "for work, in seconds (default=0.5)"),
+                       cl::init(0.5));
+
+  /// The totals a worker reports to its parent when it finishes. This
+  /// is followed by the worker's increment of every global statistic.
+  struct WorkerResults {
+    uint32_t numTestCases;
+    uint32_t numPathsExplored;
+    uint32_t numStatistics;
+    /// The size of the coverage flags following the statistics.
+    uint32_t coverageSize;
+  };
+}
+
+static bool writeAll(int fd, const void *buf, size_t size) {
+  const char *p = static_cast<const char*>(buf);
+  while (size) {
+    ssize_t n = write(fd, p, size);
+    if (n < 0) {
+      if (errno == EINTR)
+        continue;
+      return false;
+    }
+    p += n;
+    size -= n;
+  }
+  return true;
+}
+
+/// Read exactly \a size bytes from a worker. If we are asked to halt
+/// while waiting, the request is passed on to all workers so that they
+/// dump their states and report back.
+static bool readAll(int fd, void *buf, size_t size, const bool &halt,
+                    const std::vector<std::pair<int, int> > &workers,
+                    bool &haltForwarded) {
+  char *p = static_cast<char*>(buf);
+  while (size) {
+    ssize_t n = read(fd, p, size);
+    if (n < 0) {
+      if (errno != EINTR)
+        return false;
+      if (halt && !haltForwarded) {
+        haltForwarded = true;
+        for (unsigned i = 0; i < workers.size(); ++i)
+          kill(workers[i].first, SIGINT);
+      }
+      continue;
+    }
+    if (n == 0)
+      return false;
+    p += n;
+    size -= n;
+  }
+  return true;
+}
+
+static std::string workFile(const std::string &dir, const char *kind,
+                            unsigned worker, int seq = -1) {
+  std::ostringstream name;
+  name << dir << "/" << kind << "." << worker;
+  if (seq >= 0)
+    name << "." << seq;
+  return name.str();
+}
+
+/// Create an empty file, unless it already exists.
+static void touchFile(const std::string &path) {
+  int fd = open(path.c_str(), O_WRONLY | O_CREAT, 0644);
+  if (fd < 0)
+    klee_error("unable to create %s: %s", path.c_str(), strerror(errno));
+  close(fd);
+}
+
+/// List the files in \a dir named \a kind.*.
+static void listWorkFiles(const std::string &dir, const std::string &kind,
+                          std::vector<std::string> &names) {
+  DIR *d = opendir(dir.c_str());
+  if (!d)
+    klee_error("unable to read %s: %s", dir.c_str(), strerror(errno));
+  std::string prefix = kind + ".";
+  while (struct dirent *de = readdir(d))
+    if (!strncmp(de->d_name, prefix.c_str(), prefix.size()))
+      names.push_back(dir + "/" + de->d_name);
+  closedir(d);
+}
+
+namespace klee {
+  class WorkStealingTimer : public Executor::Timer {
+    Executor *executor;
+
+  public:
+    WorkStealingTimer(Executor *_executor) : executor(_executor) {}
+    ~WorkStealingTimer() {}
+
+    void run() { executor->donateWork(); }
+  };
+}
+
+void Executor::discardState(ExecutionState &state) {
+  assert(!addedStates.count(&state) && "state never reached the searcher");
+  removedStates.insert(&state);
+}
+
+void Executor::spawnWorkers(unsigned count) {
+  klee_message("splitting %u states between %u workers",
+               (unsigned) states.size(), count);
+
+  // Anything still buffered would otherwise be written once per process.
+  llvm::outs().flush();
+  llvm::errs().flush();
+  interpreterHandler->getInfoStream().flush();
+  if (pathWriter)
+    pathWriter->flush();
+  if (symPathWriter)
+    symPathWriter->flush();
+  fflush(0);
+
+  if (workTemplate) {
+    workDir = interpreterHandler->getOutputFilename("work");
+    if (mkdir(workDir.c_str(), 0775) < 0 && errno != EEXIST)
+      klee_error("unable to create %s: %s", workDir.c_str(), strerror(errno));
+  }
+
+  std::vector<std::pair<int, int> > workers;
+  for (unsigned i = 0; i < count; ++i) {
+    int fds[2];
+    if (pipe(fds) < 0)
+      klee_error("unable to create pipe for worker: %s", strerror(errno));
+
+    pid_t pid = ::fork();
+    if (pid < 0)
+      klee_error("unable to fork worker: %s", strerror(errno));
+
+    if (pid == 0) {
+      close(fds[0]);
+      for (unsigned j = 0; j < workers.size(); ++j)
+        close(workers[j].second);
+      becomeWorker(i, count, fds[1]);
+      return;
+    }
+
+    close(fds[1]);
+    workers.push_back(std::make_pair((int) pid, fds[0]));
+  }
+
+  // The workers have taken over all states.
+  for (std::set<ExecutionState*>::iterator it = states.begin(),
+         ie = states.end(); it != ie; ++it)
+    discardState(**it);
+  updateStates(0);
+
+  collectWorkers(workers);
+}
+
+void Executor::becomeWorker(unsigned index, unsigned count, int resultFD) {
+  workerIndex = index;
+  workerResultFD = resultFD;
+  workerCount = count;
+
+  StatisticManager &sm = *theStatisticManager;
+  workerStatsBase.resize(sm.getNumStatistics());
+  for (unsigned i = 0; i < workerStatsBase.size(); ++i)
+    workerStatsBase[i] = sm.getValue(sm.getStatistic(i));
+
+  interpreterHandler->setWorkerIndex(index, count);
+  if (statsTracker)
+    statsTracker->openWorkerFiles(index);
+  if (workPathWriter) {
+    std::ostringstream name;
+    name << "work." << index << ".paths.ts";
+    workPathWriter->reopen(interpreterHandler->getOutputFilename(name.str()));
+  }
+  if (workTemplate)
+    addTimer(new WorkStealingTimer(this), WorkStealingInterval);
+
+  // Deal the states out round-robin. All workers inherited the same
+  // set, so they agree on its order without further communication.
+  unsigned i = 0;
+  for (std::set<ExecutionState*>::iterator it = states.begin(),
+         ie = states.end(); it != ie; ++it, ++i)
+    if (i % count != index)
+      discardState(**it);
+  updateStates(0);
+
+  klee_message("worker %u: exploring %u states", index,
+               (unsigned) states.size());
+}
+
+void Executor::collectWorkers(const std::vector<std::pair<int, int> > &workers) {
+  StatisticManager &sm = *theStatisticManager;
+  bool haltForwarded = false;
+
+  for (unsigned i = 0; i < workers.size(); ++i) {
+    int pid = workers[i].first, fd = workers[i].second;
+
+    WorkerResults results;
+    std::vector<uint64_t> values;
+    std::vector<uint8_t> coverage;
+    bool success = readAll(fd, &results, sizeof results, haltExecution,
+                           workers, haltForwarded) &&
+                   results.numStatistics == sm.getNumStatistics();
+    if (success) {
+      values.resize(results.numStatistics);
+      success = values.empty() ||
+                readAll(fd, &values[0], values.size() * sizeof(values[0]),
+                        haltExecution, workers, haltForwarded);
+    }
+    if (success) {
+      coverage.resize(results.coverageSize);
+      success = coverage.empty() ||
+                readAll(fd, &coverage[0], coverage.size(), haltExecution,
+                        workers, haltForwarded);
+    }
+
+    if (success) {
+      // Workers cover the same code, so coverage is merged as a union
+      // rather than summed.
+      for (unsigned j = 0; j < values.size(); ++j) {
+        Statistic &stat = sm.getStatistic(j);
+        if (stat.getID() != stats::coveredInstructions.getID() &&
+            stat.getID() != stats::uncoveredInstructions.getID() &&
+            stat.getID() != stats::trueBranches.getID() &&
+            stat.getID() != stats::falseBranches.getID())
+          sm.incrementGlobalValue(stat, values[j]);
+      }
+      if (statsTracker)
+        statsTracker->mergeCoverage(coverage);
+      interpreterHandler->addWorkerResults(results.numTestCases,
+                                           results.numPathsExplored);
+    } else {
+      klee_warning("worker %u (pid %d) exited without reporting its results",
+                   i, pid);
+    }
+    close(fd);
+
+    int status;
+    while (waitpid(pid, &status, 0) < 0 && errno == EINTR)
+      ;
+  }
+}
+
+void Executor::finishWorker() {
+  // Count as idle for good, so that the others know when all work is done.
+  if (!workDir.empty())
+    touchFile(workFile(workDir, "idle", workerIndex));
+
+  if (statsTracker)
+    statsTracker->done();
+  if (pathWriter)
+    pathWriter->flush();
+  if (symPathWriter)
+    symPathWriter->flush();
+
+  StatisticManager &sm = *theStatisticManager;
+  WorkerResults results;
+  results.numTestCases = interpreterHandler->getNumTestCases();
+  results.numPathsExplored = interpreterHandler->getNumPathsExplored();
+  results.numStatistics = workerStatsBase.size();
+
+  std::vector<uint64_t> values(workerStatsBase.size());
+  for (unsigned i = 0; i < values.size(); ++i)
+    values[i] = sm.getValue(sm.getStatistic(i)) - workerStatsBase[i];
+
+  std::vector<uint8_t> coverage;
+  if (statsTracker)
+    statsTracker->getCoverage(coverage);
+  results.coverageSize = coverage.size();
+
+  if (!writeAll(workerResultFD, &results, sizeof results) ||
+      (!values.empty() &&
+       !writeAll(workerResultFD, &values[0], values.size() * sizeof(values[0]))) ||
+      (!coverage.empty() &&
+       !writeAll(workerResultFD, &coverage[0], coverage.size())))
+    klee_warning("worker %d: unable to report results: %s", workerIndex,
+                 strerror(errno));
+  close(workerResultFD);
+
+  llvm::outs().flush();
+  llvm::errs().flush();
+  fflush(0);
+  _exit(0);
+}
+
+void Executor::initWorkStealing(ExecutionState &initialState) {
+  if (!WorkStealing)
+    return;
+
+  if (!pathWriter) {
+    workPathWriter =
+      new TreeStreamWriter(interpreterHandler->getOutputFilename("work.paths.ts"));
+    assert(workPathWriter->good());
+    pathWriter = workPathWriter;
+    initialState.pathOS = pathWriter->open();
+  }
+
+  workTemplate = new ExecutionState(initialState);
+}
+
+void Executor::donateWork() {
+  std::vector<std::string> requests;
+  listWorkFiles(workDir, "idle", requests);
+
+  for (unsigned i = 0; i < requests.size(); ++i) {
+    if (states.size() - removedStates.size() < 2)
+      return;
+
+    // Claim the request; whoever removes it answers it.
+    if (unlink(requests[i].c_str()) < 0)
+      continue;
+
+    // The shallowest state is likely to have the largest subtree left.
+    ExecutionState *es = 0;
+    for (std::set<ExecutionState*>::iterator it = states.begin(),
+           ie = states.end(); it != ie; ++it)
+      if (!removedStates.count(*it) && (!es || (*it)->depth < es->depth))
+        es = *it;
+
+    std::vector<unsigned char> prefix;
+    pathWriter->readStream(getPathStreamID(*es), prefix);
+
+    std::string tmp = workFile(workDir, "tmp", workerIndex, workDonated);
+    std::string item = workFile(workDir, "item", workerIndex, workDonated);
+    ++workDonated;
+
+    {
+      std::ofstream out(tmp.c_str());
+      for (unsigned j = 0; j < prefix.size(); ++j)
+        out << (prefix[j] == '1' ? 1 : 0) << "\n";
+      if (!out.good())
+        klee_error("unable to write %s", tmp.c_str());
+    }
+    if (rename(tmp.c_str(), item.c_str()) < 0)
+      klee_error("unable to create %s: %s", item.c_str(), strerror(errno));
+
+    discardState(*es);
+  }
+}
+
+bool Executor::acquireWork() {
+  if (workerIndex < 0 || !workTemplate)
+    return false;
+
+  std::string request = workFile(workDir, "idle", workerIndex);
+  std::string taken = workFile(workDir, "taken", workerIndex);
+
+  while (!haltExecution) {
+    // Ask again each time round: a busy worker may have claimed our
+    // request and its answer been taken by another idle worker.
+    touchFile(request);
+
+    std::vector<std::string> items;
+    listWorkFiles(workDir, "item", items);
+
+    for (unsigned i = 0; i < items.size(); ++i) {
+      // Withdraw our request first, so that we never count as idle
+      // while holding work.
+      unlink(request.c_str());
+      if (rename(items[i].c_str(), taken.c_str()) < 0)
+        continue;
+
+      std::vector<bool> prefix;
+      std::ifstream in(taken.c_str());
+      unsigned value;
+      while (in >> value)
+        prefix.push_back(value != 0);
+      in.close();
+      unlink(taken.c_str());
+
+      ExecutionState *es = new ExecutionState(*workTemplate);
+      es->pathPrefix = prefix;
+      es->pathOS = pathWriter->open();
+      if (symPathWriter)
+        es->symPathOS = symPathWriter->open();
+
+      // The tree of our previous states is gone by now.
+      delete processTree;
+      processTree = new PTree(es);
+      es->ptreeNode = processTree->root;
+
+      addedStates.insert(es);
+      updateStates(0);
+      return true;
+    }
+
+    // Nobody holds any work when every worker has asked for some.
+    std::vector<std::string> requests;
+    listWorkFiles(workDir, "idle", requests);
+    if (items.empty() && requests.size() == workerCount)
+      break;
+
+    processTimers(0, 0);
+    usleep(10000);
+  }
+
+  return false;
+}
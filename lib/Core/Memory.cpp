@@ -18,6 +18,7 @@
 
 #include "ObjectHolder.h"
 #include "MemoryManager.h"
+#include "StateSpiller.h"
 
 #if LLVM_VERSION_CODE >= LLVM_VERSION(3, 3)
 #include <llvm/IR/Function.h>
@@ -32,6 +33,7 @@
 #include "llvm/Support/CommandLine.h"
 #include "llvm/Support/raw_ostream.h"
 
+#include <algorithm>
 #include <cassert>
 #include <sstream>
 
@@ -98,14 +100,68 @@ void MemoryObject::getAllocInfo(std::string &result) const {
 
 /***/
 
+namespace klee {
+/// A fixed-size slice of the contents of an ObjectState. Copies of an
+/// object share its pages, a page is only duplicated when one of the
+/// objects sharing it is about to modify it.
+class ObjectPage {
+public:
+  enum {
+    Bits = 12,
+    Size = 1 << Bits,
+    Mask = Size - 1
+  };
+
+  unsigned refCount;
+  unsigned size;
+
+  uint8_t *concreteStore;
+  // null if all bytes on the page are concrete
+  BitArray *concreteMask;
+  // null if no byte on the page is flushed
+  BitArray *flushMask;
+  // null if no byte on the page has a known symbolic value
+  ref<Expr> *knownSymbolics;
+
+  explicit ObjectPage(unsigned _size)
+    : refCount(0),
+      size(_size),
+      concreteStore(new uint8_t[_size]),
+      concreteMask(0),
+      flushMask(0),
+      knownSymbolics(0) {
+    memset(concreteStore, 0, size);
+  }
+
+  ObjectPage(const ObjectPage &p)
+    : refCount(0),
+      size(p.size),
+      concreteStore(new uint8_t[p.size]),
+      concreteMask(p.concreteMask ? new BitArray(*p.concreteMask, p.size) : 0),
+      flushMask(p.flushMask ? new BitArray(*p.flushMask, p.size) : 0),
+      knownSymbolics(0) {
+    if (p.knownSymbolics) {
+      knownSymbolics = new ref<Expr>[size];
+      for (unsigned i=0; i<size; i++)
+        knownSymbolics[i] = p.knownSymbolics[i];
+    }
+
+    memcpy(concreteStore, p.concreteStore, size*sizeof(*concreteStore));
+  }
+
+  ~ObjectPage() {
+    delete concreteMask;
+    delete flushMask;
+    delete[] knownSymbolics;
+    delete[] concreteStore;
+  }
+};
+}
+
 ObjectState::ObjectState(const MemoryObject *mo)
   : copyOnWriteOwner(0),
     refCount(0),
     object(mo),
-    concreteStore(new uint8_t[mo->size]),
-    concreteMask(0),
-    flushMask(0),
-    knownSymbolics(0),
     updates(0, 0),
     size(mo->size),
     readOnly(false) {
@@ -116,7 +172,7 @@ ObjectState::ObjectState(const MemoryObject *mo)
         getArrayCache()->CreateArray("tmp_arr" + llvm::utostr(++id), size);
     updates = UpdateList(array, 0);
   }
-  memset(concreteStore, 0, size);
+  allocatePages();
 }
 
 
@@ -124,26 +180,19 @@ ObjectState::ObjectState(const MemoryObject *mo, const Array *array)
   : copyOnWriteOwner(0),
     refCount(0),
     object(mo),
-    concreteStore(new uint8_t[mo->size]),
-    concreteMask(0),
-    flushMask(0),
-    knownSymbolics(0),
     updates(array, 0),
     size(mo->size),
     readOnly(false) {
   mo->refCount++;
+  allocatePages();
   makeSymbolic();
-  memset(concreteStore, 0, size);
 }
 
 ObjectState::ObjectState(const ObjectState &os) 
   : copyOnWriteOwner(0),
     refCount(0),
     object(os.object),
-    concreteStore(new uint8_t[os.size]),
-    concreteMask(os.concreteMask ? new BitArray(*os.concreteMask, os.size) : 0),
-    flushMask(os.flushMask ? new BitArray(*os.flushMask, os.size) : 0),
-    knownSymbolics(0),
+    pages(os.pages),
     updates(os.updates),
     size(os.size),
     readOnly(false) {
@@ -151,20 +200,15 @@ ObjectState::ObjectState(const ObjectState &os)
   if (object)
     object->refCount++;
 
-  if (os.knownSymbolics) {
-    knownSymbolics = new ref<Expr>[size];
-    for (unsigned i=0; i<size; i++)
-      knownSymbolics[i] = os.knownSymbolics[i];
-  }
-
-  memcpy(concreteStore, os.concreteStore, size*sizeof(*concreteStore));
+  for (unsigned i=0; i<pages.size(); i++)
+    ++pages[i]->refCount;
 }
 
 ObjectState::~ObjectState() {
-  if (concreteMask) delete concreteMask;
-  if (flushMask) delete flushMask;
-  if (knownSymbolics) delete[] knownSymbolics;
-  delete[] concreteStore;
+  // Pages are null while spilled.
+  for (unsigned i=0; i<pages.size(); i++)
+    if (pages[i] && --pages[i]->refCount == 0)
+      delete pages[i];
 
   if (object)
   {
@@ -177,6 +221,128 @@ ObjectState::~ObjectState() {
   }
 }
 
+void ObjectState::allocatePages() {
+  for (unsigned base=0; base<size; base+=ObjectPage::Size) {
+    ObjectPage *page = new ObjectPage(std::min(size - base,
+                                               (unsigned) ObjectPage::Size));
+    ++page->refCount;
+    pages.push_back(page);
+  }
+}
+
+void ObjectState::spill(SpillWriter &writer) {
+  writer.writeUpdates(updates);
+  updates = UpdateList(0, 0);
+
+  for (unsigned i=0; i<pages.size(); i++) {
+    ObjectPage *page = pages[i];
+    if (page->refCount > 1) {
+      // Shared with another copy, it stays in memory.
+      writer.writeU8(0);
+      continue;
+    }
+    writer.writeU8(1);
+
+    writer.writeBytes(page->concreteStore, page->size);
+    writer.writeU8((page->concreteMask ? 1 : 0) |
+                   (page->flushMask ? 2 : 0) |
+                   (page->knownSymbolics ? 4 : 0));
+    BitArray *masks[] = { page->concreteMask, page->flushMask };
+    for (unsigned m=0; m<2; m++) {
+      if (!masks[m])
+        continue;
+      for (unsigned bit=0; bit<page->size; bit+=8) {
+        uint8_t byte = 0;
+        for (unsigned j=0; j<8 && bit+j<page->size; j++)
+          byte |= masks[m]->get(bit+j) << j;
+        writer.writeU8(byte);
+      }
+    }
+    if (page->knownSymbolics)
+      for (unsigned j=0; j<page->size; j++)
+        writer.writeExpr(page->knownSymbolics[j]);
+
+    delete page;
+    pages[i] = 0;
+  }
+}
+
+void ObjectState::reload(SpillReader &reader) {
+  updates = reader.readUpdates();
+
+  for (unsigned i=0; i<pages.size(); i++) {
+    if (!reader.readU8())
+      continue;
+
+    unsigned base = i << ObjectPage::Bits;
+    ObjectPage *page = new ObjectPage(std::min(size - base,
+                                               (unsigned) ObjectPage::Size));
+    ++page->refCount;
+    pages[i] = page;
+
+    reader.readBytes(page->concreteStore, page->size);
+    uint8_t flags = reader.readU8();
+    if (flags & 1)
+      page->concreteMask = new BitArray(page->size);
+    if (flags & 2)
+      page->flushMask = new BitArray(page->size);
+    BitArray *masks[] = { page->concreteMask, page->flushMask };
+    for (unsigned m=0; m<2; m++) {
+      if (!masks[m])
+        continue;
+      for (unsigned bit=0; bit<page->size; bit+=8) {
+        uint8_t byte = reader.readU8();
+        for (unsigned j=0; j<8 && bit+j<page->size; j++)
+          masks[m]->set(bit+j, (byte >> j) & 1);
+      }
+    }
+    if (flags & 4) {
+      page->knownSymbolics = new ref<Expr>[page->size];
+      for (unsigned j=0; j<page->size; j++)
+        page->knownSymbolics[j] = reader.readExpr();
+    }
+  }
+}
+
+const ObjectPage &ObjectState::getPage(unsigned offset) const {
+  return *pages[offset >> ObjectPage::Bits];
+}
+
+ObjectPage &ObjectState::getWriteablePage(unsigned offset) const {
+  ObjectPage *&page = pages[offset >> ObjectPage::Bits];
+  if (page->refCount > 1) {
+    --page->refCount;
+    page = new ObjectPage(*page);
+    ++page->refCount;
+  }
+  return *page;
+}
+
+void ObjectState::copyConcreteStoreTo(uint8_t *dst) const {
+  for (unsigned i=0; i<pages.size(); i++)
+    memcpy(dst + (i << ObjectPage::Bits), pages[i]->concreteStore,
+           pages[i]->size);
+}
+
+bool ObjectState::isConcreteStoreEqual(const uint8_t *src) const {
+  for (unsigned i=0; i<pages.size(); i++)
+    if (memcmp(src + (i << ObjectPage::Bits), pages[i]->concreteStore,
+               pages[i]->size) != 0)
+      return false;
+  return true;
+}
+
+void ObjectState::copyConcreteStoreFrom(const uint8_t *src) {
+  // Only unshare the pages whose contents actually changed.
+  for (unsigned i=0; i<pages.size(); i++) {
+    unsigned base = i << ObjectPage::Bits;
+    if (memcmp(src + base, pages[i]->concreteStore, pages[i]->size) != 0) {
+      ObjectPage &page = getWriteablePage(base);
+      memcpy(page.concreteStore, src + base, page.size);
+    }
+  }
+}
+
 ArrayCache *ObjectState::getArrayCache() const {
   assert(object && "object was NULL");
   return object->parent->getArrayCache();
@@ -236,12 +402,15 @@ const UpdateList &ObjectState::getUpdates() const {
 }
 
 void ObjectState::makeConcrete() {
-  if (concreteMask) delete concreteMask;
-  if (flushMask) delete flushMask;
-  if (knownSymbolics) delete[] knownSymbolics;
-  concreteMask = 0;
-  flushMask = 0;
-  knownSymbolics = 0;
+  for (unsigned i=0; i<pages.size(); i++) {
+    ObjectPage &page = getWriteablePage(i << ObjectPage::Bits);
+    delete page.concreteMask;
+    delete page.flushMask;
+    delete[] page.knownSymbolics;
+    page.concreteMask = 0;
+    page.flushMask = 0;
+    page.knownSymbolics = 0;
+  }
 }
 
 void ObjectState::makeSymbolic() {
@@ -258,14 +427,15 @@ void ObjectState::makeSymbolic() {
 
 void ObjectState::initializeToZero() {
   makeConcrete();
-  memset(concreteStore, 0, size);
+  for (unsigned i=0; i<pages.size(); i++)
+    memset(pages[i]->concreteStore, 0, pages[i]->size);
 }
 
 void ObjectState::initializeToRandom() {  
   makeConcrete();
-  for (unsigned i=0; i<size; i++) {
+  for (unsigned i=0; i<pages.size(); i++) {
     // randomly selected by 256 sided die
-    concreteStore[i] = 0xAB;
+    memset(pages[i]->concreteStore, 0xAB, pages[i]->size);
   }
 }
 
@@ -286,42 +456,45 @@ void ObjectState::fastRangeCheckOffset(ref<Expr> offset,
 
 void ObjectState::flushRangeForRead(unsigned rangeBase, 
                                     unsigned rangeSize) const {
-  if (!flushMask) flushMask = new BitArray(size, true);
- 
   for (unsigned offset=rangeBase; offset<rangeBase+rangeSize; offset++) {
     if (!isByteFlushed(offset)) {
+      ObjectPage &page = getWriteablePage(offset);
+      unsigned index = offset & ObjectPage::Mask;
       if (isByteConcrete(offset)) {
         updates.extend(ConstantExpr::create(offset, Expr::Int32),
-                       ConstantExpr::create(concreteStore[offset], Expr::Int8));
+                       ConstantExpr::create(page.concreteStore[index],
+                                            Expr::Int8));
       } else {
         assert(isByteKnownSymbolic(offset) && "invalid bit set in flushMask");
         updates.extend(ConstantExpr::create(offset, Expr::Int32),
-                       knownSymbolics[offset]);
+                       page.knownSymbolics[index]);
       }
 
-      flushMask->unset(offset);
+      if (!page.flushMask) page.flushMask = new BitArray(page.size, true);
+      page.flushMask->unset(index);
     }
   } 
 }
 
 void ObjectState::flushRangeForWrite(unsigned rangeBase, 
                                      unsigned rangeSize) {
-  if (!flushMask) flushMask = new BitArray(size, true);
-
   for (unsigned offset=rangeBase; offset<rangeBase+rangeSize; offset++) {
     if (!isByteFlushed(offset)) {
+      const ObjectPage &page = getPage(offset);
+      unsigned index = offset & ObjectPage::Mask;
       if (isByteConcrete(offset)) {
         updates.extend(ConstantExpr::create(offset, Expr::Int32),
-                       ConstantExpr::create(concreteStore[offset], Expr::Int8));
+                       ConstantExpr::create(page.concreteStore[index],
+                                            Expr::Int8));
         markByteSymbolic(offset);
       } else {
         assert(isByteKnownSymbolic(offset) && "invalid bit set in flushMask");
         updates.extend(ConstantExpr::create(offset, Expr::Int32),
-                       knownSymbolics[offset]);
+                       page.knownSymbolics[index]);
         setKnownSymbolic(offset, 0);
       }
 
-      flushMask->unset(offset);
+      markByteFlushed(offset);
     } else {
       // flushed bytes that are written over still need
       // to be marked out
@@ -335,60 +508,115 @@ void ObjectState::flushRangeForWrite(unsigned rangeBase,
 }
 
 bool ObjectState::isByteConcrete(unsigned offset) const {
-  return !concreteMask || concreteMask->get(offset);
+  const ObjectPage &page = getPage(offset);
+  return !page.concreteMask ||
+         page.concreteMask->get(offset & ObjectPage::Mask);
 }
 
 bool ObjectState::isByteFlushed(unsigned offset) const {
-  return flushMask && !flushMask->get(offset);
+  const ObjectPage &page = getPage(offset);
+  return page.flushMask && !page.flushMask->get(offset & ObjectPage::Mask);
 }
 
 bool ObjectState::isByteKnownSymbolic(unsigned offset) const {
-  return knownSymbolics && knownSymbolics[offset].get();
+  const ObjectPage &page = getPage(offset);
+  return page.knownSymbolics &&
+         page.knownSymbolics[offset & ObjectPage::Mask].get();
 }
 
 void ObjectState::markByteConcrete(unsigned offset) {
-  if (concreteMask)
-    concreteMask->set(offset);
+  if (getPage(offset).concreteMask)
+    getWriteablePage(offset).concreteMask->set(offset & ObjectPage::Mask);
 }
 
 void ObjectState::markByteSymbolic(unsigned offset) {
-  if (!concreteMask)
-    concreteMask = new BitArray(size, true);
-  concreteMask->unset(offset);
+  ObjectPage &page = getWriteablePage(offset);
+  if (!page.concreteMask)
+    page.concreteMask = new BitArray(page.size, true);
+  page.concreteMask->unset(offset & ObjectPage::Mask);
 }
 
 void ObjectState::markByteUnflushed(unsigned offset) {
-  if (flushMask)
-    flushMask->set(offset);
+  if (getPage(offset).flushMask)
+    getWriteablePage(offset).flushMask->set(offset & ObjectPage::Mask);
 }
 
 void ObjectState::markByteFlushed(unsigned offset) {
-  if (!flushMask) {
-    flushMask = new BitArray(size, false);
-  } else {
-    flushMask->unset(offset);
-  }
+  ObjectPage &page = getWriteablePage(offset);
+  if (!page.flushMask)
+    page.flushMask = new BitArray(page.size, true);
+  page.flushMask->unset(offset & ObjectPage::Mask);
 }
 
 void ObjectState::setKnownSymbolic(unsigned offset, 
                                    Expr *value /* can be null */) {
-  if (knownSymbolics) {
-    knownSymbolics[offset] = value;
+  if (getPage(offset).knownSymbolics) {
+    getWriteablePage(offset).knownSymbolics[offset & ObjectPage::Mask] = value;
   } else {
     if (value) {
-      knownSymbolics = new ref<Expr>[size];
-      knownSymbolics[offset] = value;
+      ObjectPage &page = getWriteablePage(offset);
+      page.knownSymbolics = new ref<Expr>[page.size];
+      page.knownSymbolics[offset & ObjectPage::Mask] = value;
     }
   }
 }
 
 /***/
 
+bool ObjectState::readConcrete(unsigned offset, unsigned numBytes,
+                               uint64_t &result) const {
+  if (numBytes > 8 || (offset >> ObjectPage::Bits) !=
+                           ((offset + numBytes - 1) >> ObjectPage::Bits))
+    return false;
+
+  const ObjectPage &page = getPage(offset);
+  unsigned index = offset & ObjectPage::Mask;
+  if (page.concreteMask &&
+      !page.concreteMask->allSet(index, index + numBytes))
+    return false;
+
+  const uint8_t *bytes = page.concreteStore + index;
+  bool littleEndian = Context::get().isLittleEndian();
+  result = 0;
+  for (unsigned i = 0; i != numBytes; ++i) {
+    unsigned idx = littleEndian ? i : (numBytes - i - 1);
+    result |= (uint64_t) bytes[idx] << (8 * i);
+  }
+  return true;
+}
+
+bool ObjectState::writeConcrete(unsigned offset, unsigned numBytes,
+                                uint64_t value) {
+  if ((offset >> ObjectPage::Bits) !=
+      ((offset + numBytes - 1) >> ObjectPage::Bits))
+    return false;
+
+  ObjectPage &page = getWriteablePage(offset);
+  unsigned index = offset & ObjectPage::Mask;
+  uint8_t *bytes = page.concreteStore + index;
+  bool littleEndian = Context::get().isLittleEndian();
+  for (unsigned i = 0; i != numBytes; ++i) {
+    unsigned idx = littleEndian ? i : (numBytes - i - 1);
+    bytes[idx] = (uint8_t) (value >> (8 * i));
+  }
+
+  // Same as write8 on each byte: the bytes become concrete and unflushed.
+  if (page.knownSymbolics)
+    for (unsigned i = 0; i != numBytes; ++i)
+      page.knownSymbolics[index + i] = 0;
+  if (page.concreteMask)
+    page.concreteMask->setRange(index, index + numBytes);
+  if (page.flushMask)
+    page.flushMask->setRange(index, index + numBytes);
+  return true;
+}
+
 ref<Expr> ObjectState::read8(unsigned offset) const {
   if (isByteConcrete(offset)) {
-    return ConstantExpr::create(concreteStore[offset], Expr::Int8);
+    return ConstantExpr::create(
+        getPage(offset).concreteStore[offset & ObjectPage::Mask], Expr::Int8);
   } else if (isByteKnownSymbolic(offset)) {
-    return knownSymbolics[offset];
+    return getPage(offset).knownSymbolics[offset & ObjectPage::Mask];
   } else {
     assert(isByteFlushed(offset) && "unflushed byte without cache value");
     
@@ -414,9 +642,32 @@ ref<Expr> ObjectState::read8(ref<Expr> offset) const {
   return ReadExpr::create(getUpdates(), ZExtExpr::create(offset, Expr::Int32));
 }
 
+unsigned ObjectState::getNumDifferentBytes(const ObjectState &b,
+                                           unsigned limit) const {
+  assert(size == b.size && "comparing states of different objects");
+  // Bytes neither concrete nor known are read from the update list.
+  bool sameUpdates =
+    updates.root == b.updates.root && updates.head == b.updates.head;
+
+  unsigned count = 0;
+  for (unsigned i=0; i<pages.size() && count<=limit; i++) {
+    unsigned base = i << ObjectPage::Bits;
+    unsigned end = std::min(size, base + (unsigned) ObjectPage::Size);
+    bool samePage = pages[i] == b.pages[i];
+    if (samePage && sameUpdates)
+      continue;
+    for (unsigned offset=base; offset<end && count<=limit; offset++) {
+      if (samePage && (isByteConcrete(offset) || isByteKnownSymbolic(offset)))
+        continue;
+      count += read8(offset) != b.read8(offset);
+    }
+  }
+  return count;
+}
+
 void ObjectState::write8(unsigned offset, uint8_t value) {
   //assert(read_only == false && "writing to read-only object!");
-  concreteStore[offset] = value;
+  getWriteablePage(offset).concreteStore[offset & ObjectPage::Mask] = value;
   setKnownSymbolic(offset, 0);
 
   markByteConcrete(offset);
@@ -486,9 +737,15 @@ ref<Expr> ObjectState::read(unsigned offset, Expr::Width width) const {
   if (width == Expr::Bool)
     return ExtractExpr::create(read8(offset), 0, Expr::Bool);
 
-  // Otherwise, follow the slow general case.
   unsigned NumBytes = width / 8;
   assert(width == NumBytes * 8 && "Invalid width for read size!");
+
+  // Fully concrete reads need no expression per byte.
+  uint64_t value;
+  if (readConcrete(offset, NumBytes, value))
+    return ConstantExpr::create(value, width);
+
+  // Otherwise, follow the slow general case.
   ref<Expr> Res(0);
   for (unsigned i = 0; i != NumBytes; ++i) {
     unsigned idx = Context::get().isLittleEndian() ? i : (NumBytes - i - 1);
@@ -560,6 +817,9 @@ void ObjectState::write(unsigned offset, ref<Expr> value) {
 } 
 
 void ObjectState::write16(unsigned offset, uint16_t value) {
+  if (writeConcrete(offset, 2, value))
+    return;
+
   unsigned NumBytes = 2;
   for (unsigned i = 0; i != NumBytes; ++i) {
     unsigned idx = Context::get().isLittleEndian() ? i : (NumBytes - i - 1);
@@ -568,6 +828,9 @@ void ObjectState::write16(unsigned offset, uint16_t value) {
 }
 
 void ObjectState::write32(unsigned offset, uint32_t value) {
+  if (writeConcrete(offset, 4, value))
+    return;
+
   unsigned NumBytes = 4;
   for (unsigned i = 0; i != NumBytes; ++i) {
     unsigned idx = Context::get().isLittleEndian() ? i : (NumBytes - i - 1);
@@ -576,6 +839,9 @@ void ObjectState::write32(unsigned offset, uint32_t value) {
 }
 
 void ObjectState::write64(unsigned offset, uint64_t value) {
+  if (writeConcrete(offset, 8, value))
+    return;
+
   unsigned NumBytes = 8;
   for (unsigned i = 0; i != NumBytes; ++i) {
     unsigned idx = Context::get().isLittleEndian() ? i : (NumBytes - i - 1);
@@ -26,7 +26,10 @@ namespace klee {
 
 class BitArray;
 class MemoryManager;
+class ObjectPage;
 class Solver;
+class SpillReader;
+class SpillWriter;
 class ArrayCache;
 
 class MemoryObject {
@@ -156,14 +159,11 @@ private:
 
   const MemoryObject *object;
 
-  uint8_t *concreteStore;
-  // XXX cleanup name of flushMask (its backwards or something)
-  BitArray *concreteMask;
-
-  // mutable because may need flushed during read of const
-  mutable BitArray *flushMask;
-
-  ref<Expr> *knownSymbolics;
+  // The contents of the object, split into fixed-size pages which are
+  // shared with copies of this object until one of them writes to the
+  // page. Mutable because a flush during a read of a const object may
+  // need to unshare a page.
+  mutable std::vector<ObjectPage*> pages;
 
   // mutable because we may need flush during read of const
   mutable UpdateList updates;
@@ -208,6 +208,11 @@ public:
   void write32(unsigned offset, uint32_t value);
   void write64(unsigned offset, uint64_t value);
 
+  /// Count the bytes that read differently in \arg b, a state of the same
+  /// object, stopping once the count exceeds \arg limit. Pages shared
+  /// with \arg b are skipped unless their bytes come from the updates.
+  unsigned getNumDifferentBytes(const ObjectState &b, unsigned limit) const;
+
 private:
   const UpdateList &getUpdates() const;
 
@@ -234,6 +239,28 @@ private:
   void markByteUnflushed(unsigned offset);
   void setKnownSymbolic(unsigned offset, Expr *value);
 
+  // Read or write numBytes concrete bytes as a single value, in target
+  // byte order. Returns false, without any effect, if the bytes are not
+  // all concrete (for reads) or do not lie on a single page.
+  bool readConcrete(unsigned offset, unsigned numBytes,
+                    uint64_t &result) const;
+  bool writeConcrete(unsigned offset, unsigned numBytes, uint64_t value);
+
+  void allocatePages();
+  const ObjectPage &getPage(unsigned offset) const;
+  ObjectPage &getWriteablePage(unsigned offset) const;
+
+  // Transfer the concrete contents to and from external memory of the
+  // size of the object, exclusively for AddressSpace.
+  void copyConcreteStoreTo(uint8_t *dst) const;
+  bool isConcreteStoreEqual(const uint8_t *src) const;
+  void copyConcreteStoreFrom(const uint8_t *src);
+
+  // Move the updates and the pages not shared with other objects to
+  // and from a spill file, exclusively for AddressSpace.
+  void spill(SpillWriter &writer);
+  void reload(SpillReader &reader);
+
   void print();
   ArrayCache *getArrayCache() const;
 };
@@ -12,42 +12,90 @@
 #include <klee/Expr.h>
 #include <klee/util/ExprPPrinter.h>
 
+#include <new>
 #include <vector>
 
 using namespace klee;
 
   /* *** */
 
-PTree::PTree(const data_type &_root) : root(new Node(0,_root)) {
+PTree::PTree(const data_type &_root) : freeNodes(0), nextFree(NodesPerChunk) {
+  root = allocate(0, _root);
 }
 
-PTree::~PTree() {}
+PTree::~PTree() {
+  std::vector<Node*> stack;
+  if (root)
+    stack.push_back(root);
+  while (!stack.empty()) {
+    Node *n = stack.back();
+    stack.pop_back();
+    if (n->left) {
+      stack.push_back(n->left);
+      stack.push_back(n->right);
+    }
+    n->~Node();
+  }
+
+  for (unsigned i = 0; i < chunks.size(); ++i)
+    ::operator delete(chunks[i]);
+}
+
+PTreeNode *PTree::allocate(Node *parent, const data_type &data) {
+  void *memory;
+  if (freeNodes) {
+    memory = freeNodes;
+    freeNodes = freeNodes->parent;
+  } else {
+    if (nextFree == NodesPerChunk) {
+      chunks.push_back(static_cast<Node*>(
+                         ::operator new(NodesPerChunk * sizeof(Node))));
+      nextFree = 0;
+    }
+    memory = chunks.back() + nextFree++;
+  }
+  return new (memory) Node(parent, data);
+}
+
+void PTree::release(Node *n) {
+  n->~Node();
+  n->parent = freeNodes;
+  freeNodes = n;
+}
 
 std::pair<PTreeNode*, PTreeNode*>
 PTree::split(Node *n, 
              const data_type &leftData, 
              const data_type &rightData) {
   assert(n && !n->left && !n->right);
-  n->left = new Node(n, leftData);
-  n->right = new Node(n, rightData);
+  n->left = allocate(n, leftData);
+  n->right = allocate(n, rightData);
   return std::make_pair(n->left, n->right);
 }
 
 void PTree::remove(Node *n) {
   assert(!n->left && !n->right);
-  do {
-    Node *p = n->parent;
-    delete n;
-    if (p) {
-      if (n == p->left) {
-        p->left = 0;
-      } else {
-        assert(n == p->right);
-        p->right = 0;
-      }
-    }
-    n = p;
-  } while (n && !n->left && !n->right);
+  Node *p = n->parent;
+  release(n);
+  if (!p) {
+    root = 0;
+    return;
+  }
+
+  // Replace the parent, left with a single child, by the sibling.
+  Node *sibling = n == p->left ? p->right : p->left;
+  assert(sibling && "inner node with a single child");
+  Node *grandparent = p->parent;
+  sibling->parent = grandparent;
+  if (!grandparent) {
+    root = sibling;
+  } else if (grandparent->left == p) {
+    grandparent->left = sibling;
+  } else {
+    assert(grandparent->right == p);
+    grandparent->right = sibling;
+  }
+  release(p);
 }
 
 void PTree::dump(llvm::raw_ostream &os) {
@@ -61,7 +109,8 @@ void PTree::dump(llvm::raw_ostream &os) {
   os << "\tnode [style=\"filled\",width=.1,height=.1,fontname=\"Terminus\"]\n";
   os << "\tedge [arrowsize=.3]\n";
   std::vector<PTree::Node*> stack;
-  stack.push_back(root);
+  if (root)
+    stack.push_back(root);
   while (!stack.empty()) {
     PTree::Node *n = stack.back();
     stack.pop_back();
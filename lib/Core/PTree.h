@@ -12,16 +12,37 @@
 
 #include <klee/Expr.h>
 
+#include <vector>
+
 namespace klee {
   class ExecutionState;
 
+  /// PTree - The process tree, with a leaf for each state.
+  ///
+  /// Every inner node has exactly two children: when a leaf is removed,
+  /// its parent is replaced by the sibling. Nodes are carved out of
+  /// chunks owned by the tree, so that the nodes split off together sit
+  /// next to each other.
   class PTree { 
     typedef ExecutionState* data_type;
 
   public:
     typedef class PTreeNode Node;
+    /// The root, or null once the last state is removed.
     Node *root;
 
+  private:
+    enum { NodesPerChunk = 1024 };
+
+    std::vector<Node*> chunks;
+    /// Released nodes, chained through their parent field.
+    Node *freeNodes;
+    unsigned nextFree;
+
+    Node *allocate(Node *parent, const data_type &data);
+    void release(Node *n);
+
+  public:
     PTree(const data_type &_root);
     ~PTree();
     
@@ -0,0 +1,415 @@
+//===-- ReachableUncovered.cpp --------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "ReachableUncovered.h"
+
+#include "CoreStats.h"
+
+#include "klee/Statistics.h"
+#include "klee/Config/Version.h"
+#include "klee/Internal/Module/InstructionInfoTable.h"
+#include "klee/Internal/Module/KModule.h"
+#include "klee/Internal/Support/ErrorHandling.h"
+#include "klee/Internal/Support/ModuleUtil.h"
+
+#if LLVM_VERSION_CODE > LLVM_VERSION(3, 2)
+#include "llvm/IR/BasicBlock.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/InlineAsm.h"
+#include "llvm/IR/Module.h"
+#else
+#include "llvm/BasicBlock.h"
+#include "llvm/Function.h"
+#include "llvm/Instructions.h"
+#include "llvm/InlineAsm.h"
+#include "llvm/Module.h"
+#endif
+
+#if LLVM_VERSION_CODE < LLVM_VERSION(3, 5)
+#include "llvm/Support/CallSite.h"
+#include "llvm/Support/CFG.h"
+#else
+#include "llvm/IR/CallSite.h"
+#include "llvm/IR/CFG.h"
+#endif
+#include "llvm/Support/CommandLine.h"
+
+#include <algorithm>
+#include <functional>
+#include <map>
+#include <queue>
+
+using namespace klee;
+using namespace llvm;
+
+namespace {
+  cl::opt<bool>
+  DebugCheckUncoveredDistances("debug-check-uncovered-distances",
+                               cl::init(false),
+                               cl::desc("Check the distances to uncovered instructions against a full "
+                                        "recomputation after each update (slow, default=off)"));
+}
+
+typedef std::map<Instruction*, std::vector<Function*> > calltargets_ty;
+
+static std::vector<Instruction*> getSuccs(Instruction *i) {
+  BasicBlock *bb = i->getParent();
+  std::vector<Instruction*> res;
+
+  if (i==bb->getTerminator()) {
+    for (succ_iterator it = succ_begin(bb), ie = succ_end(bb); it != ie; ++it)
+      res.push_back(it->begin());
+  } else {
+    res.push_back(++BasicBlock::iterator(i));
+  }
+
+  return res;
+}
+
+/// Fill \arg begin and \arg edges, in compressed row form, from the
+/// (row, edge) pairs in \arg list.
+template<class Edge>
+static void compress(unsigned numRows,
+                     const std::vector< std::pair<unsigned, Edge> > &list,
+                     std::vector<unsigned> &begin, std::vector<Edge> &edges) {
+  begin.assign(numRows + 1, 0);
+  for (unsigned i = 0; i < list.size(); ++i)
+    ++begin[list[i].first + 1];
+  for (unsigned i = 0; i < numRows; ++i)
+    begin[i + 1] += begin[i];
+
+  std::vector<unsigned> pos(begin.begin(), begin.end() - 1);
+  edges.resize(list.size());
+  for (unsigned i = 0; i < list.size(); ++i)
+    edges[pos[list[i].first]++] = list[i].second;
+}
+
+ReachableUncovered::ReachableUncovered(KModule *km) {
+  build(km);
+
+  unsigned n = succBegin.size() - 1;
+  uncovered.assign(n, 0);
+  dist.assign(n, 0);
+  invalid.assign(n, 0);
+}
+
+void ReachableUncovered::build(KModule *km) {
+  Module *m = km->module;
+  const InstructionInfoTable &infos = *km->infos;
+  StatisticManager &sm = *theStatisticManager;
+  calltargets_ty callTargets;
+  std::map<Function*, unsigned> functionShortestPath;
+
+  // Compute call targets. It would be nice to use alias information
+  // instead of assuming all indirect calls hit all escaping
+  // functions, eh?
+  for (Module::iterator fnIt = m->begin(), fn_ie = m->end();
+       fnIt != fn_ie; ++fnIt) {
+    for (Function::iterator bbIt = fnIt->begin(), bb_ie = fnIt->end();
+         bbIt != bb_ie; ++bbIt) {
+      for (BasicBlock::iterator it = bbIt->begin(), ie = bbIt->end();
+           it != ie; ++it) {
+        if (isa<CallInst>(it) || isa<InvokeInst>(it)) {
+          CallSite cs(it);
+          if (isa<InlineAsm>(cs.getCalledValue())) {
+            // We can never call through here so assume no targets
+            // (which should be correct anyhow).
+            callTargets.insert(std::make_pair(it,
+                                              std::vector<Function*>()));
+          } else if (Function *target = getDirectCallTarget(cs)) {
+            callTargets[it].push_back(target);
+          } else {
+            callTargets[it] =
+              std::vector<Function*>(km->escapingFunctions.begin(),
+                                     km->escapingFunctions.end());
+          }
+        }
+      }
+    }
+  }
+
+  // Initialize minDistToReturn to shortest paths through
+  // functions. 0 is unreachable.
+  std::vector<Instruction *> instructions;
+  for (Module::iterator fnIt = m->begin(), fn_ie = m->end();
+       fnIt != fn_ie; ++fnIt) {
+    if (fnIt->isDeclaration()) {
+      if (fnIt->doesNotReturn()) {
+        functionShortestPath[fnIt] = 0;
+      } else {
+        functionShortestPath[fnIt] = 1; // whatever
+      }
+    } else {
+      functionShortestPath[fnIt] = 0;
+    }
+
+    // Not sure if I should bother to preorder here. XXX I should.
+    for (Function::iterator bbIt = fnIt->begin(), bb_ie = fnIt->end();
+         bbIt != bb_ie; ++bbIt) {
+      for (BasicBlock::iterator it = bbIt->begin(), ie = bbIt->end();
+           it != ie; ++it) {
+        instructions.push_back(it);
+        unsigned id = infos.getInfo(it).id;
+        sm.setIndexedValue(stats::minDistToReturn,
+                           id,
+                           isa<ReturnInst>(it)
+#if LLVM_VERSION_CODE < LLVM_VERSION(3, 1)
+                           || isa<UnwindInst>(it)
+#endif
+                           );
+      }
+    }
+  }
+
+  std::reverse(instructions.begin(), instructions.end());
+
+  // I'm so lazy it's not even worklisted.
+  bool changed;
+  do {
+    changed = false;
+    for (std::vector<Instruction*>::iterator it = instructions.begin(),
+           ie = instructions.end(); it != ie; ++it) {
+      Instruction *inst = *it;
+      unsigned bestThrough = 0;
+
+      if (isa<CallInst>(inst) || isa<InvokeInst>(inst)) {
+        std::vector<Function*> &targets = callTargets[inst];
+        for (std::vector<Function*>::iterator fnIt = targets.begin(),
+               ie = targets.end(); fnIt != ie; ++fnIt) {
+          uint64_t dist = functionShortestPath[*fnIt];
+          if (dist) {
+            dist = 1+dist; // count instruction itself
+            if (bestThrough==0 || dist<bestThrough)
+              bestThrough = dist;
+          }
+        }
+      } else {
+        bestThrough = 1;
+      }
+
+      if (bestThrough) {
+        unsigned id = infos.getInfo(*it).id;
+        uint64_t best, cur = best = sm.getIndexedValue(stats::minDistToReturn, id);
+        std::vector<Instruction*> succs = getSuccs(*it);
+        for (std::vector<Instruction*>::iterator it2 = succs.begin(),
+               ie = succs.end(); it2 != ie; ++it2) {
+          uint64_t dist = sm.getIndexedValue(stats::minDistToReturn,
+                                             infos.getInfo(*it2).id);
+          if (dist) {
+            uint64_t val = bestThrough + dist;
+            if (best==0 || val<best)
+              best = val;
+          }
+        }
+        // there's a corner case here when a function only includes a single
+        // instruction (a ret). in that case, we MUST update
+        // functionShortestPath, or it will remain 0 (erroneously indicating
+        // that no return instructions are reachable)
+        Function *f = inst->getParent()->getParent();
+        if (best != cur
+            || (inst == f->begin()->begin()
+                && functionShortestPath[f] != best)) {
+          sm.setIndexedValue(stats::minDistToReturn, id, best);
+          changed = true;
+
+          // Update shortest path if this is the entry point.
+          if (inst==f->begin()->begin())
+            functionShortestPath[f] = best;
+        }
+      }
+    }
+  } while (changed);
+
+  // With the shortest paths through calls known, the edges are fixed.
+  std::vector< std::pair<unsigned, Edge> > succList, predList;
+  for (std::vector<Instruction*>::iterator it = instructions.begin(),
+         ie = instructions.end(); it != ie; ++it) {
+    Instruction *inst = *it;
+    unsigned id = infos.getInfo(inst).id;
+    unsigned bestThrough = 0;
+
+    if (isa<CallInst>(inst) || isa<InvokeInst>(inst)) {
+      std::vector<Function*> &targets = callTargets[inst];
+      for (std::vector<Function*>::iterator fnIt = targets.begin(),
+             ie = targets.end(); fnIt != ie; ++fnIt) {
+        unsigned dist = functionShortestPath[*fnIt];
+        if (dist) {
+          dist = 1+dist; // count instruction itself
+          if (bestThrough==0 || dist<bestThrough)
+            bestThrough = dist;
+        }
+
+        if (!(*fnIt)->isDeclaration()) {
+          Edge e = { infos.getFunctionInfo(*fnIt).id, 1 };
+          succList.push_back(std::make_pair(id, e));
+        }
+      }
+    } else {
+      bestThrough = 1;
+    }
+
+    if (bestThrough) {
+      std::vector<Instruction*> s = getSuccs(inst);
+      for (std::vector<Instruction*>::iterator it2 = s.begin(),
+             ie = s.end(); it2 != ie; ++it2) {
+        Edge e = { infos.getInfo(*it2).id, bestThrough };
+        succList.push_back(std::make_pair(id, e));
+      }
+    }
+  }
+
+  for (unsigned i = 0; i < succList.size(); ++i) {
+    Edge e = { succList[i].first, succList[i].second.weight };
+    predList.push_back(std::make_pair(succList[i].second.node, e));
+  }
+
+  unsigned n = infos.getMaxID();
+  compress(n, succList, succBegin, succs);
+  compress(n, predList, predBegin, preds);
+}
+
+bool ReachableUncovered::takeCoverage(std::vector<unsigned> &covered,
+                                      std::vector<unsigned> &uncoveredNow) {
+  StatisticManager &sm = *theStatisticManager;
+  for (unsigned id = 0; id < uncovered.size(); ++id) {
+    char now = sm.getIndexedValue(stats::uncoveredInstructions, id) != 0;
+    if (now != uncovered[id]) {
+      (now ? uncoveredNow : covered).push_back(id);
+      uncovered[id] = now;
+    }
+  }
+  return !covered.empty() || !uncoveredNow.empty();
+}
+
+void ReachableUncovered::update(const std::vector<unsigned> &covered,
+                                const std::vector<unsigned> &uncoveredNow,
+                                changes_ty &changes) {
+  // Distances only grow as instructions get covered. Those that may
+  // grow are the ones whose shortest path went through a newly covered
+  // instruction, found by walking back along the edges on such paths.
+  // All other distances still have their path and stay the same.
+  std::vector<unsigned> stack(covered), affected;
+  for (unsigned i = 0; i < covered.size(); ++i)
+    invalid[covered[i]] = 1;
+  while (!stack.empty()) {
+    unsigned node = stack.back();
+    stack.pop_back();
+    affected.push_back(node);
+    if (!dist[node])
+      continue;
+    for (unsigned i = predBegin[node]; i < predBegin[node + 1]; ++i) {
+      unsigned pred = preds[i].node;
+      if (!invalid[pred] && !uncovered[pred] &&
+          dist[pred] == preds[i].weight + dist[node]) {
+        invalid[pred] = 1;
+        stack.push_back(pred);
+      }
+    }
+  }
+
+  for (unsigned i = 0; i < affected.size(); ++i)
+    dist[affected[i]] = 0;
+
+  // Restart the affected instructions from their unaffected successors
+  // and from the new uncovered instructions, then settle them shortest
+  // first.
+  typedef std::pair<uint64_t, unsigned> entry_ty;
+  std::priority_queue<entry_ty, std::vector<entry_ty>,
+                      std::greater<entry_ty> > queue;
+  for (unsigned i = 0; i < affected.size(); ++i) {
+    unsigned node = affected[i];
+    uint64_t best = uncovered[node];
+    for (unsigned j = succBegin[node]; j < succBegin[node + 1]; ++j) {
+      uint64_t d = dist[succs[j].node];
+      if (d && (best == 0 || succs[j].weight + d < best))
+        best = succs[j].weight + d;
+    }
+    dist[node] = best;
+    if (best)
+      queue.push(std::make_pair(best, node));
+  }
+  for (unsigned i = 0; i < uncoveredNow.size(); ++i) {
+    unsigned node = uncoveredNow[i];
+    if (dist[node] != 1) {
+      dist[node] = 1;
+      invalid[node] = 1;
+      affected.push_back(node);
+      queue.push(std::make_pair(1, node));
+    }
+  }
+
+  while (!queue.empty()) {
+    entry_ty top = queue.top();
+    queue.pop();
+    unsigned node = top.second;
+    if (top.first != dist[node])
+      continue;
+    for (unsigned i = predBegin[node]; i < predBegin[node + 1]; ++i) {
+      unsigned pred = preds[i].node;
+      uint64_t d = preds[i].weight + top.first;
+      if (dist[pred] == 0 || d < dist[pred]) {
+        if (!invalid[pred]) {
+          invalid[pred] = 1;
+          affected.push_back(pred);
+        }
+        dist[pred] = d;
+        queue.push(std::make_pair(d, pred));
+      }
+    }
+  }
+
+  for (unsigned i = 0; i < affected.size(); ++i) {
+    unsigned node = affected[i];
+    if (invalid[node]) {
+      invalid[node] = 0;
+      changes.push_back(std::make_pair(node, dist[node]));
+    }
+  }
+}
+
+void ReachableUncovered::apply(const changes_ty &changes) {
+  StatisticManager &sm = *theStatisticManager;
+  for (changes_ty::const_iterator it = changes.begin(), ie = changes.end();
+       it != ie; ++it) {
+    dist[it->first] = it->second;
+    sm.setIndexedValue(stats::minDistToUncovered, it->first, it->second);
+  }
+
+  if (DebugCheckUncoveredDistances)
+    check();
+}
+
+void ReachableUncovered::check() const {
+  // Recompute every distance from the uncovered instructions, with the
+  // fixpoint used before the updates were incremental.
+  std::vector<uint64_t> full(uncovered.begin(), uncovered.end());
+  bool changed;
+  do {
+    changed = false;
+    for (unsigned node = full.size(); node-- > 0;) {
+      uint64_t best = full[node];
+      for (unsigned i = succBegin[node]; i < succBegin[node + 1]; ++i) {
+        uint64_t d = full[succs[i].node];
+        if (d && (best == 0 || succs[i].weight + d < best))
+          best = succs[i].weight + d;
+      }
+      if (best != full[node]) {
+        full[node] = best;
+        changed = true;
+      }
+    }
+  } while (changed);
+
+  for (unsigned node = 0; node < full.size(); ++node)
+    if (dist[node] != full[node])
+      klee_error("distance to uncovered code of instruction %u is %llu, "
+                 "expected %llu", node, (unsigned long long) dist[node],
+                 (unsigned long long) full[node]);
+}
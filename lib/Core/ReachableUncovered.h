@@ -0,0 +1,84 @@
+//===-- ReachableUncovered.h ------------------------------------*- C++ -*-===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef KLEE_REACHABLEUNCOVERED_H
+#define KLEE_REACHABLEUNCOVERED_H
+
+#include <stdint.h>
+#include <vector>
+
+namespace klee {
+  class KModule;
+
+  /// ReachableUncovered - Maintains the minDistToUncovered statistic, the
+  /// distance from each instruction to the closest uncovered one.
+  ///
+  /// The interprocedural CFG is built once, indexed by instruction id, as
+  /// flat arrays of successor and predecessor edges. An edge runs from an
+  /// instruction to each of its successors, weighted by the shortest path
+  /// through the instruction (past the callee, for calls), and from a call
+  /// to the entry of each defined callee, weighted 1. When instructions
+  /// get covered, only the distances that went through them are
+  /// recomputed.
+  class ReachableUncovered {
+  public:
+    typedef std::vector< std::pair<unsigned, uint64_t> > changes_ty;
+
+  private:
+    struct Edge {
+      unsigned node;
+      unsigned weight;
+    };
+
+    /// The edges of instruction i are succs[succBegin[i]] up to
+    /// succs[succBegin[i+1]], and likewise for preds.
+    std::vector<unsigned> succBegin, predBegin;
+    std::vector<Edge> succs, preds;
+
+    /// Whether each instruction was uncovered when last looked at.
+    std::vector<char> uncovered;
+    /// The distance to an uncovered instruction, 0 if none is reachable.
+    std::vector<uint64_t> dist;
+
+    /// Scratch space for update().
+    std::vector<char> invalid;
+
+    void build(KModule *km);
+
+    /// Compare the distances with a recomputation from scratch, failing
+    /// on the first difference.
+    void check() const;
+
+  public:
+    /// Build the graph for \arg km and set the minDistToReturn statistic.
+    /// Distances are computed by the first update().
+    explicit ReachableUncovered(KModule *km);
+
+    /// Compare the uncoveredInstructions statistic with what was seen
+    /// last, collecting the instructions covered and uncovered since.
+    /// Returns false if nothing changed.
+    bool takeCoverage(std::vector<unsigned> &covered,
+                      std::vector<unsigned> &uncoveredNow);
+
+    /// Recompute the distances after the given coverage changes, as
+    /// returned by takeCoverage(), appending the new distances to
+    /// \arg changes.
+    void update(const std::vector<unsigned> &covered,
+                const std::vector<unsigned> &uncoveredNow,
+                changes_ty &changes);
+
+    /// Record the result of an update(), possibly done in another
+    /// process, in the minDistToUncovered statistic. With
+    /// --debug-check-uncovered-distances, the distances are then checked
+    /// against a full recomputation.
+    void apply(const changes_ty &changes);
+  };
+}
+
+#endif
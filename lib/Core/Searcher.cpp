@@ -11,6 +11,7 @@
 
 #include "CoreStats.h"
 #include "Executor.h"
+#include "Memory.h"
 #include "PTree.h"
 #include "StatsTracker.h"
 
@@ -33,6 +34,7 @@
 #include "llvm/Instructions.h"
 #include "llvm/Module.h"
 #endif
+#include "llvm/Analysis/PostDominators.h"
 #include "llvm/Support/CommandLine.h"
 
 #if LLVM_VERSION_CODE < LLVM_VERSION(3, 5)
@@ -41,6 +43,7 @@
 #include "llvm/IR/CallSite.h"
 #endif
 
+#include <algorithm>
 #include <cassert>
 #include <fstream>
 #include <climits>
@@ -51,6 +54,26 @@ using namespace llvm;
 namespace {
   cl::opt<bool>
   DebugLogMerge("debug-log-merge");
+
+  cl::opt<unsigned>
+  WeightUpdateInterval("weight-update-interval",
+                       cl::desc("Refresh the weight of the running state for the nurs searchers "
+                                "when it enters a basic block, calls or returns, or at the latest "
+                                "after this many instructions (default=1 (every instruction))"),
+                       cl::init(1));
+
+  cl::opt<unsigned>
+  AutoMergeMaxItes("auto-merge-max-ites",
+                   cl::desc("Merge two states with --use-auto-merge only if it takes at most "
+                            "this many ite expressions and path constraints, however many "
+                            "paths the merge saves (default=64)"),
+                   cl::init(64));
+
+  cl::opt<unsigned>
+  AutoMergeMaxWait("auto-merge-max-wait",
+                   cl::desc("Instructions to keep states waiting for the others to reach "
+                            "their join point with --use-auto-merge (default=100000)"),
+                   cl::init(100000));
 }
 
 namespace klee {
@@ -162,7 +185,10 @@ void RandomSearcher::update(ExecutionState *current,
 
 WeightedRandomSearcher::WeightedRandomSearcher(WeightType _type)
   : states(new DiscretePDF<ExecutionState*>()),
-    type(_type) {
+    type(_type),
+    stale(0),
+    staleSteps(0),
+    staleDepth(0) {
   switch(type) {
   case Depth: 
     updateWeights = false;
@@ -172,6 +198,7 @@ WeightedRandomSearcher::WeightedRandomSearcher(WeightType _type)
   case QueryCost:
   case MinDistToUncovered:
   case CoveringNew:
+  case CoveringNewPerQueryCost:
     updateWeights = true;
     break;
   default:
@@ -207,28 +234,76 @@ double WeightedRandomSearcher::getWeight(ExecutionState *es) {
   case QueryCost:
     return (es->queryCost < .1) ? 1. : 1./es->queryCost;
   case CoveringNew:
+  case CoveringNewPerQueryCost:
   case MinDistToUncovered: {
     uint64_t md2u = computeMinDistToUncovered(es->pc,
                                               es->stack.back().minDistToUncoveredOnReturn);
 
     double invMD2U = 1. / (md2u ? md2u : 10000);
-    if (type==CoveringNew) {
-      double invCovNew = 0.;
-      if (es->instsSinceCovNew)
-        invCovNew = 1. / std::max(1, (int) es->instsSinceCovNew - 1000);
-      return (invCovNew * invCovNew + invMD2U * invMD2U);
-    } else {
+    if (type==MinDistToUncovered)
       return invMD2U * invMD2U;
-    }
+
+    double invCovNew = 0.;
+    if (es->instsSinceCovNew)
+      invCovNew = 1. / std::max(1, (int) es->instsSinceCovNew - 1000);
+    double coverage = invCovNew * invCovNew + invMD2U * invMD2U;
+    if (type==CoveringNew)
+      return coverage;
+
+    // Coverage per second of solver time, predicted from the queries
+    // issued where the state is about to run, or failing that in its
+    // call path. The 10ms base keeps cheap sites from dominating.
+    return coverage / (.01 + getPredictedQueryCost(es));
   }
   }
 }
 
+double WeightedRandomSearcher::getPredictedQueryCost(ExecutionState *es) {
+  StatisticManager &sm = *theStatisticManager;
+  unsigned id = es->pc->info->id;
+  uint64_t queries = sm.getIndexedValue(stats::solverQueries, id);
+  uint64_t time = sm.getIndexedValue(stats::solverTime, id);
+
+  StackFrame &sf = es->stack.back();
+  if (!queries && sf.callPathNode) {
+    queries = sf.callPathNode->statistics.getValue(stats::solverQueries);
+    time = sf.callPathNode->statistics.getValue(stats::solverTime);
+  }
+
+  return queries ? time / 1000000. / queries : 0.;
+}
+
 void WeightedRandomSearcher::update(ExecutionState *current,
                                     const std::set<ExecutionState*> &addedStates,
                                     const std::set<ExecutionState*> &removedStates) {
-  if (current && updateWeights && !removedStates.count(current))
-    states->update(current, getWeight(current));
+  if (stale && removedStates.count(stale))
+    stale = 0;
+
+  if (current && updateWeights && !removedStates.count(current)) {
+    if (WeightUpdateInterval <= 1) {
+      states->update(current, getWeight(current));
+    } else {
+      // Bring the weight of the state that ran before up to date, as it
+      // will not be refreshed until it runs again.
+      if (stale != current) {
+        if (stale && staleSteps)
+          states->update(stale, getWeight(stale));
+        stale = current;
+        staleSteps = 0;
+        staleDepth = current->stack.size();
+      }
+
+      ++staleSteps;
+      llvm::Instruction *inst = current->pc->inst;
+      if (staleSteps >= WeightUpdateInterval ||
+          inst == &inst->getParent()->front() ||
+          current->stack.size() != staleDepth) {
+        states->update(current, getWeight(current));
+        staleSteps = 0;
+        staleDepth = current->stack.size();
+      }
+    }
+  }
   
   for (std::set<ExecutionState*>::const_iterator it = addedStates.begin(),
          ie = addedStates.end(); it != ie; ++it) {
@@ -259,19 +334,17 @@ ExecutionState &RandomPathSearcher::selectState() {
   unsigned flips=0, bits=0;
   PTree::Node *n = executor.processTree->root;
   
+  // Inner nodes always have two children, so the walk takes one coin
+  // flip per level. A leaf at depth d is picked with probability 2^-d,
+  // which bounds the expected number of flips by log2 of the number of
+  // leaves.
   while (!n->data) {
-    if (!n->left) {
-      n = n->right;
-    } else if (!n->right) {
-      n = n->left;
-    } else {
-      if (bits==0) {
-        flips = theRNG.getInt32();
-        bits = 32;
-      }
-      --bits;
-      n = (flips&(1<<bits)) ? n->left : n->right;
+    if (bits==0) {
+      flips = theRNG.getInt32();
+      bits = 32;
     }
+    --bits;
+    n = (flips&(1<<bits)) ? n->left : n->right;
   }
 
   return *n->data;
@@ -339,6 +412,8 @@ entry:
       statesAtMerge.insert(std::make_pair(mp, &es));
     } else {
       ExecutionState *mergeWith = it->second;
+      executor.reloadState(*mergeWith);
+      executor.reloadState(es);
       if (mergeWith->merge(es)) {
         // hack, because we are terminating the state we need to let
         // the baseSearcher know about it again
@@ -432,11 +507,13 @@ ExecutionState &MergingSearcher::selectState() {
     while (!toMerge.empty()) {
       ExecutionState *base = *toMerge.begin();
       toMerge.erase(toMerge.begin());
+      executor.reloadState(*base);
       
       std::set<ExecutionState*> toErase;
       for (std::set<ExecutionState*>::iterator it = toMerge.begin(),
              ie = toMerge.end(); it != ie; ++it) {
         ExecutionState *mergeWith = *it;
+        executor.reloadState(*mergeWith);
         
         if (base->merge(*mergeWith)) {
           toErase.insert(mergeWith);
@@ -494,6 +571,384 @@ void MergingSearcher::update(ExecutionState *current,
 
 ///
 
+/// Estimate the extra solver work of merging \arg b into \arg a: the
+/// number of values that become ite expressions plus the number of path
+/// constraints that end up in the disjunction. Gives up past \arg limit.
+static unsigned getMergeCost(const ExecutionState &a, const ExecutionState &b,
+                             unsigned limit) {
+  if (a.stack.size() != b.stack.size())
+    return UINT_MAX;
+
+  std::set< ref<Expr> > aConstraints(a.constraints.begin(),
+                                     a.constraints.end());
+  std::set< ref<Expr> > bConstraints(b.constraints.begin(),
+                                     b.constraints.end());
+  unsigned cost = 0;
+  for (std::set< ref<Expr> >::iterator it = aConstraints.begin(),
+         ie = aConstraints.end(); it != ie; ++it)
+    cost += !bConstraints.count(*it);
+  for (std::set< ref<Expr> >::iterator it = bConstraints.begin(),
+         ie = bConstraints.end(); it != ie; ++it)
+    cost += !aConstraints.count(*it);
+
+  for (unsigned i = 0; i < a.stack.size() && cost <= limit; ++i) {
+    const StackFrame &af = a.stack[i], &bf = b.stack[i];
+    if (af.kf != bf.kf)
+      return UINT_MAX;
+    for (unsigned j = 0; j < af.kf->numRegisters; ++j) {
+      ref<Expr> av = af.locals[j].getValue();
+      ref<Expr> bv = bf.locals[j].getValue();
+      if (!av.isNull() && !bv.isNull() && av != bv)
+        ++cost;
+    }
+  }
+
+  MemoryMap::iterator ai = a.addressSpace.objects.begin();
+  MemoryMap::iterator bi = b.addressSpace.objects.begin();
+  MemoryMap::iterator ae = a.addressSpace.objects.end();
+  MemoryMap::iterator be = b.addressSpace.objects.end();
+  for (; ai != ae && bi != be && cost <= limit; ++ai, ++bi) {
+    if (ai->first != bi->first)
+      return UINT_MAX;
+    if (ai->second == bi->second)
+      continue;
+    const ObjectState *aos = ai->second, *bos = bi->second;
+    cost += aos->getNumDifferentBytes(*bos, limit - cost);
+  }
+
+  return cost;
+}
+
+AutoMergingSearcher::AutoMergingSearcher(Executor &_executor,
+                                         Searcher *_baseSearcher)
+  : executor(_executor),
+    baseSearcher(_baseSearcher),
+    nextRegionId(0) {
+}
+
+AutoMergingSearcher::~AutoMergingSearcher() {
+  for (std::map<Function*, PostDominatorTree*>::iterator
+         it = postDominators.begin(), ie = postDominators.end();
+       it != ie; ++it)
+    delete it->second;
+
+  // Regions are only referenced from states.
+  std::set<Region*> regions;
+  for (std::map<ExecutionState*, std::vector<Region*> >::iterator
+         it = stateRegions.begin(), ie = stateRegions.end(); it != ie; ++it)
+    regions.insert(it->second.begin(), it->second.end());
+  for (std::map<uint64_t, Region*>::iterator it = waitingRegions.begin(),
+         ie = waitingRegions.end(); it != ie; ++it)
+    regions.insert(it->second);
+  for (std::set<Region*>::iterator it = regions.begin(), ie = regions.end();
+       it != ie; ++it)
+    delete *it;
+
+  delete baseSearcher;
+}
+
+///
+
+Instruction *AutoMergingSearcher::getJoinPoint(BasicBlock *bb) {
+  std::map<BasicBlock*, Instruction*>::iterator it = joinPoints.find(bb);
+  if (it != joinPoints.end())
+    return it->second;
+
+  Function *f = bb->getParent();
+  PostDominatorTree *&pdt = postDominators[f];
+  if (!pdt) {
+    pdt = new PostDominatorTree();
+    pdt->runOnFunction(*f);
+  }
+
+  // No join point if the paths leave the function separately.
+  Instruction *join = 0;
+  DomTreeNode *node = pdt->getNode(bb);
+  BasicBlock *joinBB = 0;
+  if (node && node->getIDom())
+    joinBB = node->getIDom()->getBlock();
+
+  if (joinBB) {
+    // Nor if a path can come back to the branch before the join, as the
+    // states would keep forking into the region while others wait.
+    std::vector<BasicBlock*> stack;
+    std::set<BasicBlock*> visited;
+    TerminatorInst *ti = bb->getTerminator();
+    for (unsigned i = 0; i < ti->getNumSuccessors(); ++i)
+      stack.push_back(ti->getSuccessor(i));
+    bool cyclic = false;
+    while (!stack.empty() && !cyclic) {
+      BasicBlock *next = stack.back();
+      stack.pop_back();
+      if (next == joinBB || !visited.insert(next).second)
+        continue;
+      if (next == bb) {
+        cyclic = true;
+        break;
+      }
+      TerminatorInst *nti = next->getTerminator();
+      for (unsigned i = 0; i < nti->getNumSuccessors(); ++i)
+        stack.push_back(nti->getSuccessor(i));
+    }
+    if (!cyclic)
+      join = joinBB->getFirstNonPHI();
+  }
+
+  joinPoints.insert(std::make_pair(bb, join));
+  return join;
+}
+
+AutoMergingSearcher::Region *
+AutoMergingSearcher::createRegion(ExecutionState &es) {
+  Instruction *i = es.prevPC->inst;
+  if (!isa<BranchInst>(i) && !isa<SwitchInst>(i))
+    return 0;
+
+  Instruction *join = getJoinPoint(i->getParent());
+  if (!join)
+    return 0;
+
+  Region *r = new Region();
+  r->id = nextRegionId++;
+  r->join = join;
+  r->depth = es.stack.size();
+  r->pending = 0;
+  r->waitStart = 0;
+  return r;
+}
+
+void AutoMergingSearcher::enterRegion(ExecutionState *es, Region *r) {
+  stateRegions[es].push_back(r);
+  ++r->pending;
+}
+
+void AutoMergingSearcher::leaveRegion(Region *r) {
+  assert(r->pending && "leaving a region no state is in");
+  // Once no state is left to arrive, the waiting ones are merged by the
+  // next selectState().
+  if (!--r->pending && r->waiting.empty())
+    delete r;
+}
+
+void AutoMergingSearcher::removeRegionState(ExecutionState *es) {
+  std::map<ExecutionState*, Region*>::iterator it = waitingStates.find(es);
+  if (it != waitingStates.end()) {
+    Region *r = it->second;
+    waitingStates.erase(it);
+    r->waiting.erase(std::find(r->waiting.begin(), r->waiting.end(), es));
+    if (r->waiting.empty()) {
+      waitingRegions.erase(r->id);
+      if (!r->pending)
+        delete r;
+    }
+  }
+
+  std::map<ExecutionState*, std::vector<Region*> >::iterator it2 =
+    stateRegions.find(es);
+  if (it2 != stateRegions.end()) {
+    std::vector<Region*> regions;
+    regions.swap(it2->second);
+    stateRegions.erase(it2);
+    for (std::vector<Region*>::iterator it = regions.begin(),
+           ie = regions.end(); it != ie; ++it)
+      leaveRegion(*it);
+  }
+}
+
+bool AutoMergingSearcher::isAtJoin(ExecutionState &es) {
+  std::map<ExecutionState*, std::vector<Region*> >::iterator it =
+    stateRegions.find(&es);
+  if (it == stateRegions.end())
+    return false;
+
+  // Drop the regions of frames the state returned from.
+  std::vector<Region*> &regions = it->second;
+  while (!regions.empty() && regions.back()->depth > es.stack.size()) {
+    Region *r = regions.back();
+    regions.pop_back();
+    leaveRegion(r);
+  }
+
+  return !regions.empty() && regions.back()->depth == es.stack.size() &&
+    regions.back()->join == es.pc->inst;
+}
+
+void AutoMergingSearcher::wait(ExecutionState &es) {
+  std::vector<Region*> &regions = stateRegions[&es];
+  Region *r = regions.back();
+  regions.pop_back();
+
+  baseSearcher->removeState(&es, &es);
+  if (r->waiting.empty()) {
+    r->waitStart = stats::instructions;
+    waitingRegions.insert(std::make_pair(r->id, r));
+  }
+  r->waiting.push_back(&es);
+  waitingStates.insert(std::make_pair(&es, r));
+  --r->pending;
+}
+
+void AutoMergingSearcher::mergeRegion(Region *r) {
+  std::vector<ExecutionState*> toMerge;
+  toMerge.swap(r->waiting);
+  waitingRegions.erase(r->id);
+  for (std::vector<ExecutionState*>::iterator it = toMerge.begin(),
+         ie = toMerge.end(); it != ie; ++it)
+    waitingStates.erase(*it);
+
+  if (DebugLogMerge) {
+    const InstructionInfo &ii = executor.kmodule->infos->getInfo(r->join);
+    llvm::errs() << "-- merging " << toMerge.size() << " states at ";
+    if (ii.file != "")
+      llvm::errs() << ii.file << ":" << ii.line;
+    else
+      llvm::errs() << "assembly.ll:" << ii.assemblyLine;
+    llvm::errs() << " --\n";
+  }
+
+  while (!toMerge.empty()) {
+    ExecutionState *base = toMerge.front();
+    executor.reloadState(*base);
+
+    std::vector<ExecutionState*> rest;
+    for (std::vector<ExecutionState*>::iterator it = toMerge.begin() + 1,
+           ie = toMerge.end(); it != ie; ++it) {
+      ExecutionState *mergeWith = *it;
+      executor.reloadState(*mergeWith);
+
+      // Merging saves a state, and the paths it would fork later; take
+      // that to be worth a fixed amount of extra solver work.
+      if (getMergeCost(*base, *mergeWith, AutoMergeMaxItes) <=
+            AutoMergeMaxItes && base->merge(*mergeWith)) {
+        if (DebugLogMerge)
+          llvm::errs() << "\tmerged: " << base << " with " << mergeWith
+                       << "\n";
+        mergedStates.insert(mergeWith);
+        executor.terminateState(*mergeWith);
+      } else {
+        rest.push_back(mergeWith);
+      }
+    }
+
+    // Carry on from the join.
+    baseSearcher->addState(base);
+    toMerge.swap(rest);
+  }
+
+  if (!r->pending)
+    delete r;
+}
+
+ExecutionState &AutoMergingSearcher::selectState() {
+  for (;;) {
+    // Merge the regions all states have arrived at or left, and stop
+    // waiting for the states that take too long.
+    std::vector<Region*> ready;
+    for (std::map<uint64_t, Region*>::iterator it = waitingRegions.begin(),
+           ie = waitingRegions.end(); it != ie; ++it) {
+      Region *r = it->second;
+      if (!r->pending || stats::instructions - r->waitStart > AutoMergeMaxWait)
+        ready.push_back(r);
+    }
+    for (std::vector<Region*>::iterator it = ready.begin(), ie = ready.end();
+         it != ie; ++it)
+      mergeRegion(*it);
+
+    if (baseSearcher->empty()) {
+      // Everything left is waiting; the innermost region goes first.
+      assert(!waitingRegions.empty() && "selecting from an empty searcher");
+      mergeRegion(waitingRegions.rbegin()->second);
+      continue;
+    }
+
+    ExecutionState &es = baseSearcher->selectState();
+    if (!isAtJoin(es))
+      return es;
+    wait(es);
+  }
+}
+
+void AutoMergingSearcher::update(ExecutionState *current,
+                                 const std::set<ExecutionState*> &addedStates,
+                                 const std::set<ExecutionState*> &removedStates) {
+  if (!addedStates.empty()) {
+    if (current) {
+      // Forked states are in the regions of the state they came from,
+      // and in a new one if it forked at a branch.
+      std::vector<Region*> regions;
+      std::map<ExecutionState*, std::vector<Region*> >::iterator it =
+        stateRegions.find(current);
+      if (it != stateRegions.end())
+        regions = it->second;
+      Region *r = createRegion(*current);
+      if (r)
+        enterRegion(current, r);
+      for (std::set<ExecutionState*>::const_iterator it2 = addedStates.begin(),
+             ie = addedStates.end(); it2 != ie; ++it2) {
+        for (std::vector<Region*>::iterator it3 = regions.begin(),
+               ie3 = regions.end(); it3 != ie3; ++it3)
+          enterRegion(*it2, *it3);
+        if (r)
+          enterRegion(*it2, r);
+      }
+    } else {
+      // States resumed after a parked branch come back together with the
+      // state they forked, if any, which is their sibling in the process
+      // tree.
+      std::vector<ExecutionState*> resumed;
+      for (std::set<ExecutionState*>::const_iterator it = addedStates.begin(),
+             ie = addedStates.end(); it != ie; ++it)
+        if (parkedStates.erase(*it))
+          resumed.push_back(*it);
+      for (std::vector<ExecutionState*>::iterator it = resumed.begin(),
+             ie = resumed.end(); it != ie; ++it) {
+        ExecutionState *es = *it;
+        PTreeNode *parent = es->ptreeNode->parent;
+        if (!parent)
+          continue;
+        PTreeNode *sibling =
+          parent->left == es->ptreeNode ? parent->right : parent->left;
+        ExecutionState *forked = sibling->left ? 0 : sibling->data;
+        if (!forked || !addedStates.count(forked) ||
+            std::find(resumed.begin(), resumed.end(), forked) != resumed.end())
+          continue;
+
+        std::vector<Region*> regions;
+        std::map<ExecutionState*, std::vector<Region*> >::iterator it2 =
+          stateRegions.find(es);
+        if (it2 != stateRegions.end())
+          regions = it2->second;
+        Region *r = createRegion(*es);
+        if (r)
+          enterRegion(es, r);
+        for (std::vector<Region*>::iterator it3 = regions.begin(),
+               ie3 = regions.end(); it3 != ie3; ++it3)
+          enterRegion(forked, *it3);
+        if (r)
+          enterRegion(forked, r);
+      }
+    }
+  }
+
+  // The base searcher knows neither the waiting nor the merged states.
+  std::set<ExecutionState*> alt;
+  for (std::set<ExecutionState*>::const_iterator it = removedStates.begin(),
+         ie = removedStates.end(); it != ie; ++it) {
+    ExecutionState *es = *it;
+    if (!mergedStates.erase(es) && !waitingStates.count(es))
+      alt.insert(es);
+    // A state parked on a branch query comes back, and may still arrive
+    // at the joins of its regions.
+    if (executor.parkedStates.count(es))
+      parkedStates.insert(es);
+    else
+      removeRegionState(es);
+  }
+  baseSearcher->update(current, addedStates, alt);
+}
+
+///
+
 BatchingSearcher::BatchingSearcher(Searcher *_baseSearcher,
                                    double _timeBudget,
                                    unsigned _instructionBudget) 
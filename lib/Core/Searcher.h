@@ -20,6 +20,7 @@ namespace llvm {
   class BasicBlock;
   class Function;
   class Instruction;
+  class PostDominatorTree;
   class raw_ostream;
 }
 
@@ -76,7 +77,8 @@ namespace klee {
       NURS_Depth,
       NURS_ICnt,
       NURS_CPICnt,
-      NURS_QC
+      NURS_QC,
+      NURS_CovQC
     };
   };
 
@@ -130,15 +132,25 @@ namespace klee {
       InstCount,
       CPInstCount,
       MinDistToUncovered,
-      CoveringNew
+      CoveringNew,
+      CoveringNewPerQueryCost
     };
 
   private:
     DiscretePDF<ExecutionState*> *states;
     WeightType type;
     bool updateWeights;
+    /// With --weight-update-interval, the state whose weight may be out
+    /// of date, the instructions it ran since and its stack depth when
+    /// last refreshed.
+    ExecutionState *stale;
+    unsigned staleSteps;
+    unsigned staleDepth;
     
     double getWeight(ExecutionState*);
+    /// The average solver time, in seconds, of the queries issued at the
+    /// state's next instruction or else in its call path.
+    double getPredictedQueryCost(ExecutionState*);
 
   public:
     WeightedRandomSearcher(WeightType type);
@@ -158,6 +170,7 @@ namespace klee {
       case CPInstCount        : os << "CPInstCount\n"; return;
       case MinDistToUncovered : os << "MinDistToUncovered\n"; return;
       case CoveringNew        : os << "CoveringNew\n"; return;
+      case CoveringNewPerQueryCost : os << "CoveringNewPerQueryCost\n"; return;
       default                 : os << "<unknown type>\n"; return;
       }
     }
@@ -226,6 +239,73 @@ namespace klee {
     }
   };
 
+  /// AutoMergingSearcher - Merges states at the points where the paths
+  /// of a branch join again, without klee_merge() annotations.
+  ///
+  /// When a state forks at a conditional branch, the states share a merge
+  /// region ending at the first non-PHI instruction of the immediate
+  /// post-dominator of the branch; branches inside a loop the region
+  /// does not leave get none. States reaching the end of a region wait
+  /// there, until every state forked into it has arrived or left, and
+  /// are then merged into ite expressions, as long as the extra solver
+  /// work stays under a fixed threshold (see --auto-merge-max-ites).
+  class AutoMergingSearcher : public Searcher {
+    struct Region {
+      uint64_t id;
+      llvm::Instruction *join;
+      /// The stack depth of the frame that forked.
+      unsigned depth;
+      /// The number of states that may still arrive at the join.
+      unsigned pending;
+      /// The instruction count when the first waiting state arrived.
+      uint64_t waitStart;
+      std::vector<ExecutionState*> waiting;
+    };
+
+    Executor &executor;
+    Searcher *baseSearcher;
+    uint64_t nextRegionId;
+
+    /// The regions each state is in, innermost last.
+    std::map<ExecutionState*, std::vector<Region*> > stateRegions;
+    /// The regions with waiting states, by id.
+    std::map<uint64_t, Region*> waitingRegions;
+    std::map<ExecutionState*, Region*> waitingStates;
+    /// States merged away, waiting for the executor to remove them.
+    std::set<ExecutionState*> mergedStates;
+    /// States parked on an asynchronous branch query, which keep their
+    /// regions until they come back.
+    std::set<ExecutionState*> parkedStates;
+
+    std::map<llvm::Function*, llvm::PostDominatorTree*> postDominators;
+    std::map<llvm::BasicBlock*, llvm::Instruction*> joinPoints;
+
+  private:
+    llvm::Instruction *getJoinPoint(llvm::BasicBlock *bb);
+    Region *createRegion(ExecutionState &es);
+    void enterRegion(ExecutionState *es, Region *r);
+    void leaveRegion(Region *r);
+    void removeRegionState(ExecutionState *es);
+    bool isAtJoin(ExecutionState &es);
+    void wait(ExecutionState &es);
+    void mergeRegion(Region *r);
+
+  public:
+    AutoMergingSearcher(Executor &executor, Searcher *baseSearcher);
+    ~AutoMergingSearcher();
+
+    ExecutionState &selectState();
+    void update(ExecutionState *current,
+                const std::set<ExecutionState*> &addedStates,
+                const std::set<ExecutionState*> &removedStates);
+    bool empty() { return baseSearcher->empty() && waitingStates.empty(); }
+    void printName(llvm::raw_ostream &os) {
+      os << "<AutoMergingSearcher> baseSearcher:\n";
+      baseSearcher->printName(os);
+      os << "</AutoMergingSearcher>\n";
+    }
+  };
+
   class BatchingSearcher : public Searcher {
     Searcher *baseSearcher;
     double timeBudget;
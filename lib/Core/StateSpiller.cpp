@@ -0,0 +1,347 @@
+//===-- StateSpiller.cpp --------------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "StateSpiller.h"
+
+#include "klee/ExecutionState.h"
+#include "klee/Internal/Support/ErrorHandling.h"
+
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+using namespace klee;
+
+namespace {
+  enum {
+    NullTag,
+    PinTag,
+    NodeTag
+  };
+}
+
+/***/
+
+void SpillWriter::writeU32(uint32_t value) {
+  for (unsigned i = 0; i != 4; ++i)
+    buffer.push_back(value >> (8 * i));
+}
+
+void SpillWriter::writeU64(uint64_t value) {
+  writeU32(value);
+  writeU32(value >> 32);
+}
+
+void SpillWriter::writeBytes(const void *data, unsigned size) {
+  const unsigned char *bytes = (const unsigned char*) data;
+  buffer.insert(buffer.end(), bytes, bytes + size);
+}
+
+void SpillWriter::writeExpr(const ref<Expr> &e, unsigned extraRefs) {
+  if (e.isNull()) {
+    writeU8(NullTag);
+    return;
+  }
+
+  if (e->refCount > 1 + extraRefs) {
+    std::map<const Expr*, unsigned>::iterator it =
+      pinnedExprIds.insert(std::make_pair(e.get(),
+                                          pins.exprs.size())).first;
+    if (it->second == pins.exprs.size())
+      pins.exprs.push_back(e);
+    writeU8(PinTag);
+    writeU32(it->second);
+    return;
+  }
+
+  writeU8(NodeTag);
+  writeU8(e->getKind());
+  switch (e->getKind()) {
+  case Expr::Constant: {
+    const llvm::APInt &value = cast<ConstantExpr>(e)->getAPValue();
+    writeU32(value.getBitWidth());
+    for (unsigned i = 0; i != value.getNumWords(); ++i)
+      writeU64(value.getRawData()[i]);
+    break;
+  }
+  case Expr::Read: {
+    const ReadExpr *re = cast<ReadExpr>(e);
+    writeUpdates(re->updates);
+    writeExpr(re->index);
+    break;
+  }
+  case Expr::Extract: {
+    const ExtractExpr *ee = cast<ExtractExpr>(e);
+    writeU32(ee->offset);
+    writeU32(ee->width);
+    writeExpr(ee->expr);
+    break;
+  }
+  case Expr::ZExt:
+  case Expr::SExt:
+    writeU32(e->getWidth());
+    // getKid returns a new reference.
+    writeExpr(e->getKid(0), 1);
+    break;
+  default:
+    for (unsigned i = 0; i != e->getNumKids(); ++i)
+      writeExpr(e->getKid(i), 1);
+    break;
+  }
+}
+
+void SpillWriter::writeUpdates(const UpdateList &updates) {
+  writeU64((uintptr_t) updates.root);
+
+  // Write the updates only this list refers to, oldest first; the rest
+  // is pinned from the first shared update on.
+  std::vector<const UpdateNode*> fresh;
+  const UpdateNode *un = updates.head;
+  for (; un && !un->isShared(); un = un->next)
+    fresh.push_back(un);
+
+  writeU32(fresh.size());
+  if (un) {
+    std::map<const UpdateNode*, unsigned>::iterator it =
+      pinnedUpdateIds.insert(std::make_pair(un, pins.updates.size())).first;
+    if (it->second == pins.updates.size())
+      pins.updates.push_back(UpdateList(updates.root, un));
+    writeU8(PinTag);
+    writeU32(it->second);
+  } else {
+    writeU8(NullTag);
+  }
+  for (std::vector<const UpdateNode*>::reverse_iterator it = fresh.rbegin(),
+         ie = fresh.rend(); it != ie; ++it) {
+    writeExpr((*it)->index);
+    writeExpr((*it)->value);
+  }
+}
+
+/***/
+
+uint8_t SpillReader::readU8() {
+  assert(pos < end && "reading past the end of a spilled state");
+  return *pos++;
+}
+
+uint32_t SpillReader::readU32() {
+  uint32_t value = 0;
+  for (unsigned i = 0; i != 4; ++i)
+    value |= (uint32_t) readU8() << (8 * i);
+  return value;
+}
+
+uint64_t SpillReader::readU64() {
+  uint64_t low = readU32();
+  return low | ((uint64_t) readU32() << 32);
+}
+
+void SpillReader::readBytes(void *data, unsigned size) {
+  assert(size <= (unsigned) (end - pos) &&
+         "reading past the end of a spilled state");
+  memcpy(data, pos, size);
+  pos += size;
+}
+
+ref<Expr> SpillReader::readExpr() {
+  switch (readU8()) {
+  case NullTag:
+    return ref<Expr>();
+  case PinTag:
+    return pins.exprs[readU32()];
+  default:
+    break;
+  }
+
+  Expr::Kind kind = (Expr::Kind) readU8();
+  ref<Expr> res;
+  switch (kind) {
+  case Expr::Constant: {
+    unsigned width = readU32();
+    std::vector<uint64_t> words((width + 63) / 64);
+    for (unsigned i = 0; i != words.size(); ++i)
+      words[i] = readU64();
+    res = ConstantExpr::alloc(llvm::APInt(width, words.size(), &words[0]));
+    break;
+  }
+  case Expr::NotOptimized:
+    res = NotOptimizedExpr::alloc(readExpr());
+    break;
+  case Expr::Read: {
+    UpdateList updates = readUpdates();
+    res = ReadExpr::alloc(updates, readExpr());
+    break;
+  }
+  case Expr::Select: {
+    ref<Expr> c = readExpr(), t = readExpr();
+    res = SelectExpr::alloc(c, t, readExpr());
+    break;
+  }
+  case Expr::Concat: {
+    ref<Expr> l = readExpr();
+    res = ConcatExpr::alloc(l, readExpr());
+    break;
+  }
+  case Expr::Extract: {
+    unsigned offset = readU32();
+    Expr::Width width = readU32();
+    res = ExtractExpr::alloc(readExpr(), offset, width);
+    break;
+  }
+  case Expr::ZExt: {
+    Expr::Width width = readU32();
+    res = ZExtExpr::alloc(readExpr(), width);
+    break;
+  }
+  case Expr::SExt: {
+    Expr::Width width = readU32();
+    res = SExtExpr::alloc(readExpr(), width);
+    break;
+  }
+  case Expr::Not:
+    res = NotExpr::alloc(readExpr());
+    break;
+
+#define BINARY(K)                               \
+  case Expr::K: {                               \
+    ref<Expr> l = readExpr();                   \
+    res = K ## Expr::alloc(l, readExpr());      \
+    break;                                      \
+  }
+  BINARY(Add) BINARY(Sub) BINARY(Mul)
+  BINARY(UDiv) BINARY(SDiv) BINARY(URem) BINARY(SRem)
+  BINARY(And) BINARY(Or) BINARY(Xor)
+  BINARY(Shl) BINARY(LShr) BINARY(AShr)
+  BINARY(Eq) BINARY(Ne) BINARY(Ult) BINARY(Ule) BINARY(Ugt) BINARY(Uge)
+  BINARY(Slt) BINARY(Sle) BINARY(Sgt) BINARY(Sge)
+#undef BINARY
+
+  default:
+    assert(0 && "invalid kind in spilled state");
+  }
+
+  return res;
+}
+
+UpdateList SpillReader::readUpdates() {
+  const Array *root = (const Array*) (uintptr_t) readU64();
+  unsigned numFresh = readU32();
+  const UpdateNode *base = 0;
+  if (readU8() == PinTag)
+    base = pins.updates[readU32()].head;
+
+  UpdateList updates(root, base);
+  for (unsigned i = 0; i != numFresh; ++i) {
+    ref<Expr> index = readExpr();
+    updates.extend(index, readExpr());
+  }
+  return updates;
+}
+
+/***/
+
+StateSpiller::StateSpiller(const std::string &_prefix)
+  : prefix(_prefix), fd(-1), fileSize(0) {}
+
+StateSpiller::~StateSpiller() {
+  closeFile();
+}
+
+bool StateSpiller::openFile() {
+  std::string path = prefix + "XXXXXX";
+  std::vector<char> name(path.begin(), path.end());
+  name.push_back(0);
+  fd = mkstemp(&name[0]);
+  if (fd < 0) {
+    klee_warning("unable to create spill file %s: %s", path.c_str(),
+                 strerror(errno));
+    return false;
+  }
+  // The file goes away with the last descriptor, however KLEE exits.
+  unlink(&name[0]);
+  fileSize = 0;
+  return true;
+}
+
+void StateSpiller::closeFile() {
+  if (fd >= 0)
+    close(fd);
+  fd = -1;
+  fileSize = 0;
+}
+
+bool StateSpiller::spill(ExecutionState &state) {
+  assert(!state.spilled && "state already spilled");
+  if (fd < 0 && !openFile())
+    return false;
+
+  SpillWriter writer;
+  state.spill(writer);
+  const std::vector<unsigned char> &buffer = writer.getBuffer();
+
+  size_t written = 0;
+  while (written < buffer.size()) {
+    ssize_t res = pwrite(fd, &buffer[written], buffer.size() - written,
+                         fileSize + written);
+    if (res < 0 && errno == EINTR)
+      continue;
+    if (res <= 0) {
+      klee_warning_once(0, "unable to write spill file: %s", strerror(errno));
+      // Put the state back together from the buffer.
+      SpillReader reader(&buffer[0], buffer.size(), writer.getPins());
+      state.reload(reader);
+      if (records.empty())
+        closeFile();
+      return false;
+    }
+    written += res;
+  }
+
+  Record &record = records[&state];
+  record.offset = fileSize;
+  record.size = buffer.size();
+  record.pins = writer.getPins();
+  fileSize += buffer.size();
+  return true;
+}
+
+void StateSpiller::reload(ExecutionState &state) {
+  std::map<const ExecutionState*, Record>::iterator it = records.find(&state);
+  assert(it != records.end() && "state not spilled");
+
+  std::vector<unsigned char> buffer(it->second.size);
+  size_t read = 0;
+  while (read < buffer.size()) {
+    ssize_t res = pread(fd, &buffer[read], buffer.size() - read,
+                        it->second.offset + read);
+    if (res < 0 && errno == EINTR)
+      continue;
+    if (res <= 0)
+      klee_error("unable to read spill file: %s", strerror(errno));
+    read += res;
+  }
+
+  SpillReader reader(&buffer[0], buffer.size(), it->second.pins);
+  state.reload(reader);
+  assert(reader.atEnd() && "spilled state only partially reloaded");
+
+  records.erase(it);
+  // The space of reloaded states is reclaimed once the file is empty.
+  if (records.empty())
+    closeFile();
+}
+
+void StateSpiller::discard(ExecutionState &state) {
+  records.erase(&state);
+  if (records.empty())
+    closeFile();
+}
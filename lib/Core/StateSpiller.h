@@ -0,0 +1,120 @@
+//===-- StateSpiller.h ------------------------------------------*- C++ -*-===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef KLEE_STATESPILLER_H
+#define KLEE_STATESPILLER_H
+
+#include "klee/Expr.h"
+
+#include <map>
+#include <string>
+#include <vector>
+
+namespace klee {
+  class ExecutionState;
+
+  /// SpillPins - The expressions and updates a spilled state shares with
+  /// the rest of the run, kept in memory and referred to by index.
+  struct SpillPins {
+    std::vector< ref<Expr> > exprs;
+    /// Each list holds its head update, and with it the updates before.
+    std::vector<UpdateList> updates;
+  };
+
+  /// SpillWriter - Serializes the parts of a state that are written to
+  /// disk. Only the expression and update nodes the state holds the sole
+  /// reference to are written; a node referred to from elsewhere is
+  /// pinned, and with it everything below it. Arrays are immutable and
+  /// live for the whole run, so they are written by address.
+  class SpillWriter {
+    std::vector<unsigned char> buffer;
+    SpillPins pins;
+    std::map<const Expr*, unsigned> pinnedExprIds;
+    std::map<const UpdateNode*, unsigned> pinnedUpdateIds;
+
+  public:
+    void writeU8(uint8_t value) { buffer.push_back(value); }
+    void writeU32(uint32_t value);
+    void writeU64(uint64_t value);
+    void writeBytes(const void *data, unsigned size);
+    /// Write \arg e, which the caller refers to through \arg extraRefs
+    /// references besides the one the state holds.
+    void writeExpr(const ref<Expr> &e, unsigned extraRefs = 0);
+    void writeUpdates(const UpdateList &updates);
+
+    const std::vector<unsigned char> &getBuffer() const { return buffer; }
+    const SpillPins &getPins() const { return pins; }
+  };
+
+  /// SpillReader - Reads back what a SpillWriter wrote.
+  class SpillReader {
+    const unsigned char *pos, *end;
+    const SpillPins &pins;
+
+  public:
+    SpillReader(const unsigned char *data, unsigned size,
+                const SpillPins &_pins)
+      : pos(data), end(data + size), pins(_pins) {}
+
+    uint8_t readU8();
+    uint32_t readU32();
+    uint64_t readU64();
+    void readBytes(void *data, unsigned size);
+    ref<Expr> readExpr();
+    UpdateList readUpdates();
+
+    bool atEnd() const { return pos == end; }
+  };
+
+  /// StateSpiller - Moves the bulk of inactive states to a file and back.
+  ///
+  /// A spilled state keeps its place in the searcher and its stack frames,
+  /// address space bindings and process tree node, so searchers can still
+  /// look at it. Its constraints, registers, and the contents of the
+  /// object states it owns alone are written to disk, as far as they are
+  /// not shared: constraint chunks, update lists, expressions and pages
+  /// it shares with other states stay in memory. The state must be reloaded before
+  /// it is run, merged or terminated with a test case.
+  class StateSpiller {
+    struct Record {
+      uint64_t offset;
+      unsigned size;
+      SpillPins pins;
+    };
+
+    std::string prefix;
+    /// The spill file, open while it holds records.
+    int fd;
+    uint64_t fileSize;
+    std::map<const ExecutionState*, Record> records;
+
+    bool openFile();
+    void closeFile();
+
+  public:
+    /// Spill files are created, and immediately unlinked, at paths
+    /// starting with \arg prefix.
+    explicit StateSpiller(const std::string &prefix);
+    ~StateSpiller();
+
+    /// Write the bulk of the state to disk, returning false (and leaving
+    /// the state untouched) if the spill file cannot be written.
+    bool spill(ExecutionState &state);
+
+    /// Bring back a spilled state.
+    void reload(ExecutionState &state);
+
+    /// Forget a spilled state that is being deleted.
+    void discard(ExecutionState &state);
+
+    unsigned getNumSpilled() const { return records.size(); }
+  };
+}
+
+#endif
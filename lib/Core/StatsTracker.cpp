@@ -25,6 +25,7 @@
 #include "CoreStats.h"
 #include "Executor.h"
 #include "MemoryManager.h"
+#include "ReachableUncovered.h"
 #include "UserSearcher.h"
 
 #if LLVM_VERSION_CODE > LLVM_VERSION(3, 2)
@@ -57,7 +58,12 @@
 #include "llvm/IR/CFG.h"
 #endif
 
+#include <cerrno>
 #include <fstream>
+#include <sstream>
+#include <poll.h>
+#include <signal.h>
+#include <sys/wait.h>
 #include <unistd.h>
 
 using namespace klee;
@@ -103,6 +109,12 @@ namespace {
   UncoveredUpdateInterval("uncovered-update-interval",
                           cl::init(30.),
 			  cl::desc("(default=30.0s)"));
+
+  cl::opt<bool>
+  BackgroundUncoveredUpdate("background-uncovered-update",
+                            cl::init(false),
+                            cl::desc("Update the distances to uncovered instructions in a forked process, "
+                                     "while execution goes on (default=off)"));
   
   cl::opt<bool>
   UseCallPaths("use-call-paths",
@@ -151,6 +163,35 @@ namespace klee {
 
 //
 
+static bool writeAll(int fd, const void *buf, size_t size) {
+  const char *p = static_cast<const char*>(buf);
+  while (size) {
+    ssize_t n = write(fd, p, size);
+    if (n < 0) {
+      if (errno == EINTR)
+        continue;
+      return false;
+    }
+    p += n;
+    size -= n;
+  }
+  return true;
+}
+
+static bool readAll(int fd, void *buf, size_t size) {
+  char *p = static_cast<char*>(buf);
+  while (size) {
+    ssize_t n = read(fd, p, size);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      return false;
+    p += n;
+    size -= n;
+  }
+  return true;
+}
+
 /// Check for special cases where we statically know an instruction is
 /// uncoverable. Currently the case is an unreachable instruction
 /// following a noreturn call; the instruction is really only there to
@@ -184,7 +225,11 @@ StatsTracker::StatsTracker(Executor &_executor, std::string _objectFilename,
     numBranches(0),
     fullBranches(0),
     partialBranches(0),
-    updateMinDistToUncovered(_updateMinDistToUncovered) {
+    updateMinDistToUncovered(_updateMinDistToUncovered),
+    reachable(0),
+    startedUpdates(false),
+    updatePid(0),
+    updateFD(-1) {
   KModule *km = executor.kmodule;
 
   if (!sys::path::is_absolute(objectFilename)) {
@@ -252,6 +297,8 @@ StatsTracker::StatsTracker(Executor &_executor, std::string _objectFilename,
 }
 
 StatsTracker::~StatsTracker() {  
+  abandonBackgroundUpdate();
+  delete reachable;
   if (statsFile)
     delete statsFile;
   if (istatsFile)
@@ -265,6 +312,91 @@ void StatsTracker::done() {
     writeIStats();
 }
 
+void StatsTracker::openWorkerFiles(unsigned index) {
+  // The update process belongs to the parent, start our own.
+  if (updateFD >= 0) {
+    close(updateFD);
+    updateFD = -1;
+    std::vector<unsigned> covered, uncovered;
+    covered.swap(pendingCovered);
+    uncovered.swap(pendingUncovered);
+    if (!startBackgroundUpdate(covered, uncovered)) {
+      ReachableUncovered::changes_ty changes;
+      reachable->update(covered, uncovered, changes);
+      reachable->apply(changes);
+    }
+  }
+
+  std::stringstream prefix;
+  prefix << "run." << index;
+
+  if (statsFile) {
+    delete statsFile;
+    statsFile = executor.interpreterHandler->openOutputFile(prefix.str() +
+                                                            ".stats");
+    assert(statsFile && "unable to open statistics trace file");
+    writeStatsHeader();
+    writeStatsLine();
+  }
+
+  if (istatsFile) {
+    delete istatsFile;
+    istatsFile = executor.interpreterHandler->openOutputFile(prefix.str() +
+                                                             ".istats");
+    assert(istatsFile && "unable to open istats file");
+  }
+}
+
+void StatsTracker::getCoverage(std::vector<uint8_t> &coverage) {
+  if (!OutputIStats)
+    return;
+
+  StatisticManager &sm = *theStatisticManager;
+  coverage.assign(executor.kmodule->infos->getMaxID(), 0);
+  for (unsigned id = 0; id < coverage.size(); ++id) {
+    if (sm.getIndexedValue(stats::coveredInstructions, id))
+      coverage[id] |= CoveredFlag;
+    if (sm.getIndexedValue(stats::trueBranches, id))
+      coverage[id] |= TrueBranchFlag;
+    if (sm.getIndexedValue(stats::falseBranches, id))
+      coverage[id] |= FalseBranchFlag;
+  }
+}
+
+void StatsTracker::mergeCoverage(const std::vector<uint8_t> &coverage) {
+  if (!OutputIStats)
+    return;
+
+  // Same as stepInstruction and markBranchVisited, for what only the
+  // worker covered.
+  StatisticManager &sm = *theStatisticManager;
+  for (unsigned id = 0; id < coverage.size(); ++id) {
+    if ((coverage[id] & CoveredFlag) &&
+        !sm.getIndexedValue(stats::coveredInstructions, id)) {
+      sm.setIndexedValue(stats::coveredInstructions, id, 1);
+      sm.setIndexedValue(stats::uncoveredInstructions, id, 0);
+      sm.incrementGlobalValue(stats::coveredInstructions, 1);
+      sm.incrementGlobalValue(stats::uncoveredInstructions, (uint64_t) -1);
+    }
+
+    bool hasTrue = sm.getIndexedValue(stats::trueBranches, id);
+    bool hasFalse = sm.getIndexedValue(stats::falseBranches, id);
+    if ((coverage[id] & TrueBranchFlag) && !hasTrue) {
+      sm.setIndexedValue(stats::trueBranches, id, 1);
+      sm.incrementGlobalValue(stats::trueBranches, 1);
+      if (hasFalse) { ++fullBranches; --partialBranches; }
+      else ++partialBranches;
+      hasTrue = true;
+    }
+    if ((coverage[id] & FalseBranchFlag) && !hasFalse) {
+      sm.setIndexedValue(stats::falseBranches, id, 1);
+      sm.incrementGlobalValue(stats::falseBranches, 1);
+      if (hasTrue) { ++fullBranches; --partialBranches; }
+      else ++partialBranches;
+    }
+  }
+}
+
 void StatsTracker::stepInstruction(ExecutionState &es) {
   if (OutputIStats) {
     if (TrackInstructionTime) {
@@ -345,6 +477,14 @@ void StatsTracker::framePopped(ExecutionState &es) {
 }
 
 
+void StatsTracker::resumeInstruction(ExecutionState &es, KInstruction *ki) {
+  if (OutputIStats) {
+    theStatisticManager->setIndex(ki->info->id);
+    if (UseCallPaths)
+      theStatisticManager->setContext(&es.stack.back().callPathNode->statistics);
+  }
+}
+
 void StatsTracker::markBranchVisited(ExecutionState *visitedTrue, 
                                      ExecutionState *visitedFalse) {
   if (OutputIStats) {
@@ -388,6 +528,7 @@ void StatsTracker::writeStatsHeader() {
              << "'CexCacheTime',"
              << "'ForkTime',"
              << "'ResolveTime',"
+             << "'HiddenSolverTime',"
 #ifdef DEBUG
 	     << "'ArrayHashTime',"
 #endif
@@ -418,6 +559,7 @@ void StatsTracker::writeStatsLine() {
              << "," << stats::cexCacheTime / 1000000.
              << "," << stats::forkTime / 1000000.
              << "," << stats::resolveTime / 1000000.
+             << "," << stats::hiddenSolverTime / 1000000.
 #ifdef DEBUG
              << "," << stats::arrayHashTime / 1000000.
 #endif
@@ -590,26 +732,6 @@ void StatsTracker::writeIStats() {
 
 ///
 
-typedef std::map<Instruction*, std::vector<Function*> > calltargets_ty;
-
-static calltargets_ty callTargets;
-static std::map<Function*, std::vector<Instruction*> > functionCallers;
-static std::map<Function*, unsigned> functionShortestPath;
-
-static std::vector<Instruction*> getSuccs(Instruction *i) {
-  BasicBlock *bb = i->getParent();
-  std::vector<Instruction*> res;
-
-  if (i==bb->getTerminator()) {
-    for (succ_iterator it = succ_begin(bb), ie = succ_end(bb); it != ie; ++it)
-      res.push_back(it->begin());
-  } else {
-    res.push_back(++BasicBlock::iterator(i));
-  }
-
-  return res;
-}
-
 uint64_t klee::computeMinDistToUncovered(const KInstruction *ki,
                                          uint64_t minDistAtRA) {
   StatisticManager &sm = *theStatisticManager;
@@ -633,222 +755,115 @@ uint64_t klee::computeMinDistToUncovered(const KInstruction *ki,
 }
 
 void StatsTracker::computeReachableUncovered() {
-  KModule *km = executor.kmodule;
-  Module *m = km->module;
-  static bool init = true;
-  const InstructionInfoTable &infos = *km->infos;
-  StatisticManager &sm = *theStatisticManager;
-  
-  if (init) {
-    init = false;
-
-    // Compute call targets. It would be nice to use alias information
-    // instead of assuming all indirect calls hit all escaping
-    // functions, eh?
-    for (Module::iterator fnIt = m->begin(), fn_ie = m->end(); 
-         fnIt != fn_ie; ++fnIt) {
-      for (Function::iterator bbIt = fnIt->begin(), bb_ie = fnIt->end(); 
-           bbIt != bb_ie; ++bbIt) {
-        for (BasicBlock::iterator it = bbIt->begin(), ie = bbIt->end(); 
-             it != ie; ++it) {
-          if (isa<CallInst>(it) || isa<InvokeInst>(it)) {
-            CallSite cs(it);
-            if (isa<InlineAsm>(cs.getCalledValue())) {
-              // We can never call through here so assume no targets
-              // (which should be correct anyhow).
-              callTargets.insert(std::make_pair(it,
-                                                std::vector<Function*>()));
-            } else if (Function *target = getDirectCallTarget(cs)) {
-              callTargets[it].push_back(target);
-            } else {
-              callTargets[it] = 
-                std::vector<Function*>(km->escapingFunctions.begin(),
-                                       km->escapingFunctions.end());
-            }
-          }
-        }
-      }
+  if (!reachable)
+    reachable = new ReachableUncovered(executor.kmodule);
+
+  // Take the result of the last update if it is done, or keep using the
+  // current distances until it is.
+  if (updateFD >= 0 && !finishBackgroundUpdate()) {
+    updateFrameDistances();
+    return;
+  }
+
+  std::vector<unsigned> covered, uncovered;
+  if (reachable->takeCoverage(covered, uncovered)) {
+    // The first computation is needed right away.
+    if (!BackgroundUncoveredUpdate || !startedUpdates ||
+        !startBackgroundUpdate(covered, uncovered)) {
+      ReachableUncovered::changes_ty changes;
+      reachable->update(covered, uncovered, changes);
+      reachable->apply(changes);
     }
+    startedUpdates = true;
+  }
 
-    // Compute function callers as reflexion of callTargets.
-    for (calltargets_ty::iterator it = callTargets.begin(), 
-           ie = callTargets.end(); it != ie; ++it)
-      for (std::vector<Function*>::iterator fit = it->second.begin(), 
-             fie = it->second.end(); fit != fie; ++fit) 
-        functionCallers[*fit].push_back(it->first);
-
-    // Initialize minDistToReturn to shortest paths through
-    // functions. 0 is unreachable.
-    std::vector<Instruction *> instructions;
-    for (Module::iterator fnIt = m->begin(), fn_ie = m->end(); 
-         fnIt != fn_ie; ++fnIt) {
-      if (fnIt->isDeclaration()) {
-        if (fnIt->doesNotReturn()) {
-          functionShortestPath[fnIt] = 0;
-        } else {
-          functionShortestPath[fnIt] = 1; // whatever
-        }
-      } else {
-        functionShortestPath[fnIt] = 0;
-      }
+  updateFrameDistances();
+}
 
-      // Not sure if I should bother to preorder here. XXX I should.
-      for (Function::iterator bbIt = fnIt->begin(), bb_ie = fnIt->end(); 
-           bbIt != bb_ie; ++bbIt) {
-        for (BasicBlock::iterator it = bbIt->begin(), ie = bbIt->end(); 
-             it != ie; ++it) {
-          instructions.push_back(it);
-          unsigned id = infos.getInfo(it).id;
-          sm.setIndexedValue(stats::minDistToReturn, 
-                             id, 
-                             isa<ReturnInst>(it)
-#if LLVM_VERSION_CODE < LLVM_VERSION(3, 1)
-                             || isa<UnwindInst>(it)
-#endif
-                             );
-        }
-      }
-    }
-  
-    std::reverse(instructions.begin(), instructions.end());
-    
-    // I'm so lazy it's not even worklisted.
-    bool changed;
-    do {
-      changed = false;
-      for (std::vector<Instruction*>::iterator it = instructions.begin(),
-             ie = instructions.end(); it != ie; ++it) {
-        Instruction *inst = *it;
-        unsigned bestThrough = 0;
-
-        if (isa<CallInst>(inst) || isa<InvokeInst>(inst)) {
-          std::vector<Function*> &targets = callTargets[inst];
-          for (std::vector<Function*>::iterator fnIt = targets.begin(),
-                 ie = targets.end(); fnIt != ie; ++fnIt) {
-            uint64_t dist = functionShortestPath[*fnIt];
-            if (dist) {
-              dist = 1+dist; // count instruction itself
-              if (bestThrough==0 || dist<bestThrough)
-                bestThrough = dist;
-            }
-          }
-        } else {
-          bestThrough = 1;
-        }
-       
-        if (bestThrough) {
-          unsigned id = infos.getInfo(*it).id;
-          uint64_t best, cur = best = sm.getIndexedValue(stats::minDistToReturn, id);
-          std::vector<Instruction*> succs = getSuccs(*it);
-          for (std::vector<Instruction*>::iterator it2 = succs.begin(),
-                 ie = succs.end(); it2 != ie; ++it2) {
-            uint64_t dist = sm.getIndexedValue(stats::minDistToReturn,
-                                               infos.getInfo(*it2).id);
-            if (dist) {
-              uint64_t val = bestThrough + dist;
-              if (best==0 || val<best)
-                best = val;
-            }
-          }
-          // there's a corner case here when a function only includes a single
-          // instruction (a ret). in that case, we MUST update
-          // functionShortestPath, or it will remain 0 (erroneously indicating
-          // that no return instructions are reachable)
-          Function *f = inst->getParent()->getParent();
-          if (best != cur
-              || (inst == f->begin()->begin()
-                  && functionShortestPath[f] != best)) {
-            sm.setIndexedValue(stats::minDistToReturn, id, best);
-            changed = true;
-
-            // Update shortest path if this is the entry point.
-            if (inst==f->begin()->begin())
-              functionShortestPath[f] = best;
-          }
-        }
-      }
-    } while (changed);
+bool StatsTracker::startBackgroundUpdate(const std::vector<unsigned> &covered,
+                                         const std::vector<unsigned> &uncovered) {
+  int fds[2];
+  if (pipe(fds) < 0)
+    return false;
+
+  // Anything still buffered would otherwise be written twice.
+  llvm::outs().flush();
+  llvm::errs().flush();
+  fflush(0);
+
+  pid_t pid = fork();
+  if (pid < 0) {
+    close(fds[0]);
+    close(fds[1]);
+    return false;
   }
 
-  // compute minDistToUncovered, 0 is unreachable
-  std::vector<Instruction *> instructions;
-  for (Module::iterator fnIt = m->begin(), fn_ie = m->end(); 
-       fnIt != fn_ie; ++fnIt) {
-    // Not sure if I should bother to preorder here.
-    for (Function::iterator bbIt = fnIt->begin(), bb_ie = fnIt->end(); 
-         bbIt != bb_ie; ++bbIt) {
-      for (BasicBlock::iterator it = bbIt->begin(), ie = bbIt->end(); 
-           it != ie; ++it) {
-        unsigned id = infos.getInfo(it).id;
-        instructions.push_back(&*it);
-        sm.setIndexedValue(stats::minDistToUncovered, 
-                           id, 
-                           sm.getIndexedValue(stats::uncoveredInstructions, id));
-      }
-    }
+  if (pid == 0) {
+    close(fds[0]);
+    ReachableUncovered::changes_ty changes;
+    reachable->update(covered, uncovered, changes);
+    uint64_t size = changes.size();
+    if (!writeAll(fds[1], &size, sizeof size) ||
+        (size && !writeAll(fds[1], &changes[0], size * sizeof(changes[0]))))
+      _exit(1);
+    _exit(0);
   }
-  
-  std::reverse(instructions.begin(), instructions.end());
-  
-  // I'm so lazy it's not even worklisted.
-  bool changed;
-  do {
-    changed = false;
-    for (std::vector<Instruction*>::iterator it = instructions.begin(),
-           ie = instructions.end(); it != ie; ++it) {
-      Instruction *inst = *it;
-      uint64_t best, cur = best = sm.getIndexedValue(stats::minDistToUncovered, 
-                                                     infos.getInfo(inst).id);
-      unsigned bestThrough = 0;
-      
-      if (isa<CallInst>(inst) || isa<InvokeInst>(inst)) {
-        std::vector<Function*> &targets = callTargets[inst];
-        for (std::vector<Function*>::iterator fnIt = targets.begin(),
-               ie = targets.end(); fnIt != ie; ++fnIt) {
-          uint64_t dist = functionShortestPath[*fnIt];
-          if (dist) {
-            dist = 1+dist; // count instruction itself
-            if (bestThrough==0 || dist<bestThrough)
-              bestThrough = dist;
-          }
 
-          if (!(*fnIt)->isDeclaration()) {
-            uint64_t calleeDist = sm.getIndexedValue(stats::minDistToUncovered,
-                                                     infos.getFunctionInfo(*fnIt).id);
-            if (calleeDist) {
-              calleeDist = 1+calleeDist; // count instruction itself
-              if (best==0 || calleeDist<best)
-                best = calleeDist;
-            }
-          }
-        }
-      } else {
-        bestThrough = 1;
-      }
-      
-      if (bestThrough) {
-        std::vector<Instruction*> succs = getSuccs(inst);
-        for (std::vector<Instruction*>::iterator it2 = succs.begin(),
-               ie = succs.end(); it2 != ie; ++it2) {
-          uint64_t dist = sm.getIndexedValue(stats::minDistToUncovered,
-                                             infos.getInfo(*it2).id);
-          if (dist) {
-            uint64_t val = bestThrough + dist;
-            if (best==0 || val<best)
-              best = val;
-          }
-        }
-      }
+  close(fds[1]);
+  updatePid = pid;
+  updateFD = fds[0];
+  pendingCovered = covered;
+  pendingUncovered = uncovered;
+  return true;
+}
 
-      if (best != cur) {
-        sm.setIndexedValue(stats::minDistToUncovered, 
-                           infos.getInfo(inst).id, 
-                           best);
-        changed = true;
-      }
-    }
-  } while (changed);
+bool StatsTracker::finishBackgroundUpdate() {
+  struct pollfd pfd;
+  pfd.fd = updateFD;
+  pfd.events = POLLIN;
+  pfd.revents = 0;
+  int res;
+  while ((res = poll(&pfd, 1, 0)) < 0 && errno == EINTR)
+    ;
+  if (res == 0)
+    return false;
+
+  ReachableUncovered::changes_ty changes;
+  uint64_t size;
+  bool success = readAll(updateFD, &size, sizeof size);
+  if (success && size) {
+    changes.resize(size);
+    success = readAll(updateFD, &changes[0], size * sizeof(changes[0]));
+  }
+  close(updateFD);
+  updateFD = -1;
+  int status;
+  while (waitpid(updatePid, &status, 0) < 0 && errno == EINTR)
+    ;
+
+  // If the process died, redo its work here.
+  if (!success) {
+    changes.clear();
+    reachable->update(pendingCovered, pendingUncovered, changes);
+  }
+  reachable->apply(changes);
+  pendingCovered.clear();
+  pendingUncovered.clear();
+  return true;
+}
+
+void StatsTracker::abandonBackgroundUpdate() {
+  if (updateFD < 0)
+    return;
+  kill(updatePid, SIGKILL);
+  close(updateFD);
+  updateFD = -1;
+  int status;
+  while (waitpid(updatePid, &status, 0) < 0 && errno == EINTR)
+    ;
+}
 
+void StatsTracker::updateFrameDistances() {
   for (std::set<ExecutionState*>::iterator it = executor.states.begin(),
          ie = executor.states.end(); it != ie; ++it) {
     ExecutionState *es = *it;
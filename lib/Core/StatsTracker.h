@@ -13,6 +13,7 @@
 #include "CallPathManager.h"
 
 #include <set>
+#include <vector>
 
 namespace llvm {
   class BranchInst;
@@ -26,6 +27,7 @@ namespace klee {
   class Executor;  
   class InstructionInfoTable;
   class InterpreterHandler;
+  class ReachableUncovered;
   struct KInstruction;
   struct StackFrame;
 
@@ -46,6 +48,21 @@ namespace klee {
 
     bool updateMinDistToUncovered;
 
+    ReachableUncovered *reachable;
+    bool startedUpdates;
+    /// The process updating the distances in the background and the pipe
+    /// it answers on, -1 if there is none.
+    int updatePid, updateFD;
+    /// The coverage changes the background update works on.
+    std::vector<unsigned> pendingCovered, pendingUncovered;
+
+    /// The flags of getCoverage().
+    enum {
+      CoveredFlag = 1,
+      TrueBranchFlag = 2,
+      FalseBranchFlag = 4
+    };
+
   public:
     static bool useStatistics();
 
@@ -55,6 +72,15 @@ namespace klee {
     void writeStatsLine();
     void writeIStats();
 
+    bool startBackgroundUpdate(const std::vector<unsigned> &covered,
+                               const std::vector<unsigned> &uncovered);
+    /// Apply the result of the background update if it is ready,
+    /// returning false if it is not.
+    bool finishBackgroundUpdate();
+    void abandonBackgroundUpdate();
+    /// Update minDistToUncoveredOnReturn in the frames of all states.
+    void updateFrameDistances();
+
   public:
     StatsTracker(Executor &_executor, std::string _objectFilename,
                  bool _updateMinDistToUncovered);
@@ -75,10 +101,27 @@ namespace klee {
     // called when execution is done and stats files should be flushed
     void done();
 
+    // called in a forked worker process (see --num-workers) so that it
+    // writes its own run.<index>.stats and run.<index>.istats files
+    void openWorkerFiles(unsigned index);
+
+    // get the instructions and branch directions covered so far, as
+    // flags by instruction id, for a worker to report to its parent
+    void getCoverage(std::vector<uint8_t> &coverage);
+
+    // add the coverage reported by a worker to our own, counting what
+    // several workers covered once
+    void mergeCoverage(const std::vector<uint8_t> &coverage);
+
     // process stats for a single instruction step, es is the state
     // about to be stepped
     void stepInstruction(ExecutionState &es);
 
+    // restore the statistics index and context of instruction ki, which
+    // es last stepped, to finish executing it after other states have
+    // been stepped
+    void resumeInstruction(ExecutionState &es, KInstruction *ki);
+
     /// Return time in seconds since execution start.
     double elapsed();
 
@@ -19,9 +19,25 @@
 
 #include "llvm/Support/TimeValue.h"
 
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
 using namespace klee;
 using namespace llvm;
 
+namespace {
+  /// What the process running an asynchronous query reports back.
+  struct AsyncResult {
+    int32_t success;
+    int32_t validity;
+    double solverTime;
+  };
+}
+
 /***/
 
 bool TimingSolver::evaluate(const ExecutionState& state, ref<Expr> expr,
@@ -42,6 +58,32 @@ bool TimingSolver::evaluate(const ExecutionState& state, ref<Expr> expr,
   sys::TimeValue delta = util::getWallTimeVal();
   delta -= now;
   stats::solverTime += delta.usec();
+  ++stats::solverQueries;
+  state.queryCost += delta.usec()/1000000.;
+
+  return success;
+}
+
+bool TimingSolver::evaluate(const ExecutionState& state,
+                            const std::vector< ref<Expr> > &exprs,
+                            std::vector<Solver::Validity> &results) {
+  sys::TimeValue now = util::getWallTimeVal();
+
+  bool success;
+  if (simplifyExprs) {
+    std::vector< ref<Expr> > simplified;
+    for (unsigned i = 0; i != exprs.size(); ++i)
+      simplified.push_back(isa<ConstantExpr>(exprs[i]) ? exprs[i] :
+                           state.constraints.simplifyExpr(exprs[i]));
+    success = solver->evaluate(state.constraints, simplified, results);
+  } else {
+    success = solver->evaluate(state.constraints, exprs, results);
+  }
+
+  sys::TimeValue delta = util::getWallTimeVal();
+  delta -= now;
+  stats::solverTime += delta.usec();
+  ++stats::solverQueries;
   state.queryCost += delta.usec()/1000000.;
 
   return success;
@@ -65,6 +107,7 @@ bool TimingSolver::mustBeTrue(const ExecutionState& state, ref<Expr> expr,
   sys::TimeValue delta = util::getWallTimeVal();
   delta -= now;
   stats::solverTime += delta.usec();
+  ++stats::solverQueries;
   state.queryCost += delta.usec()/1000000.;
 
   return success;
@@ -111,6 +154,7 @@ bool TimingSolver::getValue(const ExecutionState& state, ref<Expr> expr,
   sys::TimeValue delta = util::getWallTimeVal();
   delta -= now;
   stats::solverTime += delta.usec();
+  ++stats::solverQueries;
   state.queryCost += delta.usec()/1000000.;
 
   return success;
@@ -134,6 +178,7 @@ TimingSolver::getInitialValues(const ExecutionState& state,
   sys::TimeValue delta = util::getWallTimeVal();
   delta -= now;
   stats::solverTime += delta.usec();
+  ++stats::solverQueries;
   state.queryCost += delta.usec()/1000000.;
   
   return success;
@@ -143,3 +188,128 @@ std::pair< ref<Expr>, ref<Expr> >
 TimingSolver::getRange(const ExecutionState& state, ref<Expr> expr) {
   return solver->getRange(Query(state.constraints, expr));
 }
+
+SolverFuture *TimingSolver::evaluateAsync(const ExecutionState& state,
+                                          ref<Expr> expr) {
+  int p[2];
+  if (pipe(p) < 0)
+    return 0;
+
+  // Don't let the child flush our buffered output a second time.
+  fflush(stdout);
+  fflush(stderr);
+
+  pid_t pid = fork();
+  if (pid < 0) {
+    close(p[0]);
+    close(p[1]);
+    return 0;
+  }
+
+  if (pid == 0) {
+    close(p[0]);
+    AsyncResult res;
+    Solver::Validity validity = Solver::Unknown;
+    double start = util::getWallTime();
+
+    if (simplifyExprs)
+      expr = state.constraints.simplifyExpr(expr);
+    res.success = solver->evaluate(Query(state.constraints, expr), validity);
+    res.validity = validity;
+    res.solverTime = util::getWallTime() - start;
+
+    const char *buf = reinterpret_cast<const char*>(&res);
+    size_t size = sizeof res;
+    while (size) {
+      ssize_t n = write(p[1], buf, size);
+      if (n < 0 && errno == EINTR)
+        continue;
+      if (n <= 0)
+        _exit(1);
+      buf += n;
+      size -= n;
+    }
+    _exit(0);
+  }
+
+  close(p[1]);
+  return new SolverFuture(state, pid, p[0]);
+}
+
+void SolverFuture::receive() {
+  AsyncResult res;
+  char *buf = reinterpret_cast<char*>(&res);
+  size_t size = sizeof res;
+  while (size) {
+    ssize_t n = read(fd, buf, size);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      break;
+    buf += n;
+    size -= n;
+  }
+
+  // A process that died without answering counts as a failed query.
+  success = !size && res.success;
+  if (success) {
+    result = (Solver::Validity) res.validity;
+    solverTime = res.solverTime;
+  }
+
+  close(fd);
+  fd = -1;
+  int status;
+  while (waitpid(pid, &status, 0) < 0 && errno == EINTR)
+    ;
+  done = true;
+}
+
+SolverFuture::~SolverFuture() {
+  if (!done) {
+    kill(pid, SIGKILL);
+    close(fd);
+    int status;
+    while (waitpid(pid, &status, 0) < 0 && errno == EINTR)
+      ;
+  }
+}
+
+bool SolverFuture::isReady() {
+  if (!done) {
+    struct pollfd pfd;
+    pfd.fd = fd;
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+    if (poll(&pfd, 1, 0) > 0)
+      receive();
+  }
+  return done;
+}
+
+bool SolverFuture::get(Solver::Validity &res) {
+  if (!done) {
+    double start = util::getWallTime();
+    struct pollfd pfd;
+    pfd.fd = fd;
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+    while (poll(&pfd, 1, -1) < 0 && errno == EINTR)
+      ;
+    blockedTime = util::getWallTime() - start;
+    receive();
+  }
+
+  // Charged here rather than on receipt, when the branch is the current
+  // instruction again.
+  uint64_t usec = (uint64_t) (solverTime * 1000000.);
+  stats::solverTime += usec;
+  ++stats::solverQueries;
+  if (solverTime > blockedTime)
+    stats::hiddenSolverTime += (uint64_t) ((solverTime - blockedTime) *
+                                           1000000.);
+  state.queryCost += solverTime;
+
+  res = result;
+  return success;
+}
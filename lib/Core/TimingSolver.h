@@ -15,10 +15,46 @@
 
 #include <vector>
 
+#include <sys/types.h>
+
 namespace klee {
   class ExecutionState;
   class Solver;  
 
+  /// SolverFuture - The pending result of a validity query running in a
+  /// forked process, see TimingSolver::evaluateAsync(). Deleting an
+  /// unfinished future kills its process.
+  class SolverFuture {
+    friend class TimingSolver;
+
+    const ExecutionState &state;
+    pid_t pid;
+    int fd;
+    bool done, success;
+    Solver::Validity result;
+    /// The time the query took, as measured by the forked process.
+    double solverTime;
+    /// The time spent blocked waiting for the result.
+    double blockedTime;
+
+    SolverFuture(const ExecutionState &_state, pid_t _pid, int _fd)
+      : state(_state), pid(_pid), fd(_fd), done(false), success(false),
+        result(Solver::Unknown), solverTime(0), blockedTime(0) {}
+
+    void receive();
+
+  public:
+    ~SolverFuture();
+
+    /// Check, without blocking, whether the result is available.
+    bool isReady();
+
+    /// Wait for the result. Returns false if the query failed. The
+    /// solver time is charged to the current instruction, so this is
+    /// called once, with the branch current.
+    bool get(Solver::Validity &result);
+  };
+
   /// TimingSolver - A simple class which wraps a solver and handles
   /// tracking the statistics that we care about.
   class TimingSolver {
@@ -48,6 +84,15 @@ namespace klee {
 
     bool evaluate(const ExecutionState&, ref<Expr>, Solver::Validity &result);
 
+    bool evaluate(const ExecutionState&, const std::vector< ref<Expr> > &exprs,
+                  std::vector<Solver::Validity> &results);
+
+    /// Start evaluating \arg expr in a forked process, which sees the
+    /// solver and its caches as they are now. The state must stay alive
+    /// and unchanged until the result is retrieved. Returns null if the
+    /// process could not be created.
+    SolverFuture *evaluateAsync(const ExecutionState&, ref<Expr> expr);
+
     bool mustBeTrue(const ExecutionState&, ref<Expr>, bool &result);
 
     bool mustBeFalse(const ExecutionState&, ref<Expr>, bool &result);
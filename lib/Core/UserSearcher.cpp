@@ -31,6 +31,7 @@ namespace {
 			clEnumValN(Searcher::NURS_ICnt, "nurs:icnt", "use NURS with Instr-Count"),
 			clEnumValN(Searcher::NURS_CPICnt, "nurs:cpicnt", "use NURS with CallPath-Instr-Count"),
 			clEnumValN(Searcher::NURS_QC, "nurs:qc", "use NURS with Query-Cost"),
+			clEnumValN(Searcher::NURS_CovQC, "nurs:covqc", "use NURS with Coverage-New per predicted Query-Cost"),
 			clEnumValEnd));
 
   cl::opt<bool>
@@ -61,6 +62,10 @@ namespace {
   UseBumpMerge("use-bump-merge", 
            cl::desc("Enable support for klee_merge() (extra experimental)"));
 
+  cl::opt<bool>
+  UseAutoMerge("use-auto-merge",
+               cl::desc("Merge states where the paths of the branches they forked at join (experimental)"));
+
 }
 
 
@@ -69,7 +74,8 @@ bool klee::userSearcherRequiresMD2U() {
 	  std::find(CoreSearch.begin(), CoreSearch.end(), Searcher::NURS_CovNew) != CoreSearch.end() ||
 	  std::find(CoreSearch.begin(), CoreSearch.end(), Searcher::NURS_ICnt) != CoreSearch.end() ||
 	  std::find(CoreSearch.begin(), CoreSearch.end(), Searcher::NURS_CPICnt) != CoreSearch.end() ||
-	  std::find(CoreSearch.begin(), CoreSearch.end(), Searcher::NURS_QC) != CoreSearch.end());
+	  std::find(CoreSearch.begin(), CoreSearch.end(), Searcher::NURS_QC) != CoreSearch.end() ||
+	  std::find(CoreSearch.begin(), CoreSearch.end(), Searcher::NURS_CovQC) != CoreSearch.end());
 }
 
 
@@ -86,6 +92,7 @@ Searcher *getNewSearcher(Searcher::CoreSearchType type, Executor &executor) {
   case Searcher::NURS_ICnt: searcher = new WeightedRandomSearcher(WeightedRandomSearcher::InstCount); break;
   case Searcher::NURS_CPICnt: searcher = new WeightedRandomSearcher(WeightedRandomSearcher::CPInstCount); break;
   case Searcher::NURS_QC: searcher = new WeightedRandomSearcher(WeightedRandomSearcher::QueryCost); break;
+  case Searcher::NURS_CovQC: searcher = new WeightedRandomSearcher(WeightedRandomSearcher::CoveringNewPerQueryCost); break;
   }
 
   return searcher;
@@ -122,6 +129,14 @@ Searcher *klee::constructUserSearcher(Executor &executor) {
     searcher = new MergingSearcher(executor, searcher);
   } else if (UseBumpMerge) {
     searcher = new BumpMergingSearcher(executor, searcher);
+  } else if (UseAutoMerge) {
+    // Random path selection would pick the states waiting to be merged.
+    if (std::find(CoreSearch.begin(), CoreSearch.end(), Searcher::RandomPath) != CoreSearch.end())
+      klee_error("--use-auto-merge does not work with random-path search, which is on by default; pick others with --search");
+    // Paused states would leave their merge regions.
+    if (UseIterativeDeepeningTimeSearch)
+      klee_error("--use-auto-merge does not work with --use-iterative-deepening-time-search");
+    searcher = new AutoMergingSearcher(executor, searcher);
   }
   
   if (UseIterativeDeepeningTimeSearch) {
@@ -0,0 +1,425 @@
+//===-- CompiledConstraints.cpp -------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "klee/util/CompiledConstraints.h"
+
+#include "klee/util/Assignment.h"
+
+#include <algorithm>
+
+using namespace klee;
+
+static inline uint64_t getMask(unsigned width) {
+  return width == 64 ? ~0ULL : (1ULL << width) - 1;
+}
+
+static inline int64_t signExtend(uint64_t value, unsigned width) {
+  return (int64_t) (value << (64 - width)) >> (64 - width);
+}
+
+unsigned CompiledConstraints::emit(Opcode opcode, Expr::Width width,
+                                   unsigned a, unsigned b, unsigned c,
+                                   uint64_t imm) {
+  Instruction ins;
+  ins.opcode = opcode;
+  ins.width = width;
+  ins.isConstraint = false;
+  ins.ops[0] = a;
+  ins.ops[1] = b;
+  ins.ops[2] = c;
+  ins.imm = imm;
+  code.push_back(ins);
+  return code.size() - 1;
+}
+
+bool CompiledConstraints::addConstraint(ref<Expr> e) {
+  unsigned reg;
+  if (!valid || !compile(e, reg))
+    return valid = false;
+  code[reg].isConstraint = true;
+  constraints.push_back(e);
+  return true;
+}
+
+bool CompiledConstraints::compileRead(const ReadExpr *re, unsigned &result) {
+  unsigned index;
+  if (!compile(re->index, index))
+    return false;
+
+  const Array *root = re->updates.root;
+  if (root->getRange() > 64)
+    return false;
+  std::map<const Array*, unsigned>::iterator it = arraySlots.find(root);
+  unsigned slot;
+  if (it != arraySlots.end()) {
+    slot = it->second;
+  } else {
+    slot = arrays.size();
+    arraySlots.insert(std::make_pair(root, slot));
+    arrays.push_back(root);
+    constantArrays.push_back(std::vector<uint64_t>());
+    for (unsigned i = 0; i != root->constantValues.size(); ++i)
+      constantArrays.back().push_back(root->constantValues[i]->getZExtValue());
+  }
+  result = emit(Read, root->getRange(), index, 0, 0, slot);
+
+  // Apply the updates oldest first, so the newest matching one wins.
+  std::vector<const UpdateNode*> updates;
+  for (const UpdateNode *un = re->updates.head; un; un = un->next)
+    updates.push_back(un);
+  for (std::vector<const UpdateNode*>::reverse_iterator
+         it = updates.rbegin(), ie = updates.rend(); it != ie; ++it) {
+    unsigned updateIndex, updateValue;
+    if (!compile((*it)->index, updateIndex) ||
+        !compile((*it)->value, updateValue))
+      return false;
+    result = emit(Update, root->getRange(), index, updateIndex, updateValue,
+                  result);
+  }
+  return true;
+}
+
+bool CompiledConstraints::compile(ref<Expr> e, unsigned &result) {
+  std::map<const Expr*, unsigned>::iterator it = registers.find(e.get());
+  if (it != registers.end()) {
+    result = it->second;
+    return true;
+  }
+
+  Expr::Width width = e->getWidth();
+  if (width > 64)
+    return false;
+
+  unsigned kids[3];
+  unsigned numKids = e->getNumKids();
+  // Reads compile their own operands, through the update list.
+  if (!isa<ReadExpr>(e))
+    for (unsigned i = 0; i != numKids; ++i)
+      if (!compile(e->getKid(i), kids[i]))
+        return false;
+
+  switch (e->getKind()) {
+  case Expr::Constant:
+    result = emit(Constant, width, 0, 0, 0,
+                  cast<ConstantExpr>(e)->getZExtValue());
+    break;
+
+  case Expr::NotOptimized:
+  case Expr::ZExt:
+    // Registers hold zero-extended values.
+    result = kids[0];
+    break;
+
+  case Expr::Read:
+    if (!compileRead(cast<ReadExpr>(e), result))
+      return false;
+    break;
+
+  case Expr::Select:
+    result = emit(Select, width, kids[0], kids[1], kids[2]);
+    break;
+  case Expr::Concat:
+    result = emit(Concat, width, kids[0], kids[1], 0,
+                  e->getKid(1)->getWidth());
+    break;
+  case Expr::Extract:
+    result = emit(Extract, width, kids[0], 0, 0,
+                  cast<ExtractExpr>(e)->offset);
+    break;
+  case Expr::SExt:
+    result = emit(SExt, width, kids[0], 0, 0, e->getKid(0)->getWidth());
+    break;
+  case Expr::Not:
+    result = emit(Not, width, kids[0]);
+    break;
+
+  case Expr::Add:  result = emit(Add, width, kids[0], kids[1]); break;
+  case Expr::Sub:  result = emit(Sub, width, kids[0], kids[1]); break;
+  case Expr::Mul:  result = emit(Mul, width, kids[0], kids[1]); break;
+  case Expr::UDiv: result = emit(UDiv, width, kids[0], kids[1]); break;
+  case Expr::SDiv: result = emit(SDiv, width, kids[0], kids[1]); break;
+  case Expr::URem: result = emit(URem, width, kids[0], kids[1]); break;
+  case Expr::SRem: result = emit(SRem, width, kids[0], kids[1]); break;
+  case Expr::And:  result = emit(And, width, kids[0], kids[1]); break;
+  case Expr::Or:   result = emit(Or, width, kids[0], kids[1]); break;
+  case Expr::Xor:  result = emit(Xor, width, kids[0], kids[1]); break;
+  case Expr::Shl:  result = emit(Shl, width, kids[0], kids[1]); break;
+  case Expr::LShr: result = emit(LShr, width, kids[0], kids[1]); break;
+  case Expr::AShr: result = emit(AShr, width, kids[0], kids[1]); break;
+
+  // Comparisons keep the operand width, for the signed ones.
+  case Expr::Eq:
+    result = emit(Eq, width, kids[0], kids[1]);
+    break;
+  case Expr::Ne:
+    result = emit(Not, width, emit(Eq, width, kids[0], kids[1]));
+    break;
+  case Expr::Ult:
+    result = emit(Ult, width, kids[0], kids[1]);
+    break;
+  case Expr::Ule:
+    result = emit(Ule, width, kids[0], kids[1]);
+    break;
+  case Expr::Ugt:
+    result = emit(Ult, width, kids[1], kids[0]);
+    break;
+  case Expr::Uge:
+    result = emit(Ule, width, kids[1], kids[0]);
+    break;
+  case Expr::Slt:
+    result = emit(Slt, width, kids[0], kids[1], 0, e->getKid(0)->getWidth());
+    break;
+  case Expr::Sle:
+    result = emit(Sle, width, kids[0], kids[1], 0, e->getKid(0)->getWidth());
+    break;
+  case Expr::Sgt:
+    result = emit(Slt, width, kids[1], kids[0], 0, e->getKid(0)->getWidth());
+    break;
+  case Expr::Sge:
+    result = emit(Sle, width, kids[1], kids[0], 0, e->getKid(0)->getWidth());
+    break;
+
+  default:
+    return false;
+  }
+
+  registers.insert(std::make_pair(e.get(), result));
+  return true;
+}
+
+bool CompiledConstraints::satisfies(const Assignment &a) const {
+  const Assignment *assignments[1] = { &a };
+  bool result;
+  evaluateLanes(assignments, 1, &result);
+  return result;
+}
+
+void CompiledConstraints::satisfies(const Assignment *const *assignments,
+                                    unsigned n, bool *results) const {
+  for (unsigned i = 0; i < n; i += MaxLanes)
+    evaluateLanes(assignments + i, std::min(n - i, (unsigned) MaxLanes),
+                  results + i);
+}
+
+void CompiledConstraints::evaluateLanes(const Assignment *const *assignments,
+                                        unsigned n, bool *results) const {
+  assert(valid && "evaluating constraints that failed to compile");
+  assert(n <= MaxLanes);
+
+  // The bindings of every array read, per lane.
+  std::vector<const std::vector<unsigned char>*>
+    bound(arrays.size() * MaxLanes);
+  bool ok[MaxLanes];
+  for (unsigned l = 0; l != n; ++l) {
+    ok[l] = true;
+    for (unsigned slot = 0; slot != arrays.size(); ++slot) {
+      Assignment::bindings_ty::const_iterator it =
+        assignments[l]->bindings.find(arrays[slot]);
+      if (it != assignments[l]->bindings.end())
+        bound[slot * MaxLanes + l] = &it->second;
+    }
+  }
+
+  values.resize(code.size() * MaxLanes);
+  for (unsigned i = 0, e = code.size(); i != e; ++i) {
+    const Instruction &ins = code[i];
+    uint64_t *r = &values[i * MaxLanes];
+    const uint64_t *a = &values[ins.ops[0] * MaxLanes];
+    const uint64_t *b = &values[ins.ops[1] * MaxLanes];
+    const uint64_t *c = &values[ins.ops[2] * MaxLanes];
+    unsigned width = ins.width;
+    uint64_t mask = getMask(width);
+
+    switch (ins.opcode) {
+    case Constant:
+      for (unsigned l = 0; l != n; ++l)
+        r[l] = ins.imm;
+      break;
+
+    case Read: {
+      const std::vector<uint64_t> &constants = constantArrays[ins.imm];
+      for (unsigned l = 0; l != n; ++l) {
+        uint64_t index = a[l];
+        const std::vector<unsigned char> *binding =
+          bound[ins.imm * MaxLanes + l];
+        if (index < constants.size()) {
+          r[l] = constants[index];
+        } else if (binding && index < binding->size()) {
+          r[l] = (*binding)[index];
+        } else {
+          // A free value is not a concrete result.
+          if (assignments[l]->allowFreeValues)
+            ok[l] = false;
+          r[l] = 0;
+        }
+      }
+      break;
+    }
+    case Update: {
+      const uint64_t *older = &values[ins.imm * MaxLanes];
+      for (unsigned l = 0; l != n; ++l)
+        r[l] = a[l] == b[l] ? c[l] : older[l];
+      break;
+    }
+
+    case Select:
+      for (unsigned l = 0; l != n; ++l)
+        r[l] = a[l] ? b[l] : c[l];
+      break;
+    case Concat:
+      for (unsigned l = 0; l != n; ++l)
+        r[l] = (a[l] << ins.imm) | b[l];
+      break;
+    case Extract:
+      for (unsigned l = 0; l != n; ++l)
+        r[l] = (a[l] >> ins.imm) & mask;
+      break;
+    case SExt:
+      for (unsigned l = 0; l != n; ++l)
+        r[l] = (uint64_t) signExtend(a[l], ins.imm) & mask;
+      break;
+    case Not:
+      for (unsigned l = 0; l != n; ++l)
+        r[l] = ~a[l] & mask;
+      break;
+
+    case Add:
+      for (unsigned l = 0; l != n; ++l)
+        r[l] = (a[l] + b[l]) & mask;
+      break;
+    case Sub:
+      for (unsigned l = 0; l != n; ++l)
+        r[l] = (a[l] - b[l]) & mask;
+      break;
+    case Mul:
+      for (unsigned l = 0; l != n; ++l)
+        r[l] = (a[l] * b[l]) & mask;
+      break;
+
+    // The evaluator leaves a division by zero unevaluated, which never
+    // satisfies a constraint.
+    case UDiv:
+      for (unsigned l = 0; l != n; ++l) {
+        if (!b[l]) {
+          ok[l] = false;
+          r[l] = 0;
+        } else {
+          r[l] = a[l] / b[l];
+        }
+      }
+      break;
+    case URem:
+      for (unsigned l = 0; l != n; ++l) {
+        if (!b[l]) {
+          ok[l] = false;
+          r[l] = 0;
+        } else {
+          r[l] = a[l] % b[l];
+        }
+      }
+      break;
+    case SDiv:
+      for (unsigned l = 0; l != n; ++l) {
+        int64_t x = signExtend(a[l], width), y = signExtend(b[l], width);
+        if (!y) {
+          ok[l] = false;
+          r[l] = 0;
+        } else if (y == -1) {
+          // Avoid overflowing on the most negative value; negation wraps.
+          r[l] = (0 - a[l]) & mask;
+        } else {
+          r[l] = (uint64_t) (x / y) & mask;
+        }
+      }
+      break;
+    case SRem:
+      for (unsigned l = 0; l != n; ++l) {
+        int64_t x = signExtend(a[l], width), y = signExtend(b[l], width);
+        if (!y) {
+          ok[l] = false;
+          r[l] = 0;
+        } else if (y == -1) {
+          r[l] = 0;
+        } else {
+          r[l] = (uint64_t) (x % y) & mask;
+        }
+      }
+      break;
+
+    case And:
+      for (unsigned l = 0; l != n; ++l)
+        r[l] = a[l] & b[l];
+      break;
+    case Or:
+      for (unsigned l = 0; l != n; ++l)
+        r[l] = a[l] | b[l];
+      break;
+    case Xor:
+      for (unsigned l = 0; l != n; ++l)
+        r[l] = a[l] ^ b[l];
+      break;
+    case Shl:
+      for (unsigned l = 0; l != n; ++l)
+        r[l] = b[l] >= width ? 0 : (a[l] << b[l]) & mask;
+      break;
+    case LShr:
+      for (unsigned l = 0; l != n; ++l)
+        r[l] = b[l] >= width ? 0 : a[l] >> b[l];
+      break;
+    case AShr:
+      for (unsigned l = 0; l != n; ++l) {
+        int64_t x = signExtend(a[l], width);
+        if (b[l] >= width)
+          r[l] = x < 0 ? mask : 0;
+        else
+          r[l] = (uint64_t) (x >> b[l]) & mask;
+      }
+      break;
+
+    case Eq:
+      for (unsigned l = 0; l != n; ++l)
+        r[l] = a[l] == b[l];
+      break;
+    case Ult:
+      for (unsigned l = 0; l != n; ++l)
+        r[l] = a[l] < b[l];
+      break;
+    case Ule:
+      for (unsigned l = 0; l != n; ++l)
+        r[l] = a[l] <= b[l];
+      break;
+    case Slt:
+      for (unsigned l = 0; l != n; ++l)
+        r[l] = signExtend(a[l], ins.imm) < signExtend(b[l], ins.imm);
+      break;
+    case Sle:
+      for (unsigned l = 0; l != n; ++l)
+        r[l] = signExtend(a[l], ins.imm) <= signExtend(b[l], ins.imm);
+      break;
+
+    default:
+      assert(0 && "invalid opcode");
+    }
+
+    if (ins.isConstraint) {
+      bool any = false;
+      for (unsigned l = 0; l != n; ++l) {
+        if (!r[l])
+          ok[l] = false;
+        any |= ok[l];
+      }
+      // Stop as soon as every lane has failed a constraint.
+      if (!any)
+        break;
+    }
+  }
+
+  for (unsigned l = 0; l != n; ++l)
+    results[l] = ok[l];
+}
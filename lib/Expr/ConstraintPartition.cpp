@@ -0,0 +1,218 @@
+//===-- ConstraintPartition.cpp -------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "klee/util/ConstraintPartition.h"
+
+#include "klee/util/ExprUtil.h"
+
+#include <algorithm>
+
+using namespace klee;
+
+namespace {
+  /// The array bytes an expression reads: either a concrete index, or
+  /// the whole array for a symbolic index.
+  struct ArrayAccess {
+    const Array *array;
+    bool isWhole;
+    unsigned byte;
+  };
+
+  void findAccesses(ref<Expr> e, std::vector<ArrayAccess> &result) {
+    std::vector< ref<ReadExpr> > reads;
+    findReads(e, /* visitUpdates= */ true, reads);
+    for (unsigned i = 0; i != reads.size(); ++i) {
+      ReadExpr *re = reads[i].get();
+
+      // Reads of a constant array don't alias.
+      if (re->updates.root->isConstantArray() && !re->updates.head)
+        continue;
+
+      ArrayAccess access;
+      access.array = re->updates.root;
+      if (ConstantExpr *CE = dyn_cast<ConstantExpr>(re->index)) {
+        access.isWhole = false;
+        access.byte = (unsigned) CE->getZExtValue(32);
+      } else {
+        access.isWhole = true;
+        access.byte = 0;
+      }
+      result.push_back(access);
+    }
+  }
+}
+
+ConstraintPartition::ConstraintPartition(const ConstraintPartition &p)
+  : numConstraints(p.numConstraints), chunks(p.chunks), arrays(p.arrays),
+    refCount(0) {
+  for (std::vector<NodeChunk*>::iterator it = chunks.begin(),
+         ie = chunks.end(); it != ie; ++it)
+    ++(*it)->refCount;
+  for (arrays_ty::iterator it = arrays.begin(), ie = arrays.end();
+       it != ie; ++it)
+    ++it->second->refCount;
+}
+
+ConstraintPartition::~ConstraintPartition() {
+  for (std::vector<NodeChunk*>::iterator it = chunks.begin(),
+         ie = chunks.end(); it != ie; ++it)
+    if (--(*it)->refCount == 0)
+      delete *it;
+  for (arrays_ty::iterator it = arrays.begin(), ie = arrays.end();
+       it != ie; ++it)
+    if (--it->second->refCount == 0)
+      delete it->second;
+}
+
+ConstraintPartition::Node &
+ConstraintPartition::getWriteableNode(unsigned index) {
+  NodeChunk *&chunk = chunks[index / NodeChunk::Capacity];
+  if (chunk->refCount > 1) {
+    NodeChunk *copy = new NodeChunk(*chunk);
+    copy->refCount = 1;
+    --chunk->refCount;
+    chunk = copy;
+  }
+  return chunk->nodes[index % NodeChunk::Capacity];
+}
+
+ConstraintPartition::ArrayUsers &
+ConstraintPartition::getWriteableUsers(const Array *array) {
+  ArrayUsers *&users = arrays[array];
+  if (!users) {
+    users = new ArrayUsers();
+  } else if (users->refCount > 1) {
+    ArrayUsers *copy = new ArrayUsers(*users);
+    copy->refCount = 1;
+    --users->refCount;
+    users = copy;
+  }
+  return *users;
+}
+
+void ConstraintPartition::addConstraint(ref<Expr> e) {
+  unsigned index = numConstraints++;
+  if (index % NodeChunk::Capacity == 0)
+    chunks.push_back(new NodeChunk());
+  Node &node = getWriteableNode(index);
+  node.parent = index;
+  node.factorSize = 1;
+  node.next = index;
+
+  std::vector<ArrayAccess> accesses;
+  findAccesses(e, accesses);
+  for (std::vector<ArrayAccess>::iterator it = accesses.begin(),
+         ie = accesses.end(); it != ie; ++it)
+    touch(index, it->array, it->isWhole, it->byte);
+}
+
+void ConstraintPartition::touch(unsigned index, const Array *array,
+                                bool isWhole, unsigned byte) {
+  // Only copy the users of a shared array if they change.
+  arrays_ty::const_iterator ai = arrays.find(array);
+  if (ai != arrays.end()) {
+    const ArrayUsers &users = *ai->second;
+    if (users.isWhole) {
+      unite(index, users.whole);
+      return;
+    }
+    if (!isWhole) {
+      std::map<unsigned, unsigned>::const_iterator it =
+        users.bytes.find(byte);
+      if (it != users.bytes.end()) {
+        unite(index, it->second);
+        return;
+      }
+    }
+  }
+
+  ArrayUsers &users = getWriteableUsers(array);
+  if (isWhole) {
+    // From now on the array is a single element, so every constraint
+    // reading it joins one factor.
+    for (std::map<unsigned, unsigned>::iterator it = users.bytes.begin(),
+           ie = users.bytes.end(); it != ie; ++it)
+      unite(index, it->second);
+    users.bytes.clear();
+    users.isWhole = true;
+    users.whole = index;
+  } else {
+    users.bytes.insert(std::make_pair(byte, index));
+  }
+}
+
+unsigned ConstraintPartition::getFactor(unsigned index) const {
+  // Path halving, on the nodes no copy shares.
+  unsigned parent;
+  while ((parent = getNode(index).parent) != index) {
+    unsigned grandparent = getNode(parent).parent;
+    NodeChunk *chunk = chunks[index / NodeChunk::Capacity];
+    if (chunk->refCount == 1)
+      chunk->nodes[index % NodeChunk::Capacity].parent = grandparent;
+    index = grandparent;
+  }
+  return index;
+}
+
+void ConstraintPartition::unite(unsigned a, unsigned b) {
+  a = getFactor(a);
+  b = getFactor(b);
+  if (a == b)
+    return;
+
+  if (getNode(a).factorSize < getNode(b).factorSize)
+    std::swap(a, b);
+  Node &na = getWriteableNode(a);
+  Node &nb = getWriteableNode(b);
+  nb.parent = a;
+  na.factorSize += nb.factorSize;
+  // Splice the two circular member lists.
+  std::swap(na.next, nb.next);
+}
+
+void ConstraintPartition::getFactors(ref<Expr> e,
+                                     std::vector<unsigned> &result) const {
+  std::vector<ArrayAccess> accesses;
+  findAccesses(e, accesses);
+
+  std::vector<unsigned> factors;
+  for (std::vector<ArrayAccess>::iterator it = accesses.begin(),
+         ie = accesses.end(); it != ie; ++it) {
+    arrays_ty::const_iterator users = arrays.find(it->array);
+    if (users == arrays.end())
+      continue;
+
+    if (users->second->isWhole) {
+      factors.push_back(getFactor(users->second->whole));
+    } else if (it->isWhole) {
+      for (std::map<unsigned, unsigned>::const_iterator
+             bi = users->second->bytes.begin(),
+             be = users->second->bytes.end(); bi != be; ++bi)
+        factors.push_back(getFactor(bi->second));
+    } else {
+      std::map<unsigned, unsigned>::const_iterator bi =
+        users->second->bytes.find(it->byte);
+      if (bi != users->second->bytes.end())
+        factors.push_back(getFactor(bi->second));
+    }
+  }
+
+  std::sort(factors.begin(), factors.end());
+  factors.erase(std::unique(factors.begin(), factors.end()), factors.end());
+  result.insert(result.end(), factors.begin(), factors.end());
+}
+
+void ConstraintPartition::getMembers(unsigned factor,
+                                     std::vector<unsigned> &result) const {
+  unsigned index = factor;
+  do {
+    result.push_back(index);
+    index = getNode(index).next;
+  } while (index != factor);
+}
@@ -9,6 +9,7 @@
 
 #include "klee/Constraints.h"
 
+#include "klee/util/ConstraintPartition.h"
 #include "klee/util/ExprPPrinter.h"
 #include "klee/util/ExprVisitor.h"
 #if LLVM_VERSION_CODE >= LLVM_VERSION(3, 3)
@@ -19,6 +20,7 @@
 #include "llvm/Support/CommandLine.h"
 #include "klee/Internal/Module/KModule.h"
 
+#include <algorithm>
 #include <map>
 
 using namespace klee;
@@ -75,21 +77,179 @@ public:
   }
 };
 
+ConstraintManager::ConstraintManager(
+    const std::vector< ref<Expr> > &_constraints)
+  : tail(0), numConstraints(0), partition(0) {
+  for (std::vector< ref<Expr> >::const_iterator it = _constraints.begin(),
+         ie = _constraints.end(); it != ie; ++it)
+    push_back(*it);
+}
+
+ConstraintManager::ConstraintManager(const ConstraintManager &cs)
+  : tail(cs.tail), numConstraints(cs.numConstraints),
+    partition(cs.partition) {
+  if (tail)
+    ++tail->refCount;
+  if (partition)
+    ++partition->refCount;
+}
+
+ConstraintManager::~ConstraintManager() {
+  release(tail);
+  release(partition);
+}
+
+ConstraintManager &ConstraintManager::operator=(const ConstraintManager &cs) {
+  if (cs.tail)
+    ++cs.tail->refCount;
+  if (cs.partition)
+    ++cs.partition->refCount;
+  release(tail);
+  release(partition);
+  tail = cs.tail;
+  numConstraints = cs.numConstraints;
+  partition = cs.partition;
+  chunks.clear();
+  return *this;
+}
+
+void ConstraintManager::release(Chunk *chunk) {
+  // Iterative, as a long path would otherwise recurse once per chunk.
+  while (chunk && --chunk->refCount == 0) {
+    Chunk *prev = chunk->prev;
+    delete chunk;
+    chunk = prev;
+  }
+}
+
+void ConstraintManager::release(ConstraintPartition *partition) {
+  if (partition && --partition->refCount == 0)
+    delete partition;
+}
+
+ConstraintManager::Chunk *const *ConstraintManager::getChunks() const {
+  unsigned numChunks =
+      (numConstraints + Chunk::Capacity - 1) / Chunk::Capacity;
+  if (chunks.size() != numChunks || (numChunks && chunks.back() != tail)) {
+    chunks.resize(numChunks);
+    Chunk *chunk = tail;
+    for (unsigned i = numChunks; i != 0; chunk = chunk->prev)
+      chunks[--i] = chunk;
+  }
+  return chunks.empty() ? 0 : &chunks[0];
+}
+
+void ConstraintManager::push_back(ref<Expr> e) {
+  unsigned index = numConstraints % Chunk::Capacity;
+  if (index == 0) {
+    Chunk *chunk = new Chunk(tail);
+    release(tail);
+    tail = chunk;
+  } else if (tail->used != index) {
+    // Another set sharing the chunk has added constraints after ours.
+    Chunk *chunk = new Chunk(tail->prev);
+    for (unsigned i = 0; i != index; ++i)
+      chunk->elts[i] = tail->elts[i];
+    chunk->used = index;
+    release(tail);
+    tail = chunk;
+    // The old chunk may be freed, and its address reused for a later
+    // chunk, so don't leave it in the spine.
+    chunks.clear();
+  }
+
+  tail->elts[index] = e;
+  tail->used = index + 1;
+  ++numConstraints;
+}
+
+bool ConstraintManager::operator==(const ConstraintManager &other) const {
+  if (numConstraints != other.numConstraints)
+    return false;
+  if (tail == other.tail)
+    return true;
+  return std::equal(begin(), end(), other.begin());
+}
+
+const ConstraintPartition &ConstraintManager::getPartition() const {
+  if (!partition) {
+    partition = new ConstraintPartition();
+    partition->refCount = 1;
+  } else if (partition->refCount > 1 && partition->size() != numConstraints) {
+    // Copies share the partition of their common prefix; extend a private
+    // copy of it, which shares all it leaves unchanged.
+    ConstraintPartition *copy = new ConstraintPartition(*partition);
+    copy->refCount = 1;
+    release(partition);
+    partition = copy;
+  }
+
+  assert(partition->size() <= numConstraints && "partition out of date");
+  if (partition->size() != numConstraints) {
+    for (constraint_iterator it = begin() + partition->size(), ie = end();
+         it != ie; ++it)
+      partition->addConstraint(*it);
+  }
+  return *partition;
+}
+
+void ConstraintManager::truncate(unsigned n) {
+  assert(n <= numConstraints && "cannot grow a constraint set");
+  unsigned numChunks = (numConstraints + Chunk::Capacity - 1) / Chunk::Capacity;
+  unsigned newNumChunks = (n + Chunk::Capacity - 1) / Chunk::Capacity;
+
+  Chunk *chunk = tail;
+  for (; numChunks != newNumChunks; --numChunks)
+    chunk = chunk->prev;
+  if (chunk)
+    ++chunk->refCount;
+  release(tail);
+  tail = chunk;
+  numConstraints = n;
+  // Dropped chunks may be freed; see push_back().
+  chunks.clear();
+
+  if (partition && partition->size() > n) {
+    release(partition);
+    partition = 0;
+  }
+}
+
+void ConstraintManager::takeUnshared(std::vector< ref<Expr> > &removed) {
+  unsigned numChunks = (numConstraints + Chunk::Capacity - 1) / Chunk::Capacity;
+  Chunk *chunk = tail;
+  for (; chunk && chunk->refCount == 1; chunk = chunk->prev)
+    --numChunks;
+  unsigned n = std::min(numChunks * (unsigned) Chunk::Capacity,
+                        numConstraints);
+
+  removed.insert(removed.end(), begin() + n, end());
+  truncate(n);
+}
+
+void ConstraintManager::append(const std::vector< ref<Expr> > &constraints) {
+  for (std::vector< ref<Expr> >::const_iterator it = constraints.begin(),
+         ie = constraints.end(); it != ie; ++it)
+    push_back(*it);
+}
+
 bool ConstraintManager::rewriteConstraints(ExprVisitor &visitor) {
-  ConstraintManager::constraints_ty old;
+  std::vector< ref<Expr> > old(begin(), end());
   bool changed = false;
 
-  constraints.swap(old);
-  for (ConstraintManager::constraints_ty::iterator 
-         it = old.begin(), ie = old.end(); it != ie; ++it) {
-    ref<Expr> &ce = *it;
+  // The constraints before the first one rewritten stay in place, and
+  // stay shared with other sets.
+  for (unsigned i = 0; i != old.size(); ++i) {
+    ref<Expr> &ce = old[i];
     ref<Expr> e = visitor.visit(ce);
 
     if (e!=ce) {
+      if (!changed)
+        truncate(i);
       addConstraintInternal(e); // enable further reductions
       changed = true;
-    } else {
-      constraints.push_back(ce);
+    } else if (changed) {
+      push_back(ce);
     }
   }
 
@@ -106,8 +266,8 @@ ref<Expr> ConstraintManager::simplifyExpr(ref<Expr> e) const {
 
   std::map< ref<Expr>, ref<Expr> > equalities;
   
-  for (ConstraintManager::constraints_ty::const_iterator 
-         it = constraints.begin(), ie = constraints.end(); it != ie; ++it) {
+  for (ConstraintManager::constraint_iterator 
+         it = begin(), ie = end(); it != ie; ++it) {
     if (const EqExpr *ee = dyn_cast<EqExpr>(*it)) {
       if (isa<ConstantExpr>(ee->left)) {
         equalities.insert(std::make_pair(ee->right,
@@ -155,12 +315,12 @@ void ConstraintManager::addConstraintInternal(ref<Expr> e) {
 	rewriteConstraints(visitor);
       }
     }
-    constraints.push_back(e);
+    push_back(e);
     break;
   }
     
   default:
-    constraints.push_back(e);
+    push_back(e);
     break;
   }
 }
@@ -18,10 +18,19 @@
 // FIXME: We shouldn't need this once fast constant support moves into
 // Core. If we need to do arithmetic, we probably want to use APInt.
 #include "klee/Internal/Support/IntEvaluation.h"
+#include "klee/Internal/ADT/SlabAllocator.h"
 
 #include "klee/util/ExprPPrinter.h"
 
+#include <ciso646>
 #include <sstream>
+#ifdef _LIBCPP_VERSION
+#include <unordered_map>
+#define unordered_multimap std::unordered_multimap
+#else
+#include <tr1/unordered_map>
+#define unordered_multimap std::tr1::unordered_multimap
+#endif
 
 using namespace klee;
 using namespace llvm;
@@ -31,12 +40,76 @@ namespace {
   ConstArrayOpt("const-array-opt",
 	 cl::init(false),
 	 cl::desc("Enable various optimizations involving all-constant arrays."));
+
+  cl::opt<bool>
+  ExprHashConsing("expr-hash-consing",
+                  cl::init(false),
+                  cl::desc("Keep a single node for all structurally equal "
+                           "expressions (default=off)"));
+
+  /// The interned expressions, by hash value. The table does not hold a
+  /// reference; nodes remove themselves when they are destroyed.
+  typedef unordered_multimap<unsigned, Expr*> CachedExprMap;
 }
 
+#undef unordered_multimap
+
 /***/
 
 unsigned Expr::count = 0;
 
+size_t SlabAllocator::freeBytes = 0;
+
+static SlabAllocator exprAllocator;
+
+void *Expr::operator new(size_t size) {
+  return exprAllocator.allocate(size);
+}
+
+void Expr::operator delete(void *p, size_t size) {
+  exprAllocator.deallocate(p, size);
+}
+
+static CachedExprMap &getCachedExprs() {
+  // Never destroyed, as expressions held by globals may outlive it.
+  static CachedExprMap *cachedExprs = new CachedExprMap();
+  return *cachedExprs;
+}
+
+Expr::~Expr() {
+  Expr::count--;
+
+  if (isCached) {
+    CachedExprMap &cache = getCachedExprs();
+    std::pair<CachedExprMap::iterator, CachedExprMap::iterator> range =
+      cache.equal_range(hashValue);
+    for (CachedExprMap::iterator it = range.first; it != range.second; ++it) {
+      if (it->second == this) {
+        cache.erase(it);
+        break;
+      }
+    }
+  }
+}
+
+ref<Expr> Expr::createCachedExpr(const ref<Expr> &e) {
+  if (!ExprHashConsing)
+    return e;
+
+  // The kids of e are interned already, so comparing against a candidate
+  // only descends as far as the first shared kid.
+  CachedExprMap &cache = getCachedExprs();
+  std::pair<CachedExprMap::iterator, CachedExprMap::iterator> range =
+    cache.equal_range(e->hashValue);
+  for (CachedExprMap::iterator it = range.first; it != range.second; ++it)
+    if (it->second->compare(*e) == 0)
+      return it->second;
+
+  cache.insert(std::make_pair(e->hashValue, e.get()));
+  e->isCached = true;
+  return e;
+}
+
 ref<Expr> Expr::createTempRead(const Array *array, Expr::Width w) {
   UpdateList ul(array, 0);
 
@@ -8,6 +8,7 @@
 //===----------------------------------------------------------------------===//
 
 #include "klee/Expr.h"
+#include "klee/Internal/ADT/SlabAllocator.h"
 
 #include <cassert>
 
@@ -15,6 +16,16 @@ using namespace klee;
 
 ///
 
+static SlabAllocator updateNodeAllocator;
+
+void *UpdateNode::operator new(size_t size) {
+  return updateNodeAllocator.allocate(size);
+}
+
+void UpdateNode::operator delete(void *p, size_t size) {
+  updateNodeAllocator.deallocate(p, size);
+}
+
 UpdateNode::UpdateNode(const UpdateNode *_next, 
                        const ref<Expr> &_index, 
                        const ref<Expr> &_value) 
@@ -30,7 +41,7 @@ UpdateNode::UpdateNode(const UpdateNode *_next,
   */
   computeHash();
   if (next) {
-    ++next->refCount;
+    RefCountPolicy::increment(next->refCount);
     size = 1 + next->size;
   }
   else size = 1;
@@ -64,13 +75,13 @@ unsigned UpdateNode::computeHash() {
 UpdateList::UpdateList(const Array *_root, const UpdateNode *_head)
   : root(_root),
     head(_head) {
-  if (head) ++head->refCount;
+  if (head) RefCountPolicy::increment(head->refCount);
 }
 
 UpdateList::UpdateList(const UpdateList &b)
   : root(b.root),
     head(b.head) {
-  if (head) ++head->refCount;
+  if (head) RefCountPolicy::increment(head->refCount);
 }
 
 UpdateList::~UpdateList() {
@@ -127,7 +138,7 @@ void UpdateList::tryFreeNodes() {
   //  nullptr
   //  ^Head0
   //
-  while (head && --head->refCount==0) {
+  while (head && RefCountPolicy::decrement(head->refCount)) {
     const UpdateNode *n = head->next;
     delete head;
     head = n;
@@ -135,7 +146,7 @@ void UpdateList::tryFreeNodes() {
 }
 
 UpdateList &UpdateList::operator=(const UpdateList &b) {
-  if (b.head) ++b.head->refCount;
+  if (b.head) RefCountPolicy::increment(b.head->refCount);
   // Drop reference to the current head and free a chain of nodes
   // if we are the only UpdateList referencing them
   tryFreeNodes();
@@ -151,9 +162,9 @@ void UpdateList::extend(const ref<Expr> &index, const ref<Expr> &value) {
     assert(root->getRange() == value->getWidth());
   }
 
-  if (head) --head->refCount;
+  if (head) RefCountPolicy::decrement(head->refCount);
   head = new UpdateNode(head, index, value);
-  ++head->refCount;
+  RefCountPolicy::increment(head->refCount);
 }
 
 int UpdateList::compare(const UpdateList &b) const {
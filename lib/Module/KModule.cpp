@@ -552,12 +552,17 @@ KFunction::KFunction(llvm::Function *_function,
     for (llvm::BasicBlock::iterator it = bbit->begin(), ie = bbit->end();
          it != ie; ++it) {
       KInstruction *ki;
+      KBranchInstruction *kbi = 0;
 
       switch(it->getOpcode()) {
       case Instruction::GetElementPtr:
       case Instruction::InsertValue:
       case Instruction::ExtractValue:
         ki = new KGEPInstruction(); break;
+      case Instruction::Br:
+      case Instruction::Switch:
+      case Instruction::Invoke:
+        ki = kbi = new KBranchInstruction(); break;
       default:
         ki = new KInstruction(); break;
       }
@@ -584,6 +589,20 @@ KFunction::KFunction(llvm::Function *_function,
         }
       }
 
+      if (kbi) {
+        TerminatorInst *ti = cast<TerminatorInst>(it);
+        for (unsigned j=0, e=ti->getNumSuccessors(); j<e; ++j) {
+          BasicBlock *succ = ti->getSuccessor(j);
+          KBranchTarget target;
+          target.entry = basicBlockEntry[succ];
+          if (PHINode *first = dyn_cast<PHINode>(succ->begin()))
+            target.incomingBBIndex = first->getBasicBlockIndex(bbit);
+          else
+            target.incomingBBIndex = -1;
+          kbi->targets.push_back(target);
+        }
+      }
+
       instructions[i++] = ki;
     }
   }
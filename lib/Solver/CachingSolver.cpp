@@ -78,6 +78,9 @@ public:
   ~CachingSolver() { cache.clear(); delete solver; }
 
   bool computeValidity(const Query&, Solver::Validity &result);
+  bool computeValidities(const ConstraintManager &constraints,
+                         const std::vector< ref<Expr> > &exprs,
+                         std::vector<Solver::Validity> &results);
   bool computeTruth(const Query&, bool &isValid);
   bool computeValue(const Query& query, ref<Expr> &result) {
     ++stats::queryCacheMisses;
@@ -96,6 +99,18 @@ public:
   void setCoreSolverTimeout(double timeout);
 };
 
+static IncompleteSolver::PartialValidity
+getPartialValidity(Solver::Validity result) {
+  switch (result) {
+  case Solver::True: 
+    return IncompleteSolver::MustBeTrue;
+  case Solver::False: 
+    return IncompleteSolver::MustBeFalse;
+  default: 
+    return IncompleteSolver::TrueOrFalse;
+  }
+}
+
 /** @returns the canonical version of the given query.  The reference
     negationUsed is set to true if the original query was negated in
     the canonicalization process. */
@@ -202,16 +217,55 @@ bool CachingSolver::computeValidity(const Query& query,
   if (!solver->impl->computeValidity(query, result))
     return false;
 
-  switch (result) {
-  case Solver::True: 
-    cachedResult = IncompleteSolver::MustBeTrue; break;
-  case Solver::False: 
-    cachedResult = IncompleteSolver::MustBeFalse; break;
-  default: 
-    cachedResult = IncompleteSolver::TrueOrFalse; break;
+  cacheInsert(query, getPartialValidity(result));
+  return true;
+}
+
+bool CachingSolver::computeValidities(const ConstraintManager &constraints,
+                                      const std::vector< ref<Expr> > &exprs,
+                                      std::vector<Solver::Validity> &results) {
+  results.resize(exprs.size());
+
+  // Answer what the cache knows in full, and pass the rest down in one
+  // batch.
+  std::vector< ref<Expr> > missing;
+  std::vector<unsigned> missingIndices;
+  for (unsigned i = 0; i != exprs.size(); ++i) {
+    IncompleteSolver::PartialValidity cachedResult;
+    if (cacheLookup(Query(constraints, exprs[i]), cachedResult)) {
+      switch (cachedResult) {
+      case IncompleteSolver::MustBeTrue:
+        results[i] = Solver::True;
+        ++stats::queryCacheHits;
+        continue;
+      case IncompleteSolver::MustBeFalse:
+        results[i] = Solver::False;
+        ++stats::queryCacheHits;
+        continue;
+      case IncompleteSolver::TrueOrFalse:
+        results[i] = Solver::Unknown;
+        ++stats::queryCacheHits;
+        continue;
+      default:
+        break;
+      }
+    }
+    ++stats::queryCacheMisses;
+    missing.push_back(exprs[i]);
+    missingIndices.push_back(i);
+  }
+
+  if (missing.empty())
+    return true;
+
+  std::vector<Solver::Validity> missingResults;
+  if (!solver->impl->computeValidities(constraints, missing, missingResults))
+    return false;
+  for (unsigned i = 0; i != missing.size(); ++i) {
+    results[missingIndices[i]] = missingResults[i];
+    cacheInsert(Query(constraints, missing[i]),
+                getPartialValidity(missingResults[i]));
   }
-  
-  cacheInsert(query, cachedResult);
   return true;
 }
 
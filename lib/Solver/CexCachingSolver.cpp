@@ -14,6 +14,7 @@
 #include "klee/SolverImpl.h"
 #include "klee/TimerStatIncrementer.h"
 #include "klee/util/Assignment.h"
+#include "klee/util/CompiledConstraints.h"
 #include "klee/util/ExprUtil.h"
 #include "klee/util/ExprVisitor.h"
 #include "klee/Internal/ADT/MapOfSets.h"
@@ -24,6 +25,9 @@
 
 #include "llvm/Support/CommandLine.h"
 
+#include <algorithm>
+#include <list>
+
 using namespace klee;
 using namespace llvm;
 
@@ -44,46 +48,113 @@ namespace {
   cl::opt<bool>
   CexCacheExperimental("cex-cache-exp", cl::init(false));
 
+  cl::opt<unsigned>
+  CexCacheMaxMemory("cex-cache-max-memory",
+                    cl::desc("Evict the least recently used counterexamples once the cache takes about this many kilobytes (default=0 (unlimited))"),
+                    cl::init(0));
+
 }
 
 ///
 
 typedef std::set< ref<Expr> > KeyType;
 
-struct AssignmentLessThan {
-  bool operator()(const Assignment *a, const Assignment *b) {
-    return a->bindings < b->bindings;
+/// The arrays a key reads, sorted. Keys of different independent factors
+/// read different arrays, and a subset of a key reads a subset of its
+/// arrays.
+typedef std::vector<const Array*> ArraysType;
+
+namespace {
+
+/// A counterexample, shared by all the cache entries it answers.
+struct CachedAssignment {
+  Assignment assignment;
+  uint64_t hash;
+  /// The number of cache entries using the assignment.
+  unsigned refCount;
+
+  CachedAssignment(const std::vector<const Array*> &objects,
+                   std::vector< std::vector<unsigned char> > &values)
+    : assignment(objects, values), hash(0), refCount(0) {
+    // FNV-1a over the bindings.
+    hash = 14695981039346656037ULL;
+    for (Assignment::bindings_ty::iterator it = assignment.bindings.begin(),
+           ie = assignment.bindings.end(); it != ie; ++it) {
+      hash = (hash ^ (uint64_t) (uintptr_t) it->first) * 1099511628211ULL;
+      for (unsigned i = 0; i != it->second.size(); ++i)
+        hash = (hash ^ it->second[i]) * 1099511628211ULL;
+    }
+  }
+
+  size_t getSize() const {
+    size_t size = sizeof *this;
+    for (Assignment::bindings_ty::const_iterator
+           it = assignment.bindings.begin(), ie = assignment.bindings.end();
+         it != ie; ++it)
+      size += 64 + it->second.size();
+    return size;
+  }
+};
+
+struct CacheEntry {
+  KeyType key;
+  ArraysType arrays;
+  /// The counterexample, or null if the key is unsatisfiable.
+  CachedAssignment *assignment;
+  std::list<CacheEntry*>::iterator lruPosition;
+  size_t size;
+
+  Assignment *getAssignment() const {
+    return assignment ? &assignment->assignment : 0;
   }
 };
 
+}
 
 class CexCachingSolver : public SolverImpl {
-  typedef std::set<Assignment*, AssignmentLessThan> assignmentsTable_ty;
+  typedef std::multimap<uint64_t, CachedAssignment*> assignmentsTable_ty;
+  typedef MapOfSets<ref<Expr>, CacheEntry*> cache_ty;
+  typedef std::map<ArraysType, cache_ty> factors_ty;
 
   Solver *solver;
   
-  MapOfSets<ref<Expr>, Assignment*> cache;
-  // memo table
+  /// The cache, split by the arrays the keys read.
+  factors_ty factors;
+  // memo table, by content hash
   assignmentsTable_ty assignmentsTable;
+  /// The entries, most recently used first.
+  std::list<CacheEntry*> lru;
+  /// An estimate of the memory taken by the entries and assignments.
+  size_t cacheSize;
 
-  bool searchForAssignment(KeyType &key, 
+  bool searchForAssignment(KeyType &key, const ArraysType &arrays,
                            Assignment *&result);
   
-  bool lookupAssignment(const Query& query, KeyType &key, Assignment *&result);
+  bool lookupAssignment(const Query& query, KeyType &key,
+                        ArraysType &arrays, Assignment *&result);
 
   bool lookupAssignment(const Query& query, Assignment *&result) {
     KeyType key;
-    return lookupAssignment(query, key, result);
+    ArraysType arrays;
+    return lookupAssignment(query, key, arrays, result);
   }
 
   bool getAssignment(const Query& query, Assignment *&result);
+
+  CachedAssignment *internAssignment(CachedAssignment *a);
+  void insert(const KeyType &key, const ArraysType &arrays,
+              CachedAssignment *a);
+  void evict(CacheEntry *entry);
   
 public:
-  CexCachingSolver(Solver *_solver) : solver(_solver) {}
+  CexCachingSolver(Solver *_solver) : solver(_solver), cacheSize(0) {}
   ~CexCachingSolver();
   
   bool computeTruth(const Query&, bool &isValid);
   bool computeValidity(const Query&, Solver::Validity &result);
+  bool computeValidities(const ConstraintManager &constraints,
+                         const std::vector< ref<Expr> > &exprs,
+                         std::vector<Solver::Validity> &results);
   bool computeValue(const Query&, ref<Expr> &result);
   bool computeInitialValues(const Query&,
                             const std::vector<const Array*> &objects,
@@ -97,86 +168,146 @@ public:
 ///
 
 struct NullAssignment {
-  bool operator()(Assignment *a) const { return !a; }
+  bool operator()(CacheEntry *e) const { return !e->assignment; }
 };
 
 struct NonNullAssignment {
-  bool operator()(Assignment *a) const { return a!=0; }
+  bool operator()(CacheEntry *e) const { return e->assignment!=0; }
 };
 
-struct NullOrSatisfyingAssignment {
+namespace {
+
+/// Checks cached assignments against a key. The key is compiled the first
+/// time it is needed, and checked with the expression evaluator if it
+/// cannot be compiled.
+class KeyChecker {
   KeyType &key;
+  CompiledConstraints program;
+  bool compiled;
+
+  bool compile() {
+    if (!compiled) {
+      compiled = true;
+      program.addConstraints(key.begin(), key.end());
+    }
+    return program.isValid();
+  }
+
+public:
+  KeyChecker(KeyType &_key) : key(_key), compiled(false) {}
+
+  bool satisfies(Assignment &a) {
+    if (compile())
+      return program.satisfies(a);
+    return a.satisfies(key.begin(), key.end());
+  }
+
+  /// Return the first of \arg n assignments satisfying the key, or null.
+  Assignment *findSatisfying(Assignment *const *assignments, unsigned n) {
+    if (!compile()) {
+      for (unsigned i = 0; i != n; ++i)
+        if (assignments[i]->satisfies(key.begin(), key.end()))
+          return assignments[i];
+      return 0;
+    }
+
+    bool results[CompiledConstraints::MaxLanes];
+    for (unsigned i = 0; i < n; i += CompiledConstraints::MaxLanes) {
+      unsigned lanes = std::min(n - i,
+                                (unsigned) CompiledConstraints::MaxLanes);
+      program.satisfies(assignments + i, lanes, results);
+      for (unsigned l = 0; l != lanes; ++l)
+        if (results[l])
+          return assignments[i + l];
+    }
+    return 0;
+  }
+};
+
+}
+
+struct NullOrSatisfyingAssignment {
+  KeyChecker &checker;
   
-  NullOrSatisfyingAssignment(KeyType &_key) : key(_key) {}
+  NullOrSatisfyingAssignment(KeyChecker &_checker) : checker(_checker) {}
 
-  bool operator()(Assignment *a) const { 
-    return !a || a->satisfies(key.begin(), key.end()); 
+  bool operator()(CacheEntry *e) const { 
+    return !e->assignment || checker.satisfies(e->assignment->assignment);
   }
 };
 
 /// searchForAssignment - Look for a cached solution for a query.
 ///
 /// \param key - The query to look up.
+/// \param arrays - The arrays the query reads.
 /// \param result [out] - The cached result, if the lookup is succesful. This is
 /// either a satisfying assignment (for a satisfiable query), or 0 (for an
 /// unsatisfiable query).
 /// \return - True if a cached result was found.
-bool CexCachingSolver::searchForAssignment(KeyType &key, Assignment *&result) {
-  Assignment * const *lookup = cache.lookup(key);
-  if (lookup) {
-    result = *lookup;
-    return true;
-  }
-
-  if (CexCacheTryAll) {
+bool CexCachingSolver::searchForAssignment(KeyType &key,
+                                           const ArraysType &arrays,
+                                           Assignment *&result) {
+  CacheEntry **lookup = 0;
+  KeyChecker checker(key);
+  factors_ty::iterator exact = factors.find(arrays);
+  if (exact != factors.end())
+    lookup = exact->second.lookup(key);
+
+  // Only the factors over a superset of the arrays can hold supersets of
+  // the key, and likewise for subsets.
+  if (!lookup && CexCacheSuperSet) {
     // Look for a satisfying assignment for a superset, which is trivially an
     // assignment for any subset.
-    Assignment **lookup = 0;
-    if (CexCacheSuperSet)
-      lookup = cache.findSuperset(key, NonNullAssignment());
+    for (factors_ty::iterator it = factors.begin(), ie = factors.end();
+         it != ie && !lookup; ++it)
+      if (std::includes(it->first.begin(), it->first.end(),
+                        arrays.begin(), arrays.end()))
+        lookup = it->second.findSuperset(key, NonNullAssignment());
+  }
 
-    // Otherwise, look for a subset which is unsatisfiable, see below.
-    if (!lookup) 
-      lookup = cache.findSubset(key, NullAssignment());
+  if (!lookup) {
+    // FIXME: Which order? one is sure to be better.
 
-    // If either lookup succeeded, then we have a cached solution.
-    if (lookup) {
-      result = *lookup;
-      return true;
+    // Otherwise, look for a subset which is unsatisfiable -- if the subset is
+    // unsatisfiable then no additional constraints can produce a valid
+    // assignment. Unless trying all assignments below anyway, while searching
+    // subsets we also explicitly the solutions for satisfiable subsets to see
+    // if they solve the current query and return them if so. This is cheap
+    // and frequently succeeds.
+    for (factors_ty::iterator it = factors.begin(), ie = factors.end();
+         it != ie && !lookup; ++it) {
+      if (!std::includes(arrays.begin(), arrays.end(),
+                         it->first.begin(), it->first.end()))
+        continue;
+      if (CexCacheTryAll)
+        lookup = it->second.findSubset(key, NullAssignment());
+      else
+        lookup = it->second.findSubset(key, NullOrSatisfyingAssignment(checker));
     }
+  }
 
+  // If a lookup succeeded, then we have a cached solution.
+  if (lookup) {
+    CacheEntry *entry = *lookup;
+    lru.splice(lru.begin(), lru, entry->lruPosition);
+    result = entry->getAssignment();
+    return true;
+  }
+
+  if (CexCacheTryAll) {
     // Otherwise, iterate through the set of current assignments to see if one
     // of them satisfies the query.
+    std::vector<Assignment*> assignments;
+    assignments.reserve(assignmentsTable.size());
     for (assignmentsTable_ty::iterator it = assignmentsTable.begin(), 
-           ie = assignmentsTable.end(); it != ie; ++it) {
-      Assignment *a = *it;
-      if (a->satisfies(key.begin(), key.end())) {
+           ie = assignmentsTable.end(); it != ie; ++it)
+      assignments.push_back(&it->second->assignment);
+    if (!assignments.empty())
+      if (Assignment *a = checker.findSatisfying(&assignments[0],
+                                                 assignments.size())) {
         result = a;
         return true;
       }
-    }
-  } else {
-    // FIXME: Which order? one is sure to be better.
-
-    // Look for a satisfying assignment for a superset, which is trivially an
-    // assignment for any subset.
-    Assignment **lookup = 0;
-    if (CexCacheSuperSet)
-      lookup = cache.findSuperset(key, NonNullAssignment());
-
-    // Otherwise, look for a subset which is unsatisfiable -- if the subset is
-    // unsatisfiable then no additional constraints can produce a valid
-    // assignment. While searching subsets, we also explicitly the solutions for
-    // satisfiable subsets to see if they solve the current query and return
-    // them if so. This is cheap and frequently succeeds.
-    if (!lookup) 
-      lookup = cache.findSubset(key, NullOrSatisfyingAssignment(key));
-
-    // If either lookup succeeded, then we have a cached solution.
-    if (lookup) {
-      result = *lookup;
-      return true;
-    }
   }
   
   return false;
@@ -186,12 +317,14 @@ bool CexCachingSolver::searchForAssignment(KeyType &key, Assignment *&result) {
 ///
 /// \param query - The query to lookup.
 /// \param key [out] - On return, the key constructed for the query.
+/// \param arrays [out] - On return, the arrays the key reads.
 /// \param result [out] - The cached result, if the lookup is succesful. This is
 /// either a satisfying assignment (for a satisfiable query), or 0 (for an
 /// unsatisfiable query).
 /// \return True if a cached result was found.
 bool CexCachingSolver::lookupAssignment(const Query &query, 
                                         KeyType &key,
+                                        ArraysType &arrays,
                                         Assignment *&result) {
   key = KeyType(query.constraints.begin(), query.constraints.end());
   ref<Expr> neg = Expr::createIsZero(query.expr);
@@ -205,7 +338,10 @@ bool CexCachingSolver::lookupAssignment(const Query &query,
     key.insert(neg);
   }
 
-  bool found = searchForAssignment(key, result);
+  findSymbolicObjects(key.begin(), key.end(), arrays);
+  std::sort(arrays.begin(), arrays.end());
+
+  bool found = searchForAssignment(key, arrays, result);
   if (found)
     ++stats::queryCexCacheHits;
   else ++stats::queryCexCacheMisses;
@@ -213,9 +349,86 @@ bool CexCachingSolver::lookupAssignment(const Query &query,
   return found;
 }
 
+/// internAssignment - Return the cached assignment with the same contents
+/// as \arg a, taking ownership of \arg a.
+CachedAssignment *CexCachingSolver::internAssignment(CachedAssignment *a) {
+  std::pair<assignmentsTable_ty::iterator, assignmentsTable_ty::iterator>
+    range = assignmentsTable.equal_range(a->hash);
+  for (assignmentsTable_ty::iterator it = range.first; it != range.second;
+       ++it) {
+    if (it->second->assignment.bindings == a->assignment.bindings) {
+      delete a;
+      return it->second;
+    }
+  }
+
+  assignmentsTable.insert(std::make_pair(a->hash, a));
+  cacheSize += a->getSize();
+  return a;
+}
+
+void CexCachingSolver::insert(const KeyType &key, const ArraysType &arrays,
+                              CachedAssignment *a) {
+  factors_ty::iterator factor = factors.find(arrays);
+  if (factor != factors.end())
+    if (CacheEntry **existing = factor->second.lookup(key))
+      evict(*existing);
+
+  CacheEntry *entry = new CacheEntry();
+  entry->key = key;
+  entry->arrays = arrays;
+  entry->assignment = a;
+  if (a)
+    ++a->refCount;
+  // Roughly what the entry adds to the trie, if none of its nodes are
+  // shared.
+  entry->size = sizeof *entry + key.size() * 96 +
+    arrays.size() * sizeof(const Array*);
+  entry->lruPosition = lru.insert(lru.begin(), entry);
+  cacheSize += entry->size;
+  factors[arrays].insert(key, entry);
+
+  // Keep the newest entry even if it alone exceeds the limit.
+  if (CexCacheMaxMemory) {
+    size_t limit = (size_t) CexCacheMaxMemory << 10;
+    while (cacheSize > limit && lru.size() > 1) {
+      evict(lru.back());
+      ++stats::queryCexCacheEvictions;
+    }
+  }
+}
+
+void CexCachingSolver::evict(CacheEntry *entry) {
+  factors_ty::iterator it = factors.find(entry->arrays);
+  assert(it != factors.end() && "evicting an entry not in the cache");
+  it->second.erase(entry->key);
+  if (it->second.empty())
+    factors.erase(it);
+
+  lru.erase(entry->lruPosition);
+  cacheSize -= entry->size;
+
+  CachedAssignment *a = entry->assignment;
+  if (a && --a->refCount == 0) {
+    std::pair<assignmentsTable_ty::iterator, assignmentsTable_ty::iterator>
+      range = assignmentsTable.equal_range(a->hash);
+    for (assignmentsTable_ty::iterator ai = range.first; ai != range.second;
+         ++ai) {
+      if (ai->second == a) {
+        assignmentsTable.erase(ai);
+        break;
+      }
+    }
+    cacheSize -= a->getSize();
+    delete a;
+  }
+  delete entry;
+}
+
 bool CexCachingSolver::getAssignment(const Query& query, Assignment *&result) {
   KeyType key;
-  if (lookupAssignment(query, key, result))
+  ArraysType arrays;
+  if (lookupAssignment(query, key, arrays, result))
     return true;
 
   std::vector<const Array*> objects;
@@ -227,30 +440,23 @@ bool CexCachingSolver::getAssignment(const Query& query, Assignment *&result) {
                                           hasSolution))
     return false;
     
-  Assignment *binding;
+  CachedAssignment *binding;
   if (hasSolution) {
-    binding = new Assignment(objects, values);
-
     // Memoize the result.
-    std::pair<assignmentsTable_ty::iterator, bool>
-      res = assignmentsTable.insert(binding);
-    if (!res.second) {
-      delete binding;
-      binding = *res.first;
-    }
+    binding = internAssignment(new CachedAssignment(objects, values));
     
     if (DebugCexCacheCheckBinding)
-      if (!binding->satisfies(key.begin(), key.end())) {
+      if (!binding->assignment.satisfies(key.begin(), key.end())) {
         query.dump();
-        binding->dump();
+        binding->assignment.dump();
         klee_error("Generated assignment doesn't match query");
       }
   } else {
-    binding = (Assignment*) 0;
+    binding = (CachedAssignment*) 0;
   }
   
-  result = binding;
-  cache.insert(key, binding);
+  insert(key, arrays, binding);
+  result = binding ? &binding->assignment : 0;
 
   return true;
 }
@@ -258,11 +464,14 @@ bool CexCachingSolver::getAssignment(const Query& query, Assignment *&result) {
 ///
 
 CexCachingSolver::~CexCachingSolver() {
-  cache.clear();
+  factors.clear();
   delete solver;
+  for (std::list<CacheEntry*>::iterator it = lru.begin(), ie = lru.end();
+       it != ie; ++it)
+    delete *it;
   for (assignmentsTable_ty::iterator it = assignmentsTable.begin(), 
          ie = assignmentsTable.end(); it != ie; ++it)
-    delete *it;
+    delete it->second;
 }
 
 bool CexCachingSolver::computeValidity(const Query& query,
@@ -289,6 +498,52 @@ bool CexCachingSolver::computeValidity(const Query& query,
   return true;
 }
 
+bool CexCachingSolver::computeValidities(const ConstraintManager &constraints,
+                                         const std::vector< ref<Expr> > &exprs,
+                                         std::vector<Solver::Validity> &results) {
+  TimerStatIncrementer t(stats::cexCacheTime);
+  Query constraintsQuery(constraints, ConstantExpr::alloc(0, Expr::Bool));
+  Assignment *a;
+  if (!getAssignment(constraintsQuery, a))
+    return false;
+  assert(a && "computeValidities() must have assignment");
+
+  // A model of the constraints shows one way each expression can go.
+  // The expressions the cache knows nothing more about are passed down
+  // in one batch.
+  results.resize(exprs.size());
+  std::vector< ref<Expr> > pending;
+  std::vector<unsigned> pendingIndices;
+  for (unsigned i = 0; i != exprs.size(); ++i) {
+    Query query(constraints, exprs[i]);
+    ref<Expr> q = a->evaluate(exprs[i]);
+    assert(isa<ConstantExpr>(q) && 
+           "assignment evaluation did not result in constant");
+    bool isTrue = cast<ConstantExpr>(q)->isTrue();
+
+    Assignment *other;
+    if (lookupAssignment(isTrue ? query : query.negateExpr(), other)) {
+      if (other)
+        results[i] = Solver::Unknown;
+      else
+        results[i] = isTrue ? Solver::True : Solver::False;
+    } else {
+      pending.push_back(exprs[i]);
+      pendingIndices.push_back(i);
+    }
+  }
+
+  if (pending.empty())
+    return true;
+
+  std::vector<Solver::Validity> pendingResults;
+  if (!solver->impl->computeValidities(constraints, pending, pendingResults))
+    return false;
+  for (unsigned i = 0; i != pending.size(); ++i)
+    results[pendingIndices[i]] = pendingResults[i];
+  return true;
+}
+
 bool CexCachingSolver::computeTruth(const Query& query,
                                     bool &isValid) {
   TimerStatIncrementer t(stats::cexCacheTime);
@@ -36,24 +36,24 @@ using namespace klee;
 using namespace metaSMT;
 using namespace metaSMT::solver;
 
-static klee::Solver *handleMetaSMT() {
+static klee::Solver *handleMetaSMT(bool useForkedSolver) {
   Solver *coreSolver = NULL;
   std::string backend;
   switch (MetaSMTBackend) {
   case METASMT_BACKEND_STP:
     backend = "STP";
     coreSolver = new MetaSMTSolver<DirectSolver_Context<STP_Backend> >(
-        UseForkedCoreSolver, CoreSolverOptimizeDivides);
+        useForkedSolver, CoreSolverOptimizeDivides);
     break;
   case METASMT_BACKEND_Z3:
     backend = "Z3";
     coreSolver = new MetaSMTSolver<DirectSolver_Context<Z3_Backend> >(
-        UseForkedCoreSolver, CoreSolverOptimizeDivides);
+        useForkedSolver, CoreSolverOptimizeDivides);
     break;
   case METASMT_BACKEND_BOOLECTOR:
     backend = "Boolector";
     coreSolver = new MetaSMTSolver<DirectSolver_Context<Boolector> >(
-        UseForkedCoreSolver, CoreSolverOptimizeDivides);
+        useForkedSolver, CoreSolverOptimizeDivides);
     break;
   default:
     llvm_unreachable("Unrecognised metasmt backend");
@@ -66,12 +66,12 @@ static klee::Solver *handleMetaSMT() {
 
 namespace klee {
 
-Solver *createCoreSolver(CoreSolverType cst) {
+static Solver *createBackend(CoreSolverType cst, bool useForkedSolver) {
   switch (cst) {
   case STP_SOLVER:
 #ifdef ENABLE_STP
     llvm::errs() << "Using STP solver backend\n";
-    return new STPSolver(UseForkedCoreSolver, CoreSolverOptimizeDivides);
+    return new STPSolver(useForkedSolver, CoreSolverOptimizeDivides);
 #else
     llvm::errs() << "Not compiled with STP support\n";
     return NULL;
@@ -79,7 +79,7 @@ Solver *createCoreSolver(CoreSolverType cst) {
   case METASMT_SOLVER:
 #ifdef ENABLE_METASMT
     llvm::errs() << "Using MetaSMT solver backend\n";
-    return handleMetaSMT();
+    return handleMetaSMT(useForkedSolver);
 #else
     llvm::errs() << "Not compiled with MetaSMT support\n";
     return NULL;
@@ -97,4 +97,43 @@ Solver *createCoreSolver(CoreSolverType cst) {
     llvm_unreachable("Unsupported CoreSolverType");
   }
 }
+
+static Solver *createPortfolio() {
+  std::vector<CoreSolverType> types(PortfolioBackends.begin(),
+                                    PortfolioBackends.end());
+  if (types.empty()) {
+#ifdef ENABLE_STP
+    types.push_back(STP_SOLVER);
+#endif
+#ifdef ENABLE_Z3
+    types.push_back(Z3_SOLVER);
+#endif
+#ifdef ENABLE_METASMT
+    types.push_back(METASMT_SOLVER);
+#endif
+  }
+
+  // Every backend already runs in a process of its own, so none of them
+  // needs to fork again.
+  std::vector<std::pair<CoreSolverType, Solver *> > backends;
+  for (unsigned i = 0; i < types.size(); ++i) {
+    Solver *backend = createBackend(types[i], /*useForkedSolver=*/false);
+    if (!backend) {
+      for (unsigned j = 0; j < backends.size(); ++j)
+        delete backends[j].second;
+      return NULL;
+    }
+    backends.push_back(std::make_pair(types[i], backend));
+  }
+
+  llvm::errs() << "Using a portfolio of " << backends.size()
+               << " solver backends\n";
+  return createPortfolioSolver(backends);
+}
+
+Solver *createCoreSolver(CoreSolverType cst) {
+  if (cst == PORTFOLIO_SOLVER)
+    return createPortfolio();
+  return createBackend(cst, UseForkedCoreSolver);
+}
 }
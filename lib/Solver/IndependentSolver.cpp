@@ -15,10 +15,12 @@
 #include "klee/SolverImpl.h"
 #include "klee/Internal/Support/Debug.h"
 
+#include "klee/util/ConstraintPartition.h"
 #include "klee/util/ExprUtil.h"
 #include "klee/util/Assignment.h"
 
 #include "llvm/Support/raw_ostream.h"
+#include <algorithm>
 #include <map>
 #include <vector>
 #include <ostream>
@@ -263,6 +265,13 @@ inline llvm::raw_ostream &operator<<(llvm::raw_ostream &os,
 static std::list<IndependentElementSet>*
 getAllIndependentConstraintsSets(const Query &query) {
   std::list<IndependentElementSet> *factors = new std::list<IndependentElementSet>();
+  const ConstraintPartition &partition = query.constraints.getPartition();
+  ConstraintManager::const_iterator constraints = query.constraints.begin();
+
+  // The factors the query expression joins together come first, then the
+  // remaining factors in the order of their oldest constraint; within a
+  // factor the constraints keep their order.
+  std::set<unsigned> queryFactors;
   ConstantExpr *CE = dyn_cast<ConstantExpr>(query.expr);
   if (CE) {
     assert(CE && CE->isFalse() && "the expr should always be false and "
@@ -270,85 +279,55 @@ getAllIndependentConstraintsSets(const Query &query) {
   } else {
     ref<Expr> neg = Expr::createIsZero(query.expr);
     factors->push_back(IndependentElementSet(neg));
-  }
 
-  for (ConstraintManager::const_iterator it = query.constraints.begin(),
-                                         ie = query.constraints.end();
-       it != ie; ++it) {
-    // iterate through all the previously separated constraints.  Until we
-    // actually return, factors is treated as a queue of expressions to be
-    // evaluated.  If the queue property isn't maintained, then the exprs
-    // could be returned in an order different from how they came it, negatively
-    // affecting later stages.
-    factors->push_back(IndependentElementSet(*it));
+    std::vector<unsigned> related, members;
+    partition.getFactors(neg, related);
+    for (std::vector<unsigned>::iterator it = related.begin(),
+           ie = related.end(); it != ie; ++it) {
+      queryFactors.insert(*it);
+      partition.getMembers(*it, members);
+    }
+    std::sort(members.begin(), members.end());
+    for (std::vector<unsigned>::iterator it = members.begin(),
+           ie = members.end(); it != ie; ++it)
+      factors->back().add(IndependentElementSet(constraints[*it]));
   }
 
-  bool doneLoop = false;
-  do {
-    doneLoop = true;
-    std::list<IndependentElementSet> *done =
-        new std::list<IndependentElementSet>;
-    while (factors->size() > 0) {
-      IndependentElementSet current = factors->front();
-      factors->pop_front();
-      // This list represents the set of factors that are separate from current.
-      // Those that are not inserted into this list (queue) intersect with
-      // current.
-      std::list<IndependentElementSet> *keep =
-          new std::list<IndependentElementSet>;
-      while (factors->size() > 0) {
-        IndependentElementSet compare = factors->front();
-        factors->pop_front();
-        if (current.intersects(compare)) {
-          if (current.add(compare)) {
-            // Means that we have added (z=y)added to (x=y)
-            // Now need to see if there are any (z=?)'s
-            doneLoop = false;
-          }
-        } else {
-          keep->push_back(compare);
-        }
-      }
-      done->push_back(current);
-      delete factors;
-      factors = keep;
+  std::map<unsigned, IndependentElementSet*> factorSets;
+  for (unsigned i = 0; i != query.constraints.size(); ++i) {
+    unsigned factor = partition.getFactor(i);
+    if (queryFactors.count(factor))
+      continue;
+
+    std::map<unsigned, IndependentElementSet*>::iterator it =
+      factorSets.find(factor);
+    if (it != factorSets.end()) {
+      it->second->add(IndependentElementSet(constraints[i]));
+    } else {
+      factors->push_back(IndependentElementSet(constraints[i]));
+      factorSets.insert(std::make_pair(factor, &factors->back()));
     }
-    delete factors;
-    factors = done;
-  } while (!doneLoop);
+  }
 
   return factors;
 }
 
-static 
-IndependentElementSet getIndependentConstraints(const Query& query,
-                                                std::vector< ref<Expr> > &result) {
-  IndependentElementSet eltsClosure(query.expr);
-  std::vector< std::pair<ref<Expr>, IndependentElementSet> > worklist;
-
-  for (ConstraintManager::const_iterator it = query.constraints.begin(), 
-         ie = query.constraints.end(); it != ie; ++it)
-    worklist.push_back(std::make_pair(*it, IndependentElementSet(*it)));
-
-  // XXX This should be more efficient (in terms of low level copy stuff).
-  bool done = false;
-  do {
-    done = true;
-    std::vector< std::pair<ref<Expr>, IndependentElementSet> > newWorklist;
-    for (std::vector< std::pair<ref<Expr>, IndependentElementSet> >::iterator
-           it = worklist.begin(), ie = worklist.end(); it != ie; ++it) {
-      if (it->second.intersects(eltsClosure)) {
-        if (eltsClosure.add(it->second))
-          done = false;
-        result.push_back(it->first);
-        // Means that we have added (z=y)added to (x=y)
-        // Now need to see if there are any (z=?)'s
-      } else {
-        newWorklist.push_back(*it);
-      }
-    }
-    worklist.swap(newWorklist);
-  } while (!done);
+static
+void getIndependentConstraints(const Query& query,
+                               std::vector< ref<Expr> > &result) {
+  const ConstraintPartition &partition = query.constraints.getPartition();
+  std::vector<unsigned> factors, required;
+  partition.getFactors(query.expr, factors);
+  for (std::vector<unsigned>::iterator it = factors.begin(),
+         ie = factors.end(); it != ie; ++it)
+    partition.getMembers(*it, required);
+
+  // Keep the constraints in their original order.
+  std::sort(required.begin(), required.end());
+  ConstraintManager::const_iterator constraints = query.constraints.begin();
+  for (std::vector<unsigned>::iterator it = required.begin(),
+         ie = required.end(); it != ie; ++it)
+    result.push_back(constraints[*it]);
 
   KLEE_DEBUG(
     std::set< ref<Expr> > reqset(result.begin(), result.end());
@@ -362,11 +341,7 @@ IndependentElementSet getIndependentConstraints(const Query& query,
       errs() << " " << (reqset.count(*it) ? "(required)" : "(independent)") << "\n";
       errs() << "\telts: " << IndependentElementSet(*it) << "\n";
     }
-    errs() << "elts closure: " << eltsClosure << "\n";
  );
-
-
-  return eltsClosure;
 }
 
 
@@ -401,6 +376,9 @@ public:
 
   bool computeTruth(const Query&, bool &isValid);
   bool computeValidity(const Query&, Solver::Validity &result);
+  bool computeValidities(const ConstraintManager &constraints,
+                         const std::vector< ref<Expr> > &exprs,
+                         std::vector<Solver::Validity> &results);
   bool computeValue(const Query&, ref<Expr> &result);
   bool computeInitialValues(const Query& query,
                             const std::vector<const Array*> &objects,
@@ -414,17 +392,59 @@ public:
 bool IndependentSolver::computeValidity(const Query& query,
                                         Solver::Validity &result) {
   std::vector< ref<Expr> > required;
-  IndependentElementSet eltsClosure =
-    getIndependentConstraints(query, required);
+  getIndependentConstraints(query, required);
   ConstraintManager tmp(required);
   return solver->impl->computeValidity(Query(tmp, query.expr), 
                                        result);
 }
 
+bool IndependentSolver::computeValidities(const ConstraintManager &constraints,
+                                          const std::vector< ref<Expr> > &exprs,
+                                          std::vector<Solver::Validity> &results) {
+  // The expressions depending on the same factors are passed down in one
+  // batch, with the constraints of those factors.
+  const ConstraintPartition &partition = constraints.getPartition();
+  std::map<std::vector<unsigned>, std::vector<unsigned> > batches;
+  for (unsigned i = 0; i != exprs.size(); ++i) {
+    std::vector<unsigned> factors;
+    partition.getFactors(exprs[i], factors);
+    std::sort(factors.begin(), factors.end());
+    batches[factors].push_back(i);
+  }
+
+  results.resize(exprs.size());
+  for (std::map<std::vector<unsigned>, std::vector<unsigned> >::iterator
+         it = batches.begin(), ie = batches.end(); it != ie; ++it) {
+    std::vector<unsigned> required;
+    for (std::vector<unsigned>::const_iterator it2 = it->first.begin(),
+           ie2 = it->first.end(); it2 != ie2; ++it2)
+      partition.getMembers(*it2, required);
+
+    // Keep the constraints in their original order.
+    std::sort(required.begin(), required.end());
+    std::vector< ref<Expr> > requiredConstraints;
+    ConstraintManager::const_iterator all = constraints.begin();
+    for (std::vector<unsigned>::iterator it2 = required.begin(),
+           ie2 = required.end(); it2 != ie2; ++it2)
+      requiredConstraints.push_back(all[*it2]);
+    ConstraintManager tmp(requiredConstraints);
+
+    std::vector< ref<Expr> > batch;
+    for (std::vector<unsigned>::iterator it2 = it->second.begin(),
+           ie2 = it->second.end(); it2 != ie2; ++it2)
+      batch.push_back(exprs[*it2]);
+    std::vector<Solver::Validity> batchResults;
+    if (!solver->impl->computeValidities(tmp, batch, batchResults))
+      return false;
+    for (unsigned i = 0; i != batch.size(); ++i)
+      results[it->second[i]] = batchResults[i];
+  }
+  return true;
+}
+
 bool IndependentSolver::computeTruth(const Query& query, bool &isValid) {
   std::vector< ref<Expr> > required;
-  IndependentElementSet eltsClosure = 
-    getIndependentConstraints(query, required);
+  getIndependentConstraints(query, required);
   ConstraintManager tmp(required);
   return solver->impl->computeTruth(Query(tmp, query.expr), 
                                     isValid);
@@ -432,8 +452,7 @@ bool IndependentSolver::computeTruth(const Query& query, bool &isValid) {
 
 bool IndependentSolver::computeValue(const Query& query, ref<Expr> &result) {
   std::vector< ref<Expr> > required;
-  IndependentElementSet eltsClosure = 
-    getIndependentConstraints(query, required);
+  getIndependentConstraints(query, required);
   ConstraintManager tmp(required);
   return solver->impl->computeValue(Query(tmp, query.expr), result);
 }
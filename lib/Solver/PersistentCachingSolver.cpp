@@ -0,0 +1,608 @@
+//===-- PersistentCachingSolver.cpp - On-disk query cache -----------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// A validity, value and counterexample cache that outlives the process.
+// Results are appended as records to a file which is memory-mapped for
+// reading, so several klee processes can share one cache file: every
+// record is written with a single O_APPEND write and carries a checksum,
+// which lets readers skip records still being written.
+//
+// A record holds the query it answers, serialized with arrays numbered in
+// order of first use instead of being identified by name, so the same
+// query from another run (with differently named arrays) finds it. The
+// records are indexed by a hash of the serialized query, and a hit is
+// only taken if the stored query is the same.
+//
+//===----------------------------------------------------------------------===//
+
+#include "klee/Solver.h"
+
+#include "klee/Constraints.h"
+#include "klee/Expr.h"
+#include "klee/IncompleteSolver.h"
+#include "klee/SolverImpl.h"
+#include "klee/SolverStats.h"
+#include "klee/Internal/Support/ErrorHandling.h"
+
+#include <algorithm>
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <ciso646>
+#ifdef _LIBCPP_VERSION
+#include <unordered_map>
+#define unordered_map std::unordered_map
+#define unordered_multimap std::unordered_multimap
+#else
+#include <tr1/unordered_map>
+#define unordered_map std::tr1::unordered_map
+#define unordered_multimap std::tr1::unordered_multimap
+#endif
+
+using namespace klee;
+
+namespace {
+
+typedef std::vector<unsigned char> bytes_ty;
+
+void writeU32(bytes_ty &buffer, uint32_t value) {
+  for (unsigned i = 0; i != 4; ++i)
+    buffer.push_back(value >> (8 * i));
+}
+
+void writeU64(bytes_ty &buffer, uint64_t value) {
+  writeU32(buffer, value);
+  writeU32(buffer, value >> 32);
+}
+
+uint32_t readU32(const unsigned char *p) {
+  uint32_t value = 0;
+  for (unsigned i = 0; i != 4; ++i)
+    value |= (uint32_t) p[i] << (8 * i);
+  return value;
+}
+
+uint64_t readU64(const unsigned char *p) {
+  return readU32(p) | ((uint64_t) readU32(p + 4) << 32);
+}
+
+/// Serializes queries into the form they are stored and compared in.
+/// Arrays are numbered in order of first use and described by their size
+/// and constant values. Shared subexpressions and update lists are
+/// written once and referred back to afterwards, so queries that differ
+/// only in how much they share are told apart, which costs a miss but
+/// never a wrong answer.
+class QueryWriter {
+  bytes_ty &buffer;
+  unordered_map<const Array *, unsigned> arrays;
+  unordered_map<const Expr *, unsigned> exprs;
+  unordered_map<const UpdateNode *, unsigned> updates;
+
+  enum {
+    NullTag,
+    BackrefTag,
+    NodeTag
+  };
+
+  void writeUpdates(const UpdateList &ul) {
+    writeArray(ul.root);
+
+    // Write the updates not written before, oldest first.
+    std::vector<const UpdateNode *> fresh;
+    const UpdateNode *un = ul.head;
+    for (; un && !updates.count(un); un = un->next)
+      fresh.push_back(un);
+
+    writeU32(buffer, fresh.size());
+    if (un) {
+      buffer.push_back(BackrefTag);
+      writeU32(buffer, updates[un]);
+    } else {
+      buffer.push_back(NullTag);
+    }
+    while (!fresh.empty()) {
+      writeExpr(fresh.back()->index);
+      writeExpr(fresh.back()->value);
+      unsigned id = updates.size();
+      updates.insert(std::make_pair(fresh.back(), id));
+      fresh.pop_back();
+    }
+  }
+
+public:
+  explicit QueryWriter(bytes_ty &_buffer) : buffer(_buffer) {}
+
+  void writeArray(const Array *array) {
+    std::pair<unordered_map<const Array *, unsigned>::iterator, bool> res =
+        arrays.insert(std::make_pair(array, (unsigned) arrays.size()));
+    if (!res.second) {
+      buffer.push_back(BackrefTag);
+      writeU32(buffer, res.first->second);
+      return;
+    }
+    buffer.push_back(NodeTag);
+    writeU32(buffer, array->size);
+    writeU32(buffer, array->domain);
+    writeU32(buffer, array->range);
+    writeU32(buffer, array->constantValues.size());
+    for (unsigned i = 0; i < array->constantValues.size(); ++i)
+      writeU64(buffer, array->constantValues[i]->getZExtValue());
+  }
+
+  void writeExpr(const ref<Expr> &e) {
+    unordered_map<const Expr *, unsigned>::iterator it = exprs.find(e.get());
+    if (it != exprs.end()) {
+      buffer.push_back(BackrefTag);
+      writeU32(buffer, it->second);
+      return;
+    }
+
+    buffer.push_back(NodeTag);
+    buffer.push_back(e->getKind());
+    writeU32(buffer, e->getWidth());
+    if (const ConstantExpr *CE = dyn_cast<ConstantExpr>(e)) {
+      const llvm::APInt &value = CE->getAPValue();
+      for (unsigned i = 0; i < value.getNumWords(); ++i)
+        writeU64(buffer, value.getRawData()[i]);
+    } else if (const ReadExpr *RE = dyn_cast<ReadExpr>(e)) {
+      writeUpdates(RE->updates);
+      writeExpr(RE->index);
+    } else {
+      if (const ExtractExpr *EE = dyn_cast<ExtractExpr>(e))
+        writeU32(buffer, EE->offset);
+      for (unsigned i = 0; i < e->getNumKids(); ++i)
+        writeExpr(e->getKid(i));
+    }
+
+    unsigned id = exprs.size();
+    exprs.insert(std::make_pair(e.get(), id));
+  }
+
+  void writeQuery(const Query &query) {
+    writeU32(buffer, query.constraints.size());
+    for (ConstraintManager::constraint_iterator it = query.constraints.begin(),
+           ie = query.constraints.end(); it != ie; ++it)
+      writeExpr(*it);
+    writeExpr(query.expr);
+  }
+
+  void writeObjects(const std::vector<const Array *> &objects) {
+    writeU32(buffer, objects.size());
+    for (unsigned i = 0; i < objects.size(); ++i)
+      writeArray(objects[i]);
+  }
+};
+
+/// The header of a cache entry as stored on disk. It is followed by the
+/// serialized query and the result, padded to 8 bytes.
+struct RecordHeader {
+  enum Kind {
+    Validity = 1,
+    Value = 2,
+    InitialValues = 3
+  };
+
+  uint32_t magic;
+  uint32_t checksum;
+  uint32_t kind;
+  uint32_t keySize;
+  uint32_t resultSize;
+  uint32_t padding;
+
+  static const uint32_t Magic = 0x4b514332; // "KQC2"
+
+  size_t getSize() const {
+    return (sizeof(RecordHeader) + keySize + resultSize + 7) & ~(size_t) 7;
+  }
+
+  const unsigned char *getKey() const {
+    return (const unsigned char *) (this + 1);
+  }
+
+  const unsigned char *getResult() const { return getKey() + keySize; }
+
+  uint32_t computeChecksum() const {
+    // FNV-1a over the kind, sizes and contents.
+    uint32_t sum = 2166136261U;
+    const unsigned char *p = (const unsigned char *) &kind;
+    for (unsigned i = 0; i != 3 * sizeof(uint32_t); ++i)
+      sum = (sum ^ p[i]) * 16777619U;
+    for (p = getKey(); p != getResult() + resultSize; ++p)
+      sum = (sum ^ *p) * 16777619U;
+    return sum;
+  }
+};
+
+uint64_t hashKey(uint32_t kind, const unsigned char *key, size_t size) {
+  uint64_t hash = 14695981039346656037ULL ^ kind;
+  for (size_t i = 0; i != size; ++i)
+    hash = (hash ^ key[i]) * 1099511628211ULL;
+  return hash;
+}
+
+class PersistentCache {
+  int fd;
+  size_t pageSize;
+
+  /// The file is read through windows which reach past its end as it was
+  /// when they were mapped, so records appended later usually show up in
+  /// the last window without mapping anything. A new window, starting at
+  /// the first unread record, is only needed once the file outgrows the
+  /// last one. Records are read in place, so windows stay mapped.
+  struct Window {
+    const char *data;
+    size_t offset, size;
+  };
+  std::vector<Window> windows;
+  /// The file offset of the first record not indexed yet.
+  size_t scanned;
+  bool corrupt;
+
+  /// The records indexed so far, by hashKey() of their kind and query.
+  typedef unordered_multimap<uint64_t, const RecordHeader *> index_ty;
+  index_ty records;
+
+  /// Index the records appended since the last refresh, by us or by
+  /// other processes sharing the file. Returns false if there were none.
+  bool refresh() {
+    struct stat st;
+    if (corrupt || fstat(fd, &st) < 0 || (size_t) st.st_size <= scanned)
+      return false;
+    size_t size = st.st_size;
+
+    if (windows.empty() ||
+        windows.back().offset + windows.back().size < size) {
+      Window w;
+      w.offset = scanned & ~(pageSize - 1);
+      w.size = std::max(2 * (size - w.offset), (size_t) 1 << 20);
+      w.size = (w.size + pageSize - 1) & ~(pageSize - 1);
+      void *p = mmap(0, w.size, PROT_READ, MAP_SHARED, fd, w.offset);
+      if (p == MAP_FAILED) {
+        klee_warning_once(0, "unable to map persistent query cache: %s",
+                          strerror(errno));
+        return false;
+      }
+      w.data = static_cast<const char *>(p);
+      windows.push_back(w);
+    }
+
+    const Window &w = windows.back();
+    size_t start = scanned;
+    while (scanned + sizeof(RecordHeader) <= size) {
+      const RecordHeader *r =
+          (const RecordHeader *) (w.data + (scanned - w.offset));
+      if (r->magic != RecordHeader::Magic) {
+        klee_warning("persistent query cache is corrupt, ignoring the rest");
+        corrupt = true;
+        break;
+      }
+      size_t next = scanned + r->getSize();
+      // Not all there yet, or still being written.
+      if (next > size || (r->checksum != r->computeChecksum() && next == size))
+        break;
+      if (r->checksum == r->computeChecksum())
+        records.insert(std::make_pair(hashKey(r->kind, r->getKey(),
+                                              r->keySize), r));
+      scanned = next;
+    }
+    return scanned != start;
+  }
+
+  void find(uint32_t kind, const bytes_ty &key, uint64_t hash,
+            std::vector<const RecordHeader *> &result) {
+    std::pair<index_ty::iterator, index_ty::iterator> range =
+        records.equal_range(hash);
+    for (index_ty::iterator it = range.first; it != range.second; ++it) {
+      const RecordHeader *r = it->second;
+      if (r->kind == kind && r->keySize == key.size() &&
+          !memcmp(r->getKey(), &key[0], key.size()))
+        result.push_back(r);
+    }
+  }
+
+public:
+  PersistentCache(int _fd)
+    : fd(_fd), pageSize(sysconf(_SC_PAGESIZE)), scanned(0), corrupt(false) {
+    refresh();
+  }
+
+  ~PersistentCache() {
+    for (unsigned i = 0; i < windows.size(); ++i)
+      munmap((void *) windows[i].data, windows[i].size);
+    close(fd);
+  }
+
+  /// Find the records of the given kind for the serialized query \a key,
+  /// looking at what was appended to the file if there are none.
+  void lookup(uint32_t kind, const bytes_ty &key,
+              std::vector<const RecordHeader *> &result) {
+    uint64_t hash = hashKey(kind, &key[0], key.size());
+    find(kind, key, hash, result);
+    if (result.empty() && refresh())
+      find(kind, key, hash, result);
+  }
+
+  void append(uint32_t kind, const bytes_ty &key, const bytes_ty &result) {
+    RecordHeader header;
+    memset(&header, 0, sizeof header);
+    header.magic = RecordHeader::Magic;
+    header.kind = kind;
+    header.keySize = key.size();
+    header.resultSize = result.size();
+
+    std::vector<char> buffer(header.getSize(), 0);
+    memcpy(&buffer[0], &header, sizeof header);
+    memcpy(&buffer[sizeof header], &key[0], key.size());
+    if (!result.empty())
+      memcpy(&buffer[sizeof header + key.size()], &result[0], result.size());
+    RecordHeader *r = (RecordHeader *) &buffer[0];
+    r->checksum = r->computeChecksum();
+
+    ssize_t n;
+    do {
+      n = write(fd, &buffer[0], buffer.size());
+    } while (n < 0 && errno == EINTR);
+    if (n != (ssize_t) buffer.size())
+      klee_warning_once(0, "unable to write to persistent query cache: %s",
+                        strerror(errno));
+  }
+};
+
+/// Merge two facts known about the same query.
+IncompleteSolver::PartialValidity
+combine(IncompleteSolver::PartialValidity a,
+        IncompleteSolver::PartialValidity b) {
+  if (a == b || a == IncompleteSolver::MustBeTrue ||
+      a == IncompleteSolver::MustBeFalse ||
+      a == IncompleteSolver::TrueOrFalse)
+    return a;
+  if (b == IncompleteSolver::MustBeTrue ||
+      b == IncompleteSolver::MustBeFalse ||
+      b == IncompleteSolver::TrueOrFalse)
+    return b;
+  // One of each of MayBeTrue and MayBeFalse.
+  return IncompleteSolver::TrueOrFalse;
+}
+
+class PersistentCachingSolver : public SolverImpl {
+private:
+  Solver *solver;
+  PersistentCache *cache;
+
+  bool lookupValidity(const bytes_ty &key,
+                      IncompleteSolver::PartialValidity &result);
+  void insertValidity(const bytes_ty &key,
+                      IncompleteSolver::PartialValidity validity);
+
+public:
+  PersistentCachingSolver(Solver *_solver, PersistentCache *_cache)
+    : solver(_solver), cache(_cache) {}
+  ~PersistentCachingSolver() {
+    delete cache;
+    delete solver;
+  }
+
+  bool computeValidity(const Query &, Solver::Validity &result);
+  bool computeTruth(const Query &, bool &isValid);
+  bool computeValue(const Query &, ref<Expr> &result);
+  bool computeInitialValues(const Query &query,
+                            const std::vector<const Array *> &objects,
+                            std::vector<std::vector<unsigned char> > &values,
+                            bool &hasSolution);
+  SolverRunStatus getOperationStatusCode();
+  char *getConstraintLog(const Query &);
+  void setCoreSolverTimeout(double timeout);
+};
+}
+
+bool PersistentCachingSolver::lookupValidity(
+    const bytes_ty &key, IncompleteSolver::PartialValidity &result) {
+  std::vector<const RecordHeader *> found;
+  cache->lookup(RecordHeader::Validity, key, found);
+  bool hasResult = false;
+  for (unsigned i = 0; i < found.size(); ++i) {
+    if (found[i]->resultSize != 1)
+      continue;
+    IncompleteSolver::PartialValidity v =
+        (IncompleteSolver::PartialValidity) (int8_t) found[i]->getResult()[0];
+    result = hasResult ? combine(result, v) : v;
+    hasResult = true;
+  }
+  return hasResult;
+}
+
+void PersistentCachingSolver::insertValidity(
+    const bytes_ty &key, IncompleteSolver::PartialValidity validity) {
+  IncompleteSolver::PartialValidity known;
+  if (lookupValidity(key, known) && combine(known, validity) == known)
+    return;
+  cache->append(RecordHeader::Validity, key,
+                bytes_ty(1, (unsigned char) (int8_t) validity));
+}
+
+bool PersistentCachingSolver::computeValidity(const Query &query,
+                                              Solver::Validity &result) {
+  bytes_ty key;
+  QueryWriter(key).writeQuery(query);
+  IncompleteSolver::PartialValidity cached;
+  bool hasCached = lookupValidity(key, cached);
+
+  if (hasCached) {
+    switch (cached) {
+    case IncompleteSolver::MustBeTrue:
+      ++stats::queryPersistentCacheHits;
+      result = Solver::True;
+      return true;
+    case IncompleteSolver::MustBeFalse:
+      ++stats::queryPersistentCacheHits;
+      result = Solver::False;
+      return true;
+    case IncompleteSolver::TrueOrFalse:
+      ++stats::queryPersistentCacheHits;
+      result = Solver::Unknown;
+      return true;
+    default:
+      break;
+    }
+  }
+
+  ++stats::queryPersistentCacheMisses;
+  if (!solver->impl->computeValidity(query, result))
+    return false;
+
+  switch (result) {
+  case Solver::True:
+    cached = IncompleteSolver::MustBeTrue; break;
+  case Solver::False:
+    cached = IncompleteSolver::MustBeFalse; break;
+  default:
+    cached = IncompleteSolver::TrueOrFalse; break;
+  }
+  insertValidity(key, cached);
+  return true;
+}
+
+bool PersistentCachingSolver::computeTruth(const Query &query,
+                                           bool &isValid) {
+  bytes_ty key;
+  QueryWriter(key).writeQuery(query);
+  IncompleteSolver::PartialValidity cached;
+  bool hasCached = lookupValidity(key, cached);
+
+  // a cached result of MayBeTrue forces us to check whether
+  // a False assignment exists.
+  if (hasCached && cached != IncompleteSolver::MayBeTrue) {
+    ++stats::queryPersistentCacheHits;
+    isValid = (cached == IncompleteSolver::MustBeTrue);
+    return true;
+  }
+
+  ++stats::queryPersistentCacheMisses;
+  if (!solver->impl->computeTruth(query, isValid))
+    return false;
+
+  insertValidity(key, isValid ? IncompleteSolver::MustBeTrue
+                              : IncompleteSolver::MayBeFalse);
+  return true;
+}
+
+bool PersistentCachingSolver::computeValue(const Query &query,
+                                           ref<Expr> &result) {
+  Expr::Width width = query.expr->getWidth();
+  bytes_ty key;
+  QueryWriter(key).writeQuery(query);
+  unsigned numWords = (width + 63) / 64;
+
+  // The result is the width followed by the words of the value.
+  std::vector<const RecordHeader *> found;
+  cache->lookup(RecordHeader::Value, key, found);
+  for (unsigned i = 0; i < found.size(); ++i) {
+    const unsigned char *p = found[i]->getResult();
+    if (found[i]->resultSize != 4 + 8 * numWords || readU32(p) != width)
+      continue;
+    std::vector<uint64_t> words(numWords);
+    for (unsigned j = 0; j < numWords; ++j)
+      words[j] = readU64(p + 4 + 8 * j);
+    ++stats::queryPersistentCacheHits;
+    result = ConstantExpr::alloc(llvm::APInt(width, numWords, &words[0]));
+    return true;
+  }
+
+  ++stats::queryPersistentCacheMisses;
+  if (!solver->impl->computeValue(query, result))
+    return false;
+
+  if (ConstantExpr *CE = dyn_cast<ConstantExpr>(result)) {
+    const llvm::APInt &value = CE->getAPValue();
+    bytes_ty data;
+    writeU32(data, width);
+    for (unsigned j = 0; j < numWords; ++j)
+      writeU64(data, value.getRawData()[j]);
+    cache->append(RecordHeader::Value, key, data);
+  }
+  return true;
+}
+
+bool PersistentCachingSolver::computeInitialValues(
+    const Query &query, const std::vector<const Array *> &objects,
+    std::vector<std::vector<unsigned char> > &values, bool &hasSolution) {
+  bytes_ty key;
+  QueryWriter writer(key);
+  writer.writeQuery(query);
+  writer.writeObjects(objects);
+
+  // The result is whether there is a solution, followed by the bytes of
+  // each object if so.
+  std::vector<const RecordHeader *> found;
+  cache->lookup(RecordHeader::InitialValues, key, found);
+  for (unsigned i = 0; i < found.size(); ++i) {
+    const unsigned char *p = found[i]->getResult();
+    size_t size = 1;
+    if (*p)
+      for (unsigned j = 0; j < objects.size(); ++j)
+        size += objects[j]->size;
+    if (found[i]->resultSize != size)
+      continue;
+    ++stats::queryPersistentCacheHits;
+    hasSolution = *p++;
+    if (hasSolution) {
+      values.resize(objects.size());
+      for (unsigned j = 0; j < objects.size(); ++j) {
+        values[j].assign(p, p + objects[j]->size);
+        p += objects[j]->size;
+      }
+    }
+    return true;
+  }
+
+  ++stats::queryPersistentCacheMisses;
+  if (!solver->impl->computeInitialValues(query, objects, values,
+                                          hasSolution))
+    return false;
+
+  bytes_ty data(1, hasSolution);
+  if (hasSolution)
+    for (unsigned i = 0; i < objects.size(); ++i)
+      data.insert(data.end(), values[i].begin(), values[i].end());
+  cache->append(RecordHeader::InitialValues, key, data);
+  return true;
+}
+
+SolverImpl::SolverRunStatus PersistentCachingSolver::getOperationStatusCode() {
+  return solver->impl->getOperationStatusCode();
+}
+
+char *PersistentCachingSolver::getConstraintLog(const Query &query) {
+  return solver->impl->getConstraintLog(query);
+}
+
+void PersistentCachingSolver::setCoreSolverTimeout(double timeout) {
+  solver->impl->setCoreSolverTimeout(timeout);
+}
+
+///
+
+Solver *klee::createPersistentCachingSolver(Solver *_solver,
+                                            std::string path) {
+  int fd = open(path.c_str(), O_RDWR | O_CREAT | O_APPEND, 0644);
+  if (fd < 0) {
+    klee_warning("unable to open persistent query cache %s: %s",
+                 path.c_str(), strerror(errno));
+    return _solver;
+  }
+  return new Solver(
+      new PersistentCachingSolver(_solver, new PersistentCache(fd)));
+}
+
+#undef unordered_map
+#undef unordered_multimap
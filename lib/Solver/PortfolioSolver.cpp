@@ -0,0 +1,335 @@
+//===-- PortfolioSolver.cpp -----------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "klee/Solver.h"
+#include "klee/SolverImpl.h"
+#include "klee/SolverStats.h"
+#include "klee/Constraints.h"
+#include "klee/TimerStatIncrementer.h"
+#include "klee/Internal/System/Time.h"
+#include "klee/util/Assignment.h"
+#include "klee/util/ExprUtil.h"
+
+#include "llvm/Support/ErrorHandling.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+using namespace klee;
+
+namespace {
+
+/// What a backend reports back to the parent, followed by the values
+/// of all objects if the query has a solution.
+struct BackendResult {
+  int32_t status;
+  uint8_t hasSolution;
+};
+
+class PortfolioSolverImpl : public SolverImpl {
+private:
+  std::vector<std::pair<CoreSolverType, Solver *> > backends;
+  double timeout;
+  SolverRunStatus runStatusCode;
+
+  SolverRunStatus runBackends(const Query &,
+                              const std::vector<const Array *> &objects,
+                              std::vector<std::vector<unsigned char> > &values,
+                              bool &hasSolution);
+
+public:
+  PortfolioSolverImpl(
+      const std::vector<std::pair<CoreSolverType, Solver *> > &_backends);
+  ~PortfolioSolverImpl();
+
+  char *getConstraintLog(const Query &);
+  void setCoreSolverTimeout(double _timeout);
+
+  bool computeTruth(const Query &, bool &isValid);
+  bool computeValue(const Query &, ref<Expr> &result);
+  bool computeInitialValues(const Query &,
+                            const std::vector<const Array *> &objects,
+                            std::vector<std::vector<unsigned char> > &values,
+                            bool &hasSolution);
+  SolverRunStatus getOperationStatusCode();
+};
+}
+
+static bool writeAll(int fd, const void *buf, size_t size) {
+  const char *p = static_cast<const char *>(buf);
+  while (size) {
+    ssize_t n = write(fd, p, size);
+    if (n < 0) {
+      if (errno == EINTR)
+        continue;
+      return false;
+    }
+    p += n;
+    size -= n;
+  }
+  return true;
+}
+
+static bool readAll(int fd, void *buf, size_t size) {
+  char *p = static_cast<char *>(buf);
+  while (size) {
+    ssize_t n = read(fd, p, size);
+    if (n < 0) {
+      if (errno == EINTR)
+        continue;
+      return false;
+    }
+    if (n == 0)
+      return false;
+    p += n;
+    size -= n;
+  }
+  return true;
+}
+
+static Statistic &getWinStatistic(CoreSolverType cst) {
+  switch (cst) {
+  case STP_SOLVER:
+    return stats::queryPortfolioWinsSTP;
+  case Z3_SOLVER:
+    return stats::queryPortfolioWinsZ3;
+  case METASMT_SOLVER:
+    return stats::queryPortfolioWinsMetaSMT;
+  default:
+    llvm_unreachable("backend cannot answer queries");
+  }
+}
+
+PortfolioSolverImpl::PortfolioSolverImpl(
+    const std::vector<std::pair<CoreSolverType, Solver *> > &_backends)
+    : backends(_backends), timeout(0.0),
+      runStatusCode(SOLVER_RUN_STATUS_FAILURE) {
+  assert(!backends.empty() && "portfolio without backends");
+}
+
+PortfolioSolverImpl::~PortfolioSolverImpl() {
+  for (unsigned i = 0; i < backends.size(); ++i)
+    delete backends[i].second;
+}
+
+char *PortfolioSolverImpl::getConstraintLog(const Query &query) {
+  return backends[0].second->getConstraintLog(query);
+}
+
+void PortfolioSolverImpl::setCoreSolverTimeout(double _timeout) {
+  timeout = _timeout;
+  for (unsigned i = 0; i < backends.size(); ++i)
+    backends[i].second->setCoreSolverTimeout(_timeout);
+}
+
+bool PortfolioSolverImpl::computeTruth(const Query &query, bool &isValid) {
+  std::vector<const Array *> objects;
+  std::vector<std::vector<unsigned char> > values;
+  bool hasSolution;
+
+  if (!computeInitialValues(query, objects, values, hasSolution))
+    return false;
+
+  isValid = !hasSolution;
+  return true;
+}
+
+bool PortfolioSolverImpl::computeValue(const Query &query, ref<Expr> &result) {
+  std::vector<const Array *> objects;
+  std::vector<std::vector<unsigned char> > values;
+  bool hasSolution;
+
+  // Find the object used in the expression, and compute an assignment
+  // for them.
+  findSymbolicObjects(query.expr, objects);
+  if (!computeInitialValues(query.withFalse(), objects, values, hasSolution))
+    return false;
+  assert(hasSolution && "state has invalid constraint set");
+
+  // Evaluate the expression with the computed assignment.
+  Assignment a(objects, values);
+  result = a.evaluate(query.expr);
+
+  return true;
+}
+
+bool PortfolioSolverImpl::computeInitialValues(
+    const Query &query, const std::vector<const Array *> &objects,
+    std::vector<std::vector<unsigned char> > &values, bool &hasSolution) {
+  TimerStatIncrementer t(stats::queryTime);
+
+  ++stats::queries;
+  if (!objects.empty())
+    ++stats::queryCounterexamples;
+
+  runStatusCode = runBackends(query, objects, values, hasSolution);
+  if (runStatusCode != SOLVER_RUN_STATUS_SUCCESS_SOLVABLE &&
+      runStatusCode != SOLVER_RUN_STATUS_SUCCESS_UNSOLVABLE)
+    return false;
+
+  if (hasSolution)
+    ++stats::queriesInvalid;
+  else
+    ++stats::queriesValid;
+  return true;
+}
+
+SolverImpl::SolverRunStatus PortfolioSolverImpl::runBackends(
+    const Query &query, const std::vector<const Array *> &objects,
+    std::vector<std::vector<unsigned char> > &values, bool &hasSolution) {
+  unsigned n = backends.size();
+  std::vector<pid_t> pids;
+  std::vector<struct pollfd> fds;
+
+  fflush(stdout);
+  fflush(stderr);
+
+  for (unsigned i = 0; i < n; ++i) {
+    int p[2];
+    if (pipe(p) < 0) {
+      fprintf(stderr, "error: unable to create pipe for solver: %s\n",
+              strerror(errno));
+      break;
+    }
+
+    pid_t pid = fork();
+    if (pid < 0) {
+      fprintf(stderr, "error: unable to fork solver: %s\n", strerror(errno));
+      close(p[0]);
+      close(p[1]);
+      break;
+    }
+
+    if (pid == 0) {
+      close(p[0]);
+      for (unsigned j = 0; j < fds.size(); ++j)
+        close(fds[j].fd);
+
+      SolverImpl *impl = backends[i].second->impl;
+      std::vector<std::vector<unsigned char> > result;
+      bool solvable = false;
+      BackendResult br;
+      impl->computeInitialValues(query, objects, result, solvable);
+      br.status = impl->getOperationStatusCode();
+      br.hasSolution = solvable;
+
+      bool ok = writeAll(p[1], &br, sizeof br);
+      if (br.status == SOLVER_RUN_STATUS_SUCCESS_SOLVABLE)
+        for (unsigned j = 0; ok && j < result.size(); ++j)
+          ok = result[j].empty() ||
+               writeAll(p[1], &result[j][0], result[j].size());
+      _exit(ok ? 0 : 1);
+    }
+
+    close(p[1]);
+    pids.push_back(pid);
+    struct pollfd pfd;
+    pfd.fd = p[0];
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+    fds.push_back(pfd);
+  }
+
+  if (pids.empty())
+    return SOLVER_RUN_STATUS_FORK_FAILED;
+
+  // Take the first backend that answers. One that gives up does not end
+  // the race as long as others are still running.
+  SolverRunStatus status = SOLVER_RUN_STATUS_FAILURE;
+  double deadline = timeout ? util::getWallTime() + timeout : 0;
+  unsigned running = pids.size();
+  int winner = -1;
+
+  while (running && winner < 0) {
+    int wait = -1;
+    if (deadline) {
+      double left = deadline - util::getWallTime();
+      if (left <= 0) {
+        status = SOLVER_RUN_STATUS_TIMEOUT;
+        break;
+      }
+      wait = (int) (left * 1000) + 1;
+    }
+
+    int res = poll(&fds[0], fds.size(), wait);
+    if (res < 0) {
+      if (errno == EINTR)
+        continue;
+      status = SOLVER_RUN_STATUS_INTERRUPTED;
+      break;
+    }
+
+    for (unsigned i = 0; i < fds.size() && winner < 0; ++i) {
+      if (fds[i].fd < 0 || !fds[i].revents)
+        continue;
+
+      BackendResult br;
+      if (!readAll(fds[i].fd, &br, sizeof br)) {
+        status = SOLVER_RUN_STATUS_INTERRUPTED;
+      } else if (br.status == SOLVER_RUN_STATUS_SUCCESS_SOLVABLE) {
+        values = std::vector<std::vector<unsigned char> >(objects.size());
+        bool ok = true;
+        for (unsigned j = 0; ok && j < objects.size(); ++j) {
+          values[j].resize(objects[j]->size);
+          ok = values[j].empty() ||
+               readAll(fds[i].fd, &values[j][0], values[j].size());
+        }
+        if (ok) {
+          hasSolution = true;
+          status = SOLVER_RUN_STATUS_SUCCESS_SOLVABLE;
+          winner = i;
+        } else {
+          status = SOLVER_RUN_STATUS_INTERRUPTED;
+        }
+      } else if (br.status == SOLVER_RUN_STATUS_SUCCESS_UNSOLVABLE) {
+        hasSolution = false;
+        status = SOLVER_RUN_STATUS_SUCCESS_UNSOLVABLE;
+        winner = i;
+      } else {
+        status = (SolverRunStatus) br.status;
+      }
+
+      if (winner < 0) {
+        close(fds[i].fd);
+        fds[i].fd = -1;
+        --running;
+      }
+    }
+  }
+
+  for (unsigned i = 0; i < pids.size(); ++i) {
+    if ((int) i != winner)
+      kill(pids[i], SIGKILL);
+    if (fds[i].fd >= 0)
+      close(fds[i].fd);
+
+    int s;
+    while (waitpid(pids[i], &s, 0) < 0 && errno == EINTR)
+      ;
+  }
+
+  if (winner >= 0)
+    ++getWinStatistic(backends[winner].first);
+
+  return status;
+}
+
+SolverImpl::SolverRunStatus PortfolioSolverImpl::getOperationStatusCode() {
+  return runStatusCode;
+}
+
+Solver *klee::createPortfolioSolver(
+    const std::vector<std::pair<CoreSolverType, Solver *> > &backends) {
+  return new Solver(new PortfolioSolverImpl(backends));
+}
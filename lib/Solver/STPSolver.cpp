@@ -67,6 +67,12 @@ private:
   bool useForkedSTP;
   SolverRunStatus runStatusCode;
 
+  /// Solve the validity query \a expr under the constraints asserted in
+  /// the validity checker.
+  bool runQuery(ref<Expr> expr, const std::vector<const Array *> &objects,
+                std::vector<std::vector<unsigned char> > &values,
+                bool &hasSolution);
+
 public:
   STPSolverImpl(bool _useForkedSTP, bool _optimizeDivides = true);
   ~STPSolverImpl();
@@ -75,6 +81,9 @@ public:
   void setCoreSolverTimeout(double _timeout) { timeout = _timeout; }
 
   bool computeTruth(const Query &, bool &isValid);
+  bool computeValidities(const ConstraintManager &constraints,
+                         const std::vector<ref<Expr> > &exprs,
+                         std::vector<Solver::Validity> &results);
   bool computeValue(const Query &, ref<Expr> &result);
   bool computeInitialValues(const Query &,
                             const std::vector<const Array *> &objects,
@@ -128,8 +137,8 @@ STPSolverImpl::~STPSolverImpl() {
 
 char *STPSolverImpl::getConstraintLog(const Query &query) {
   vc_push(vc);
-  for (std::vector<ref<Expr> >::const_iterator it = query.constraints.begin(),
-                                               ie = query.constraints.end();
+  for (ConstraintManager::const_iterator it = query.constraints.begin(),
+                                         ie = query.constraints.end();
        it != ie; ++it)
     vc_assertFormula(vc, builder->construct(*it));
   assert(query.expr == ConstantExpr::alloc(0, Expr::Bool) &&
@@ -155,6 +164,43 @@ bool STPSolverImpl::computeTruth(const Query &query, bool &isValid) {
   return true;
 }
 
+bool STPSolverImpl::computeValidities(const ConstraintManager &constraints,
+                                      const std::vector<ref<Expr> > &exprs,
+                                      std::vector<Solver::Validity> &results) {
+  TimerStatIncrementer t(stats::queryTime);
+
+  // The constraints are asserted and constructed once for all queries.
+  vc_push(vc);
+  for (ConstraintManager::const_iterator it = constraints.begin(),
+                                         ie = constraints.end();
+       it != ie; ++it)
+    vc_assertFormula(vc, builder->construct(*it));
+
+  std::vector<const Array *> objects;
+  std::vector<std::vector<unsigned char> > values;
+  results.resize(exprs.size());
+  bool success = true;
+  for (unsigned i = 0; i != exprs.size(); ++i) {
+    bool hasSolution;
+    success = runQuery(exprs[i], objects, values, hasSolution);
+    if (!success)
+      break;
+    if (!hasSolution) {
+      results[i] = Solver::True;
+      continue;
+    }
+    success = runQuery(Expr::createIsZero(exprs[i]), objects, values,
+                       hasSolution);
+    if (!success)
+      break;
+    results[i] = hasSolution ? Solver::Unknown : Solver::False;
+  }
+
+  vc_pop(vc);
+
+  return success;
+}
+
 bool STPSolverImpl::computeValue(const Query &query, ref<Expr> &result) {
   std::vector<const Array *> objects;
   std::vector<std::vector<unsigned char> > values;
@@ -321,8 +367,6 @@ runAndGetCexForked(::VC vc, STPBuilder *builder, ::VCExpr q,
 bool STPSolverImpl::computeInitialValues(
     const Query &query, const std::vector<const Array *> &objects,
     std::vector<std::vector<unsigned char> > &values, bool &hasSolution) {
-  runStatusCode = SOLVER_RUN_STATUS_FAILURE;
-
   TimerStatIncrementer t(stats::queryTime);
 
   vc_push(vc);
@@ -332,10 +376,23 @@ bool STPSolverImpl::computeInitialValues(
        it != ie; ++it)
     vc_assertFormula(vc, builder->construct(*it));
 
+  bool success = runQuery(query.expr, objects, values, hasSolution);
+
+  vc_pop(vc);
+
+  return success;
+}
+
+bool STPSolverImpl::runQuery(ref<Expr> expr,
+                             const std::vector<const Array *> &objects,
+                             std::vector<std::vector<unsigned char> > &values,
+                             bool &hasSolution) {
+  runStatusCode = SOLVER_RUN_STATUS_FAILURE;
+
   ++stats::queries;
   ++stats::queryCounterexamples;
 
-  ExprHandle stp_e = builder->construct(query.expr);
+  ExprHandle stp_e = builder->construct(expr);
 
   if (DebugDumpSTPQueries) {
     char *buf;
@@ -363,8 +420,6 @@ bool STPSolverImpl::computeInitialValues(
       ++stats::queriesValid;
   }
 
-  vc_pop(vc);
-
   return success;
 }
 
@@ -45,6 +45,35 @@ bool Solver::evaluate(const Query& query, Validity &result) {
   return impl->computeValidity(query, result);
 }
 
+bool Solver::evaluate(const ConstraintManager &constraints,
+                      const std::vector< ref<Expr> > &exprs,
+                      std::vector<Validity> &results) {
+  results.resize(exprs.size());
+
+  // Maintain invariants implementations expect.
+  std::vector< ref<Expr> > pending;
+  std::vector<unsigned> pendingIndices;
+  for (unsigned i = 0; i != exprs.size(); ++i) {
+    assert(exprs[i]->getWidth() == Expr::Bool && "Invalid expression type!");
+    if (ConstantExpr *CE = dyn_cast<ConstantExpr>(exprs[i])) {
+      results[i] = CE->isTrue() ? True : False;
+    } else {
+      pending.push_back(exprs[i]);
+      pendingIndices.push_back(i);
+    }
+  }
+
+  if (pending.empty())
+    return true;
+
+  std::vector<Validity> pendingResults;
+  if (!impl->computeValidities(constraints, pending, pendingResults))
+    return false;
+  for (unsigned i = 0; i != pending.size(); ++i)
+    results[pendingIndices[i]] = pendingResults[i];
+  return true;
+}
+
 bool Solver::mustBeTrue(const Query& query, bool &result) {
   assert(query.expr->getWidth() == Expr::Bool && "Invalid expression type!");
 
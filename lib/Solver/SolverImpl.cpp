@@ -28,6 +28,16 @@ bool SolverImpl::computeValidity(const Query &query, Solver::Validity &result) {
   return true;
 }
 
+bool SolverImpl::computeValidities(const ConstraintManager &constraints,
+                                   const std::vector< ref<Expr> > &exprs,
+                                   std::vector<Solver::Validity> &results) {
+  results.resize(exprs.size());
+  for (unsigned i = 0; i != exprs.size(); ++i)
+    if (!computeValidity(Query(constraints, exprs[i]), results[i]))
+      return false;
+  return true;
+}
+
 const char *SolverImpl::getOperationStatusString(SolverRunStatus statusCode) {
   switch (statusCode) {
   case SOLVER_RUN_STATUS_SUCCESS_SOLVABLE:
@@ -19,9 +19,19 @@ Statistic stats::queryCacheHits("QueryCacheHits", "QChits") ;
 Statistic stats::queryCacheMisses("QueryCacheMisses", "QCmisses");
 Statistic stats::queryCexCacheHits("QueryCexCacheHits", "QCexHits") ;
 Statistic stats::queryCexCacheMisses("QueryCexCacheMisses", "QCexMisses");
+Statistic stats::queryCexCacheEvictions("QueryCexCacheEvictions", "QCexEvictions");
+Statistic stats::queryConstraintsReused("QueryConstraintsReused", "QCreused");
 Statistic stats::queryConstructTime("QueryConstructTime", "QBtime") ;
 Statistic stats::queryConstructs("QueriesConstructs", "QB");
 Statistic stats::queryCounterexamples("QueriesCEX", "Qcex");
+Statistic stats::queryPersistentCacheHits("QueryPersistentCacheHits",
+                                          "QPChits");
+Statistic stats::queryPersistentCacheMisses("QueryPersistentCacheMisses",
+                                            "QPCmisses");
+Statistic stats::queryPortfolioWinsMetaSMT("QueryPortfolioWinsMetaSMT",
+                                           "QPWmetasmt");
+Statistic stats::queryPortfolioWinsSTP("QueryPortfolioWinsSTP", "QPWstp");
+Statistic stats::queryPortfolioWinsZ3("QueryPortfolioWinsZ3", "QPWz3");
 Statistic stats::queryTime("QueryTime", "Qtime");
 
 #ifdef DEBUG
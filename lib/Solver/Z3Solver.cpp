@@ -12,9 +12,22 @@
 #include "klee/Constraints.h"
 #include "klee/Solver.h"
 #include "klee/SolverImpl.h"
+#include "klee/SolverStats.h"
 #include "klee/util/Assignment.h"
 #include "klee/util/ExprUtil.h"
 
+#include "llvm/Support/CommandLine.h"
+
+namespace {
+llvm::cl::opt<unsigned> Z3IncrementalContexts(
+    "z3-incremental-contexts",
+    llvm::cl::desc("Keep up to this many Z3 solvers that retain the "
+                   "constraints of earlier queries, and solve each query in "
+                   "the one sharing the longest prefix of its constraints "
+                   "(default=0 (off))"),
+    llvm::cl::init(0));
+}
+
 namespace klee {
 
 class Z3SolverImpl : public SolverImpl {
@@ -26,6 +39,32 @@ private:
   // Parameter symbols
   ::Z3_symbol timeoutParamStrSymbol;
 
+  /// A solver that keeps the constraints of earlier queries asserted,
+  /// each in its own scope so that they can be popped again.
+  struct IncrementalContext {
+    ::Z3_solver solver;
+    std::vector<ref<Expr> > asserted;
+    unsigned lastUse;
+  };
+  std::vector<IncrementalContext> contexts;
+  unsigned useCounter;
+
+  /// Pick the incremental context sharing the longest constraint prefix
+  /// with \a constraints and bring its assertions in line with them.
+  ::Z3_solver getIncrementalSolver(const ConstraintManager &constraints);
+
+  /// Get a solver with \a constraints asserted, to be given back with
+  /// releaseSolver().
+  ::Z3_solver acquireSolver(const ConstraintManager &constraints);
+  void releaseSolver(::Z3_solver theSolver);
+
+  /// Solve the validity query \a expr in a scope of its own on top of the
+  /// constraints asserted in \a theSolver.
+  bool runQuery(::Z3_solver theSolver, ref<Expr> expr,
+                const std::vector<const Array *> *objects,
+                std::vector<std::vector<unsigned char> > *values,
+                bool &hasSolution);
+
   bool internalRunSolver(const Query &,
                          const std::vector<const Array *> *objects,
                          std::vector<std::vector<unsigned char> > *values,
@@ -48,6 +87,9 @@ public:
   }
 
   bool computeTruth(const Query &, bool &isValid);
+  bool computeValidities(const ConstraintManager &constraints,
+                         const std::vector<ref<Expr> > &exprs,
+                         std::vector<Solver::Validity> &results);
   bool computeValue(const Query &, ref<Expr> &result);
   bool computeInitialValues(const Query &,
                             const std::vector<const Array *> &objects,
@@ -63,7 +105,7 @@ public:
 
 Z3SolverImpl::Z3SolverImpl()
     : builder(new Z3Builder(/*autoClearConstructCache=*/false)), timeout(0.0),
-      runStatusCode(SOLVER_RUN_STATUS_FAILURE) {
+      runStatusCode(SOLVER_RUN_STATUS_FAILURE), useCounter(0) {
   assert(builder && "unable to create Z3Builder");
   solverParameters = Z3_mk_params(builder->ctx);
   Z3_params_inc_ref(builder->ctx, solverParameters);
@@ -72,6 +114,8 @@ Z3SolverImpl::Z3SolverImpl()
 }
 
 Z3SolverImpl::~Z3SolverImpl() {
+  for (unsigned i = 0; i < contexts.size(); ++i)
+    Z3_solver_dec_ref(builder->ctx, contexts[i].solver);
   Z3_params_dec_ref(builder->ctx, solverParameters);
   delete builder;
 }
@@ -88,8 +132,8 @@ void Z3Solver::setCoreSolverTimeout(double timeout) {
 
 char *Z3SolverImpl::getConstraintLog(const Query &query) {
   std::vector<Z3ASTHandle> assumptions;
-  for (std::vector<ref<Expr> >::const_iterator it = query.constraints.begin(),
-                                               ie = query.constraints.end();
+  for (ConstraintManager::const_iterator it = query.constraints.begin(),
+                                         ie = query.constraints.end();
        it != ie; ++it) {
     assumptions.push_back(builder->construct(*it));
   }
@@ -134,6 +178,35 @@ bool Z3SolverImpl::computeTruth(const Query &query, bool &isValid) {
   return status;
 }
 
+bool Z3SolverImpl::computeValidities(const ConstraintManager &constraints,
+                                     const std::vector<ref<Expr> > &exprs,
+                                     std::vector<Solver::Validity> &results) {
+  TimerStatIncrementer t(stats::queryTime);
+  // The constraints are asserted once, and each expression is asked about
+  // in a scope popped again before the next.
+  Z3_solver theSolver = acquireSolver(constraints);
+  results.resize(exprs.size());
+  bool success = true;
+  for (unsigned i = 0; i != exprs.size(); ++i) {
+    bool hasSolution;
+    success = runQuery(theSolver, exprs[i], NULL, NULL, hasSolution);
+    if (!success)
+      break;
+    if (!hasSolution) {
+      results[i] = Solver::True;
+      continue;
+    }
+    success = runQuery(theSolver, Expr::createIsZero(exprs[i]), NULL, NULL,
+                       hasSolution);
+    if (!success)
+      break;
+    results[i] = hasSolution ? Solver::Unknown : Solver::False;
+  }
+  releaseSolver(theSolver);
+  builder->clearConstructCache();
+  return success;
+}
+
 bool Z3SolverImpl::computeValue(const Query &query, ref<Expr> &result) {
   std::vector<const Array *> objects;
   std::vector<std::vector<unsigned char> > values;
@@ -159,31 +232,100 @@ bool Z3SolverImpl::computeInitialValues(
   return internalRunSolver(query, &objects, &values, hasSolution);
 }
 
-bool Z3SolverImpl::internalRunSolver(
-    const Query &query, const std::vector<const Array *> *objects,
-    std::vector<std::vector<unsigned char> > *values, bool &hasSolution) {
-  TimerStatIncrementer t(stats::queryTime);
-  // TODO: Does making a new solver for each query have a performance
-  // impact vs making one global solver and using push and pop?
+::Z3_solver
+Z3SolverImpl::getIncrementalSolver(const ConstraintManager &constraints) {
+  // Queries from one state extend the path condition of earlier ones, and
+  // states forked from a common parent share its constraints as a prefix.
+  IncrementalContext *best = 0;
+  unsigned bestPrefix = 0;
+  for (unsigned i = 0; i < contexts.size(); ++i) {
+    IncrementalContext &ic = contexts[i];
+    unsigned prefix = 0;
+    ConstraintManager::const_iterator it = constraints.begin();
+    while (prefix < ic.asserted.size() && it != constraints.end() &&
+           ic.asserted[prefix] == *it)
+      ++prefix, ++it;
+    if (!best || prefix > bestPrefix ||
+        (prefix == bestPrefix && ic.lastUse > best->lastUse)) {
+      best = &ic;
+      bestPrefix = prefix;
+    }
+  }
+
+  // Start a new lineage instead of tearing down an unrelated one.
+  if (!bestPrefix && contexts.size() < Z3IncrementalContexts) {
+    IncrementalContext ic;
+    ic.solver = Z3_mk_simple_solver(builder->ctx);
+    Z3_solver_inc_ref(builder->ctx, ic.solver);
+    contexts.push_back(ic);
+    best = &contexts.back();
+  } else if (!bestPrefix) {
+    // Replace the least recently used context.
+    for (unsigned i = 0; i < contexts.size(); ++i)
+      if (contexts[i].lastUse < best->lastUse)
+        best = &contexts[i];
+  }
+  best->lastUse = ++useCounter;
+
+  if (best->asserted.size() > bestPrefix) {
+    Z3_solver_pop(builder->ctx, best->solver,
+                  best->asserted.size() - bestPrefix);
+    best->asserted.resize(bestPrefix);
+  }
+  stats::queryConstraintsReused += bestPrefix;
+
+  ConstraintManager::const_iterator it = constraints.begin();
+  std::advance(it, bestPrefix);
+  for (ConstraintManager::const_iterator ie = constraints.end();
+       it != ie; ++it) {
+    Z3_solver_push(builder->ctx, best->solver);
+    Z3_solver_assert(builder->ctx, best->solver, builder->construct(*it));
+    best->asserted.push_back(*it);
+  }
+
+  return best->solver;
+}
+
+::Z3_solver
+Z3SolverImpl::acquireSolver(const ConstraintManager &constraints) {
   // TODO: is the "simple_solver" the right solver to use for
   // best performance?
-  Z3_solver theSolver = Z3_mk_simple_solver(builder->ctx);
-  Z3_solver_inc_ref(builder->ctx, theSolver);
+  Z3_solver theSolver;
+  if (Z3IncrementalContexts) {
+    theSolver = getIncrementalSolver(constraints);
+  } else {
+    theSolver = Z3_mk_simple_solver(builder->ctx);
+    Z3_solver_inc_ref(builder->ctx, theSolver);
+    for (ConstraintManager::const_iterator it = constraints.begin(),
+                                           ie = constraints.end();
+         it != ie; ++it) {
+      Z3_solver_assert(builder->ctx, theSolver, builder->construct(*it));
+    }
+  }
   Z3_solver_set_params(builder->ctx, theSolver, solverParameters);
+  return theSolver;
+}
 
+void Z3SolverImpl::releaseSolver(::Z3_solver theSolver) {
+  if (!Z3IncrementalContexts)
+    Z3_solver_dec_ref(builder->ctx, theSolver);
+}
+
+bool Z3SolverImpl::runQuery(::Z3_solver theSolver, ref<Expr> expr,
+                            const std::vector<const Array *> *objects,
+                            std::vector<std::vector<unsigned char> > *values,
+                            bool &hasSolution) {
   runStatusCode = SOLVER_RUN_STATUS_FAILURE;
 
-  for (ConstraintManager::const_iterator it = query.constraints.begin(),
-                                         ie = query.constraints.end();
-       it != ie; ++it) {
-    Z3_solver_assert(builder->ctx, theSolver, builder->construct(*it));
-  }
   ++stats::queries;
   if (objects)
     ++stats::queryCounterexamples;
 
+  // The query itself only lives until we have the answer.
+  Z3_solver_push(builder->ctx, theSolver);
+
   Z3ASTHandle z3QueryExpr =
-      Z3ASTHandle(builder->construct(query.expr), builder->ctx);
+      Z3ASTHandle(builder->construct(expr), builder->ctx);
 
   // KLEE Queries are validity queries i.e.
   // ∀ X Constraints(X) → query(X)
@@ -198,13 +340,7 @@ bool Z3SolverImpl::internalRunSolver(
   runStatusCode = handleSolverResponse(theSolver, satisfiable, objects, values,
                                        hasSolution);
 
-  Z3_solver_dec_ref(builder->ctx, theSolver);
-  // Clear the builder's cache to prevent memory usage exploding.
-  // By using ``autoClearConstructCache=false`` and clearning now
-  // we allow Z3_ast expressions to be shared from an entire
-  // ``Query`` rather than only sharing within a single call to
-  // ``builder->construct()``.
-  builder->clearConstructCache();
+  Z3_solver_pop(builder->ctx, theSolver, 1);
 
   if (runStatusCode == SolverImpl::SOLVER_RUN_STATUS_SUCCESS_SOLVABLE ||
       runStatusCode == SolverImpl::SOLVER_RUN_STATUS_SUCCESS_UNSOLVABLE) {
@@ -218,6 +354,22 @@ bool Z3SolverImpl::internalRunSolver(
   return false; // failed
 }
 
+bool Z3SolverImpl::internalRunSolver(
+    const Query &query, const std::vector<const Array *> *objects,
+    std::vector<std::vector<unsigned char> > *values, bool &hasSolution) {
+  TimerStatIncrementer t(stats::queryTime);
+  Z3_solver theSolver = acquireSolver(query.constraints);
+  bool success = runQuery(theSolver, query.expr, objects, values, hasSolution);
+  releaseSolver(theSolver);
+  // Clear the builder's cache to prevent memory usage exploding.
+  // By using ``autoClearConstructCache=false`` and clearning now
+  // we allow Z3_ast expressions to be shared from an entire
+  // ``Query`` rather than only sharing within a single call to
+  // ``builder->construct()``.
+  builder->clearConstructCache();
+  return success;
+}
+
 SolverImpl::SolverRunStatus Z3SolverImpl::handleSolverResponse(
     ::Z3_solver theSolver, ::Z3_lbool satisfiable,
     const std::vector<const Array *> *objects,
@@ -100,6 +100,26 @@ void TreeStreamWriter::flush() {
   output->flush();
 }
 
+bool TreeStreamWriter::reopen(const std::string &newPath) {
+  assert(output);
+  flush();
+
+  std::ifstream is(path.c_str(), std::ios::in | std::ios::binary);
+  std::ofstream *os = new std::ofstream(newPath.c_str(),
+                                        std::ios::out | std::ios::binary);
+  if (!is.good() || !os->good()) {
+    delete os;
+    return false;
+  }
+  if (is.peek() != std::ifstream::traits_type::eof())
+    *os << is.rdbuf();
+
+  delete output;
+  output = os;
+  path = newPath;
+  return output->good();
+}
+
 void TreeStreamWriter::readStream(TreeStreamID streamID,
                                   std::vector<unsigned char> &out) {
   assert(streamID>0 && streamID<ids);
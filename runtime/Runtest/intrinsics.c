@@ -73,7 +73,17 @@ void klee_make_symbolic(void *array, size_t nbytes, const char *name) {
       }
       tmp[strlen(tmp)-1] = '\0'; /* kill newline */
     }
-    testData = kTest_fromFile(name);
+    if (kTest_isArchive(name)) {
+      /* Replay the test at KTEST_INDEX, the first by default; the archive
+         stays open for the rest of the run. */
+      KTestArchive *archive = kTestArchive_open(name);
+      char *index = getenv("KTEST_INDEX");
+      unsigned i = index ? strtoul(index, 0, 10) : 0;
+      if (archive && i < kTestArchive_numTests(archive))
+        testData = kTestArchive_getTest(archive, i);
+    } else {
+      testData = kTest_fromFile(name);
+    }
     if (!testData) {
       fprintf(stderr, "KLEE-RUNTIME: unable to open .ktest file\n");
       exit(1);
@@ -0,0 +1,67 @@
+#!/usr/bin/python
+
+# ===-- klee-ips.py -------------------------------------------------------===##
+#
+#                      The KLEE Symbolic Virtual Machine
+#
+#  This file is distributed under the University of Illinois Open Source
+#  License. See LICENSE.TXT for details.
+#
+# ===----------------------------------------------------------------------===##
+
+# Run klee on each given bitcode file and report the instructions executed
+# per second of wall time, as recorded in the last line of run.stats. To
+# compare two builds, run the same files with each --klee.
+
+from __future__ import division
+
+import ast, os, shutil, subprocess, sys, tempfile
+from optparse import OptionParser
+
+def lastStats(path):
+    header, last = None, None
+    for ln in open(path):
+        if header is None:
+            header = ast.literal_eval(ln)
+        else:
+            last = ast.literal_eval(ln)
+    if last is None:
+        raise ValueError("no statistics in %s" % path)
+    return dict(zip(header, last))
+
+def main(args):
+    op = OptionParser("usage: %prog [options] file.bc...")
+    op.add_option('', '--klee', dest='klee', default='klee',
+                  help='klee binary to run (default=klee)')
+    op.add_option('', '--klee-args', dest='kleeArgs', default='',
+                  help='extra arguments passed to klee')
+    op.add_option('', '--runs', dest='runs', type='int', default=3,
+                  help='runs per file, the fastest is reported (default=3)')
+    opts, files = op.parse_args(args)
+    if not files:
+        op.error("no bitcode files given")
+
+    print '%-30s %14s %10s %14s' % ('File', 'Instructions', 'Time (s)',
+                                    'Instrs/s')
+    for f in files:
+        best = None
+        for i in range(opts.runs):
+            out = tempfile.mkdtemp()
+            shutil.rmtree(out)
+            cmd = [opts.klee, '--output-dir=' + out] + \
+                  opts.kleeArgs.split() + [f]
+            devnull = open(os.devnull, 'w')
+            subprocess.call(cmd, stdout=devnull, stderr=devnull)
+            devnull.close()
+            try:
+                stats = lastStats(os.path.join(out, 'run.stats'))
+            finally:
+                shutil.rmtree(out, ignore_errors=True)
+            if best is None or stats['WallTime'] < best['WallTime']:
+                best = stats
+        insts, time = best['Instructions'], best['WallTime']
+        print '%-30s %14d %10.2f %14.0f' % (os.path.basename(f), insts, time,
+                                            insts / time if time else 0)
+
+if __name__ == '__main__':
+    main(sys.argv[1:])
@@ -0,0 +1,42 @@
+; RUN: %S/ConcreteTest.py --klee='%klee' --lli=%lli %s
+
+; Branches and switches into blocks with phi nodes, taking each edge
+; through its pre-decoded successor; a switch reaches the same block
+; through several cases.
+
+declare void @print_i32(i32)
+
+define i32 @main() {
+entry:
+	br label %loop
+loop:
+	%i = phi i32 [0, %entry], [%next, %join]
+	%sum = phi i32 [0, %entry], [%newsum, %join]
+	switch i32 %i, label %default [ i32 0, label %small
+	                                 i32 1, label %small
+	                                 i32 2, label %odd
+	                                 i32 3, label %small ]
+small:
+	%s = phi i32 [100, %loop], [100, %loop], [100, %loop]
+	br label %join
+odd:
+	%o = mul i32 %i, 7
+	%iseven = icmp eq i32 %o, 14
+	br i1 %iseven, label %join, label %default
+default:
+	%d = phi i32 [%i, %loop], [-1, %odd]
+	%d2 = add i32 %d, 1000
+	br label %join
+join:
+	%v = phi i32 [%s, %small], [%o, %odd], [%d2, %default]
+	%w = phi i32 [1, %small], [2, %odd], [%d2, %default]
+	%vw = add i32 %v, %w
+	%newsum = add i32 %sum, %vw
+	call void @print_i32(i32 %vw)
+	%next = add i32 %i, 1
+	%done = icmp eq i32 %next, 6
+	br i1 %done, label %exit, label %loop
+exit:
+	call void @print_i32(i32 %newsum)
+	ret i32 0
+}
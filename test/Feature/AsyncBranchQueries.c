@@ -0,0 +1,27 @@
+// RUN: %llvmgcc %s -emit-llvm -O0 -c -o %t1.bc
+// RUN: rm -rf %t.klee-out %t.klee-out-2
+// RUN: %klee --output-dir=%t.klee-out --async-branch-queries=4 %t1.bc > %t1.log 2>&1
+// RUN: FileCheck -input-file=%t1.log %s
+// RUN: %klee --output-dir=%t.klee-out-2 --async-branch-queries=4 --search=random-path %t1.bc > %t2.log 2>&1
+// RUN: FileCheck -input-file=%t2.log %s
+
+// Branches decided by forked solver processes explore the same paths as
+// branches decided in place, whatever order the searcher picks states in.
+
+int main() {
+  unsigned char a[4];
+  unsigned i, count = 0;
+
+  klee_make_symbolic(a, sizeof a, "a");
+
+  for (i = 0; i < 4; i++)
+    if (a[i] > 100)
+      count++;
+
+  if (a[0] == a[1])
+    count += 10;
+
+  return count;
+}
+
+// CHECK: KLEE: done: completed paths = 24
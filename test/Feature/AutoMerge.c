@@ -0,0 +1,156 @@
+// RUN: %llvmgcc %s -emit-llvm -g -O0 -c -o %t1.bc
+// RUN: rm -rf %t.klee-out
+// RUN: %klee --output-dir=%t.klee-out --use-auto-merge --search=dfs %t1.bc > %t1.log 2>&1
+// RUN: FileCheck -input-file=%t1.log %s
+// RUN: rm -rf %t.klee-out
+// RUN: %klee --output-dir=%t.klee-out --use-auto-merge --search=nurs:covnew --debug-log-merge %t1.bc > %t2.log 2>&1
+// RUN: FileCheck -input-file=%t2.log %s
+// RUN: FileCheck -check-prefix=CHECK-LOG -input-file=%t2.log %s
+// RUN: rm -rf %t.klee-out
+// RUN: %klee --output-dir=%t.klee-out --use-auto-merge --auto-merge-max-ites=0 --search=dfs %t1.bc > %t3.log 2>&1
+// RUN: FileCheck -check-prefix=CHECK-NOMERGE -input-file=%t3.log %s
+// RUN: rm -rf %t.klee-out
+// RUN: %klee --output-dir=%t.klee-out --use-auto-merge --auto-merge-max-wait=0 --search=dfs %t1.bc > %t4.log 2>&1
+// RUN: FileCheck -check-prefix=CHECK-NOMERGE -input-file=%t4.log %s
+//
+// RUN: %llvmgcc %s -DLOOP -emit-llvm -g -O0 -c -o %t5.bc
+// RUN: rm -rf %t.klee-out
+// RUN: %klee --output-dir=%t.klee-out --use-auto-merge --search=dfs --debug-log-merge %t5.bc > %t5.log 2>&1
+// RUN: FileCheck -check-prefix=CHECK-LOOP -input-file=%t5.log %s
+//
+// RUN: %llvmgcc %s -DSWITCH -emit-llvm -g -O0 -c -o %t6.bc
+// RUN: rm -rf %t.klee-out
+// RUN: %klee --output-dir=%t.klee-out --use-auto-merge --search=dfs --debug-log-merge %t6.bc > %t6.log 2>&1
+// RUN: FileCheck -check-prefix=CHECK-SWITCH -input-file=%t6.log %s
+//
+// RUN: %llvmgcc %s -DNESTED -emit-llvm -g -O0 -c -o %t7.bc
+// RUN: rm -rf %t.klee-out
+// RUN: %klee --output-dir=%t.klee-out --use-auto-merge --search=dfs --debug-log-merge %t7.bc > %t7.log 2>&1
+// RUN: FileCheck -check-prefix=CHECK-NESTED -input-file=%t7.log %s
+
+#include <assert.h>
+#include <stdlib.h>
+
+#if defined(LOOP)
+
+// The branch is the loop condition, which the paths come back to before
+// they join, so nothing is merged.
+
+int main() {
+  unsigned char a[4];
+  unsigned i = 0;
+
+  klee_make_symbolic(a, sizeof a, "a");
+
+  while (i < 4 && a[i] > 100)
+    i++;
+
+  return i;
+}
+
+// CHECK-LOOP-NOT: -- merging
+// CHECK-LOOP: KLEE: done: completed paths = 5
+// CHECK-LOOP: KLEE: done: generated tests = 5
+
+#elif defined(SWITCH)
+
+// The four cases join after the switch and are merged into one state,
+// which forks again on the merged value.
+
+int main() {
+  unsigned x, y;
+
+  klee_make_symbolic(&x, sizeof x, "x");
+
+  switch (x % 4) {
+  case 0: y = 1; break;
+  case 1: y = 5; break;
+  case 2: y = 7; break;
+  default: y = 9; break;
+  }
+
+  assert(((x % 4 == 0) == (y == 1)) & ((x % 4 == 3) == (y == 9)));
+  if (y == 1)
+    exit(0);
+  if (y == 5)
+    exit(0);
+  if (y == 7)
+    exit(0);
+  return 0;
+}
+
+// CHECK-SWITCH: -- merging 4 states at {{.*}}AutoMerge.c:{{[0-9]+}} --
+// CHECK-SWITCH-NOT: -- merging
+// CHECK-SWITCH: KLEE: done: generated tests = 4
+
+#elif defined(NESTED)
+
+// The inner branch is merged at its own join first, then the outer one.
+
+int main() {
+  int a, b, y;
+
+  klee_make_symbolic(&a, sizeof a, "a");
+  klee_make_symbolic(&b, sizeof b, "b");
+
+  if (a > 10) {
+    if (b > 10)
+      y = 1;
+    else
+      y = 2;
+  } else {
+    y = 3;
+  }
+
+  assert(((a > 10 & b > 10) == (y == 1)) & ((a <= 10) == (y == 3)));
+  if (y == 1)
+    exit(0);
+  if (y == 2)
+    exit(0);
+  return 0;
+}
+
+// CHECK-NESTED: -- merging 2 states at {{.*}}AutoMerge.c:{{[0-9]+}} --
+// CHECK-NESTED: -- merging 2 states at {{.*}}AutoMerge.c:{{[0-9]+}} --
+// CHECK-NESTED-NOT: -- merging
+// CHECK-NESTED: KLEE: done: generated tests = 3
+
+#else
+
+// The paths through each if statement join at the increment, where
+// they are merged, so a single state leaves the loop. Its count is the
+// number of bytes above 100, whatever they are, and forks into the four
+// outcomes below. Without merging, each of the 256 paths leaves the loop
+// with a concrete count.
+
+int main() {
+  unsigned char a[8];
+  unsigned i, n = 0, count = 0;
+
+  klee_make_symbolic(a, sizeof a, "a");
+
+  for (i = 0; i < 8; i++) {
+    if (a[i] > 100)
+      count++;
+  }
+
+  for (i = 0; i < 8; i++)
+    n += a[i] > 100;
+  assert(n == count);
+
+  if (count == 0)
+    exit(0);
+  if (count == 8)
+    exit(0);
+  if (count == 3)
+    exit(0);
+  return count;
+}
+
+// CHECK-LOG: -- merging {{[0-9]+}} states at {{.*}}AutoMerge.c:{{[0-9]+}} --
+// CHECK: KLEE: done: completed paths = 4
+// CHECK: KLEE: done: generated tests = 4
+// CHECK-NOMERGE: KLEE: done: completed paths = 256
+// CHECK-NOMERGE: KLEE: done: generated tests = 256
+
+#endif
@@ -0,0 +1,28 @@
+// RUN: %llvmgcc %s -emit-llvm -O0 -c -o %t1.bc
+// RUN: rm -rf %t.klee-out
+// RUN: %klee --output-dir=%t.klee-out --cex-cache-max-memory=1 --cex-cache-superset %t1.bc > %t1.log 2>&1
+// RUN: FileCheck -input-file=%t1.log %s
+// RUN: FileCheck -check-prefix=CHECK-INFO -input-file=%t.klee-out/info %s
+
+// A counterexample cache bounded to a kilobyte evicts entries and still
+// explores the same paths; the two arrays are cached in separate factors.
+
+int main() {
+  unsigned char a[4], b[4];
+  unsigned i, count = 0;
+
+  klee_make_symbolic(a, sizeof a, "a");
+  klee_make_symbolic(b, sizeof b, "b");
+
+  for (i = 0; i < 4; i++)
+    if (a[i] > 100)
+      count++;
+
+  if (b[0] == b[1])
+    count += 10;
+
+  return count;
+}
+
+// CHECK: KLEE: done: completed paths = 32
+// CHECK-INFO: KLEE: done: cex cache evictions = {{[1-9][0-9]*}}
@@ -0,0 +1,64 @@
+// RUN: %llvmgcc %s -emit-llvm -g -c -o %t1.bc
+// RUN: rm -rf %t.klee-out
+// RUN: %klee --output-dir=%t.klee-out --exit-on-error %t1.bc 2>&1 | FileCheck %s
+
+// Multi-byte loads and stores of concrete values are done on the concrete
+// store directly, unless a byte is symbolic or the access straddles a
+// page. Either way they must see the same bytes as single-byte accesses.
+
+#include <assert.h>
+#include <stdint.h>
+#include <string.h>
+
+#define SIZE (2 * 4096)
+
+unsigned char buf[SIZE];
+
+int main() {
+  unsigned char c;
+  uint16_t u16;
+  uint32_t u32;
+  uint64_t u64;
+  unsigned i;
+
+  // Stores of each width, read back whole and byte by byte.
+  u16 = 0x0102;
+  u32 = 0x03040506;
+  u64 = 0x0708090a0b0c0d0eULL;
+  memcpy(buf + 1, &u16, sizeof u16);
+  memcpy(buf + 5, &u32, sizeof u32);
+  memcpy(buf + 11, &u64, sizeof u64);
+  assert(*(uint16_t *) (buf + 1) == 0x0102);
+  assert(*(uint32_t *) (buf + 5) == 0x03040506);
+  assert(*(uint64_t *) (buf + 11) == 0x0708090a0b0c0d0eULL);
+  assert(buf[1] == 0x02 && buf[2] == 0x01);
+  assert(buf[5] == 0x06 && buf[8] == 0x03);
+  assert(buf[11] == 0x0e && buf[18] == 0x07);
+  assert(*(uint32_t *) (buf + 3) == 0x05060000);
+
+  // Accesses straddling the page boundary.
+  *(uint64_t *) (buf + 4092) = 0x1112131415161718ULL;
+  assert(*(uint64_t *) (buf + 4092) == 0x1112131415161718ULL);
+  assert(*(uint32_t *) (buf + 4094) == 0x13141516);
+  assert(buf[4095] == 0x15 && buf[4096] == 0x14);
+
+  // A symbolic byte makes the whole load symbolic; overwriting it with a
+  // concrete store makes it concrete again.
+  klee_make_symbolic(&c, sizeof c, "c");
+  *(uint32_t *) (buf + 100) = 0;
+  buf[102] = c;
+  u32 = *(uint32_t *) (buf + 100);
+  assert(klee_is_symbolic(u32));
+  assert(!klee_is_symbolic(*(uint16_t *) (buf + 100)));
+  *(uint32_t *) (buf + 100) = 0x21222324;
+  u32 = *(uint32_t *) (buf + 100);
+  assert(!klee_is_symbolic(u32));
+  assert(u32 == 0x21222324);
+
+  for (i = 0; i < 4; ++i)
+    assert(buf[100 + i] == 0x24 - i);
+
+  return 0;
+}
+
+// CHECK: KLEE: done: completed paths = 1
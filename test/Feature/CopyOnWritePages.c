@@ -0,0 +1,49 @@
+// RUN: %llvmgcc %s -emit-llvm -g -c -o %t1.bc
+// RUN: rm -rf %t.klee-out
+// RUN: %klee --output-dir=%t.klee-out --exit-on-error %t1.bc 2>&1 | FileCheck %s
+
+// Objects larger than a page share unmodified pages between forked
+// states; writes in one state must never show up in another.
+
+#include <assert.h>
+#include <string.h>
+
+#define SIZE (5 * 4096 + 123)
+
+char buf[SIZE];
+
+int main() {
+  unsigned i, pos;
+  char c;
+  memset(buf, 'a', SIZE);
+
+  klee_make_symbolic(&i, sizeof i, "i");
+  klee_make_symbolic(&c, sizeof c, "c");
+  klee_assume(i < 4);
+  pos = i * 4096 + 4000;
+
+  // One path per page touched, the other pages stay shared.
+  if (i == 0)
+    buf[10] = 'b';
+  else if (i == 1)
+    buf[4096 + 10] = 'b';
+  else if (i == 2)
+    buf[SIZE - 1] = 'b';
+
+  // A symbolic write that flushes part of one page.
+  if (c == 'z')
+    buf[pos] = c;
+
+  assert(buf[SIZE - 2] == 'a');
+  assert((buf[10] == 'b') == (i == 0));
+  assert((buf[4096 + 10] == 'b') == (i == 1));
+  assert((buf[SIZE - 1] == 'b') == (i == 2));
+  if (c == 'z')
+    assert(buf[pos] == 'z');
+  else
+    assert(buf[pos] == 'a');
+
+  return 0;
+}
+
+// CHECK: KLEE: done: completed paths = 8
@@ -0,0 +1,32 @@
+// RUN: %llvmgcc %s -emit-llvm -O0 -c -o %t.bc
+// RUN: rm -rf %t.klee-out %t.klee-out-2 %t.klee-out-3
+// RUN: %klee --output-dir=%t.klee-out --write-ktest-archive %t.bc > %t.log 2>&1
+// RUN: FileCheck -check-prefix=CHECK-RUN -input-file=%t.log %s
+// RUN: test -f %t.klee-out/tests.ktestarc
+// RUN: not test -f %t.klee-out/test000001.ktest
+
+// Seeding from the archive replays every test in it.
+// RUN: %klee --output-dir=%t.klee-out-2 --only-replay-seeds --seed-out-dir=%t.klee-out %t.bc > %t2.log 2>&1
+// RUN: FileCheck -check-prefix=CHECK-SEED -input-file=%t2.log %s
+
+// RUN: %klee --output-dir=%t.klee-out-3 --replay-out=%t.klee-out/tests.ktestarc %t.bc > %t3.log 2>&1
+// RUN: FileCheck -check-prefix=CHECK-REPLAY -input-file=%t3.log %s
+
+#include <stdio.h>
+
+int main() {
+  int x;
+  klee_make_symbolic(&x, sizeof x, "x");
+  if (x > 10)
+    printf("big\n");
+  else if (x > 0)
+    printf("small\n");
+  else
+    printf("negative\n");
+  return 0;
+}
+
+// CHECK-RUN: KLEE: done: generated tests = 3
+// CHECK-SEED: KLEE: using 3 seeds
+// CHECK-SEED: KLEE: done: completed paths = 3
+// CHECK-REPLAY: (3/3)
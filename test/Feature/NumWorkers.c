@@ -0,0 +1,34 @@
+// RUN: %llvmgcc %s -emit-llvm -O0 -c -o %t.bc
+// RUN: rm -rf %t.klee-out
+// RUN: %klee --output-dir=%t.klee-out --num-workers=3 --search=dfs %t.bc
+// RUN: grep "KLEE: done: explored paths = 8" %t.klee-out/info
+// RUN: grep "KLEE: done: completed paths = 8" %t.klee-out/info
+// RUN: grep "KLEE: done: generated tests = 8" %t.klee-out/info
+// RUN: ls %t.klee-out/ | grep .ktest | wc -l | grep 8
+// RUN: test -f %t.klee-out/run.0.stats
+// RUN: test -f %t.klee-out/run.2.stats
+//
+// The parent merges the workers' coverage as a union, so it matches the
+// coverage of a single process.
+// RUN: rm -rf %t.single-out
+// RUN: %klee --output-dir=%t.single-out --search=dfs %t.bc
+// RUN: tail -n 1 %t.klee-out/run.stats | cut -d, -f2,3,12,13 > %t.workers.cov
+// RUN: tail -n 1 %t.single-out/run.stats | cut -d, -f2,3,12,13 > %t.single.cov
+// RUN: diff %t.single.cov %t.workers.cov
+
+// Check that splitting the search between worker processes explores
+// the same paths, does not lose or overwrite any test cases and counts
+// coverage once.
+
+int main() {
+  int x;
+  int res = 0;
+
+  klee_make_symbolic(&x, sizeof x);
+
+  if (x & 1) res += 1;
+  if (x & 2) res += 2;
+  if (x & 4) res += 4;
+
+  return res;
+}
@@ -0,0 +1,35 @@
+// RUN: %llvmgcc %s -emit-llvm -O0 -c -o %t1.bc
+// RUN: rm -rf %t.klee-out
+// RUN: %klee --output-dir=%t.klee-out %t1.bc > %t1.log 2> %t1.err
+// RUN: FileCheck -input-file=%t1.log %s
+// RUN: FileCheck -input-file=%t1.err -check-prefix=CHECK-STATS %s
+
+// A symbolic pointer that can only point into a few of many heap objects
+// resolves to exactly those objects.
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define N 200
+
+int main() {
+  int *objs[N];
+  unsigned i, k;
+
+  for (k = 0; k < N; k++) {
+    objs[k] = malloc(sizeof(int));
+    *objs[k] = k;
+  }
+
+  klee_make_symbolic(&i, sizeof i, "i");
+  klee_assume((i == 3) | (i == 100) | (i == 197));
+
+  // CHECK-DAG: value 3
+  // CHECK-DAG: value 100
+  // CHECK-DAG: value 197
+  printf("value %d\n", *objs[i]);
+
+  return 0;
+}
+
+// CHECK-STATS: KLEE: done: completed paths = 3
@@ -35,6 +35,19 @@
 // RUN: %klee --output-dir=%t.klee-out --use-iterative-deepening-time-search --use-batching-search --search=nurs:depth %t2.bc
 // RUN: rm -rf %t.klee-out
 // RUN: %klee --output-dir=%t.klee-out --use-iterative-deepening-time-search --use-batching-search --search=nurs:qc %t2.bc
+// RUN: rm -rf %t.klee-out
+// RUN: %klee --output-dir=%t.klee-out --search=nurs:md2u --uncovered-update-interval=0.01 --debug-check-uncovered-distances %t2.bc
+// RUN: rm -rf %t.klee-out
+// RUN: %klee --output-dir=%t.klee-out --search=nurs:md2u --uncovered-update-interval=0.01 --background-uncovered-update --debug-check-uncovered-distances %t2.bc
+// RUN: rm -rf %t.klee-out
+// RUN: %klee --output-dir=%t.klee-out --search=nurs:covnew --weight-update-interval=100 %t2.bc
+// RUN: rm -rf %t.klee-out
+// RUN: %klee --output-dir=%t.klee-out --search=nurs:covqc %t2.bc
+//
+// nurs:covqc weighs states by their distance to uncovered code, so the
+// distances must be kept up to date: some instructions can still reach
+// the uncovered early return in main.
+// RUN: awk '/^events:/ { for (i = 2; i <= NF; ++i) if ($i == "UCdist") col = i + 1 } /^[0-9]/ && col && $col > 0 { found = 1 } END { exit !found }' %t.klee-out/run.istats
 
 
 /* this test is basically just for coverage and doesn't really do any
@@ -63,9 +76,14 @@ int validate(char *buf, int N) {
 #endif
 int main(int argc, char **argv) {
   int N = SYMBOLIC_SIZE;
-  unsigned char *buf = malloc(N);
+  unsigned char *buf;
   int i;
-  
+
+  // Never taken, so it stays uncovered.
+  if (N != SYMBOLIC_SIZE)
+    return 2;
+
+  buf = malloc(N);
   klee_make_symbolic(buf, N);
   if (validate(buf, N))
     return buf[0];
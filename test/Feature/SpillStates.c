@@ -0,0 +1,34 @@
+// RUN: %llvmgcc %s -emit-llvm -O0 -c -o %t1.bc
+// RUN: rm -rf %t.klee-out
+// RUN: %klee --output-dir=%t.klee-out --max-memory=1 --spill-states %t1.bc > %t1.log 2>&1
+// RUN: FileCheck -input-file=%t1.log %s
+
+// Under the memory cap states are written to disk instead of being
+// killed, so every path is still explored.
+
+#include <stdlib.h>
+
+int main() {
+  unsigned char a[8];
+  unsigned i, count = 0;
+  char *buffers[8];
+
+  klee_make_symbolic(a, sizeof a, "a");
+
+  for (i = 0; i < 8; i++) {
+    buffers[i] = malloc(64 * 1024);
+    buffers[i][i] = a[i];
+    if (a[i] > 100)
+      count++;
+  }
+
+  // Keep the states busy long enough for the memory check to run.
+  for (i = 0; i < 70000; i++)
+    count += buffers[i % 8][i % 8] & 1;
+
+  return count;
+}
+
+// CHECK: KLEE: WARNING: spilling
+// CHECK-NOT: Memory limit exceeded
+// CHECK: KLEE: done: completed paths = 256
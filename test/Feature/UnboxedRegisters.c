@@ -0,0 +1,43 @@
+// RUN: %llvmgcc %s -emit-llvm -O0 -c -o %t1.bc
+// RUN: rm -rf %t.klee-out
+// RUN: %klee --output-dir=%t.klee-out --exit-on-error %t1.bc 2>&1 | FileCheck %s
+
+// Concrete integer arithmetic is done on unboxed registers; the results
+// must match what the expression builder computes, including when they
+// later meet symbolic values.
+
+#include <assert.h>
+
+int main() {
+  volatile signed char sc = -3;
+  volatile unsigned char uc = 0xfd;
+  volatile int i = -7, j = 5;
+  volatile unsigned u = 0xfffffff0u;
+  volatile long long ll = -1;
+  int arr[8] = { 0, 1, 2, 3, 4, 5, 6, 7 };
+  int *p = &arr[6];
+  int k = -4;
+  unsigned char x;
+
+  assert(sc < 0 && uc > 0);
+  assert((int) sc == -3 && (int) uc == 253);
+  assert((unsigned) sc == 0xfffffffdu);
+  assert(i + j == -2 && i - j == -12 && i * j == -35);
+  assert((i & j) == 1 && (i | j) == -3 && (i ^ j) == -4);
+  assert(i < j && (unsigned) i > (unsigned) j);
+  assert(u + 0x20 == 0x10);
+  assert((long long) i == -7 && (unsigned long long) (unsigned) i == 0xfffffff9ull);
+  assert((unsigned char) u == 0xf0 && (short) u == -16);
+  assert(ll < 0 && (unsigned long long) ll == ~0ull);
+  assert(p[k] == 2 && *(p - 6) == 0 && p[1] == 7);
+
+  klee_make_symbolic(&x, sizeof x, "x");
+  if (x + i > j)
+    assert(x > 12);
+  else
+    assert(x <= 12);
+
+  return 0;
+}
+
+// CHECK: KLEE: done: completed paths = 2
@@ -0,0 +1,27 @@
+// RUN: %llvmgcc %s -emit-llvm -O0 -c -o %t.bc
+// RUN: rm -rf %t.klee-out
+// RUN: %klee --output-dir=%t.klee-out --num-workers=2 --work-stealing --work-stealing-interval=0 --search=dfs %t.bc
+// RUN: grep "KLEE: done: completed paths = 17" %t.klee-out/info
+// RUN: grep "KLEE: done: generated tests = 17" %t.klee-out/info
+// RUN: ls %t.klee-out/ | grep .ktest | wc -l | grep 17
+// RUN: test -d %t.klee-out/work
+
+// Check that handing work over between workers neither loses nor
+// duplicates paths. The first branch leaves one worker with a single
+// path and the other with the rest.
+
+int main() {
+  int x;
+  int res = 0;
+
+  klee_make_symbolic(&x, sizeof x);
+
+  if (x & 1) {
+    if (x & 2) res += 2;
+    if (x & 4) res += 4;
+    if (x & 8) res += 8;
+    if (x & 16) res += 16;
+  }
+
+  return res;
+}
@@ -0,0 +1,40 @@
+// RUN: %llvmgcc %s -emit-llvm -O0 -c -o %t.bc
+// RUN: rm -rf %t.klee-out
+// RUN: %klee --output-dir=%t.klee-out --num-workers=3 --work-stealing --work-stealing-interval=0 --search=dfs %t.bc
+// RUN: grep "KLEE: done: completed paths = 18" %t.klee-out/info
+// RUN: grep "KLEE: done: generated tests = 18" %t.klee-out/info
+// RUN: ls %t.klee-out/ | grep .ktest | wc -l | grep 18
+
+// Check that work handed over below a switch or a pointer resolved to
+// several objects is re-executed along the branch it was taken from,
+// and that three workers all finish when they compete for the same
+// requests.
+
+int main() {
+  int x;
+  int res = 0;
+  int a[2], b[2];
+  int *objects[2] = { a, b };
+
+  klee_make_symbolic(&x, sizeof x);
+
+  if (x & 1) {
+    switch ((x >> 1) & 7) {
+    case 0: res = 10; break;
+    case 1: res = 11; break;
+    case 2: res = 12; break;
+    case 3: res = 13; break;
+    case 4: res = 14; break;
+    case 5: res = 15; break;
+    case 6: res = 16; break;
+    default: res = 17; break;
+    }
+    if (x & 16) res += 16;
+  } else {
+    int *p = objects[(x >> 5) & 1];
+    *p = 1;
+    res = a[0];
+  }
+
+  return res;
+}
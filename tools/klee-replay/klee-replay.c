@@ -255,6 +255,76 @@ static void usage(void) {
   exit(1);
 }
 
+/* Whether arg is one of the strings of the current input's arguments. */
+static int is_input_arg(const char *arg) {
+  unsigned i;
+  for (i = 0; i != input->numArgs; ++i)
+    if (arg == input->args[i])
+      return 1;
+  return 0;
+}
+
+/* Replays the current input in a subprocess. */
+static void replay_test(char *executable, const char *test_name, int first) {
+  int prg_argc;
+  char **args, **prg_argv;
+  unsigned i;
+
+  obj_index = 0;
+  prg_argc = input->numArgs;
+  /* Leave the test's own arguments alone; an archive frees them. */
+  args = (char**) malloc(prg_argc * sizeof(*args));
+  memcpy(args, input->args, prg_argc * sizeof(*args));
+  args[0] = executable;
+  prg_argv = args;
+  klee_init_env(&prg_argc, &prg_argv);
+
+  if (!first)
+    fprintf(stderr, "\n");
+  fprintf(stderr, "%s: TEST CASE: %s\n", progname, test_name);
+  fprintf(stderr, "%s: ARGS: ", progname);
+  for (i=0; i != (unsigned) prg_argc; ++i) {
+    char *s = prg_argv[i];
+    if (s[0]=='A' && s[1] && !s[2]) s[1] = '\0';
+    fprintf(stderr, "\"%s\" ", prg_argv[i]); 
+  }
+  fprintf(stderr, "\n");
+
+  /* Run the test case machinery in a subprocess, eventually this parent
+     process should be a script or something which shells out to the actual
+     execution tool. */
+  int pid = fork();
+  if (pid < 0) {
+    perror("fork");
+    _exit(66);
+  } else if (pid == 0) {
+    /* Create the input files, pipes, etc., and run the process. */
+    replay_create_files(&__exe_fs);
+    run_monitored(executable, prg_argc, prg_argv);
+    _exit(0);
+  } else {
+    /* Wait for the test case. */
+    int res, status;
+
+    do {
+      res = waitpid(pid, &status, 0);
+    } while (res < 0 && errno == EINTR);
+    
+    if (res < 0) {
+      perror("waitpid");
+      _exit(66);
+    }
+  }
+
+  /* klee_init_env returns a new array, holding the symbolic arguments in
+     strings of their own. */
+  for (i=0; i != (unsigned) prg_argc; ++i)
+    if (prg_argv[i] != executable && !is_input_arg(prg_argv[i]))
+      free(prg_argv[i]);
+  free(prg_argv);
+  free(args);
+}
+
 int main(int argc, char** argv) {
   int prg_argc;
   char ** prg_argv;  
@@ -322,9 +392,38 @@ int main(int argc, char** argv) {
   fclose(f);
 
   int idx = 0;
+  int first = 1;
   for (idx = optind + 1; idx != argc; ++idx) {
     char* input_fname = argv[idx];
-    unsigned i;
+
+    if (kTest_isArchive(input_fname)) {
+      KTestArchive *archive = kTestArchive_open(input_fname);
+      unsigned i;
+
+      if (!archive) {
+        fprintf(stderr, "%s: error: input file %s not valid.\n", progname,
+                input_fname);
+        exit(1);
+      }
+
+      for (i = 0; i != kTestArchive_numTests(archive); ++i) {
+        char test_name[4096];
+
+        snprintf(test_name, sizeof test_name, "%s:%u", input_fname,
+                 kTestArchive_getId(archive, i));
+        input = kTestArchive_getTest(archive, i);
+        if (!input) {
+          fprintf(stderr, "%s: error: input test %s not valid.\n", progname,
+                  test_name);
+          exit(1);
+        }
+        replay_test(executable, test_name, first);
+        first = 0;
+      }
+      input = 0;
+      kTestArchive_close(archive);
+      continue;
+    }
     
     input = kTest_fromFile(input_fname);
     if (!input) {
@@ -332,49 +431,8 @@ int main(int argc, char** argv) {
               input_fname);
       exit(1);
     }
-    
-    obj_index = 0;
-    prg_argc = input->numArgs;
-    prg_argv = input->args;
-    prg_argv[0] = argv[optind];
-    klee_init_env(&prg_argc, &prg_argv);
-
-    if (idx > 2)
-      fprintf(stderr, "\n");
-    fprintf(stderr, "%s: TEST CASE: %s\n", progname, input_fname);
-    fprintf(stderr, "%s: ARGS: ", progname);
-    for (i=0; i != (unsigned) prg_argc; ++i) {
-      char *s = prg_argv[i];
-      if (s[0]=='A' && s[1] && !s[2]) s[1] = '\0';
-      fprintf(stderr, "\"%s\" ", prg_argv[i]); 
-    }
-    fprintf(stderr, "\n");
-
-    /* Run the test case machinery in a subprocess, eventually this parent
-       process should be a script or something which shells out to the actual
-       execution tool. */
-    int pid = fork();
-    if (pid < 0) {
-      perror("fork");
-      _exit(66);
-    } else if (pid == 0) {
-      /* Create the input files, pipes, etc., and run the process. */
-      replay_create_files(&__exe_fs);
-      run_monitored(executable, prg_argc, prg_argv);
-      _exit(0);
-    } else {
-      /* Wait for the test case. */
-      int res, status;
-
-      do {
-        res = waitpid(pid, &status, 0);
-      } while (res < 0 && errno == EINTR);
-      
-      if (res < 0) {
-        perror("waitpid");
-        _exit(66);
-      }
-    }
+    replay_test(executable, input_fname, first);
+    first = 0;
   }
 
   return 0;
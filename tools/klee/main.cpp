@@ -121,6 +121,10 @@ namespace {
   WriteTestInfo("write-test-info",
                 cl::desc("Write additional test case information"));
 
+  cl::opt<bool>
+  WriteKTestArchive("write-ktest-archive",
+                    cl::desc("Write the .ktest files of all test cases into a single archive, tests.ktestarc"));
+
   cl::opt<bool>
   WritePaths("write-paths",
                 cl::desc("Write .path files for each test case"));
@@ -237,9 +241,14 @@ private:
   unsigned m_testIndex;  // number of tests written so far
   unsigned m_pathsExplored; // number of paths explored so far
 
+  // set in forked worker processes, see setWorkerIndex()
+  unsigned m_workerIndex, m_numWorkers;
+  unsigned m_testBase; // number of tests written before the fork
+
   // used for writing .ktest files
   int m_argc;
   char **m_argv;
+  KTestArchive *m_testArchive;
 
 public:
   KleeHandler(int argc, char **argv);
@@ -256,6 +265,9 @@ public:
                        const char *errorMessage,
                        const char *errorSuffix);
 
+  void setWorkerIndex(unsigned index, unsigned numWorkers);
+  void addWorkerResults(unsigned numTestCases, unsigned numPathsExplored);
+
   std::string getOutputFilename(const std::string &filename);
   llvm::raw_fd_ostream *openOutputFile(const std::string &filename);
   std::string getTestFilename(const std::string &suffix, unsigned id);
@@ -283,8 +295,12 @@ KleeHandler::KleeHandler(int argc, char **argv)
     m_outputDirectory(),
     m_testIndex(0),
     m_pathsExplored(0),
+    m_workerIndex(0),
+    m_numWorkers(1),
+    m_testBase(0),
     m_argc(argc),
-    m_argv(argv) {
+    m_argv(argv),
+    m_testArchive(0) {
 
   // create output directory (OutputDir or "klee-out-<i>")
   bool dir_given = OutputDir != "";
@@ -352,6 +368,12 @@ KleeHandler::KleeHandler(int argc, char **argv)
 
   // open info
   m_infoFile = openOutputFile("info");
+
+  if (WriteKTestArchive) {
+    file_path = getOutputFilename("tests.ktestarc");
+    if (!(m_testArchive = kTestArchive_create(file_path.c_str())))
+      klee_error("cannot open file \"%s\": %s", file_path.c_str(), strerror(errno));
+  }
 }
 
 KleeHandler::~KleeHandler() {
@@ -360,6 +382,7 @@ KleeHandler::~KleeHandler() {
   fclose(klee_warning_file);
   fclose(klee_message_file);
   delete m_infoFile;
+  if (m_testArchive) kTestArchive_close(m_testArchive);
 }
 
 void KleeHandler::setInterpreter(Interpreter *i) {
@@ -438,6 +461,9 @@ void KleeHandler::processTestCase(const ExecutionState &state,
     double start_time = util::getWallTime();
 
     unsigned id = ++m_testIndex;
+    // interleave the ids of the workers after those written before the fork
+    if (m_numWorkers > 1)
+      id = m_testBase + (id - 1) * m_numWorkers + m_workerIndex + 1;
 
     if (success) {
       KTest b;
@@ -457,7 +483,10 @@ void KleeHandler::processTestCase(const ExecutionState &state,
         std::copy(out[i].second.begin(), out[i].second.end(), o->bytes);
       }
 
-      if (!kTest_toFile(&b, getOutputFilename(getTestFilename("ktest", id)).c_str())) {
+      if (m_testArchive) {
+        if (!kTestArchive_append(m_testArchive, &b, id))
+          klee_warning("unable to write output test case, losing it");
+      } else if (!kTest_toFile(&b, getOutputFilename(getTestFilename("ktest", id)).c_str())) {
         klee_warning("unable to write output test case, losing it");
       }
 
@@ -550,6 +579,31 @@ void KleeHandler::processTestCase(const ExecutionState &state,
   }
 }
 
+void KleeHandler::setWorkerIndex(unsigned index, unsigned numWorkers) {
+  m_workerIndex = index;
+  m_numWorkers = numWorkers;
+  m_testBase += m_testIndex;
+  m_testIndex = 0;
+  m_pathsExplored = 0;
+
+  // the path streams are read back when writing test cases, so each
+  // worker needs a private copy to append to
+  std::stringstream suffix;
+  suffix << "." << index << ".ts";
+  if (m_pathWriter &&
+      !m_pathWriter->reopen(getOutputFilename("paths" + suffix.str())))
+    klee_error("unable to copy path stream for worker %u", index);
+  if (m_symPathWriter &&
+      !m_symPathWriter->reopen(getOutputFilename("symPaths" + suffix.str())))
+    klee_error("unable to copy symbolic path stream for worker %u", index);
+}
+
+void KleeHandler::addWorkerResults(unsigned numTestCases,
+                                   unsigned numPathsExplored) {
+  m_testIndex += numTestCases;
+  m_pathsExplored += numPathsExplored;
+}
+
   // load a .path file
 void KleeHandler::loadPathFile(std::string name,
                                      std::vector<bool> &buffer) {
@@ -575,7 +629,7 @@ void KleeHandler::getOutFiles(std::string path,
 #endif
   for (llvm::sys::fs::directory_iterator i(path,ec),e; i!=e && !ec; i.increment(ec)){
     std::string f = (*i).path();
-    if (f.substr(f.size()-6,f.size()) == ".ktest") {
+    if (StringRef(f).endswith(".ktest") || StringRef(f).endswith(".ktestarc")) {
           results.push_back(f);
     }
   }
@@ -1004,6 +1058,51 @@ static char *format_tdiff(char *buf, long seconds)
   return buf;
 }
 
+namespace {
+  /// The tests loaded from .ktest files and test archives, for replaying
+  /// or seeding. Tests read from an archive point into its mapping.
+  class KTestLoader {
+    std::vector<KTest*> ownedTests;
+    std::vector<KTestArchive*> archives;
+
+  public:
+    std::vector<KTest*> tests;
+
+    ~KTestLoader() {
+      for (unsigned i = 0; i < ownedTests.size(); ++i)
+        kTest_free(ownedTests[i]);
+      for (unsigned i = 0; i < archives.size(); ++i)
+        kTestArchive_close(archives[i]);
+    }
+
+    /// Load the tests in the file at \arg path, returning false if it
+    /// cannot be read.
+    bool load(const std::string &path) {
+      if (kTest_isArchive(path.c_str())) {
+        KTestArchive *archive = kTestArchive_open(path.c_str());
+        if (!archive)
+          return false;
+        archives.push_back(archive);
+        for (unsigned i = 0; i < kTestArchive_numTests(archive); ++i) {
+          if (KTest *out = kTestArchive_getTest(archive, i))
+            tests.push_back(out);
+          else
+            klee_warning("skipping malformed test %u in %s",
+                         kTestArchive_getId(archive, i), path.c_str());
+        }
+        return true;
+      }
+
+      KTest *out = kTest_fromFile(path.c_str());
+      if (!out)
+        return false;
+      ownedTests.push_back(out);
+      tests.push_back(out);
+      return true;
+    }
+  };
+}
+
 #ifndef SUPPORT_KLEE_UCLIBC
 static llvm::Module *linkWithUclibc(llvm::Module *mainModule, StringRef libDir) {
   fprintf(stderr, "error: invalid libc, no uclibc support!\n");
@@ -1415,17 +1514,14 @@ int main(int argc, char **argv, char **envp) {
            it = ReplayOutDir.begin(), ie = ReplayOutDir.end();
          it != ie; ++it)
       KleeHandler::getOutFiles(*it, outFiles);
-    std::vector<KTest*> kTests;
+    KTestLoader loader;
     for (std::vector<std::string>::iterator
            it = outFiles.begin(), ie = outFiles.end();
          it != ie; ++it) {
-      KTest *out = kTest_fromFile(it->c_str());
-      if (out) {
-        kTests.push_back(out);
-      } else {
+      if (!loader.load(*it))
         llvm::errs() << "KLEE: unable to open: " << *it << "\n";
-      }
     }
+    std::vector<KTest*> &kTests = loader.tests;
 
     if (RunInDir != "") {
       int res = chdir(RunInDir.c_str());
@@ -1442,27 +1538,21 @@ int main(int argc, char **argv, char **envp) {
       interpreter->setReplayOut(out);
       llvm::errs() << "KLEE: replaying: " << *it << " (" << kTest_numBytes(out)
                    << " bytes)"
-                   << " (" << ++i << "/" << outFiles.size() << ")\n";
+                   << " (" << ++i << "/" << kTests.size() << ")\n";
       // XXX should put envp in .ktest ?
       interpreter->runFunctionAsMain(mainFn, out->numArgs, out->args, pEnvp);
       if (interrupted) break;
     }
     interpreter->setReplayOut(0);
-    while (!kTests.empty()) {
-      kTest_free(kTests.back());
-      kTests.pop_back();
-    }
   } else {
-    std::vector<KTest *> seeds;
+    KTestLoader loader;
     for (std::vector<std::string>::iterator
            it = SeedOutFile.begin(), ie = SeedOutFile.end();
          it != ie; ++it) {
-      KTest *out = kTest_fromFile(it->c_str());
-      if (!out) {
+      if (!loader.load(*it)) {
         llvm::errs() << "KLEE: unable to open: " << *it << "\n";
         exit(1);
       }
-      seeds.push_back(out);
     }
     for (std::vector<std::string>::iterator
            it = SeedOutDir.begin(), ie = SeedOutDir.end();
@@ -1472,18 +1562,17 @@ int main(int argc, char **argv, char **envp) {
       for (std::vector<std::string>::iterator
              it2 = outFiles.begin(), ie = outFiles.end();
            it2 != ie; ++it2) {
-        KTest *out = kTest_fromFile(it2->c_str());
-        if (!out) {
+        if (!loader.load(*it2)) {
           llvm::errs() << "KLEE: unable to open: " << *it2 << "\n";
           exit(1);
         }
-        seeds.push_back(out);
       }
       if (outFiles.empty()) {
         llvm::errs() << "KLEE: seeds directory is empty: " << *it << "\n";
         exit(1);
       }
     }
+    std::vector<KTest *> &seeds = loader.tests;
 
     if (!seeds.empty()) {
       llvm::errs() << "KLEE: using " << seeds.size() << " seeds\n";
@@ -1496,11 +1585,6 @@ int main(int argc, char **argv, char **envp) {
       }
     }
     interpreter->runFunctionAsMain(mainFn, pArgc, pArgv, pEnvp);
-
-    while (!seeds.empty()) {
-      kTest_free(seeds.back());
-      seeds.pop_back();
-    }
   }
 
   t[1] = time(NULL);
@@ -1548,6 +1632,35 @@ int main(int argc, char **argv, char **envp) {
     << "KLEE: done: invalid queries = " << queriesInvalid << "\n"
     << "KLEE: done: query cex = " << queryCounterexamples << "\n";
 
+  uint64_t portfolioWinsSTP =
+    *theStatisticManager->getStatisticByName("QueryPortfolioWinsSTP");
+  uint64_t portfolioWinsZ3 =
+    *theStatisticManager->getStatisticByName("QueryPortfolioWinsZ3");
+  uint64_t portfolioWinsMetaSMT =
+    *theStatisticManager->getStatisticByName("QueryPortfolioWinsMetaSMT");
+  if (portfolioWinsSTP || portfolioWinsZ3 || portfolioWinsMetaSMT)
+    handler->getInfoStream()
+      << "KLEE: done: portfolio wins (stp) = " << portfolioWinsSTP << "\n"
+      << "KLEE: done: portfolio wins (z3) = " << portfolioWinsZ3 << "\n"
+      << "KLEE: done: portfolio wins (metasmt) = " << portfolioWinsMetaSMT
+      << "\n";
+
+  uint64_t persistentCacheHits =
+    *theStatisticManager->getStatisticByName("QueryPersistentCacheHits");
+  uint64_t persistentCacheMisses =
+    *theStatisticManager->getStatisticByName("QueryPersistentCacheMisses");
+  if (persistentCacheHits || persistentCacheMisses)
+    handler->getInfoStream()
+      << "KLEE: done: persistent cache hits = " << persistentCacheHits << "\n"
+      << "KLEE: done: persistent cache misses = " << persistentCacheMisses
+      << "\n";
+
+  uint64_t cexCacheEvictions =
+    *theStatisticManager->getStatisticByName("QueryCexCacheEvictions");
+  if (cexCacheEvictions)
+    handler->getInfoStream()
+      << "KLEE: done: cex cache evictions = " << cexCacheEvictions << "\n";
+
   std::stringstream stats;
   stats << "\n";
   stats << "KLEE: done: total instructions = "
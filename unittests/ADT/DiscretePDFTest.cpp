@@ -0,0 +1,122 @@
+//===-- DiscretePDFTest.cpp -----------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "gtest/gtest.h"
+
+#include "klee/Internal/ADT/DiscretePDF.h"
+
+using namespace klee;
+
+namespace {
+
+/// The largest argument to choose().
+const double AlmostOne = 1.0 - 1e-12;
+
+TEST(DiscretePDFTest, InsertAndRemove) {
+  DiscretePDF<int> pdf;
+  EXPECT_TRUE(pdf.empty());
+
+  pdf.insert(1, 1.);
+  pdf.insert(2, 2.);
+  pdf.insert(3, 3.);
+  EXPECT_FALSE(pdf.empty());
+  EXPECT_TRUE(pdf.inTree(2));
+  EXPECT_FALSE(pdf.inTree(4));
+  EXPECT_EQ(2., pdf.getWeight(2));
+
+  // Removing from the middle moves the last item into its place.
+  pdf.remove(2);
+  EXPECT_FALSE(pdf.inTree(2));
+  EXPECT_EQ(1., pdf.getWeight(1));
+  EXPECT_EQ(3., pdf.getWeight(3));
+  EXPECT_EQ(1, pdf.choose(0.));
+  EXPECT_EQ(1, pdf.choose(0.2));
+  EXPECT_EQ(3, pdf.choose(0.3));
+  EXPECT_EQ(3, pdf.choose(AlmostOne));
+
+  pdf.remove(3);
+  EXPECT_EQ(1, pdf.choose(0.));
+  EXPECT_EQ(1, pdf.choose(AlmostOne));
+  pdf.remove(1);
+  EXPECT_TRUE(pdf.empty());
+
+  // Removed items can come back.
+  pdf.insert(2, 5.);
+  EXPECT_EQ(5., pdf.getWeight(2));
+  EXPECT_EQ(2, pdf.choose(0.5));
+}
+
+TEST(DiscretePDFTest, Update) {
+  DiscretePDF<int> pdf;
+  pdf.insert(1, 1.);
+  pdf.insert(2, 1.);
+  EXPECT_EQ(1, pdf.choose(0.4));
+  EXPECT_EQ(2, pdf.choose(0.6));
+
+  pdf.update(1, 3.);
+  EXPECT_EQ(3., pdf.getWeight(1));
+  EXPECT_EQ(1, pdf.choose(0.7));
+  EXPECT_EQ(2, pdf.choose(0.8));
+
+  // An item of weight 0 is never chosen.
+  pdf.update(2, 0.);
+  EXPECT_EQ(1, pdf.choose(0.));
+  EXPECT_EQ(1, pdf.choose(AlmostOne));
+  pdf.update(2, 1.);
+  pdf.update(1, 0.);
+  EXPECT_EQ(2, pdf.choose(0.));
+  EXPECT_EQ(2, pdf.choose(AlmostOne));
+}
+
+TEST(DiscretePDFTest, Grow) {
+  // Item i has weight i + 1, over several doublings of the capacity.
+  const int n = 100;
+  DiscretePDF<int> pdf;
+  for (int i = 0; i < n; ++i)
+    pdf.insert(i, i + 1.);
+  for (int i = 0; i < n; ++i)
+    ASSERT_EQ(i + 1., pdf.getWeight(i));
+
+  // Aim at the middle of each item's share of the total.
+  double total = n * (n + 1) / 2., before = 0;
+  for (int i = 0; i < n; ++i) {
+    ASSERT_EQ(i, pdf.choose((before + (i + 1) / 2.) / total));
+    before += i + 1;
+  }
+
+  // Removing every other item keeps the others' weights.
+  for (int i = 0; i < n; i += 2)
+    pdf.remove(i);
+  for (int i = 1; i < n; i += 2)
+    ASSERT_EQ(i + 1., pdf.getWeight(i));
+  for (double p = 0; p < 1; p += 0.01)
+    ASSERT_EQ(1, pdf.choose(p) % 2);
+}
+
+TEST(DiscretePDFTest, ChooseBoundaries) {
+  DiscretePDF<int> pdf;
+  pdf.insert(1, 0.);
+  pdf.insert(2, 1.);
+  pdf.insert(3, 1.);
+  pdf.insert(4, 0.);
+  pdf.insert(5, 0.);
+
+  // The extremes pick the first and last item of nonzero weight.
+  EXPECT_EQ(2, pdf.choose(0.));
+  EXPECT_EQ(3, pdf.choose(AlmostOne));
+  EXPECT_EQ(3, pdf.choose(0.5));
+
+  // With all weights 0, some item is still returned.
+  pdf.update(2, 0.);
+  pdf.update(3, 0.);
+  EXPECT_TRUE(pdf.inTree(pdf.choose(0.)));
+  EXPECT_TRUE(pdf.inTree(pdf.choose(AlmostOne)));
+}
+
+}
@@ -0,0 +1,77 @@
+//===-- BitArrayTest.cpp --------------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "gtest/gtest.h"
+
+#include <stdint.h>
+#include <cstring>
+
+#include "klee/util/BitArray.h"
+
+using namespace klee;
+
+namespace {
+
+const unsigned Size = 100;
+
+/// Whether bits [begin, end) are set one at a time.
+bool allSetSlow(const BitArray &b, unsigned begin, unsigned end) {
+  for (unsigned i = begin; i < end; ++i)
+    if (!b.get(i))
+      return false;
+  return true;
+}
+
+TEST(BitArrayTest, AllSet) {
+  BitArray b(Size, true);
+  EXPECT_TRUE(b.allSet(0, Size));
+  EXPECT_TRUE(b.allSet(7, 7));
+
+  // Clear single bits at and around the word boundaries and compare every
+  // range against the per-bit answer.
+  const unsigned cleared[] = { 0, 31, 32, 63, 64, 99 };
+  for (unsigned k = 0; k < sizeof(cleared) / sizeof(cleared[0]); ++k) {
+    BitArray c(Size, true);
+    c.unset(cleared[k]);
+    const BitArray &cc = c;
+    for (unsigned begin = 0; begin <= Size; ++begin)
+      for (unsigned end = begin; end <= Size; ++end)
+        ASSERT_EQ(allSetSlow(cc, begin, end), cc.allSet(begin, end))
+          << "cleared " << cleared[k] << ", range [" << begin << ", "
+          << end << ")";
+  }
+}
+
+TEST(BitArrayTest, SetRange) {
+  for (unsigned begin = 0; begin <= Size; ++begin) {
+    for (unsigned end = begin; end <= Size; ++end) {
+      BitArray b(Size);
+      b.setRange(begin, end);
+      for (unsigned i = 0; i < Size; ++i)
+        ASSERT_EQ(begin <= i && i < end, b.get(i))
+          << "bit " << i << ", range [" << begin << ", " << end << ")";
+      ASSERT_TRUE(b.allSet(begin, end));
+    }
+  }
+}
+
+TEST(BitArrayTest, SetRangeKeepsOtherBits) {
+  BitArray b(Size);
+  b.set(3);
+  b.set(70);
+  b.setRange(30, 40);
+  EXPECT_TRUE(b.get(3));
+  EXPECT_TRUE(b.get(70));
+  EXPECT_FALSE(b.get(29));
+  EXPECT_FALSE(b.get(40));
+  EXPECT_TRUE(b.allSet(30, 40));
+  EXPECT_FALSE(b.allSet(29, 40));
+}
+
+}
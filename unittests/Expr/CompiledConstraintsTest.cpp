@@ -0,0 +1,180 @@
+//===-- CompiledConstraintsTest.cpp ---------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "gtest/gtest.h"
+
+#include "klee/Expr.h"
+#include "klee/util/ArrayCache.h"
+#include "klee/util/Assignment.h"
+#include "klee/util/CompiledConstraints.h"
+
+#include <vector>
+
+using namespace klee;
+
+namespace {
+
+/// A small deterministic generator, so failures reproduce.
+class Random {
+  uint64_t state;
+
+public:
+  Random() : state(0x2545F4914F6CDD1DULL) {}
+
+  unsigned next(unsigned bound) {
+    state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+    return (unsigned) (state >> 33) % bound;
+  }
+};
+
+ref<Expr> getRead(Random &r, const Array *array, Expr::Width width) {
+  ref<Expr> e = ReadExpr::create(UpdateList(array, 0),
+                                 ConstantExpr::alloc(r.next(array->size),
+                                                     Expr::Int32));
+  return ZExtExpr::create(e, width);
+}
+
+ref<Expr> getValue(Random &r, const std::vector<const Array*> &arrays,
+                   Expr::Width width, unsigned depth) {
+  if (depth == 0 || r.next(4) == 0) {
+    if (r.next(3) == 0)
+      return ConstantExpr::alloc(r.next(1000), width);
+    return getRead(r, arrays[r.next(arrays.size())], width);
+  }
+
+  ref<Expr> left = getValue(r, arrays, width, depth - 1);
+  ref<Expr> right = getValue(r, arrays, width, depth - 1);
+  // Keep divisors non-zero: the evaluator leaves those unevaluated.
+  ref<Expr> divisor = OrExpr::create(right, ConstantExpr::alloc(1, width));
+  switch (r.next(16)) {
+  case 0: return AddExpr::create(left, right);
+  case 1: return SubExpr::create(left, right);
+  case 2: return MulExpr::create(left, right);
+  case 3: return UDivExpr::create(left, divisor);
+  case 4: return SDivExpr::create(left, divisor);
+  case 5: return URemExpr::create(left, divisor);
+  case 6: return SRemExpr::create(left, divisor);
+  case 7: return AndExpr::create(left, right);
+  case 8: return XorExpr::create(left, NotExpr::create(right));
+  case 9: return ShlExpr::create(left, URemExpr::create(right,
+                                 ConstantExpr::alloc(width + 2, width)));
+  case 10: return LShrExpr::create(left, URemExpr::create(right,
+                                   ConstantExpr::alloc(width + 2, width)));
+  case 11: return AShrExpr::create(left, URemExpr::create(right,
+                                   ConstantExpr::alloc(width + 2, width)));
+  case 12:
+    return SelectExpr::create(SltExpr::create(left, right), left,
+                              ConstantExpr::alloc(7, width));
+  case 13:
+    return SExtExpr::create(ExtractExpr::create(left, 1, width / 2), width);
+  case 14:
+    return ConcatExpr::create(ExtractExpr::create(left, 0, width / 2),
+                              ExtractExpr::create(right, width / 2,
+                                                  width - width / 2));
+  default: {
+    // A read through an update list with a symbolic update index.
+    const Array *array = arrays[r.next(arrays.size())];
+    UpdateList ul(array, 0);
+    ul.extend(ConstantExpr::alloc(r.next(array->size), Expr::Int32),
+              ConstantExpr::alloc(r.next(256), Expr::Int8));
+    ul.extend(URemExpr::create(ZExtExpr::create(left, Expr::Int32),
+                               ConstantExpr::alloc(array->size, Expr::Int32)),
+              ExtractExpr::create(right, 0, Expr::Int8));
+    ref<Expr> index = ConstantExpr::alloc(r.next(array->size), Expr::Int32);
+    return ZExtExpr::create(ReadExpr::create(ul, index), width);
+  }
+  }
+}
+
+ref<Expr> getConstraint(Random &r, const std::vector<const Array*> &arrays) {
+  static const Expr::Width widths[] = { Expr::Int8, Expr::Int16, Expr::Int32,
+                                        Expr::Int64 };
+  Expr::Width width = widths[r.next(4)];
+  ref<Expr> left = getValue(r, arrays, width, 3);
+  ref<Expr> right = getValue(r, arrays, width, 3);
+  switch (r.next(6)) {
+  case 0: return EqExpr::create(left, right);
+  case 1: return NeExpr::create(left, right);
+  case 2: return UltExpr::create(left, right);
+  case 3: return UgeExpr::create(left, right);
+  case 4: return SleExpr::create(left, right);
+  default: return SgtExpr::create(left, right);
+  }
+}
+
+TEST(CompiledConstraintsTest, MatchesEvaluator) {
+  ArrayCache ac;
+  Random r;
+  std::vector<const Array*> arrays;
+  arrays.push_back(ac.CreateArray("a", 4));
+  arrays.push_back(ac.CreateArray("b", 8));
+  // Only a is bound below, so reads of b see the default zero.
+
+  unsigned satisfied = 0;
+  for (unsigned i = 0; i < 200; ++i) {
+    std::vector<ref<Expr> > constraints;
+    CompiledConstraints program;
+    unsigned n = 1 + r.next(3);
+    for (unsigned j = 0; j < n; ++j)
+      constraints.push_back(getConstraint(r, arrays));
+    ASSERT_TRUE(program.addConstraints(constraints.begin(),
+                                       constraints.end()));
+
+    std::vector<Assignment> assignments(11);
+    std::vector<const Assignment*> pointers;
+    for (unsigned k = 0; k < assignments.size(); ++k) {
+      std::vector<unsigned char> &bytes = assignments[k].bindings[arrays[0]];
+      for (unsigned b = 0; b < arrays[0]->size; ++b)
+        bytes.push_back(r.next(256));
+      pointers.push_back(&assignments[k]);
+    }
+
+    bool results[11];
+    program.satisfies(&pointers[0], pointers.size(), results);
+    for (unsigned k = 0; k < assignments.size(); ++k) {
+      bool expected = assignments[k].satisfies(constraints.begin(),
+                                               constraints.end());
+      EXPECT_EQ(expected, results[k]) << "constraint set " << i;
+      EXPECT_EQ(expected, program.satisfies(assignments[k]));
+      satisfied += expected;
+    }
+  }
+  // Both outcomes are exercised.
+  EXPECT_LT(0u, satisfied);
+  EXPECT_GT(200u * 11, satisfied);
+}
+
+TEST(CompiledConstraintsTest, DivisionByZero) {
+  ArrayCache ac;
+  const Array *array = ac.CreateArray("a", 2);
+  ref<Expr> x = Expr::createTempRead(array, Expr::Int8);
+  ref<Expr> zero = ConstantExpr::alloc(0, Expr::Int8);
+  CompiledConstraints program;
+  ASSERT_TRUE(program.addConstraint(
+                EqExpr::create(UDivExpr::create(x, x), zero)));
+
+  Assignment a;
+  a.bindings[array] = std::vector<unsigned char>(2, 0);
+  EXPECT_FALSE(program.satisfies(a));
+  a.bindings[array][0] = 5;
+  EXPECT_FALSE(program.satisfies(a));
+}
+
+TEST(CompiledConstraintsTest, WideExpressions) {
+  ArrayCache ac;
+  const Array *array = ac.CreateArray("a", 16);
+  ref<Expr> wide = ConcatExpr::create(Expr::createTempRead(array, 64),
+                                      Expr::createTempRead(array, 64));
+  CompiledConstraints program;
+  EXPECT_FALSE(program.addConstraint(
+                 EqExpr::create(wide, ConstantExpr::alloc(0, 128))));
+  EXPECT_FALSE(program.isValid());
+}
+
+}
@@ -0,0 +1,278 @@
+//===-- ConstraintsTest.cpp -----------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "gtest/gtest.h"
+
+#include "klee/Constraints.h"
+#include "klee/Expr.h"
+#include "klee/util/ArrayCache.h"
+#include "klee/util/ConstraintPartition.h"
+
+#include <algorithm>
+#include <vector>
+
+using namespace klee;
+
+namespace {
+
+/// A distinct constraint for each i.
+ref<Expr> getConstraint(const Array *array, unsigned i) {
+  return UltExpr::create(ConstantExpr::alloc(i, Expr::Int8),
+                         Expr::createTempRead(array, Expr::Int8));
+}
+
+void expectConstraints(const ConstraintManager &cm,
+                       const std::vector<ref<Expr> > &expected) {
+  ASSERT_EQ(expected.size(), cm.size());
+  std::vector<ref<Expr> > actual(cm.begin(), cm.end());
+  for (unsigned i = 0; i < expected.size(); ++i)
+    EXPECT_EQ(expected[i], actual[i]);
+  if (!expected.empty())
+    EXPECT_EQ(expected.back(), cm.back());
+}
+
+TEST(ConstraintsTest, CopiesDoNotSeeEachOthersConstraints) {
+  ArrayCache ac;
+  const Array *array = ac.CreateArray("arr", 1);
+  std::vector<ref<Expr> > parent;
+  ConstraintManager cm;
+
+  // Fork at every depth, across several chunks, and extend both copies.
+  std::vector<ConstraintManager> copies;
+  std::vector<std::vector<ref<Expr> > > expected;
+  for (unsigned i = 0; i < 100; ++i) {
+    copies.push_back(cm);
+    expected.push_back(parent);
+
+    ref<Expr> e = getConstraint(array, i);
+    cm.addConstraint(e);
+    parent.push_back(e);
+
+    ref<Expr> other = Expr::createIsZero(getConstraint(array, i));
+    copies.back().addConstraint(other);
+    expected.back().push_back(other);
+  }
+
+  expectConstraints(cm, parent);
+  for (unsigned i = 0; i < copies.size(); ++i)
+    expectConstraints(copies[i], expected[i]);
+}
+
+TEST(ConstraintsTest, RegrowAfterTruncation) {
+  ArrayCache ac;
+  const Array *array = ac.CreateArray("arr", 1);
+  std::vector<ref<Expr> > expected;
+  ConstraintManager cm;
+  for (unsigned i = 0; i < 70; ++i) {
+    expected.push_back(getConstraint(array, i));
+    cm.addConstraint(expected.back());
+  }
+
+  // Iterate, so the chunks are looked up, then drop and re-add them
+  // across chunk boundaries, getting back to the same number of chunks.
+  for (unsigned round = 0; round < 4; ++round) {
+    ConstraintManager::const_iterator it = cm.begin();
+    EXPECT_EQ(expected[0], *it);
+
+    // Shuffle the freed chunks, so the set gets back its newest chunk
+    // but not the older ones.
+    ConstraintManager *spacer = new ConstraintManager();
+    spacer->addConstraint(getConstraint(array, 200));
+
+    std::vector<ref<Expr> > removed;
+    cm.takeUnshared(removed);
+    EXPECT_TRUE(cm.empty());
+    ASSERT_EQ(expected.size(), removed.size());
+
+    ConstraintManager taker;
+    taker.addConstraint(getConstraint(array, 201));
+    delete spacer;
+    cm.append(removed);
+    expectConstraints(cm, expected);
+  }
+
+  // With the oldest chunks shared, only the newer ones are taken.
+  ConstraintManager shared;
+  std::vector<ref<Expr> > sharedExpected;
+  for (unsigned i = 0; i < 40; ++i) {
+    sharedExpected.push_back(getConstraint(array, i));
+    shared.addConstraint(sharedExpected.back());
+  }
+  ConstraintManager copy(shared);
+  std::vector<ref<Expr> > copyExpected(sharedExpected);
+  for (unsigned i = 40; i < 100; ++i) {
+    sharedExpected.push_back(getConstraint(array, i));
+    shared.addConstraint(sharedExpected.back());
+  }
+  for (unsigned round = 0; round < 4; ++round) {
+    expectConstraints(shared, sharedExpected);
+    std::vector<ref<Expr> > removed;
+    shared.takeUnshared(removed);
+    EXPECT_EQ(64u, shared.size());
+    shared.append(removed);
+  }
+  expectConstraints(shared, sharedExpected);
+  expectConstraints(copy, copyExpected);
+
+  // Rewriting the first constraint truncates the set to nothing and
+  // rebuilds it, also across chunk boundaries.
+  const Array *other = ac.CreateArray("other", 1);
+  ref<Expr> read = Expr::createTempRead(array, Expr::Int8);
+  ConstraintManager rw;
+  std::vector<ref<Expr> > rwExpected;
+  rw.addConstraint(UltExpr::create(read, ConstantExpr::alloc(100, Expr::Int8)));
+  for (unsigned i = 1; i < 70; ++i) {
+    rwExpected.push_back(getConstraint(other, i));
+    rw.addConstraint(rwExpected.back());
+  }
+  EXPECT_EQ(70, rw.end() - rw.begin());
+  rwExpected.push_back(EqExpr::create(ConstantExpr::alloc(5, Expr::Int8),
+                                      read));
+  rw.addConstraint(rwExpected.back());
+  expectConstraints(rw, rwExpected);
+}
+
+TEST(ConstraintsTest, Equality) {
+  ArrayCache ac;
+  const Array *array = ac.CreateArray("arr", 1);
+  ConstraintManager a, b;
+  for (unsigned i = 0; i < 40; ++i) {
+    a.addConstraint(getConstraint(array, i));
+    b.addConstraint(getConstraint(array, i));
+  }
+  EXPECT_TRUE(a == b);
+
+  ConstraintManager c(a);
+  EXPECT_TRUE(a == c);
+  c.addConstraint(getConstraint(array, 100));
+  EXPECT_FALSE(a == c);
+
+  a = c;
+  EXPECT_TRUE(a == c);
+}
+
+TEST(ConstraintsTest, RewriteEqualities) {
+  ArrayCache ac;
+  const Array *array = ac.CreateArray("arr", 1);
+  ref<Expr> read = Expr::createTempRead(array, Expr::Int8);
+  ConstraintManager cm;
+  cm.addConstraint(UltExpr::create(read, ConstantExpr::alloc(100, Expr::Int8)));
+  ConstraintManager copy(cm);
+
+  // Rewriting the constraints of one set must leave its copies alone.
+  cm.addConstraint(EqExpr::create(ConstantExpr::alloc(5, Expr::Int8), read));
+  EXPECT_EQ(1u, copy.size());
+  EXPECT_EQ(UltExpr::create(read, ConstantExpr::alloc(100, Expr::Int8)),
+            copy.back());
+  EXPECT_EQ(1u, cm.size());
+  EXPECT_EQ(EqExpr::create(ConstantExpr::alloc(5, Expr::Int8), read),
+            cm.back());
+}
+
+TEST(ConstraintsTest, Partition) {
+  ArrayCache ac;
+  const Array *a = ac.CreateArray("a", 4);
+  const Array *b = ac.CreateArray("b", 4);
+  const Array *c = ac.CreateArray("c", 4);
+  ref<Expr> a0 = ReadExpr::create(UpdateList(a, 0),
+                                  ConstantExpr::alloc(0, Expr::Int32));
+  ref<Expr> a1 = ReadExpr::create(UpdateList(a, 0),
+                                  ConstantExpr::alloc(1, Expr::Int32));
+  ref<Expr> b0 = ReadExpr::create(UpdateList(b, 0),
+                                  ConstantExpr::alloc(0, Expr::Int32));
+  ref<Expr> c0 = ReadExpr::create(UpdateList(c, 0),
+                                  ConstantExpr::alloc(0, Expr::Int32));
+  ref<Expr> ax = ReadExpr::create(UpdateList(a, 0), ZExtExpr::create(c0,
+                                                                 Expr::Int32));
+  ref<Expr> ten = ConstantExpr::alloc(10, Expr::Int8);
+
+  ConstraintManager cm;
+  cm.addConstraint(UltExpr::create(a0, ten));          // 0
+  cm.addConstraint(UltExpr::create(a1, ten));          // 1
+  cm.addConstraint(UltExpr::create(b0, ten));          // 2
+  cm.addConstraint(UltExpr::create(a1, b0));           // 3
+
+  const ConstraintPartition &p = cm.getPartition();
+  EXPECT_NE(p.getFactor(0), p.getFactor(1));
+  EXPECT_EQ(p.getFactor(1), p.getFactor(2));
+  EXPECT_EQ(p.getFactor(1), p.getFactor(3));
+  EXPECT_EQ(3u, p.getFactorSize(p.getFactor(3)));
+
+  std::vector<unsigned> factors, members;
+  p.getFactors(UltExpr::create(b0, a0), factors);
+  EXPECT_EQ(2u, factors.size());
+  p.getFactors(c0, factors);
+  EXPECT_EQ(2u, factors.size());
+  p.getMembers(p.getFactor(2), members);
+  std::sort(members.begin(), members.end());
+  ASSERT_EQ(3u, members.size());
+  EXPECT_EQ(1u, members[0]);
+  EXPECT_EQ(2u, members[1]);
+  EXPECT_EQ(3u, members[2]);
+
+  // A copy extends its own partition; a symbolic index into a joins
+  // everything reading a.
+  ConstraintManager copy(cm);
+  copy.addConstraint(UltExpr::create(ax, ten));        // 4
+  const ConstraintPartition &q = copy.getPartition();
+  EXPECT_EQ(q.getFactor(0), q.getFactor(4));
+  EXPECT_EQ(q.getFactor(3), q.getFactor(4));
+  EXPECT_EQ(4u, cm.getPartition().size());
+  EXPECT_NE(cm.getPartition().getFactor(0), cm.getPartition().getFactor(1));
+}
+
+TEST(ConstraintsTest, PartitionCopies) {
+  ArrayCache ac;
+  const Array *a = ac.CreateArray("a", 256);
+  const Array *b = ac.CreateArray("b", 4);
+  ref<Expr> ten = ConstantExpr::alloc(10, Expr::Int8);
+  std::vector< ref<Expr> > reads;
+  for (unsigned i = 0; i < 200; ++i)
+    reads.push_back(ReadExpr::create(UpdateList(a, 0),
+                                     ConstantExpr::alloc(i, Expr::Int32)));
+  ref<Expr> b0 = ReadExpr::create(UpdateList(b, 0),
+                                  ConstantExpr::alloc(0, Expr::Int32));
+
+  // Pairs of constraints on neighbouring bytes of a, over several chunks
+  // of the partition.
+  ConstraintManager cm;
+  for (unsigned i = 0; i < 100; ++i)
+    cm.addConstraint(UltExpr::create(reads[2 * i], reads[2 * i + 1]));
+  ASSERT_EQ(100u, cm.getPartition().size());
+
+  // Each copy joins a different set of factors.
+  ConstraintManager left(cm), right(cm);
+  for (unsigned i = 0; i < 99; ++i)
+    left.addConstraint(UltExpr::create(reads[2 * i + 1], reads[2 * i + 2]));
+  right.addConstraint(UltExpr::create(reads[1], b0));
+  right.addConstraint(UltExpr::create(reads[198], b0));
+
+  const ConstraintPartition &l = left.getPartition();
+  const ConstraintPartition &r = right.getPartition();
+  const ConstraintPartition &p = cm.getPartition();
+  EXPECT_EQ(199u, l.size());
+  EXPECT_EQ(102u, r.size());
+  EXPECT_EQ(100u, p.size());
+
+  EXPECT_EQ(199u, l.getFactorSize(l.getFactor(0)));
+  EXPECT_EQ(l.getFactor(0), l.getFactor(99));
+
+  EXPECT_EQ(r.getFactor(0), r.getFactor(99));
+  EXPECT_EQ(4u, r.getFactorSize(r.getFactor(101)));
+  EXPECT_NE(r.getFactor(0), r.getFactor(50));
+  EXPECT_EQ(1u, r.getFactorSize(r.getFactor(50)));
+
+  for (unsigned i = 0; i < 100; ++i)
+    ASSERT_EQ(1u, p.getFactorSize(p.getFactor(i)));
+  std::vector<unsigned> factors;
+  p.getFactors(UltExpr::create(b0, ten), factors);
+  EXPECT_TRUE(factors.empty());
+}
+
+}
@@ -0,0 +1,120 @@
+//===-- ExprAllocBenchmark.cpp --------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Allocation throughput and memory footprint of expression nodes. The
+// benchmarks are disabled by default; run them with
+//
+//   ExprTests --gtest_also_run_disabled_tests --gtest_filter='*Benchmark*'
+//
+//===----------------------------------------------------------------------===//
+
+#include "gtest/gtest.h"
+
+#include "klee/Expr.h"
+#include "klee/Internal/ADT/SlabAllocator.h"
+#include "klee/util/ArrayCache.h"
+
+#include <cstdio>
+#include <vector>
+
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+using namespace klee;
+
+namespace {
+
+const unsigned NumRounds = 50;
+const unsigned NumLive = 200000;
+
+double getTime() {
+  struct timeval tv;
+  gettimeofday(&tv, 0);
+  return tv.tv_sec + tv.tv_usec / 1000000.;
+}
+
+/// Resident set size in MB, or 0 where it cannot be read.
+double getRSS() {
+  FILE *f = fopen("/proc/self/statm", "r");
+  if (!f)
+    return 0;
+  unsigned long size, resident = 0;
+  if (fscanf(f, "%lu %lu", &size, &resident) != 2)
+    resident = 0;
+  fclose(f);
+  return resident * (double) sysconf(_SC_PAGESIZE) / (1024 * 1024);
+}
+
+/// Allocate blocks of the sizes typical for expression nodes, keeping a
+/// changing fraction of them alive so that the heap gets fragmented.
+template <class Alloc>
+void churn(Alloc &alloc, const char *name) {
+  static const size_t sizes[] = { 40, 48, 56, 64, 80, 96 };
+  const unsigned numSizes = sizeof(sizes) / sizeof(sizes[0]);
+  std::vector<std::pair<void *, size_t> > live(NumLive);
+
+  double rssBefore = getRSS(), start = getTime();
+  for (unsigned round = 0; round < NumRounds; ++round) {
+    for (unsigned i = round % 3; i < NumLive; i += 3) {
+      if (live[i].first)
+        alloc.deallocate(live[i].first, live[i].second);
+      size_t size = sizes[(i + round) % numSizes];
+      live[i] = std::make_pair(alloc.allocate(size), size);
+    }
+  }
+  double elapsed = getTime() - start;
+  double rssAfter = getRSS();
+
+  for (unsigned i = 0; i < NumLive; ++i)
+    if (live[i].first)
+      alloc.deallocate(live[i].first, live[i].second);
+
+  unsigned long ops = (unsigned long) NumRounds * NumLive / 3;
+  printf("%-14s %8.2f M ops/s  RSS +%.1f MB\n", name,
+         ops / elapsed / 1e6, rssAfter - rssBefore);
+}
+
+struct HeapAllocator {
+  void *allocate(size_t size) { return ::operator new(size); }
+  void deallocate(void *p, size_t) { ::operator delete(p); }
+};
+
+TEST(ExprAllocBenchmark, DISABLED_BlockChurn) {
+  HeapAllocator heap;
+  churn(heap, "operator new");
+
+  SlabAllocator slab = SlabAllocator();
+  churn(slab, "SlabAllocator");
+}
+
+TEST(ExprAllocBenchmark, DISABLED_ExprChurn) {
+  ArrayCache ac;
+  const Array *array = ac.CreateArray("arr", 256);
+  UpdateList ul(array, 0);
+  std::vector<ref<Expr> > live(NumLive);
+
+  double rssBefore = getRSS(), start = getTime();
+  unsigned long nodes = 0;
+  for (unsigned round = 0; round < NumRounds; ++round) {
+    for (unsigned i = round % 3; i < NumLive; i += 3) {
+      ref<Expr> read = ReadExpr::create(
+          ul, ConstantExpr::alloc((i + round) % 256, Expr::Int32));
+      live[i] = AddExpr::create(
+          read, ConstantExpr::alloc((i * 7) & 0xFF, Expr::Int8));
+      nodes += 4;
+    }
+  }
+  double elapsed = getTime() - start;
+
+  printf("Expr nodes     %8.2f M/s  RSS +%.1f MB\n", nodes / elapsed / 1e6,
+         getRSS() - rssBefore);
+}
+
+}
@@ -0,0 +1,74 @@
+//===-- SlabAllocatorTest.cpp ---------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "gtest/gtest.h"
+
+#include "klee/Internal/ADT/SlabAllocator.h"
+
+#include <vector>
+
+using namespace klee;
+
+namespace {
+
+TEST(SlabAllocatorTest, ReusesFreedBlocks) {
+  SlabAllocator alloc = SlabAllocator();
+  void *a = alloc.allocate(40);
+  void *b = alloc.allocate(48);
+  alloc.deallocate(a, 40);
+  EXPECT_EQ(a, alloc.allocate(33));
+  EXPECT_NE(a, alloc.allocate(40));
+  alloc.deallocate(b, 48);
+  EXPECT_EQ(b, alloc.allocate(48));
+}
+
+TEST(SlabAllocatorTest, CountsFreeBytes) {
+  size_t before = SlabAllocator::getFreeBytes();
+  SlabAllocator alloc = SlabAllocator();
+
+  // The first allocation takes a whole slab.
+  void *p = alloc.allocate(64);
+  EXPECT_EQ(before + SlabAllocator::SlabSize - 64,
+            SlabAllocator::getFreeBytes());
+
+  // Sizes are rounded up to the granularity.
+  void *q = alloc.allocate(1);
+  EXPECT_EQ(before + SlabAllocator::SlabSize - 64 - 8,
+            SlabAllocator::getFreeBytes());
+
+  alloc.deallocate(p, 64);
+  alloc.deallocate(q, 1);
+  EXPECT_EQ(before + SlabAllocator::SlabSize, SlabAllocator::getFreeBytes());
+
+  // The end of a slab too small for the next block is lost.
+  std::vector<void*> blocks;
+  for (unsigned i = 0; i < (SlabAllocator::SlabSize - 72) / 256; ++i)
+    blocks.push_back(alloc.allocate(256));
+  EXPECT_EQ(before + 72 + (SlabAllocator::SlabSize - 72) % 256,
+            SlabAllocator::getFreeBytes());
+  blocks.push_back(alloc.allocate(256));
+  EXPECT_EQ(before + 72 + SlabAllocator::SlabSize - 256,
+            SlabAllocator::getFreeBytes());
+
+  for (unsigned i = 0; i < blocks.size(); ++i)
+    alloc.deallocate(blocks[i], 256);
+  EXPECT_EQ(before + 72 + SlabAllocator::SlabSize + (blocks.size() - 1) * 256,
+            SlabAllocator::getFreeBytes());
+}
+
+TEST(SlabAllocatorTest, LargeBlocksBypassSlabs) {
+  size_t before = SlabAllocator::getFreeBytes();
+  SlabAllocator alloc = SlabAllocator();
+  void *p = alloc.allocate(SlabAllocator::MaxSize + 1);
+  EXPECT_EQ(before, SlabAllocator::getFreeBytes());
+  alloc.deallocate(p, SlabAllocator::MaxSize + 1);
+  EXPECT_EQ(before, SlabAllocator::getFreeBytes());
+}
+
+}